@@ -0,0 +1,89 @@
+//
+//  ALSBackend.cpp
+//  SMCLightSensor
+//
+//  Copyright © 2018 usrsse2. All rights reserved.
+//
+
+#include <Headers/kern_util.hpp>
+
+#include "ALSBackend.hpp"
+
+bool ACPIALSBackend::readLux(uint32_t &lux) {
+	return device->evaluateInteger("_ALI", &lux) == kIOReturnSuccess;
+}
+
+ACPIALSBackend *ACPIALSBackend::withDevice(IOACPIPlatformDevice *device) {
+	if (device->validateObject("_ALI") != kIOReturnSuccess) {
+		DBGLOG("alsd", "no _ALI method on %s", safeString(device->getName()));
+		return nullptr;
+	}
+
+	auto backend = new ACPIALSBackend;
+	if (backend)
+		backend->device = device;
+	else
+		DBGLOG("alsd", "unable to allocate acpi backend");
+
+	return backend;
+}
+
+bool I2CALSBackend::readLux(uint32_t &lux) {
+	if (chip == Chip::ISL29018) {
+		uint8_t data[2];
+		if (!transport->readRegisters(ISL29018RegDataLsb, data, sizeof(data)))
+			return false;
+		lux = decodeISL29018(data, ISL29018Range);
+	} else {
+		uint8_t data[8];
+		if (!transport->readRegisters(APDS9960RegCDataL, data, sizeof(data)))
+			return false;
+		lux = decodeAPDS9960(data);
+	}
+
+	return true;
+}
+
+I2CALSBackend *I2CALSBackend::withTransport(I2CALSTransport *transport, Chip chip) {
+	bool configured;
+	if (chip == Chip::ISL29018) {
+		configured = transport->writeRegister(ISL29018RegCommand1, ISL29018ModeALSContinuous) &&
+			transport->writeRegister(ISL29018RegCommand2, ISL29018Range4000Res16);
+	} else {
+		configured = transport->writeRegister(APDS9960RegATime, APDS9960ATime103ms) &&
+			transport->writeRegister(APDS9960RegControl, APDS9960Gain4x) &&
+			transport->writeRegister(APDS9960RegEnable, APDS9960EnablePowerALS);
+	}
+
+	if (!configured) {
+		DBGLOG("alsd", "unable to configure i2c sensor %d", static_cast<int>(chip));
+		return nullptr;
+	}
+
+	auto backend = new I2CALSBackend;
+	if (backend) {
+		backend->transport = transport;
+		backend->chip = chip;
+	} else {
+		DBGLOG("alsd", "unable to allocate i2c backend");
+	}
+
+	return backend;
+}
+
+uint32_t I2CALSBackend::decodeISL29018(const uint8_t *data, uint32_t range) {
+	// With 16-bit resolution full scale count corresponds to the selected range.
+	uint32_t count = data[0] | (static_cast<uint32_t>(data[1]) << 8);
+	return static_cast<uint32_t>((static_cast<uint64_t>(count) * range) >> 16);
+}
+
+uint32_t I2CALSBackend::decodeAPDS9960(const uint8_t *data) {
+	int64_t r = data[2] | (data[3] << 8);
+	int64_t g = data[4] | (data[5] << 8);
+	int64_t b = data[6] | (data[7] << 8);
+	// DN40 coefficients are scaled by 100000 to avoid floating point, the sum is in counts and is divided
+	// by counts per lux: 100000 * (ATIME_us / 1000) * AGAIN / DF = 100 * ATIME_us * AGAIN / DF.
+	int64_t counts = -32466 * r + 157837 * g - 73191 * b;
+	int64_t lux = counts * APDS9960DeviceFactor / (100LL * APDS9960IntegrationUs * APDS9960Gain);
+	return lux > 0 ? static_cast<uint32_t>(lux) : 0;
+}
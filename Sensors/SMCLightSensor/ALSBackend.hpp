@@ -0,0 +1,179 @@
+//
+//  ALSBackend.hpp
+//  SMCLightSensor
+//
+//  Copyright © 2018 usrsse2. All rights reserved.
+//
+
+#ifndef ALSBackend_hpp
+#define ALSBackend_hpp
+
+#include <libkern/libkern.h>
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Winconsistent-missing-override"
+#include <IOKit/acpi/IOACPIPlatformDevice.h>
+#pragma clang diagnostic pop
+
+/**
+ *  Ambient light sensor access method
+ */
+class ALSBackend {
+public:
+	virtual ~ALSBackend() {}
+
+	/**
+	 *  Backend name for logging
+	 */
+	virtual const char *name() = 0;
+
+	/**
+	 *  Obtain current illuminance
+	 *
+	 *  @param lux  illuminance in lux
+	 *
+	 *  @return true on success
+	 */
+	virtual bool readLux(uint32_t &lux) = 0;
+};
+
+/**
+ *  ACPI0008 device evaluating _ALI method
+ */
+class ACPIALSBackend : public ALSBackend {
+	/**
+	 *  Ambient light device
+	 */
+	IOACPIPlatformDevice *device {nullptr};
+
+public:
+	const char *name() override { return "acpi"; }
+	bool readLux(uint32_t &lux) override;
+
+	/**
+	 *  Create backend for an ACPI ambient light device
+	 *
+	 *  @param device  ACPI0008 device
+	 *
+	 *  @return backend or nullptr when the device has no _ALI method
+	 */
+	static ACPIALSBackend *withDevice(IOACPIPlatformDevice *device);
+};
+
+/**
+ *  I2C bus access used by I2CALSBackend
+ */
+class I2CALSTransport {
+public:
+	virtual ~I2CALSTransport() {}
+
+	/**
+	 *  Read consecutive registers in a single write-read transaction
+	 *
+	 *  @param reg   first register address
+	 *  @param data  register contents
+	 *  @param size  number of registers to read
+	 *
+	 *  @return true on success
+	 */
+	virtual bool readRegisters(uint8_t reg, uint8_t *data, uint8_t size) = 0;
+
+	/**
+	 *  Write a single register
+	 *
+	 *  @param reg    register address
+	 *  @param value  register value
+	 *
+	 *  @return true on success
+	 */
+	virtual bool writeRegister(uint8_t reg, uint8_t value) = 0;
+};
+
+/**
+ *  Native I2C ambient light sensor driver
+ */
+class I2CALSBackend : public ALSBackend {
+public:
+	/**
+	 *  Supported sensor chips
+	 */
+	enum class Chip {
+		ISL29018,
+		APDS9960
+	};
+
+	const char *name() override { return chip == Chip::ISL29018 ? "isl29018" : "apds9960"; }
+	bool readLux(uint32_t &lux) override;
+
+	/**
+	 *  Configure the sensor and create backend for it
+	 *
+	 *  @param transport  bus access, owned by the backend on success
+	 *  @param chip       sensor chip
+	 *
+	 *  @return backend or nullptr on failure
+	 */
+	static I2CALSBackend *withTransport(I2CALSTransport *transport, Chip chip);
+
+	/**
+	 *  Convert ISL29018 DATA registers to lux
+	 *
+	 *  @param data   DATA LSB and MSB registers
+	 *  @param range  full scale range in lux
+	 *
+	 *  @return illuminance in lux
+	 */
+	static uint32_t decodeISL29018(const uint8_t *data, uint32_t range);
+
+	/**
+	 *  Convert APDS9960 colour data registers to lux with the configured integration time and gain
+	 *
+	 *  @param data  CDATAL through BDATAH registers
+	 *
+	 *  @return illuminance in lux
+	 */
+	static uint32_t decodeAPDS9960(const uint8_t *data);
+
+	~I2CALSBackend() override { delete transport; }
+
+private:
+	/**
+	 *  ISL29018 registers and configuration
+	 */
+	static constexpr uint8_t ISL29018RegCommand1 {0x00};
+	static constexpr uint8_t ISL29018RegCommand2 {0x01};
+	static constexpr uint8_t ISL29018RegDataLsb  {0x02};
+	static constexpr uint8_t ISL29018ModeALSContinuous {0xA0};
+	static constexpr uint8_t ISL29018Range4000Res16    {0x01};
+	static constexpr uint32_t ISL29018Range            {4000};
+
+	/**
+	 *  APDS9960 registers and configuration
+	 */
+	static constexpr uint8_t APDS9960RegEnable  {0x80};
+	static constexpr uint8_t APDS9960RegATime   {0x81};
+	static constexpr uint8_t APDS9960RegControl {0x8F};
+	static constexpr uint8_t APDS9960RegCDataL  {0x94};
+	static constexpr uint8_t APDS9960EnablePowerALS {0x03};
+	static constexpr uint8_t APDS9960ATime103ms     {0xDB};
+	static constexpr uint8_t APDS9960Gain4x         {0x01};
+
+	/**
+	 *  APDS9960 counts per lux from DN40: integration time in ms times gain over glass attenuation
+	 *  times device factor. 0xDB gives 37 integration cycles of 2.78 ms, glass attenuation is 1.
+	 */
+	static constexpr uint32_t APDS9960IntegrationUs {(0x100 - APDS9960ATime103ms) * 2780};
+	static constexpr uint32_t APDS9960Gain          {4};
+	static constexpr uint32_t APDS9960DeviceFactor  {52};
+
+	/**
+	 *  Bus access
+	 */
+	I2CALSTransport *transport {nullptr};
+
+	/**
+	 *  Sensor chip
+	 */
+	Chip chip {Chip::ISL29018};
+};
+
+#endif /* ALSBackend_hpp */
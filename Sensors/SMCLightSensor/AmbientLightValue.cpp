@@ -7,11 +7,26 @@
 
 #include "AmbientLightValue.hpp"
 
+SMC_RESULT SMCAmbientLightReadValue::readAccess() {
+	// Let the sensor know somebody is interested in the readings.
+	if (poller)
+		poller->keyRead(getCurrentTimeNs());
+	return SmcSuccess;
+}
+
 SMC_RESULT SMCAmbientLightValue::readAccess() {
-	auto value = reinterpret_cast<Value *>(data);
+	SMCAmbientLightReadValue::readAccess();
+
 	uint32_t lux = atomic_load_explicit(currentLux, memory_order_acquire);
 	uint8_t bits = forceBits->bits();
 
+	// Forced fields keep what the host wrote, start from the current contents.
+	SMC_DATA contents[SMC_MAX_DATA_SIZE];
+	SMC_DATA_SIZE contentsSize {};
+	if (!copy(contents, contentsSize))
+		return SmcCommCollision;
+
+	auto value = reinterpret_cast<Value *>(contents);
 	if (lux == 0xFFFFFFFF) {
 		value->valid = false;
 	} else {
@@ -24,5 +39,113 @@ SMC_RESULT SMCAmbientLightValue::readAccess() {
 			value->roomLux = OSSwapHostToBigInt32(lux << 14);
 	}
 
-	return SmcSuccess;
+	// Concurrent reads may copy the contents, modify them under the sequence counter.
+	return VirtualSMCValue::update(contents);
+}
+
+uint32_t AmbientLightPoller::start(uint64_t now) {
+	atomic_init(&lastReadTime, now);
+	atomic_init(&asleep, false);
+	atomic_init(&resumed, false);
+	timeout = TimeoutMS;
+	return timeout;
+}
+
+bool AmbientLightPoller::resume(uint32_t &next) {
+	if (!atomic_exchange_explicit(&asleep, false, memory_order_acq_rel))
+		return false;
+	// Light conditions have likely changed while the display was off,
+	// the polling thread follows them closely once it sees the flag.
+	atomic_store_explicit(&resumed, true, memory_order_release);
+	next = TimeoutMinMS;
+	return true;
+}
+
+uint32_t AmbientLightPoller::next(bool published, bool changed, uint64_t now) {
+	bool justResumed = atomic_exchange_explicit(&resumed, false, memory_order_acq_rel);
+	if (published || justResumed) {
+		// Light is changing, follow it closely.
+		timeout = TimeoutMinMS;
+	} else if (!changed) {
+		// Light is stable, back off exponentially.
+		uint32_t maxTimeout = TimeoutMaxMS;
+		uint64_t lastRead = atomic_load_explicit(&lastReadTime, memory_order_relaxed);
+		if (now > lastRead && now - lastRead > ReadIdleTimeoutNs)
+			maxTimeout = TimeoutIdleMS;
+		timeout = timeout * 2 < maxTimeout ? timeout * 2 : maxTimeout;
+	}
+	// Changes within hysteresis band keep current interval.
+
+	return timeout;
+}
+
+void AmbientLightFilter::configure(uint32_t medianWindow, uint32_t emaWeight, uint32_t stepPercent) {
+	window = medianWindow == 0 ? 1 : (medianWindow > MaxWindow ? MaxWindow : medianWindow);
+	weight = emaWeight == 0 ? 1 : (emaWeight > 100 ? 100 : emaWeight);
+	step = stepPercent;
+	historySize = historyPos = 0;
+	filtered = 0xFFFFFFFF;
+}
+
+uint32_t AmbientLightFilter::update(uint32_t lux) {
+	// Invalid readings are reported as is and restart the filter.
+	if (lux == 0xFFFFFFFF) {
+		historySize = historyPos = 0;
+		filtered = lux;
+		return lux;
+	}
+
+	history[historyPos] = lux;
+	historyPos = (historyPos + 1) % window;
+	if (historySize < window)
+		historySize++;
+
+	// Median rejects single sample spikes caused by PWM and fluorescent flicker.
+	uint32_t sorted[MaxWindow];
+	for (uint32_t i = 0; i < historySize; i++) {
+		uint32_t j = i;
+		for (; j > 0 && sorted[j - 1] > history[i]; j--)
+			sorted[j] = sorted[j - 1];
+		sorted[j] = history[i];
+	}
+	uint32_t median = sorted[historySize / 2];
+
+	if (filtered == 0xFFFFFFFF) {
+		filtered = median;
+		return filtered;
+	}
+
+	uint32_t delta = median > filtered ? median - filtered : filtered - median;
+	if (step > 0 && delta > StepAbsoluteMin && static_cast<uint64_t>(delta) * 100 > static_cast<uint64_t>(filtered) * step) {
+		// Large sustained step, follow it immediately.
+		filtered = median;
+	} else {
+		uint64_t next = (static_cast<uint64_t>(median) * weight + static_cast<uint64_t>(filtered) * (100 - weight) + 50) / 100;
+		// Make sure rounding does not stall the average right before the target.
+		if (next == filtered && median != filtered)
+			next = median > filtered ? filtered + 1 : filtered - 1;
+		filtered = static_cast<uint32_t>(next);
+	}
+
+	return filtered;
+}
+
+bool AmbientLightHysteresis::update(uint32_t lux) {
+	// Sensor appearing or disappearing is always reported.
+	bool publish;
+	if ((lux == 0xFFFFFFFF) != (lastPublished == 0xFFFFFFFF)) {
+		publish = true;
+	} else if (lux == 0xFFFFFFFF) {
+		publish = false;
+	} else {
+		uint32_t delta = lux > lastPublished ? lux - lastPublished : lastPublished - lux;
+		uint64_t minRelative = static_cast<uint64_t>(lastPublished) * relative / 100;
+		uint64_t threshold = minRelative > absolute ? minRelative : absolute;
+		// Zero thresholds restore the original behaviour of reporting every update.
+		publish = threshold == 0 || delta >= threshold;
+	}
+
+	if (publish)
+		lastPublished = lux;
+	return publish;
 }
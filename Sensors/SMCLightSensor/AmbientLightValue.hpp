@@ -10,6 +10,7 @@
 
 #include <libkern/libkern.h>
 #include <VirtualSMCSDK/kern_vsmcapi.hpp>
+#include <Headers/kern_time.hpp>
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Winconsistent-missing-override"
 #include <IOKit/acpi/IOACPIPlatformDevice.h>
@@ -41,7 +42,125 @@ public:
 	uint8_t bits() { return data[0]; }
 };
 
-class SMCAmbientLightValue : public VirtualSMCValue {
+/**
+ *  Sensor polling schedule. Polls follow lux changes closely and back off exponentially
+ *  while the light is stable, up to a longer interval once macOS stops reading ALS keys.
+ *  Current time is passed explicitly, the plugin uses getCurrentTimeNs().
+ */
+class AmbientLightPoller {
+public:
+	/**
+	 *  Initial polling interval
+	 */
+	static constexpr uint32_t TimeoutMS {1000};
+
+	/**
+	 *  Polling interval right after a noticeable lux change and after display power on
+	 */
+	static constexpr uint32_t TimeoutMinMS {250};
+
+	/**
+	 *  Maximum polling interval while macOS reads ALS keys
+	 */
+	static constexpr uint32_t TimeoutMaxMS {4000};
+
+	/**
+	 *  Polling interval when nobody reads ALS keys (e.g. auto-brightness is disabled)
+	 */
+	static constexpr uint32_t TimeoutIdleMS {10000};
+
+	/**
+	 *  Time since last ALS key read after which the keys are considered unused
+	 */
+	static constexpr uint64_t ReadIdleTimeoutNs {60000000000ULL};
+
+	/**
+	 *  Initialise the schedule, the keys count as just read to give macOS time to start reading them
+	 *
+	 *  @param now  current time in nanoseconds
+	 *
+	 *  @return first polling interval in milliseconds
+	 */
+	uint32_t start(uint64_t now);
+
+	/**
+	 *  Record an ALS key read, may be called from any thread
+	 *
+	 *  @param now  current time in nanoseconds
+	 */
+	void keyRead(uint64_t now) {
+		atomic_store_explicit(&lastReadTime, now, memory_order_relaxed);
+	}
+
+	/**
+	 *  Suspend polling when the display powers off, pending poll fires once more and is not rearmed
+	 */
+	void suspend() {
+		atomic_store_explicit(&asleep, true, memory_order_release);
+	}
+
+	/**
+	 *  Resume polling when the display powers on
+	 *
+	 *  @param timeout  polling interval in milliseconds to rearm with
+	 *
+	 *  @return true if polling was suspended and needs to be rearmed
+	 */
+	bool resume(uint32_t &timeout);
+
+	/**
+	 *  @return true while polling is suspended
+	 */
+	bool suspended() {
+		return atomic_load_explicit(&asleep, memory_order_acquire);
+	}
+
+	/**
+	 *  Calculate the next polling interval
+	 *
+	 *  @param published  lux change was reported to macOS
+	 *  @param changed    lux value changed since last poll
+	 *  @param now        current time in nanoseconds
+	 *
+	 *  @return timeout in milliseconds
+	 */
+	uint32_t next(bool published, bool changed, uint64_t now);
+
+private:
+	/**
+	 *  Last time macOS read ALS keys
+	 */
+	_Atomic(uint64_t) lastReadTime;
+
+	/**
+	 *  Display is powered off, polling is suspended
+	 */
+	_Atomic(bool) asleep;
+
+	/**
+	 *  Display powered on, the next interval is not backed off
+	 */
+	_Atomic(bool) resumed;
+
+	/**
+	 *  Current polling interval
+	 */
+	uint32_t timeout {TimeoutMS};
+};
+
+/**
+ *  ALS key letting the poller know somebody is interested in the readings
+ */
+class SMCAmbientLightReadValue : public VirtualSMCValue {
+	AmbientLightPoller *poller;
+protected:
+	SMC_RESULT readAccess() override;
+
+public:
+	SMCAmbientLightReadValue(AmbientLightPoller *poller) : poller(poller) {}
+};
+
+class SMCAmbientLightValue : public SMCAmbientLightReadValue {
 	_Atomic(uint32_t) *currentLux;
 	ALSForceBits *forceBits;
 protected:
@@ -80,8 +199,143 @@ public:
 		uint32_t roomLux {0};
 	};
 
-	SMCAmbientLightValue(_Atomic(uint32_t) *currentLux, ALSForceBits *forceBits) :
-		currentLux(currentLux), forceBits(forceBits) {}
+	SMCAmbientLightValue(_Atomic(uint32_t) *currentLux, ALSForceBits *forceBits, AmbientLightPoller *poller = nullptr) :
+		SMCAmbientLightReadValue(poller), currentLux(currentLux), forceBits(forceBits) {}
+};
+
+/**
+ *  Lux flicker filter, a median window followed by an exponential moving average.
+ *  Fed with every sensor poll, SMCAmbientLightValue reports its output.
+ */
+class AmbientLightFilter {
+public:
+	/**
+	 *  Maximum median window size
+	 */
+	static constexpr uint32_t MaxWindow {9};
+
+	/**
+	 *  Default median window size (overridden by alsdmed boot-arg)
+	 */
+	static constexpr uint32_t WindowDefault {3};
+
+	/**
+	 *  Default new sample weight in percents (overridden by alsdema boot-arg)
+	 */
+	static constexpr uint32_t WeightDefault {40};
+
+	/**
+	 *  Default relative step in percents bypassing the smoothing (overridden by alsdstep boot-arg)
+	 */
+	static constexpr uint32_t StepDefault {50};
+
+	/**
+	 *  Minimal absolute step in lux bypassing the smoothing
+	 */
+	static constexpr uint32_t StepAbsoluteMin {5};
+
+	/**
+	 *  Set filter parameters, out of range values are clamped
+	 *
+	 *  @param medianWindow  median window size, 1 disables median filtering
+	 *  @param emaWeight     new sample weight in percents, 100 disables averaging
+	 *  @param stepPercent   relative step to bypass smoothing, 0 disables the fast path
+	 */
+	void configure(uint32_t medianWindow, uint32_t emaWeight, uint32_t stepPercent);
+
+	/**
+	 *  Feed a new raw sample into the filter
+	 *
+	 *  @param lux  raw lux value or 0xFFFFFFFF for invalid reading
+	 *
+	 *  @return filtered lux value
+	 */
+	uint32_t update(uint32_t lux);
+
+private:
+	/**
+	 *  Recent raw samples ring buffer
+	 */
+	uint32_t history[MaxWindow] {};
+
+	/**
+	 *  Number of valid samples in history
+	 */
+	uint32_t historySize {0};
+
+	/**
+	 *  Next history slot to write
+	 */
+	uint32_t historyPos {0};
+
+	/**
+	 *  Filter parameters
+	 */
+	uint32_t window {WindowDefault};
+	uint32_t weight {WeightDefault};
+	uint32_t step {StepDefault};
+
+	/**
+	 *  Last filter output
+	 */
+	uint32_t filtered {0xFFFFFFFF};
+};
+
+/**
+ *  ALS change interrupt decision, only filtered lux changes outside of the hysteresis band are published.
+ */
+class AmbientLightHysteresis {
+public:
+	/**
+	 *  Default minimal absolute lux change to publish (overridden by alsdhysa boot-arg)
+	 */
+	static constexpr uint32_t AbsoluteDefault {2};
+
+	/**
+	 *  Default minimal relative lux change in percents to publish (overridden by alsdhysr boot-arg)
+	 */
+	static constexpr uint32_t RelativeDefault {5};
+
+	/**
+	 *  Set hysteresis band, zero for both restores publishing every update
+	 *
+	 *  @param minAbsolute  minimal absolute change in lux
+	 *  @param minRelative  minimal relative change in percents of the last published value
+	 */
+	void configure(uint32_t minAbsolute, uint32_t minRelative) {
+		absolute = minAbsolute;
+		relative = minRelative;
+	}
+
+	/**
+	 *  Remember a value macOS obtained without an interrupt, e.g. the initial one
+	 *
+	 *  @param lux  filtered lux value or 0xFFFFFFFF for invalid reading
+	 */
+	void reset(uint32_t lux) {
+		lastPublished = lux;
+	}
+
+	/**
+	 *  Check a new value against the band, remembering it when it is to be published
+	 *
+	 *  @param lux  filtered lux value or 0xFFFFFFFF for invalid reading
+	 *
+	 *  @return true if ALS change interrupt should be posted
+	 */
+	bool update(uint32_t lux);
+
+private:
+	/**
+	 *  Hysteresis parameters
+	 */
+	uint32_t absolute {AbsoluteDefault};
+	uint32_t relative {RelativeDefault};
+
+	/**
+	 *  Last lux value macOS was notified about
+	 */
+	uint32_t lastPublished {0xFFFFFFFF};
 };
 
 #endif /* AmbientLightValue_hpp */
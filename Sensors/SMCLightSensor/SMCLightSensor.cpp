@@ -19,6 +19,24 @@ bool SMCLightSensor::init(OSDictionary *dict) {
 	}
 
 	atomic_init(&currentLux, 0);
+	luxPoller.start(getCurrentTimeNs());
+
+	uint32_t hysteresisAbsolute = AmbientLightHysteresis::AbsoluteDefault;
+	uint32_t hysteresisRelative = AmbientLightHysteresis::RelativeDefault;
+	PE_parse_boot_argn("alsdhysa", &hysteresisAbsolute, sizeof(hysteresisAbsolute));
+	PE_parse_boot_argn("alsdhysr", &hysteresisRelative, sizeof(hysteresisRelative));
+	luxHysteresis.configure(hysteresisAbsolute, hysteresisRelative);
+	DBGLOG("alsd", "using hysteresis %u lux / %u%%", hysteresisAbsolute, hysteresisRelative);
+
+	uint32_t filterWindow = AmbientLightFilter::WindowDefault;
+	uint32_t filterWeight = AmbientLightFilter::WeightDefault;
+	uint32_t filterStep = AmbientLightFilter::StepDefault;
+	PE_parse_boot_argn("alsdmed", &filterWindow, sizeof(filterWindow));
+	PE_parse_boot_argn("alsdema", &filterWeight, sizeof(filterWeight));
+	PE_parse_boot_argn("alsdstep", &filterStep, sizeof(filterStep));
+	luxFilter.configure(filterWindow, filterWeight, filterStep);
+	DBGLOG("alsd", "using filter window %u, weight %u%%, step %u%%", filterWindow, filterWeight, filterStep);
+
 	return true;
 }
 
@@ -60,7 +78,7 @@ IOService *SMCLightSensor::probe(IOService *provider, SInt32 *score) {
 		return nullptr;
 	}
 
-	alsdDevice = OSDynamicCast(IOACPIPlatformDevice, deviceIterator->getNextObject());
+	auto alsdDevice = OSDynamicCast(IOACPIPlatformDevice, deviceIterator->getNextObject());
 	deviceIterator->release();
 	
 	if (!alsdDevice) {
@@ -68,11 +86,19 @@ IOService *SMCLightSensor::probe(IOService *provider, SInt32 *score) {
 		return nullptr;
 	}
 
-	if (alsdDevice->validateObject("_ALI") != kIOReturnSuccess || !refreshSensor(false)) {
+	backend = ACPIALSBackend::withDevice(alsdDevice);
+	if (!backend || !refreshSensor(false)) {
 		SYSLOG("alsd", "No functional _ALI method on ALSD device");
+		delete backend;
+		backend = nullptr;
 		return nullptr;
 	}
 
+	DBGLOG("alsd", "using %s backend", backend->name());
+
+	static constexpr SMC_KEY keys[] {KeyAL, KeyALI0, KeyALI1, KeyALRV, KeyALV0, KeyALV1, KeyLKSB, KeyLKSS, KeyMSLD};
+	static_assert(VirtualSMCAPI::keysUnique(keys), "Duplicate ALS keys");
+
 	ALSSensor sensor {ALSSensor::Type::Unknown7, true, 6, false};
 	ALSSensor noSensor {ALSSensor::Type::NoSensor, false, 0, false};
 	SMCAmbientLightValue::Value emptyValue;
@@ -81,15 +107,15 @@ IOService *SMCLightSensor::probe(IOService *provider, SInt32 *score) {
 
 	VirtualSMCAPI::addKey(KeyAL, vsmcPlugin.data, VirtualSMCAPI::valueWithUint16(0, &forceBits, SMC_KEY_ATTRIBUTE_READ | SMC_KEY_ATTRIBUTE_WRITE));
 	VirtualSMCAPI::addKey(KeyALI0, vsmcPlugin.data, VirtualSMCAPI::valueWithData(
-		reinterpret_cast<const SMC_DATA *>(&sensor), sizeof(sensor), SmcKeyTypeAli, nullptr, SMC_KEY_ATTRIBUTE_CONST | SMC_KEY_ATTRIBUTE_READ));
+		reinterpret_cast<const SMC_DATA *>(&sensor), sizeof(sensor), SmcKeyTypeAli, new SMCAmbientLightReadValue(&luxPoller), SMC_KEY_ATTRIBUTE_CONST | SMC_KEY_ATTRIBUTE_READ));
 	VirtualSMCAPI::addKey(KeyALI1, vsmcPlugin.data, VirtualSMCAPI::valueWithData(
 		reinterpret_cast<const SMC_DATA *>(&noSensor), sizeof(noSensor), SmcKeyTypeAli, nullptr, SMC_KEY_ATTRIBUTE_CONST | SMC_KEY_ATTRIBUTE_READ));
 	VirtualSMCAPI::addKey(KeyALRV, vsmcPlugin.data, VirtualSMCAPI::valueWithUint16(1, nullptr, SMC_KEY_ATTRIBUTE_CONST | SMC_KEY_ATTRIBUTE_READ));
 	VirtualSMCAPI::addKey(KeyALV0, vsmcPlugin.data, VirtualSMCAPI::valueWithData(
-		reinterpret_cast<const SMC_DATA *>(&emptyValue), sizeof(emptyValue), SmcKeyTypeAlv, new SMCAmbientLightValue(&currentLux, &forceBits),
+		reinterpret_cast<const SMC_DATA *>(&emptyValue), sizeof(emptyValue), SmcKeyTypeAlv, new SMCAmbientLightValue(&currentLux, &forceBits, &luxPoller),
 		SMC_KEY_ATTRIBUTE_READ | SMC_KEY_ATTRIBUTE_WRITE));
 	VirtualSMCAPI::addKey(KeyALV1, vsmcPlugin.data, VirtualSMCAPI::valueWithData(
-		reinterpret_cast<const SMC_DATA *>(&emptyValue), sizeof(emptyValue), SmcKeyTypeAlv, nullptr,
+		reinterpret_cast<const SMC_DATA *>(&emptyValue), sizeof(emptyValue), SmcKeyTypeAlv, new SMCAmbientLightReadValue(&luxPoller),
 		SMC_KEY_ATTRIBUTE_READ | SMC_KEY_ATTRIBUTE_WRITE));
 	VirtualSMCAPI::addKey(KeyLKSB, vsmcPlugin.data, VirtualSMCAPI::valueWithData(reinterpret_cast<const SMC_DATA *>(&lkb), sizeof(lkb),
 		SmcKeyTypeLkb, nullptr, SMC_KEY_ATTRIBUTE_READ | SMC_KEY_ATTRIBUTE_WRITE));
@@ -108,6 +134,15 @@ bool SMCLightSensor::start(IOService *provider) {
 		return false;
 	}
 
+	// Display power tracking is optional, we just keep polling without it.
+	auto dict = IOService::serviceMatching("IODisplayWrangler");
+	if (dict) {
+		displayNotifier = addMatchingNotification(gIOPublishNotification, dict, displayNotificationHandler, this);
+		dict->release();
+	}
+	if (!displayNotifier)
+		SYSLOG("alsd", "failed to register display wrangler notification");
+
 	vsmcNotifier = VirtualSMCAPI::registerHandler(vsmcNotificationHandler, this);
 	return vsmcNotifier != nullptr;
 }
@@ -136,7 +171,7 @@ bool SMCLightSensor::vsmcNotificationHandler(void *sensors, void *refCon, IOServ
 				return false;
 			}
 
-			if (self->poller->setTimeoutMS(SensorUpdateTimeoutMS) != kIOReturnSuccess) {
+			if (self->poller->setTimeoutMS(AmbientLightPoller::TimeoutMS) != kIOReturnSuccess) {
 				SYSLOG("asld", "failed to set timeout");
 				return false;
 			}
@@ -154,20 +189,73 @@ bool SMCLightSensor::vsmcNotificationHandler(void *sensors, void *refCon, IOServ
 	return false;
 }
 
+bool SMCLightSensor::displayNotificationHandler(void *sensors, void *refCon, IOService *wrangler, IONotifier *notifier) {
+	if (sensors && wrangler) {
+		auto self = static_cast<SMCLightSensor *>(sensors);
+		if (self->displayPowerNotifier) {
+			DBGLOG("alsd", "ignoring extra display wrangler");
+			return true;
+		}
+
+		self->displayPowerNotifier = wrangler->registerInterest(gIOGeneralInterest, displayPowerNotification, self);
+		if (!self->displayPowerNotifier) {
+			SYSLOG("alsd", "failed to register display power interest");
+			return false;
+		}
+
+		DBGLOG("alsd", "subscribed to display power changes");
+		return true;
+	}
+
+	SYSLOG("alsd", "got null display wrangler notification");
+	return false;
+}
+
+IOReturn SMCLightSensor::displayPowerNotification(void *target, void *refCon, UInt32 messageType, IOService *provider, void *messageArgument, vm_size_t argSize) {
+	auto self = static_cast<SMCLightSensor *>(target);
+	if (!self)
+		return kIOReturnSuccess;
+
+	if (messageType == kIOMessageDeviceWillPowerOff) {
+		DBGLOG("alsd", "display powers off, suspending polling");
+		// Pending timer will fire once more and not rearm itself.
+		self->luxPoller.suspend();
+	} else if (messageType == kIOMessageDeviceHasPoweredOn) {
+		uint32_t timeout = 0;
+		if (self->luxPoller.resume(timeout) && self->poller) {
+			DBGLOG("alsd", "display powered on, resuming polling");
+			self->poller->setTimeoutMS(timeout);
+		}
+	}
+
+	return kIOReturnSuccess;
+}
+
 bool SMCLightSensor::refreshSensor(bool post) {
+	if (post && luxPoller.suspended())
+		return true;
+
 	uint32_t lux = 0;
-	auto ret = alsdDevice->evaluateInteger("_ALI", &lux);
-	if (ret != kIOReturnSuccess)
+	bool ret = backend->readLux(lux);
+	if (!ret)
 		lux = 0xFFFFFFFF; // ACPI invalid
 
-	atomic_store_explicit(&currentLux, lux, memory_order_release);
+	lux = luxFilter.update(lux);
+	uint32_t oldLux = atomic_exchange_explicit(&currentLux, lux, memory_order_acq_rel);
 
 	if (post) {
-		VirtualSMCAPI::postInterrupt(SmcEventALSChange);
-		poller->setTimeoutMS(SensorUpdateTimeoutMS);
+		// Only wake the brightness stack up when the change is noticeable.
+		bool published = luxHysteresis.update(lux);
+		if (published)
+			VirtualSMCAPI::postInterrupt(SmcEventALSChange);
+		if (!luxPoller.suspended())
+			poller->setTimeoutMS(luxPoller.next(published, lux != oldLux, getCurrentTimeNs()));
+	} else {
+		// Initial value is read by macOS directly.
+		luxHysteresis.reset(lux);
 	}
 
-	return ret == kIOReturnSuccess;
+	return ret;
 }
 
 void SMCLightSensor::stop(IOService *provider) {
@@ -175,6 +263,10 @@ void SMCLightSensor::stop(IOService *provider) {
 
 	// In case this is supported one day
 #if 0
+	if (displayPowerNotifier)
+		displayPowerNotifier->remove();
+	if (displayNotifier)
+		displayNotifier->remove();
 	if (poller)
 		poller->cancelTimeout();
 	if (workloop && poller)
@@ -17,7 +17,9 @@
 #include <IOKit/acpi/IOACPIPlatformDevice.h>
 #pragma clang diagnostic pop
 #include <IOKit/IOTimerEventSource.h>
+#include <IOKit/IOMessage.h>
 
+#include "ALSBackend.hpp"
 #include "AmbientLightValue.hpp"
 
 class EXPORT SMCLightSensor : public IOService {
@@ -38,6 +40,16 @@ class EXPORT SMCLightSensor : public IOService {
 	 */
 	IOTimerEventSource *poller {nullptr};
 
+	/**
+	 *  Display wrangler publication notifier
+	 */
+	IONotifier *displayNotifier {nullptr};
+
+	/**
+	 *  Display wrangler power state change notifier
+	 */
+	IONotifier *displayPowerNotifier {nullptr};
+
 	/**
 	 *  Refresh sensor values to inform macOS with light changes
 	 *
@@ -45,11 +57,6 @@ class EXPORT SMCLightSensor : public IOService {
 	 */
 	bool refreshSensor(bool post);
 
-	/**
-	 *  Interrupt submission timeout
-	 */
-	static constexpr uint32_t SensorUpdateTimeoutMS {1000};
-
 	/**
 	 *  Key name definitions
 	 */
@@ -125,15 +132,33 @@ class EXPORT SMCLightSensor : public IOService {
 	};
 
 	/**
-	 *  Ambient light device
+	 *  Ambient light sensor access method
 	 */
-	IOACPIPlatformDevice *alsdDevice {nullptr};
+	ALSBackend *backend {nullptr};
 
 	/**
 	 *  Current lux value obtained from ACPI
 	 */
 	_Atomic(uint32_t) currentLux;
 
+	/**
+	 *  Sensor polling schedule, also tracks ALS key reads and display power
+	 */
+	AmbientLightPoller luxPoller;
+
+	/**
+	 *  Flicker filter applied to raw lux values.
+	 *  It runs once per sensor poll rather than in SMCAmbientLightValue::readAccess,
+	 *  because ALV0 and ALV1 share one reading, the hysteresis check needs the filtered
+	 *  value, and filter time constants must not depend on how often macOS reads the keys.
+	 */
+	AmbientLightFilter luxFilter;
+
+	/**
+	 *  Decides which filtered lux changes are posted as ALS interrupts
+	 */
+	AmbientLightHysteresis luxHysteresis;
+
 	/**
 	 *  Supported ALS bits
 	 */
@@ -185,6 +210,30 @@ public:
 	 *  @param notifier  created notifier
 	 */
 	static bool vsmcNotificationHandler(void *sensors, void *refCon, IOService *vsmc, IONotifier *notifier);
+
+	/**
+	 *  Subscribe to power state changes of published display wrangler.
+	 *
+	 *  @param sensors   SMCLightSensor service
+	 *  @param refCon    reference
+	 *  @param wrangler  IODisplayWrangler service
+	 *  @param notifier  created notifier
+	 */
+	static bool displayNotificationHandler(void *sensors, void *refCon, IOService *wrangler, IONotifier *notifier);
+
+	/**
+	 *  Suspend or resume polling on display power changes.
+	 *
+	 *  @param target           SMCLightSensor service
+	 *  @param refCon           reference
+	 *  @param messageType      message type
+	 *  @param provider         IODisplayWrangler service
+	 *  @param messageArgument  message argument
+	 *  @param argSize          message argument size
+	 *
+	 *  @return kIOReturnSuccess
+	 */
+	static IOReturn displayPowerNotification(void *target, void *refCon, UInt32 messageType, IOService *provider, void *messageArgument, vm_size_t argSize);
 };
 
 #endif /* SMCLightSensor_hpp */
@@ -9,30 +9,29 @@
 #include "SMCProcessor.hpp"
 
 SMC_RESULT TempPackage::readAccess() {
-	uint16_t *ptr = reinterpret_cast<uint16_t *>(data);
 	IOSimpleLockLock(cp->counterLock);
-	*ptr = VirtualSMCAPI::encodeSp(type, cp->counters.tjmax[package] - cp->counters.thermalStatusPackage[package]);
+	uint16_t val = VirtualSMCAPI::encodeSp(type, cp->counters.tjmax[package] - cp->counters.thermalStatusPackage[package]);
 	cp->quickReschedule();
 	IOSimpleLockUnlock(cp->counterLock);
-	return SmcSuccess;
+	// Concurrent reads may copy the contents, modify them under the sequence counter.
+	return VirtualSMCValue::update(reinterpret_cast<const SMC_DATA *>(&val));
 }
 
 SMC_RESULT TempCore::readAccess() {
-	uint16_t *ptr = reinterpret_cast<uint16_t *>(data);
 	IOSimpleLockLock(cp->counterLock);
-	*ptr = VirtualSMCAPI::encodeSp(type, cp->counters.tjmax[package] - cp->counters.thermalStatus[core]);
+	uint16_t val = VirtualSMCAPI::encodeSp(type, cp->counters.tjmax[package] - cp->counters.thermalStatus[core]);
 	cp->quickReschedule();
 	IOSimpleLockUnlock(cp->counterLock);
-	return SmcSuccess;
+	// Concurrent reads may copy the contents, modify them under the sequence counter.
+	return VirtualSMCValue::update(reinterpret_cast<const SMC_DATA *>(&val));
 }
 
 SMC_RESULT VoltagePackage::readAccess() {
-	uint16_t *ptr = reinterpret_cast<uint16_t *>(data);
 	IOSimpleLockLock(cp->counterLock);
-	*ptr = VirtualSMCAPI::encodeSp(type, cp->counters.voltage[package]);
+	uint16_t val = VirtualSMCAPI::encodeSp(type, cp->counters.voltage[package]);
 	cp->quickReschedule();
 	IOSimpleLockUnlock(cp->counterLock);
-	return SmcSuccess;
+	return VirtualSMCValue::update(reinterpret_cast<const SMC_DATA *>(&val));
 }
 
 SMC_RESULT CpEnergyKey::readAccess() {
@@ -40,11 +39,12 @@ SMC_RESULT CpEnergyKey::readAccess() {
 	float val = cp->counters.power[0][index];
 	for (size_t i = 1; i < cp->cpuTopology.packageCount; i++)
 		val += cp->counters.power[i][index];
+	SMC_DATA encoded[sizeof(uint32_t)] {};
 	if (type == SmcKeyTypeFloat)
-		*reinterpret_cast<uint32_t *>(data) = VirtualSMCAPI::encodeFlt(val);
+		*reinterpret_cast<uint32_t *>(encoded) = VirtualSMCAPI::encodeFlt(val);
 	else
-		*reinterpret_cast<uint16_t *>(data) = VirtualSMCAPI::encodeSp(type, val);
+		*reinterpret_cast<uint16_t *>(encoded) = VirtualSMCAPI::encodeSp(type, val);
 	cp->quickReschedule();
 	IOSimpleLockUnlock(cp->counterLock);
-	return SmcSuccess;
+	return VirtualSMCValue::update(encoded);
 }
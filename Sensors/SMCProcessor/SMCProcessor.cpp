@@ -243,21 +243,22 @@ void SMCProcessor::setupKeys(int coreOffset) {
 	
 	for (pkg = 0; pkg < cpuTopology.packageCount; pkg++) {
 		if (counters.eventFlags & Counters::ThermalPackage) {
-			VirtualSMCAPI::addKey(KeyTC0D(pkg), vsmcPlugin.data, VirtualSMCAPI::valueWithSp(0, SmcKeyTypeSp78, new TempPackage(this, pkg)));
-			VirtualSMCAPI::addKey(KeyTC0E(pkg), vsmcPlugin.data, VirtualSMCAPI::valueWithSp(0, SmcKeyTypeSp78, new TempPackage(this, pkg)));
-			VirtualSMCAPI::addKey(KeyTC0F(pkg), vsmcPlugin.data, VirtualSMCAPI::valueWithSp(0, SmcKeyTypeSp78, new TempPackage(this, pkg)));
+			// All package temperature keys report the same counter, so a single value backs them.
+			if (VirtualSMCAPI::addKey(KeyTC0D(pkg), vsmcPlugin.data, VirtualSMCAPI::valueWithSp(0, SmcKeyTypeSp78, new TempPackage(this, pkg)))) {
+				VirtualSMCAPI::addAlias(KeyTC0E(pkg), vsmcPlugin.data, KeyTC0D(pkg));
+				VirtualSMCAPI::addAlias(KeyTC0F(pkg), vsmcPlugin.data, KeyTC0D(pkg));
+				VirtualSMCAPI::addAlias(KeyTC0H(pkg), vsmcPlugin.data, KeyTC0D(pkg));
+				VirtualSMCAPI::addAlias(KeyTC0P(pkg), vsmcPlugin.data, KeyTC0D(pkg));
+				VirtualSMCAPI::addAlias(KeyTC0p(pkg), vsmcPlugin.data, KeyTC0D(pkg));
+			}
 			VirtualSMCAPI::addKey(KeyTC0G(pkg), vsmcPlugin.data, VirtualSMCAPI::valueWithSp(0, SmcKeyTypeSp78));
-			VirtualSMCAPI::addKey(KeyTC0H(pkg), vsmcPlugin.data, VirtualSMCAPI::valueWithSp(0, SmcKeyTypeSp78, new TempPackage(this, pkg)));
 			VirtualSMCAPI::addKey(KeyTC0J(pkg), vsmcPlugin.data, VirtualSMCAPI::valueWithSp(0, SmcKeyTypeSp78));
-			VirtualSMCAPI::addKey(KeyTC0P(pkg), vsmcPlugin.data, VirtualSMCAPI::valueWithSp(0, SmcKeyTypeSp78, new TempPackage(this, pkg)));
-			VirtualSMCAPI::addKey(KeyTC0p(pkg), vsmcPlugin.data, VirtualSMCAPI::valueWithSp(0, SmcKeyTypeSp78, new TempPackage(this, pkg)));
 		}
 
 		if (counters.eventFlags & Counters::Voltage) {
 			VirtualSMCAPI::addKey(KeyVC0C(pkg), vsmcPlugin.data, VirtualSMCAPI::valueWithSp(0, SmcKeyTypeSp3c, new VoltagePackage(this, pkg)));
 		}
 	}
-	qsort(const_cast<VirtualSMCKeyValue *>(vsmcPlugin.data.data()), vsmcPlugin.data.size(), sizeof(VirtualSMCKeyValue), VirtualSMCKeyValue::compare);
 }
 
 IOService *SMCProcessor::probe(IOService *provider, SInt32 *score) {
@@ -22,8 +22,7 @@ namespace Fintek {
 		VirtualSMCAPI::addKey(KeyFNum, vsmcPlugin.data,
 			VirtualSMCAPI::valueWithUint8(deviceDescriptor.tachometerCount, nullptr, SMC_KEY_ATTRIBUTE_CONST | SMC_KEY_ATTRIBUTE_READ));
 		for (uint8_t index = 0; index < deviceDescriptor.tachometerCount; ++index) {
-			VirtualSMCAPI::addKey(KeyF0Ac(index), vsmcPlugin.data,
-				VirtualSMCAPI::valueWithFp(0, SmcKeyTypeFpe2, new TachometerKey(getSmcSuperIO(), this, index)));
+			addTachometerKey(vsmcPlugin, index);
 		}
 	}
 	
@@ -27,6 +27,7 @@ void SMCSuperIO::timerCallback() {
 	auto time = getCurrentTimeNs();
 	auto timerDelta = time - timerEventLastTime;
 	dataSource->update();
+	dataSource->publishTachometers();
 	// timerEventSource->setTimeoutMS calls thread_call_enter_delayed_with_leeway, which spins.
 	// If the previous one was too long ago, schedule another one for differential recalculation!
 	if (timerDelta > MaxDeltaForRescheduleNs)
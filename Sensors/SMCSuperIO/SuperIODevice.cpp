@@ -10,14 +10,35 @@
 #include "SMCSuperIO.hpp"
 #include "SuperIODevice.hpp"
 
+void SuperIODevice::addTachometerKey(VirtualSMCAPI::Plugin &vsmcPlugin, uint8_t index) {
+	auto key = new TachometerKey(getSmcSuperIO(), this, index);
+	if (VirtualSMCAPI::addKey(KeyF0Ac(index), vsmcPlugin.data, VirtualSMCAPI::valueWithFp(0, SmcKeyTypeFpe2, key)) &&
+		index < MaxTachometerKeys)
+		tachometerKeys[index] = key;
+}
+
+void SuperIODevice::publishTachometers() {
+	for (auto key : tachometerKeys)
+		if (key)
+			key->publishValue();
+}
+
 /**
  *  Keys
  */
-SMC_RESULT TachometerKey::readAccess() {
+bool TachometerKey::publishValue() {
 	IOSimpleLockLock(sio->counterLock);
 	double val = device->getTachometerValue(index);
+	IOSimpleLockUnlock(sio->counterLock);
+	uint16_t encoded = VirtualSMCAPI::encodeFp(SmcKeyTypeFpe2, val);
+	return publish(reinterpret_cast<const SMC_DATA *>(&encoded));
+}
+
+SMC_RESULT TachometerKey::readAccess() {
+	// Called when the published value is missing or stale: publish the last counters
+	// right away and request a timer update for the next reads.
+	IOSimpleLockLock(sio->counterLock);
 	const_cast<SMCSuperIO*>(sio)->quickReschedule();
 	IOSimpleLockUnlock(sio->counterLock);
-	*reinterpret_cast<uint16_t *>(data) = VirtualSMCAPI::encodeFp(SmcKeyTypeFpe2, val);
-	return SmcSuccess;
+	return publishValue() ? SmcSuccess : SmcCommCollision;
 }
@@ -13,6 +13,7 @@
 #include <IOKit/IOService.h>
 #include <architecture/i386/pio.h>
 #include <VirtualSMCSDK/kern_vsmcapi.hpp>
+#include <Headers/kern_time.hpp>
 
 #define CALL_MEMBER_FUNC(obj, func)  ((obj).*(func))
 
@@ -76,6 +77,7 @@ enum SuperIOModel
 };
 
 class SMCSuperIO;
+class TachometerKey;
 
 class SuperIODevice
 {
@@ -84,6 +86,12 @@ private:
 	const SuperIOModel deviceModel;
 	const uint16_t deviceAddress;
 	const SMCSuperIO* smcSuperIO;
+
+	/**
+	 *  Tachometer keys published on timer updates
+	 */
+	static constexpr uint8_t MaxTachometerKeys = 8;
+	TachometerKey *tachometerKeys[MaxTachometerKeys] {};
 	
 protected:
 	/**
@@ -119,6 +127,14 @@ protected:
 	static constexpr SMC_KEY KeyFNum = SMC_MAKE_IDENTIFIER('F','N','u','m');
 	static constexpr SMC_KEY KeyF0Ac(size_t i) { return SMC_MAKE_IDENTIFIER('F', KeyIndexes[i],'A', 'c'); }
 
+	/**
+	 *  Add a tachometer key published on timer updates.
+	 *
+	 *  @param vsmcPlugin  plugin to add the key to
+	 *  @param index       tachometer index
+	 */
+	void addTachometerKey(VirtualSMCAPI::Plugin &vsmcPlugin, uint8_t index);
+
 	/**
 	 *  Constructor / Destructor
 	 */
@@ -230,6 +246,11 @@ public:
 	 *  Invoked by timer event. Sync write ops with key accessors if necessary.
 	 */
 	virtual void update() = 0;
+
+	/**
+	 *  Publish current tachometer values to their keys. Invoked by timer event after update.
+	 */
+	void publishTachometers();
 	
 	/**
 	 *  Accessors
@@ -253,9 +274,24 @@ protected:
 	const SMCSuperIO *sio;
 	uint8_t index;
 	SuperIODevice *device;
+
+	/**
+	 *  Published values older than this are refreshed on read
+	 */
+	static constexpr uint64_t MaxAgeNs {convertMsToNs(1000)};
+
 	SMC_RESULT readAccess() override;
 public:
-	TachometerKey(const SMCSuperIO *sio, SuperIODevice *device, uint8_t index) : sio(sio), index(index), device(device) {}
+	TachometerKey(const SMCSuperIO *sio, SuperIODevice *device, uint8_t index) : sio(sio), index(index), device(device) {
+		setMaxAge(MaxAgeNs);
+	}
+
+	/**
+	 *  Publish current tachometer value
+	 *
+	 *  @return true on success
+	 */
+	bool publishValue();
 };
 
 #endif // _SUPERIODEVICE_HPP
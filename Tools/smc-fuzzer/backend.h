@@ -0,0 +1,66 @@
+/*
+ * Apple System Management Control (SMC) Tool
+ * Copyright (C) 2018 vit9696
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __SMC_BACKEND_H__
+#define __SMC_BACKEND_H__
+
+#include <stdint.h>
+
+// SMC transport used by the tool.
+// Keys and types are big-endian packed four character codes.
+// Methods return 0 on success, a transport error (kern_return_t) or
+// a non-zero SMC result code otherwise.
+class SMCBackend {
+public:
+  virtual ~SMCBackend() {}
+
+  virtual const char *name() const = 0;
+
+  virtual int keyInfo(uint32_t key,
+                      uint32_t *dataSize,
+                      uint32_t *dataType,
+                      uint8_t *dataAttributes) = 0;
+
+  virtual int readKey(uint32_t key, uint32_t dataSize, char bytes[32]) = 0;
+
+  virtual int writeKey(uint32_t key,
+                       uint32_t dataSize,
+                       const char bytes[32]) = 0;
+
+  virtual int keyFromIndex(uint32_t index, uint32_t *key) = 0;
+};
+
+#ifdef SMC_BACKEND_IOKIT
+// AppleSMC user client of the running system.
+// Returns nullptr if AppleSMC cannot be opened.
+SMCBackend *SMCCreateIOKitBackend();
+#endif
+
+#ifdef SMC_BACKEND_VSMC
+// VirtualSMC keystore running in this process, see Tools/vsmchost.
+// plist is VirtualSMC Info.plist or nullptr for the default one,
+// board is board-id or nullptr, bootArgs are passed to VirtualSMC.
+// Returns nullptr if VirtualSMC fails to start.
+SMCBackend *SMCCreateVirtualSMCBackend(const char *plist,
+                                       const char *board,
+                                       const char *bootArgs);
+#endif
+
+#endif
@@ -0,0 +1,146 @@
+/*
+ * Apple System Management Control (SMC) Tool
+ * Copyright (C) 2015 theopolis
+ * Copyright (C) 2006 devnull
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "backend.h"
+#include "smc.h"
+
+namespace {
+
+kern_return_t SMCOpen(io_connect_t *conn) {
+  kern_return_t result;
+  mach_port_t masterPort;
+  io_iterator_t iterator;
+  io_object_t device;
+
+  result = IOMasterPort(MACH_PORT_NULL, &masterPort);
+  if (result != kIOReturnSuccess) {
+    printf("Error: IOMasterPort() = %08x\n", result);
+    return 1;
+  }
+
+  CFMutableDictionaryRef matchingDictionary = IOServiceMatching("AppleSMC");
+  result =
+      IOServiceGetMatchingServices(masterPort, matchingDictionary, &iterator);
+  if (result != kIOReturnSuccess) {
+    printf("Error: IOServiceGetMatchingServices() = %08x\n", result);
+    return 1;
+  }
+
+  device = IOIteratorNext(iterator);
+  IOObjectRelease((io_object_t)iterator);
+  if (device == 0) {
+    printf("Error: no SMC found\n");
+    return 1;
+  }
+
+  result = IOServiceOpen(device, mach_task_self(), 0, conn);
+  IOObjectRelease(device);
+  if (result != kIOReturnSuccess) {
+    printf("Error: IOServiceOpen() = %08x\n", result);
+    return 1;
+  }
+
+  return kIOReturnSuccess;
+}
+
+class SMCIOKitBackend : public SMCBackend {
+public:
+  explicit SMCIOKitBackend(io_connect_t conn) : conn_(conn) {}
+
+  ~SMCIOKitBackend() override { IOServiceClose(conn_); }
+
+  const char *name() const override { return "iokit"; }
+
+  int keyInfo(uint32_t key,
+              uint32_t *dataSize,
+              uint32_t *dataType,
+              uint8_t *dataAttributes) override {
+    SMCKeyData_t input = {}, output = {};
+    input.key = key;
+    input.data8 = SMC_CMD_READ_KEYINFO;
+
+    int result = call(&input, &output);
+    *dataSize = output.keyInfo.dataSize;
+    *dataType = output.keyInfo.dataType;
+    *dataAttributes = output.keyInfo.dataAttributes;
+    return result;
+  }
+
+  int readKey(uint32_t key, uint32_t dataSize, char bytes[32]) override {
+    SMCKeyData_t input = {}, output = {};
+    input.key = key;
+    input.keyInfo.dataSize = dataSize;
+    input.data8 = SMC_CMD_READ_BYTES;
+
+    int result = call(&input, &output);
+    memcpy(bytes, output.bytes, sizeof(output.bytes));
+    return result;
+  }
+
+  int writeKey(uint32_t key, uint32_t dataSize, const char bytes[32]) override {
+    SMCKeyData_t input = {}, output = {};
+    input.key = key;
+    input.keyInfo.dataSize = dataSize;
+    input.data8 = SMC_CMD_WRITE_BYTES;
+    memcpy(input.bytes, bytes, sizeof(input.bytes));
+
+    return call(&input, &output);
+  }
+
+  int keyFromIndex(uint32_t index, uint32_t *key) override {
+    SMCKeyData_t input = {}, output = {};
+    input.data8 = SMC_CMD_READ_INDEX;
+    input.data32 = index;
+
+    int result = call(&input, &output);
+    *key = output.key;
+    return result;
+  }
+
+private:
+  // AppleSMC reports SMC errors in the result field of a successful call.
+  int call(SMCKeyData_t *input, SMCKeyData_t *output) {
+    size_t outputSize = sizeof(SMCKeyData_t);
+    kern_return_t result = IOConnectCallStructMethod(conn_,
+                                                     KERNEL_INDEX_SMC,
+                                                     input,
+                                                     sizeof(SMCKeyData_t),
+                                                     output,
+                                                     &outputSize);
+    if (result != kIOReturnSuccess)
+      return result;
+    return (uint8_t)output->result;
+  }
+
+  io_connect_t conn_;
+};
+
+} // namespace
+
+SMCBackend *SMCCreateIOKitBackend() {
+  io_connect_t conn;
+  if (SMCOpen(&conn) != kIOReturnSuccess)
+    return nullptr;
+  return new SMCIOKitBackend(conn);
+}
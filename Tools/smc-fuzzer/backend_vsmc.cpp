@@ -0,0 +1,112 @@
+/*
+ * Apple System Management Control (SMC) Tool
+ * Copyright (C) 2018 vit9696
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <Headers/kern_util.hpp>
+#include <Headers/kern_iokit.hpp>
+
+#include "../../VirtualSMC/kern_vsmc.hpp"
+#include "../vsmchost/vsmchost.hpp"
+#include "backend.h"
+
+namespace {
+
+// Calls the keystore the way the protocol handlers do, so that hidden keys
+// and private read/write rules behave as seen by AppleSMC.
+// VirtualSMC stores four character codes with the first character in the
+// lowest byte, the tool packs them big-endian like AppleSMC user client.
+class SMCVirtualSMCBackend : public SMCBackend {
+public:
+  explicit SMCVirtualSMCBackend(VirtualSMCKeystore *keystore)
+      : keystore_(keystore) {}
+
+  const char *name() const override { return "vsmc"; }
+
+  int keyInfo(uint32_t key,
+              uint32_t *dataSize,
+              uint32_t *dataType,
+              uint8_t *dataAttributes) override {
+    SMC_DATA_SIZE size = 0;
+    SMC_KEY_TYPE type = 0;
+    SMC_KEY_ATTRIBUTES attr = 0;
+    SMC_RESULT result = keystore_->getInfoByName(OSSwapInt32(key), size, type, attr);
+    *dataSize = size;
+    *dataType = OSSwapInt32(type);
+    *dataAttributes = attr;
+    return result;
+  }
+
+  int readKey(uint32_t key, uint32_t dataSize, char bytes[32]) override {
+    SMC_DATA data[SMC_MAX_DATA_SIZE] = {};
+    SMC_DATA_SIZE size = 0;
+    SMC_RESULT result = keystore_->readValueByName(OSSwapInt32(key), data, size);
+    if (result == SmcSuccess && size != dataSize)
+      result = SmcKeySizeMismatch;
+    if (result == SmcSuccess)
+      memcpy(bytes, data, size);
+    else
+      memset(bytes, 0, 32);
+    return result;
+  }
+
+  int writeKey(uint32_t key, uint32_t dataSize, const char bytes[32]) override {
+    if (dataSize > SMC_MAX_DATA_SIZE)
+      return SmcKeySizeMismatch;
+    return keystore_->writeValueByName(OSSwapInt32(key), reinterpret_cast<const SMC_DATA *>(bytes));
+  }
+
+  int keyFromIndex(uint32_t index, uint32_t *key) override {
+    SMC_KEY name = 0;
+    SMC_RESULT result = keystore_->readNameByIndex(index, name);
+    *key = OSSwapInt32(name);
+    return result;
+  }
+
+private:
+  VirtualSMCKeystore *keystore_;
+};
+
+} // namespace
+
+SMCBackend *SMCCreateVirtualSMCBackend(const char *plist,
+                                       const char *board,
+                                       const char *bootArgs) {
+  vsmchostSetBootArgs(bootArgs ? bootArgs : "");
+  vsmchostSetComputer(WIOKit::ComputerModel::ComputerDesktop, board);
+  ADDPR(debugEnabled) = checkKernelArgument("-vsmcdbg");
+
+  if (!plist)
+    plist = VSMCHOST_DEFAULT_PLIST;
+  auto personality = vsmchostLoadPersonality(plist);
+  if (!personality) {
+    fprintf(stderr, "Error: failed to load VirtualSMC personality from %s\n", plist);
+    return nullptr;
+  }
+
+  auto smc = vsmchostStartService(personality, new IOService);
+  if (!smc) {
+    fprintf(stderr, "Error: failed to start VirtualSMC\n");
+    return nullptr;
+  }
+
+  // Finish deferred initialisation right away, there is no work loop.
+  vsmchostRunTimers(true);
+
+  return new SMCVirtualSMCBackend(VirtualSMC::getKeystore());
+}
@@ -0,0 +1,388 @@
+/*
+ * Apple System Management Control (SMC) Tool
+ * Copyright (C) 2018 vit9696
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <ctype.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "backend.h"
+#include "campaign.h"
+#include "smc.h"
+
+// Write fuzzing campaign, see README.md for the file format.
+struct SMCCampaign {
+  std::vector<std::string> keys;
+  std::string strategy;
+  bool restore;
+  size_t checkpoint;
+  size_t started;
+};
+
+static UInt32 SMCCampaignKey(const std::string &name) {
+  UInt32 key = 0;
+  for (size_t i = 0; i < 4; i++) {
+    key = (key << 8) | (uint8_t)(i < name.size() ? name[i] : ' ');
+  }
+  return key;
+}
+
+static void SMCCampaignKeyName(char *name, UInt32 key) {
+  for (int i = 0; i < 4; i++) {
+    name[i] = (char)(key >> ((3 - i) * 8));
+  }
+  name[4] = '\0';
+}
+
+// Key value snapshot entry, values are kept as hashes only.
+struct SMCSnapshotKey {
+  UInt32 key;
+  UInt32 dataSize;
+  uint64_t hash;
+  bool isVolatile;
+};
+
+static uint64_t SMCHashValue(int result, const char *bytes, UInt32 dataSize) {
+  // FNV-1a
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  hash = (hash ^ (uint8_t)result) * 0x100000001b3ULL;
+  for (UInt32 i = 0; i < dataSize && i < sizeof(SMCBytes_t); i++) {
+    hash = (hash ^ (uint8_t)bytes[i]) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+// Rehash all snapshot keys and return the indices of changed non-volatile keys.
+static std::vector<size_t> SMCUpdateSnapshot(SMCBackend *backend, std::vector<SMCSnapshotKey> &snapshot) {
+  std::vector<size_t> changed;
+  for (size_t i = 0; i < snapshot.size(); i++) {
+    SMCBytes_t bytes;
+    int result = backend->readKey(snapshot[i].key, snapshot[i].dataSize, bytes);
+    uint64_t hash = SMCHashValue(result, bytes, snapshot[i].dataSize);
+    if (hash != snapshot[i].hash) {
+      snapshot[i].hash = hash;
+      if (!snapshot[i].isVolatile) {
+        changed.push_back(i);
+      }
+    }
+  }
+  return changed;
+}
+
+static void SMCStoreBE(char *bytes, UInt32 dataSize, uint64_t value) {
+  for (UInt32 i = 0; i < dataSize && i < 8; i++) {
+    bytes[dataSize - 1 - i] = (char)(value >> (i * 8));
+  }
+}
+
+std::vector<std::string> SMCCampaignValues(const std::string &strategy,
+                                           UInt32 dataSize,
+                                           const char *dataType) {
+  std::vector<std::string> values;
+  std::string value(dataSize, '\0');
+  UInt32 bits = dataSize >= 8 ? 64 : dataSize * 8;
+  uint64_t max = bits == 64 ? ~0ULL : (1ULL << bits) - 1;
+
+  if (strategy == "byte") {
+    for (int i = 0; i < 0x100; i++) {
+      value[0] = (char)i;
+      values.push_back(value);
+    }
+    return values;
+  }
+
+  if (strategy == "typed") {
+    if (!strncmp(dataType, "ui", 2)) {
+      uint64_t numbers[] = {0, 1, max / 2 + 1, max - 1, max};
+      for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+        SMCStoreBE(&value[0], dataSize, numbers[i]);
+        values.push_back(value);
+      }
+      return values;
+    }
+
+    if (!strncmp(dataType, "si", 2)) {
+      uint64_t numbers[] = {0, 1, max, max / 2 + 1, max / 2};
+      for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+        SMCStoreBE(&value[0], dataSize, numbers[i]);
+        values.push_back(value);
+      }
+      return values;
+    }
+
+    if (!strcmp(dataType, "flag")) {
+      const uint8_t numbers[] = {0, 1, 2, 0xFF};
+      for (size_t i = 0; i < sizeof(numbers); i++) {
+        SMCStoreBE(&value[0], dataSize, numbers[i]);
+        values.push_back(value);
+      }
+      return values;
+    }
+
+    // Fixed point: fpXY is unsigned and spXY is signed with Y fraction bits.
+    if ((!strncmp(dataType, "fp", 2) || !strncmp(dataType, "sp", 2)) &&
+        isxdigit((unsigned char)dataType[3])) {
+      unsigned frac = (unsigned)strtoul(&dataType[3], nullptr, 16);
+      bool isSigned = dataType[0] == 's';
+      uint64_t one = frac < bits ? 1ULL << frac : 0;
+      uint64_t numbers[] = {0, one, isSigned ? max & ~(one - 1) : one * 2,
+                            isSigned ? max / 2 : max, max / 2 + 1};
+      for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+        SMCStoreBE(&value[0], dataSize, numbers[i]);
+        values.push_back(value);
+      }
+      return values;
+    }
+
+    // Floats are stored in host byte order.
+    if (!strcmp(dataType, "flt ") && dataSize == sizeof(float)) {
+      const float numbers[] = {0.0f, 1.0f, -1.0f, FLT_MAX, -FLT_MAX, INFINITY, NAN};
+      for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+        memcpy(&value[0], &numbers[i], sizeof(float));
+        values.push_back(value);
+      }
+      return values;
+    }
+
+    if (!strncmp(dataType, "ch8", 3) || !strcmp(dataType, "char")) {
+      values.push_back(std::string(dataSize, 'A'));
+      values.push_back(std::string(dataSize, '\0'));
+      values.push_back(std::string(dataSize, '\x7F'));
+      values.push_back(std::string(dataSize, '\xFF'));
+      return values;
+    }
+  }
+
+  // Boundary values, also used for types without a typed strategy.
+  values.push_back(std::string(dataSize, '\0'));
+  values.push_back(std::string(dataSize, '\xFF'));
+  value.assign(dataSize, '\0');
+  value[dataSize - 1] = 1;
+  values.push_back(value);
+  value.assign(dataSize, '\0');
+  value[0] = '\x80';
+  values.push_back(value);
+  value.assign(dataSize, '\xFF');
+  value[0] = '\x7F';
+  values.push_back(value);
+  values.push_back(std::string(dataSize, '\x55'));
+  values.push_back(std::string(dataSize, '\xAA'));
+  return values;
+}
+
+static std::string SMCHexValue(const std::string &value) {
+  std::string hex;
+  char byte[3];
+  for (size_t i = 0; i < value.size(); i++) {
+    snprintf(byte, sizeof(byte), "%02x", (unsigned char)value[i]);
+    hex += byte;
+  }
+  return hex;
+}
+
+static bool SMCLoadCampaign(const char *path, SMCCampaign &campaign, const std::vector<std::string> &keys) {
+  campaign.keys.clear();
+  campaign.strategy = "typed";
+  campaign.restore = true;
+  campaign.checkpoint = 0;
+  campaign.started = 0;
+
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    // Start a new campaign over all listed keys.
+    file = fopen(path, "w");
+    if (!file) {
+      return false;
+    }
+    campaign.keys = keys;
+    fprintf(file, "# smc write fuzzing campaign\n");
+    for (size_t i = 0; i < campaign.keys.size(); i++) {
+      fprintf(file, "key %s\n", campaign.keys[i].c_str());
+    }
+    fprintf(file,
+            "strategy %s\n"
+            "restore %d\n",
+            campaign.strategy.c_str(),
+            campaign.restore);
+    fclose(file);
+    return true;
+  }
+
+  char line[256];
+  bool ranges = false;
+  while (fgets(line, sizeof(line), file)) {
+    unsigned flag;
+    unsigned long done;
+    char word[16];
+    if (!strncmp(line, "keys ", 5)) {
+      ranges = true;
+    } else if (!strncmp(line, "key ", 4) && strlen(line) >= 8) {
+      // Key names may contain spaces, take exactly four characters.
+      campaign.keys.push_back(std::string(line + 4, 4));
+    } else if (sscanf(line, "strategy %15s", word) == 1) {
+      campaign.strategy = word;
+    } else if (sscanf(line, "restore %u", &flag) == 1) {
+      campaign.restore = flag != 0;
+    } else if (sscanf(line, "checkpoint %lu", &done) == 1) {
+      campaign.checkpoint = done;
+    } else if (sscanf(line, "start %lu", &done) == 1) {
+      campaign.started = done + 1;
+    }
+  }
+  fclose(file);
+
+  // Listed key indices change with the key set, checkpoints would refer to other keys.
+  if (ranges) {
+    fprintf(stderr, "Error: key index ranges are not supported, list keys by name\n");
+    return false;
+  }
+
+  if (campaign.strategy != "byte" && campaign.strategy != "boundary" &&
+      campaign.strategy != "typed") {
+    fprintf(stderr, "Error: unknown strategy %s\n", campaign.strategy.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+int SMCRunCampaign(SMCBackend *backend, const std::vector<std::string> &keys, const char *path) {
+  SMCCampaign campaign;
+  if (!SMCLoadCampaign(path, campaign, keys)) {
+    fprintf(stderr, "Error: cannot load campaign %s\n", path);
+    return kIOReturnError;
+  }
+
+  const std::vector<std::string> &targets = campaign.keys;
+
+  // Snapshot every listed and campaign key, keys changing on their own are volatile.
+  std::vector<SMCSnapshotKey> snapshot;
+  std::vector<std::string> snapshotNames(keys);
+  for (size_t i = 0; i < targets.size(); i++) {
+    if (std::find(keys.begin(), keys.end(), targets[i]) == keys.end()) {
+      snapshotNames.push_back(targets[i]);
+    }
+  }
+  for (size_t i = 0; i < snapshotNames.size(); i++) {
+    SMCSnapshotKey entry = {};
+    UInt32 dataType;
+    uint8_t dataAttributes;
+    entry.key = SMCCampaignKey(snapshotNames[i]);
+    if (backend->keyInfo(entry.key, &entry.dataSize, &dataType, &dataAttributes) == kIOReturnSuccess) {
+      snapshot.push_back(entry);
+    }
+  }
+  SMCUpdateSnapshot(backend, snapshot);
+  std::vector<size_t> changed = SMCUpdateSnapshot(backend, snapshot);
+  for (size_t i = 0; i < changed.size(); i++) {
+    snapshot[changed[i]].isVolatile = true;
+  }
+
+  FILE *file = fopen(path, "a");
+  if (!file) {
+    fprintf(stderr, "Error: cannot open campaign %s\n", path);
+    return kIOReturnError;
+  }
+
+  // The previous run stopped while writing to this key, most likely it crashed the target.
+  if (campaign.started > campaign.checkpoint && campaign.checkpoint < targets.size()) {
+    fprintf(stderr, "Skipping [%s], previous run stopped writing to it\n",
+            targets[campaign.checkpoint].c_str());
+    fprintf(file, "crash [%s]\n", targets[campaign.checkpoint].c_str());
+    fprintf(file, "checkpoint %zu\n", ++campaign.checkpoint);
+    fflush(file);
+  }
+
+  fprintf(stderr,
+          "Campaign %s: %zu keys, %s values, %zu done, %zu volatile\n",
+          path,
+          targets.size(),
+          campaign.strategy.c_str(),
+          campaign.checkpoint,
+          changed.size());
+
+  uint64_t writes = 0, accepted = 0;
+  for (size_t k = campaign.checkpoint; k < targets.size(); k++) {
+    UInt32 key = SMCCampaignKey(targets[k]);
+    UInt32 dataSize, dataType;
+    uint8_t dataAttributes;
+    SMCBytes_t original;
+    UInt32Char_t type;
+
+    fprintf(file, "start %zu\n", k);
+    fflush(file);
+
+    if (backend->keyInfo(key, &dataSize, &dataType, &dataAttributes) == kIOReturnSuccess &&
+        dataSize > 0 && dataSize <= sizeof(SMCBytes_t)) {
+      SMCCampaignKeyName(type, dataType);
+      bool readable = backend->readKey(key, dataSize, original) == kIOReturnSuccess;
+      std::vector<std::string> values = SMCCampaignValues(campaign.strategy, dataSize, type);
+
+      for (size_t v = 0; v < values.size(); v++) {
+        SMCBytes_t bytes = {};
+        memcpy(bytes, values[v].data(), dataSize);
+        int result = backend->writeKey(key, dataSize, bytes);
+        writes++;
+        if (result != kIOReturnSuccess) {
+          continue;
+        }
+
+        accepted++;
+        if (campaign.restore && readable) {
+          backend->writeKey(key, dataSize, original);
+        }
+
+        // Without restore the written key keeps the new value, only report side effects.
+        std::string line = "write [" + targets[k] + "] " + SMCHexValue(values[v]);
+        std::string effects;
+        changed = SMCUpdateSnapshot(backend, snapshot);
+        for (size_t i = 0; i < changed.size(); i++) {
+          if (!campaign.restore && snapshot[changed[i]].key == key) {
+            continue;
+          }
+          UInt32Char_t name;
+          SMCCampaignKeyName(name, snapshot[changed[i]].key);
+          effects += std::string(" [") + name + "]";
+        }
+        if (!effects.empty()) {
+          line += " changed" + effects;
+        }
+
+        printf("  %s\n", line.c_str());
+        fprintf(file, "%s\n", line.c_str());
+      }
+    }
+
+    fprintf(file, "checkpoint %zu\n", k + 1);
+    fflush(file);
+  }
+
+  fclose(file);
+  fprintf(stderr, "Wrote %llu values, %llu accepted\n",
+          (unsigned long long)writes, (unsigned long long)accepted);
+
+  return kIOReturnSuccess;
+}
@@ -0,0 +1,46 @@
+/*
+ * Apple System Management Control (SMC) Tool
+ * Copyright (C) 2018 vit9696
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __SMC_CAMPAIGN_H__
+#define __SMC_CAMPAIGN_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "backend.h"
+
+// Values written to a key of the given size and type by a campaign strategy,
+// one of byte, boundary or typed. dataType is a four character type name.
+std::vector<std::string> SMCCampaignValues(const std::string &strategy,
+                                           uint32_t dataSize,
+                                           const char *dataType);
+
+// Run or resume the write fuzzing campaign described by the file at path,
+// see README.md for the file format. A missing file is created for all listed
+// keys. Every campaign value is written to every campaign key, accepted values
+// and listed or campaign keys that changed as a result are reported. Results
+// and progress are appended to the campaign file after each key.
+// Returns 0 on success.
+int SMCRunCampaign(SMCBackend *backend,
+                   const std::vector<std::string> &keys,
+                   const char *path);
+
+#endif
@@ -0,0 +1,217 @@
+/*
+ * Apple System Management Control (SMC) Tool
+ * Copyright (C) 2018 vit9696
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <stdio.h>
+
+#include "backend.h"
+#include "discover.h"
+#include "smc.h"
+
+// Characters valid in SMC key names, same as key_type_valid in smcread.c.
+static const bool kKeyCharValid[256] = {
+  /* 00 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  /* 10 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  /* 20 */ 1, 1, 0, 1, 1, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0,
+  /* 30 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+  /* 40 */ 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  /* 50 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  /* 60 */ 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  /* 70 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0,
+  /* 80 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  /* 90 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  /* A0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  /* B0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  /* C0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  /* D0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  /* E0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  /* F0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+bool SMCKeyCharValid(uint8_t c) {
+  return kKeyCharValid[c];
+}
+
+static UInt32 SMCDiscoverKey(const std::string &name) {
+  UInt32 key = 0;
+  for (size_t i = 0; i < 4; i++) {
+    key = (key << 8) | (uint8_t)(i < name.size() ? name[i] : ' ');
+  }
+  return key;
+}
+
+static bool SMCFoundKeyLess(const SMCFoundKey &a, const SMCFoundKey &b) {
+  return a.key < b.key;
+}
+
+static bool SMCFoundKeyEqual(const SMCFoundKey &a, const SMCFoundKey &b) {
+  return a.key == b.key;
+}
+
+int SMCDiscoverKeys(SMCBackend *backend,
+                    const std::vector<std::string> &keys,
+                    unsigned threads,
+                    const char *checkpoint,
+                    std::vector<SMCFoundKey> &found,
+                    uint64_t *probes) {
+  std::vector<uint8_t> chars;
+  int charIndex[256];
+  for (int c = 0; c < 256; c++) {
+    charIndex[c] = -1;
+    if (kKeyCharValid[c]) {
+      charIndex[c] = (int)chars.size();
+      chars.push_back(c);
+    }
+  }
+
+  size_t count = chars.size();
+  size_t shards = count * count;
+
+  std::unordered_set<UInt32> known;
+  for (std::vector<std::string>::const_iterator it = keys.begin(); it != keys.end(); it++) {
+    known.insert(SMCDiscoverKey(*it));
+  }
+
+  std::vector<bool> done(shards);
+  size_t resumed = 0;
+  std::atomic<uint64_t> probed(0);
+  found.clear();
+  *probes = 0;
+  FILE *state = nullptr;
+  if (checkpoint) {
+    FILE *prev = fopen(checkpoint, "r");
+    if (prev) {
+      char line[64];
+      unsigned value = 0, dataType = 0, dataSize = 0, dataAttributes = 0;
+      while (fgets(line, sizeof(line), prev)) {
+        if (sscanf(line, "done %x", &value) == 1) {
+          int i = charIndex[(value >> 8) & 0xFF], ii = charIndex[value & 0xFF];
+          if (i >= 0 && ii >= 0 && !done[i * count + ii]) {
+            done[i * count + ii] = true;
+            resumed++;
+          }
+        } else {
+          int fields = sscanf(line, "found %x %x %u %x", &value, &dataType, &dataSize, &dataAttributes);
+          SMCFoundKey entry = {value, dataSize, dataType, (uint8_t)dataAttributes};
+          // Checkpoints without key info only have the key, probe it once more.
+          if (fields == 1) {
+            probed++;
+          }
+          if (fields == 4 ||
+              (fields == 1 && backend->keyInfo(value, &entry.dataSize, &entry.dataType, &entry.dataAttributes) == kIOReturnSuccess)) {
+            found.push_back(entry);
+          }
+        }
+      }
+      fclose(prev);
+    }
+
+    state = fopen(checkpoint, "a");
+    if (!state) {
+      fprintf(stderr, "Error: cannot open checkpoint %s\n", checkpoint);
+      return kIOReturnError;
+    }
+  }
+
+  if (threads == 0) {
+    threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+
+  fprintf(stderr,
+          "Discovering %zu^4 keys with %u threads, %zu of %zu shards done\n",
+          count,
+          threads,
+          resumed,
+          shards);
+
+  std::atomic<size_t> next(0);
+  std::mutex lock;
+
+  auto worker = [&]() {
+    size_t shard;
+    std::vector<SMCFoundKey> hits;
+    while ((shard = next++) < shards) {
+      if (done[shard]) {
+        continue;
+      }
+
+      UInt32 prefix = ((UInt32)chars[shard / count] << 24) |
+                      ((UInt32)chars[shard % count] << 16);
+      uint64_t shardProbes = 0;
+      hits.clear();
+      for (size_t iii = 0; iii < count; iii++) {
+        for (size_t iiii = 0; iiii < count; iiii++) {
+          SMCFoundKey entry = {};
+          entry.key = prefix | ((UInt32)chars[iii] << 8) | chars[iiii];
+          if (known.count(entry.key)) {
+            continue;
+          }
+
+          shardProbes++;
+          if (backend->keyInfo(entry.key, &entry.dataSize, &entry.dataType, &entry.dataAttributes) == kIOReturnSuccess) {
+            hits.push_back(entry);
+          }
+        }
+      }
+      probed += shardProbes;
+
+      std::lock_guard<std::mutex> guard(lock);
+      found.insert(found.end(), hits.begin(), hits.end());
+      if (state) {
+        for (size_t i = 0; i < hits.size(); i++) {
+          fprintf(state, "found %08x %08x %u %02x\n",
+                  (unsigned int)hits[i].key,
+                  (unsigned int)hits[i].dataType,
+                  (unsigned int)hits[i].dataSize,
+                  (unsigned int)hits[i].dataAttributes);
+        }
+        fprintf(state, "done %04x\n", (unsigned int)(prefix >> 16));
+        fflush(state);
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (unsigned i = 1; i < threads; i++) {
+    workers.push_back(std::thread(worker));
+  }
+  worker();
+  for (size_t i = 0; i < workers.size(); i++) {
+    workers[i].join();
+  }
+
+  if (state) {
+    fclose(state);
+  }
+
+  std::sort(found.begin(), found.end(), SMCFoundKeyLess);
+  found.erase(std::unique(found.begin(), found.end(), SMCFoundKeyEqual), found.end());
+  *probes = probed;
+
+  return kIOReturnSuccess;
+}
@@ -0,0 +1,56 @@
+/*
+ * Apple System Management Control (SMC) Tool
+ * Copyright (C) 2018 vit9696
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+
+#ifndef __SMC_DISCOVER_H__
+#define __SMC_DISCOVER_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "backend.h"
+
+// Key found by discovery with the key info returned by its probe.
+struct SMCFoundKey {
+  uint32_t key;
+  uint32_t dataSize;
+  uint32_t dataType;
+  uint8_t dataAttributes;
+};
+
+// Whether c is valid in SMC key names, same as key_type_valid in smcread.c.
+bool SMCKeyCharValid(uint8_t c);
+
+// Probe every key name made of valid characters, except the listed keys,
+// with a single key info call. The keyspace is split into shards by the
+// first two characters and processed by threads workers (0 for CPU count).
+// Completed shards and found keys are appended to the checkpoint file
+// if given, and shards it lists as done are skipped, see README.md.
+// found receives all keys found by this and previous runs sorted by name,
+// probes the number of key info calls made. Returns 0 on success.
+int SMCDiscoverKeys(SMCBackend *backend,
+                    const std::vector<std::string> &keys,
+                    unsigned threads,
+                    const char *checkpoint,
+                    std::vector<SMCFoundKey> &found,
+                    uint64_t *probes);
+
+#endif
@@ -19,6 +19,8 @@
  * USA.
  */
 
+#include <algorithm>
+#include <chrono>
 #include <string>
 #include <vector>
 
@@ -26,10 +28,14 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "backend.h"
+#include "campaign.h"
+#include "discover.h"
 #include "smc.h"
+#include "snapshot.h"
 
-// We only need 1 open connection, might as well be global.
-io_connect_t kIOConnection;
+// We only need 1 open backend, might as well be global.
+SMCBackend *kSMCBackend;
 
 // When break key iteration into two steps: (1) discovery, (2) enumeration.
 std::vector<std::string> kSMCKeys;
@@ -72,22 +78,22 @@ void printFPE2(SMCVal_t val) {
 
 void printSInt(SMCVal_t val) {
 	int64_t value = val.bytes[0] & 0x80 ? -1 : 0;
-	for (int i = 0; i < val.dataSize; i++) {
+	for (UInt32 i = 0; i < val.dataSize; i++) {
 		value = (int64_t)((uint64_t)value << 8) + (uint8_t)val.bytes[i];
 	}
-	printf("%lld ", value);
+	printf("%lld ", (long long)value);
 }
 
 void printUInt(SMCVal_t val) {
 	uint64_t value = 0;
-	for (int i = 0; i < val.dataSize; i++) {
+	for (UInt32 i = 0; i < val.dataSize; i++) {
 		value = (value << 8) + (uint8_t)val.bytes[i];
 	}
-	printf("%llu ", value);
+	printf("%llu ", (unsigned long long)value);
 }
 
 void printBytesHex(SMCVal_t val) {
-  int i;
+  UInt32 i;
 
   printf("(bytes");
   for (i = 0; i < val.dataSize; i++)
@@ -115,123 +121,42 @@ void printVal(SMCVal_t val) {
   }
 }
 
-kern_return_t SMCOpen(io_connect_t *conn) {
-  kern_return_t result;
-  mach_port_t masterPort;
-  io_iterator_t iterator;
-  io_object_t device;
-
-  result = IOMasterPort(MACH_PORT_NULL, &masterPort);
-  if (result != kIOReturnSuccess) {
-    printf("Error: IOMasterPort() = %08x\n", result);
-    return 1;
-  }
-
-  CFMutableDictionaryRef matchingDictionary = IOServiceMatching("AppleSMC");
-  result =
-      IOServiceGetMatchingServices(masterPort, matchingDictionary, &iterator);
-  if (result != kIOReturnSuccess) {
-    printf("Error: IOServiceGetMatchingServices() = %08x\n", result);
-    return 1;
-  }
-
-  device = IOIteratorNext(iterator);
-  IOObjectRelease((io_object_t)iterator);
-  if (device == 0) {
-    printf("Error: no SMC found\n");
-    return 1;
-  }
-
-  result = IOServiceOpen(device, mach_task_self(), 0, conn);
-  IOObjectRelease(device);
-  if (result != kIOReturnSuccess) {
-    printf("Error: IOServiceOpen() = %08x\n", result);
-    return 1;
-  }
-
-  return kIOReturnSuccess;
-}
-
-kern_return_t SMCClose(io_connect_t conn) { return IOServiceClose(conn); }
-
-kern_return_t SMCCall(uint32_t selector,
-                      SMCKeyData_t *inputStructure,
-                      SMCKeyData_t *outputStructure) {
-  size_t structureInputSize;
-  size_t structureOutputSize;
-
-  structureInputSize = sizeof(SMCKeyData_t);
-  structureOutputSize = sizeof(SMCKeyData_t);
-
-  return IOConnectCallStructMethod(kIOConnection,
-                                   selector,
-                                   inputStructure,
-                                   structureInputSize,
-                                   outputStructure,
-                                   &structureOutputSize);
-}
-
 kern_return_t SMCReadKey(const std::string &key, SMCVal_t *val) {
   kern_return_t result;
-  SMCKeyData_t inputStructure;
-  SMCKeyData_t outputStructure;
+  UInt32 dataType;
+  uint8_t dataAttributes;
 
-  memset(&inputStructure, 0, sizeof(SMCKeyData_t));
-  memset(&outputStructure, 0, sizeof(SMCKeyData_t));
   memset(val, 0, sizeof(SMCVal_t));
 
-  inputStructure.key = _strtoul(key.c_str(), 4, 16);
+  UInt32 name = _strtoul(key.c_str(), 4, 16);
   snprintf(val->key, 5, "%s", key.c_str());
-  inputStructure.data8 = SMC_CMD_READ_KEYINFO;
 
-  result = SMCCall(KERNEL_INDEX_SMC, &inputStructure, &outputStructure);
+  result = kSMCBackend->keyInfo(name, &val->dataSize, &dataType, &dataAttributes);
   if (result != kIOReturnSuccess)
     return result;
 
-  val->dataSize = outputStructure.keyInfo.dataSize;
-  _ultostr(val->dataType, outputStructure.keyInfo.dataType);
-  inputStructure.keyInfo.dataSize = val->dataSize;
-  inputStructure.data8 = SMC_CMD_READ_BYTES;
-
-  result = SMCCall(KERNEL_INDEX_SMC, &inputStructure, &outputStructure);
-  if (result != kIOReturnSuccess)
-    return result;
+  _ultostr(val->dataType, dataType);
 
-  memcpy(val->bytes, outputStructure.bytes, sizeof(outputStructure.bytes));
-
-  return kIOReturnSuccess;
+  return kSMCBackend->readKey(name, val->dataSize, val->bytes);
 }
 
 kern_return_t SMCWriteKey(SMCVal_t writeVal) {
   kern_return_t result;
-  SMCKeyData_t inputStructure;
-  SMCKeyData_t outputStructure;
-
-  SMCVal_t readVal;
+  UInt32 dataSize, dataType;
+  uint8_t dataAttributes;
 
-  result = SMCReadKey(writeVal.key, &readVal);
+  // Only key info is needed, write-only keys cannot be read.
+  UInt32 name = _strtoul(writeVal.key, 4, 16);
+  result = kSMCBackend->keyInfo(name, &dataSize, &dataType, &dataAttributes);
   if (result != kIOReturnSuccess) {
     return result;
   }
 
-  if (readVal.dataSize != writeVal.dataSize) {
-    writeVal.dataSize = readVal.dataSize;
-  }
-
-  memset(&inputStructure, 0, sizeof(SMCKeyData_t));
-  memset(&outputStructure, 0, sizeof(SMCKeyData_t));
-
-  inputStructure.key = _strtoul(writeVal.key, 4, 16);
-  inputStructure.data8 = SMC_CMD_WRITE_BYTES;
-  inputStructure.keyInfo.dataSize = writeVal.dataSize;
-  memcpy(inputStructure.bytes, writeVal.bytes, sizeof(writeVal.bytes));
-
-  result = SMCCall(KERNEL_INDEX_SMC, &inputStructure, &outputStructure);
-  if (result != kIOReturnSuccess) {
-    return result;
+  if (dataSize != writeVal.dataSize) {
+    writeVal.dataSize = dataSize;
   }
 
-  return kIOReturnSuccess;
+  return kSMCBackend->writeKey(name, writeVal.dataSize, writeVal.bytes);
 }
 
 UInt32 SMCReadIndexCount(void) {
@@ -252,23 +177,14 @@ UInt32 SMCReadIndexCount(void) {
 void SMCGetKeys(std::vector<std::string> &keys) {
   UInt32 totalKeys = SMCReadIndexCount();
   for (UInt32 i = 0; i < totalKeys; i++) {
-    SMCKeyData_t inputStructure;
-    SMCKeyData_t outputStructure;
-
-    memset(&inputStructure, 0, sizeof(SMCKeyData_t));
-    memset(&outputStructure, 0, sizeof(SMCKeyData_t));
-
-    inputStructure.data8 = SMC_CMD_READ_INDEX;
-    inputStructure.data32 = i;
-
-    kern_return_t result =
-        SMCCall(KERNEL_INDEX_SMC, &inputStructure, &outputStructure);
+    UInt32 name;
+    kern_return_t result = kSMCBackend->keyFromIndex(i, &name);
     if (result != kIOReturnSuccess) {
       continue;
     }
 
     UInt32Char_t key;
-    _ultostr(key, outputStructure.key);
+    _ultostr(key, name);
     keys.push_back(key);
   }
 }
@@ -349,6 +265,44 @@ kern_return_t SMCCompare(const std::vector<std::string> &keys) {
   return kIOReturnSuccess;
 }
 
+// Faster SMCCompare over key names made of valid characters, see SMCDiscoverKeys.
+// Found keys are printed with the key info of their probe and a single read.
+kern_return_t SMCDiscover(const std::vector<std::string> &keys,
+                          unsigned threads,
+                          const char *checkpoint) {
+  std::vector<SMCFoundKey> found;
+  uint64_t probes = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  int result = SMCDiscoverKeys(kSMCBackend, keys, threads, checkpoint, found, &probes);
+  if (result != kIOReturnSuccess) {
+    return result;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  for (size_t i = 0; i < found.size(); i++) {
+    SMCVal_t val;
+    memset(&val, 0, sizeof(SMCVal_t));
+    _ultostr(val.key, found[i].key);
+    _ultostr(val.dataType, found[i].dataType);
+    val.dataSize = found[i].dataSize;
+    if (kSMCBackend->readKey(found[i].key, val.dataSize, val.bytes) != kIOReturnSuccess) {
+      printf("  %s  [%-4s]  unreadable\n", val.key, val.dataType);
+      continue;
+    }
+    printVal(val);
+  }
+
+  fprintf(stderr,
+          "Probed %llu keys in %.2f s (%.0f keys/s), %zu hidden keys\n",
+          (unsigned long long)probes,
+          seconds,
+          seconds > 0 ? probes / seconds : 0.0,
+          found.size());
+
+  return kIOReturnSuccess;
+}
+
 kern_return_t SMCPrintFans(void) {
   kern_return_t result;
   SMCVal_t val;
@@ -361,24 +315,27 @@ kern_return_t SMCPrintFans(void) {
 
   totalFans = _strtoul(val.bytes, val.dataSize, 10);
   printf("Total fans in system: %d\n", totalFans);
+  // Fan keys only have room for a single digit.
+  if (totalFans > 10)
+    totalFans = 10;
 
   for (i = 0; i < totalFans; i++) {
     printf("\nFan #%d:\n", i);
-    snprintf(key, 5, "F%dAc", i);
+    snprintf(key, sizeof(key), "F%cAc", '0' + i);
     SMCReadKey(key, &val);
     printf("    Actual speed : %.0f Key[%s]\n",
            fpe2ToFlt(val.bytes, val.dataSize),
            key);
-    snprintf(key, 5, "F%dMn", i);
+    snprintf(key, sizeof(key), "F%cMn", '0' + i);
     SMCReadKey(key, &val);
     printf("    Minimum speed: %.0f\n", fpe2ToFlt(val.bytes, val.dataSize));
-    snprintf(key, 5, "F%dMx", i);
+    snprintf(key, sizeof(key), "F%cMx", '0' + i);
     SMCReadKey(key, &val);
     printf("    Maximum speed: %.0f\n", fpe2ToFlt(val.bytes, val.dataSize));
-    snprintf(key, 5, "F%dSf", i);
+    snprintf(key, sizeof(key), "F%cSf", '0' + i);
     SMCReadKey(key, &val);
     printf("    Safe speed   : %.0f\n", fpe2ToFlt(val.bytes, val.dataSize));
-    sprintf(key, "F%dTg", i);
+    snprintf(key, sizeof(key), "F%cTg", '0' + i);
     SMCReadKey(key, &val);
     printf("    Target speed : %.0f\n", fpe2ToFlt(val.bytes, val.dataSize));
     SMCReadKey("FS! ", &val);
@@ -478,27 +435,63 @@ kern_return_t SMCFuzz(SMCVal_t val, bool fixed_key, bool fixed_val) {
   return kIOReturnSuccess;
 }
 
+// Available backends, the first one is the default.
+const char *kSMCBackendNames =
+#if defined(SMC_BACKEND_IOKIT) && defined(SMC_BACKEND_VSMC)
+    "iokit (default) or vsmc";
+#elif defined(SMC_BACKEND_IOKIT)
+    "iokit";
+#else
+    "vsmc";
+#endif
+
 void usage(char *prog) {
   printf("Apple System Management Control (SMC) tool %s\n", VERSION);
   printf("Usage:\n");
   printf("%s [options]\n", prog);
   printf("    -c <spell> : cast a spell\n");
   printf("    -q         : attempt to discover 'hidden' keys\n");
+  printf("    -d         : discover 'hidden' keys faster (valid key characters only)\n");
+  printf("    -j <count> : discovery threads (default: CPU count)\n");
+  printf("    -C <file>  : discovery checkpoint to resume from and append to\n");
+  printf("    -F <file>  : run or resume write fuzzing campaign\n");
   printf("    -z         : fuzz all possible keys (or one key using -k)\n");
   printf("    -f         : fan info decoded\n");
   printf("    -h         : help\n");
   printf("    -k <key>   : key to manipulate\n");
   printf("    -l         : list all keys and values\n");
+  printf("    -s         : dump JSON snapshot of all keys and values\n");
+  printf("    -n <count> : snapshot dumps (default: 1)\n");
+  printf("    -i <ms>    : interval between snapshot dumps (default: 1000)\n");
   printf("    -r         : read the value of a key\n");
   printf("    -w <value> : write the specified value to a key\n");
   printf("    -v         : version\n");
+  printf("    -B <name>  : backend, %s\n", kSMCBackendNames);
+  printf("    -p <plist> : VirtualSMC Info.plist (vsmc backend)\n");
+  printf("    -b <board> : board-id (vsmc backend)\n");
+  printf("    -a <args>  : VirtualSMC boot arguments (vsmc backend)\n");
   printf("\n");
 }
 
+SMCBackend *SMCCreateBackend(const char *name,
+                             const char *plist,
+                             const char *board,
+                             const char *bootArgs) {
+#ifdef SMC_BACKEND_IOKIT
+  if (!name || !strcmp(name, "iokit"))
+    return SMCCreateIOKitBackend();
+#endif
+#ifdef SMC_BACKEND_VSMC
+  if (!name || !strcmp(name, "vsmc"))
+    return SMCCreateVirtualSMCBackend(plist, board, bootArgs);
+#endif
+  fprintf(stderr, "Error: unsupported backend %s\n", name);
+  return nullptr;
+}
+
 int main(int argc, char *argv[]) {
   int c;
   extern char *optarg;
-  extern int optind, optopt, opterr;
 
   kern_return_t result;
   int op = OP_NONE;
@@ -506,9 +499,47 @@ int main(int argc, char *argv[]) {
   char spell[33] = {0};
   SMCVal_t val;
 
+  const char *backend = nullptr, *plist = nullptr, *board = nullptr,
+             *bootArgs = nullptr, *checkpoint = nullptr, *campaign = nullptr;
+  unsigned threads = 0, dumps = 1, interval = 1000;
+
   bool fixed_key = false, fixed_val = false;
-	while ((c = getopt(argc, argv, "fhk:lr:w:c:vzq")) != -1) {
+	while ((c = getopt(argc, argv, "fhk:lr:w:c:vzqdj:C:F:sn:i:B:p:b:a:")) != -1) {
     switch (c) {
+    case 's':
+      op = OP_SNAPSHOT;
+      break;
+    case 'n':
+      dumps = (unsigned)strtoul(optarg, nullptr, 0);
+      break;
+    case 'i':
+      interval = (unsigned)strtoul(optarg, nullptr, 0);
+      break;
+    case 'F':
+      op = OP_CAMPAIGN;
+      campaign = optarg;
+      break;
+    case 'd':
+      op = OP_DISCOVER;
+      break;
+    case 'j':
+      threads = (unsigned)strtoul(optarg, nullptr, 0);
+      break;
+    case 'C':
+      checkpoint = optarg;
+      break;
+    case 'B':
+      backend = optarg;
+      break;
+    case 'p':
+      plist = optarg;
+      break;
+    case 'b':
+      board = optarg;
+      break;
+    case 'a':
+      bootArgs = optarg;
+      break;
     case 'f':
       op = OP_READ_FAN;
       break;
@@ -560,7 +591,10 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
-  SMCOpen(&kIOConnection);
+  kSMCBackend = SMCCreateBackend(backend, plist, board, bootArgs);
+  if (!kSMCBackend) {
+    return 1;
+  }
 
   int retcode = 0;
   switch (op) {
@@ -572,6 +606,13 @@ int main(int argc, char *argv[]) {
       retcode = 1;
     }
     break;
+  case OP_SNAPSHOT:
+    result = SMCDumpSnapshots(kSMCBackend, dumps, interval, stdout);
+    if (result != kIOReturnSuccess) {
+      fprintf(stderr, "Error: SMCDumpSnapshots() = %08x\n", result);
+      retcode = 1;
+    }
+    break;
   case OP_READ:
     if (strlen(key) > 0) {
       result = SMCReadKey(key, &val);
@@ -631,8 +672,24 @@ int main(int argc, char *argv[]) {
       retcode = 1;
     }
     break;
+  case OP_DISCOVER:
+    SMCGetKeys(kSMCKeys);
+    result = SMCDiscover(kSMCKeys, threads, checkpoint);
+    if (result != kIOReturnSuccess) {
+      fprintf(stderr, "Error: SMCDiscover() = %08x\n", result);
+      retcode = 1;
+    }
+    break;
+  case OP_CAMPAIGN:
+    SMCGetKeys(kSMCKeys);
+    result = SMCRunCampaign(kSMCBackend, kSMCKeys, campaign);
+    if (result != kIOReturnSuccess) {
+      fprintf(stderr, "Error: SMCRunCampaign() = %08x\n", result);
+      retcode = 1;
+    }
+    break;
   }
 
-  SMCClose(kIOConnection);
+  delete kSMCBackend;
   return retcode;
 }
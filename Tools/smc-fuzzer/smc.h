@@ -25,7 +25,18 @@
 #include <unistd.h>
 #include <sys/types.h>
 
+#ifdef __APPLE__
 #include <IOKit/IOKitLib.h>
+#else
+#include <stdint.h>
+typedef uint16_t UInt16;
+typedef uint32_t UInt32;
+typedef int kern_return_t;
+enum {
+  kIOReturnSuccess = 0,
+  kIOReturnError = (int)0xe00002bc
+};
+#endif
 
 #define VERSION "1.01"
 
@@ -37,6 +48,9 @@
 #define OP_FUZZ 5
 #define OP_COMPARE 6
 #define OP_CAST 7
+#define OP_DISCOVER 8
+#define OP_CAMPAIGN 9
+#define OP_SNAPSHOT 10
 
 #define KERNEL_INDEX_SMC 2
 
@@ -0,0 +1,151 @@
+/*
+ * Apple System Management Control (SMC) Tool
+ * Copyright (C) 2018 vit9696
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+
+#include <algorithm>
+#include <chrono>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "backend.h"
+#include "smc.h"
+#include "snapshot.h"
+
+static UInt32 SMCSnapshotKeyValue(const char *bytes) {
+  UInt32 value = 0;
+  for (size_t i = 0; i < 4; i++) {
+    value = (value << 8) | (uint8_t)bytes[i];
+  }
+  return value;
+}
+
+static void SMCSnapshotKeyName(char *name, UInt32 key) {
+  for (int i = 0; i < 4; i++) {
+    name[i] = (char)(key >> ((3 - i) * 8));
+  }
+  name[4] = '\0';
+}
+
+int SMCLoadKeyCache(SMCBackend *backend, std::vector<SMCCachedKey> &cache, uint64_t *calls) {
+  char count[32];
+  UInt32 countSize, countType;
+  uint8_t countAttributes;
+  UInt32 countKey = SMCSnapshotKeyValue("#KEY");
+  kern_return_t result = backend->keyInfo(countKey, &countSize, &countType, &countAttributes);
+  if (result == kIOReturnSuccess) {
+    result = backend->readKey(countKey, countSize, count);
+  }
+  *calls += 2;
+  if (result != kIOReturnSuccess || countSize != 4) {
+    return result != kIOReturnSuccess ? result : kIOReturnError;
+  }
+
+  UInt32 total = SMCSnapshotKeyValue(count);
+  cache.clear();
+  for (UInt32 i = 0; i < total; i++) {
+    SMCCachedKey entry = {};
+    *calls += 2;
+    if (backend->keyFromIndex(i, &entry.key) != kIOReturnSuccess ||
+        backend->keyInfo(entry.key, &entry.dataSize, &entry.dataType, &entry.dataAttributes) != kIOReturnSuccess) {
+      fprintf(stderr, "Unable to read key info at %u index\n", (unsigned int)i);
+      continue;
+    }
+    cache.push_back(entry);
+  }
+
+  return kIOReturnSuccess;
+}
+
+static void SMCPrintJsonString(FILE *out, const char *str, size_t size) {
+  fputc('"', out);
+  for (size_t i = 0; i < size; i++) {
+    unsigned char c = str[i];
+    if (c == '"' || c == '\\')
+      fprintf(out, "\\%c", c);
+    else if (c < 0x20 || c >= 0x7F)
+      fprintf(out, "\\u%04x", c);
+    else
+      fputc(c, out);
+  }
+  fputc('"', out);
+}
+
+void SMCPrintSnapshot(SMCBackend *backend, const std::vector<SMCCachedKey> &cache, FILE *out, uint64_t *calls) {
+  fprintf(out, "[\n");
+  for (size_t i = 0; i < cache.size(); i++) {
+    const SMCCachedKey &entry = cache[i];
+    UInt32Char_t key, type;
+    char bytes[32];
+    SMCSnapshotKeyName(key, entry.key);
+    SMCSnapshotKeyName(type, entry.dataType);
+
+    int result = backend->readKey(entry.key, entry.dataSize, bytes);
+    (*calls)++;
+
+    fprintf(out, "  {\"key\": ");
+    SMCPrintJsonString(out, key, 4);
+    fprintf(out, ", \"type\": ");
+    SMCPrintJsonString(out, type, strnlen(type, 4));
+    fprintf(out, ", \"size\": %u, \"attr\": \"%02x\", ", (unsigned int)entry.dataSize, entry.dataAttributes);
+    if (result == kIOReturnSuccess) {
+      fprintf(out, "\"value\": \"");
+      for (UInt32 j = 0; j < entry.dataSize && j < sizeof(bytes); j++) {
+        fprintf(out, "%02x", (unsigned char)bytes[j]);
+      }
+      fprintf(out, "\"}");
+    } else {
+      fprintf(out, "\"error\": \"%02x\"}", (unsigned int)result & 0xFF);
+    }
+    fprintf(out, "%s\n", i + 1 < cache.size() ? "," : "");
+  }
+  fprintf(out, "]\n");
+}
+
+int SMCDumpSnapshots(SMCBackend *backend, unsigned count, unsigned interval, FILE *out) {
+  std::vector<SMCCachedKey> cache;
+  uint64_t calls = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  kern_return_t result = SMCLoadKeyCache(backend, cache, &calls);
+  if (result != kIOReturnSuccess) {
+    return result;
+  }
+  double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+  fprintf(stderr, "Key info: %zu keys, %llu calls, %.1f us\n",
+          cache.size(), (unsigned long long)calls, us);
+
+  for (unsigned n = 0; n < std::max(count, 1U); n++) {
+    if (n > 0 && interval > 0) {
+      usleep(interval * 1000);
+    }
+
+    calls = 0;
+    start = std::chrono::steady_clock::now();
+    SMCPrintSnapshot(backend, cache, out, &calls);
+    fflush(out);
+    us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    fprintf(stderr, "Dump %u: %zu keys, %llu calls, %.1f us\n",
+            n, cache.size(), (unsigned long long)calls, us);
+  }
+
+  return kIOReturnSuccess;
+}
@@ -0,0 +1,61 @@
+/*
+ * Apple System Management Control (SMC) Tool
+ * Copyright (C) 2018 vit9696
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+
+#ifndef __SMC_SNAPSHOT_H__
+#define __SMC_SNAPSHOT_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include "backend.h"
+
+// Key info cached across repeated snapshots, types and sizes are static.
+struct SMCCachedKey {
+  uint32_t key;
+  uint32_t dataSize;
+  uint32_t dataType;
+  uint8_t dataAttributes;
+};
+
+// Enumerate listed keys with one index and one key info call per key.
+// Backend calls made are added to calls. Returns 0 on success.
+int SMCLoadKeyCache(SMCBackend *backend,
+                    std::vector<SMCCachedKey> &cache,
+                    uint64_t *calls);
+
+// Print a JSON snapshot with one key per line to out, reading only the values.
+// Backend calls made are added to calls.
+void SMCPrintSnapshot(SMCBackend *backend,
+                      const std::vector<SMCCachedKey> &cache,
+                      FILE *out,
+                      uint64_t *calls);
+
+// Dump all listed keys count times to out, see README.md for the format.
+// Key info is read once, later dumps only read values, so a dump costs
+// one call per key. Call counts and timings are reported to stderr.
+// Returns 0 on success.
+int SMCDumpSnapshots(SMCBackend *backend,
+                     unsigned count,
+                     unsigned interval,
+                     FILE *out);
+
+#endif
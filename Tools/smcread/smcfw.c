@@ -0,0 +1,815 @@
+//
+//  smcfw.c
+//  smcread
+//
+//  Copyright © 2017 vit9696. All rights reserved.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "smcfw.h"
+
+const bool smcfw_key_char_valid[256] = {
+	/* 00 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* 10 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* 20 */ 1, 1, 0, 1, 1, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0,
+	/* 30 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+	/* 40 */ 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	/* 50 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	/* 60 */ 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	/* 70 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0,
+	/* 80 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* 90 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* A0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* B0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* C0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* D0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* E0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* F0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+/**
+ *  Hex digit values, -1 for anything else
+ */
+static const int8_t hex_value[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5, ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16
+};
+
+static inline int hex_digit(char c) {
+	// Table is biased by one to keep the initializer short
+	return hex_value[(uint8_t)c] - 1;
+}
+
+/**
+ *  Update line parser states, lines look like:
+ *  # Version: 2.16f68
+ *  D:<hex address>:<decimal count>:<hex bytes>
+ *  +:<decimal count>:<hex bytes>
+ *  Records starting with + continue at the address following the previous one.
+ */
+enum {
+	UpdateLineStart,
+	UpdateDataMark,
+	UpdateAddress,
+	UpdateCountMark,
+	UpdateCount,
+	UpdateData,
+	UpdateSkip
+};
+
+bool smcfw_is_update(const uint8_t *buf, size_t sz) {
+	return sz >= 4 && buf[0] == '#' && buf[1] == ' ' && buf[2] == 'V' && buf[3] == 'e';
+}
+
+void smcfw_update_init(SMCUpdateDecoder *dec) {
+	memset(dec, 0, sizeof(*dec));
+	dec->state = UpdateLineStart;
+	dec->nibble = -1;
+}
+
+/**
+ *  Make sure the image can hold the next record, gaps are filled with 0xFF
+ */
+static bool update_reserve(SMCUpdateDecoder *dec, size_t end) {
+	if (end <= dec->cursz)
+		return true;
+
+	size_t newsz = dec->cursz > 0 ? dec->cursz * 2 : 0x10000;
+	if (newsz < end)
+		newsz = end;
+
+	uint8_t *newbuf = realloc(dec->bin, newsz);
+	if (!newbuf) {
+		fprintf(stderr, "Failed to allocate %zu bytes for smc conversion\n", newsz);
+		return false;
+	}
+
+	memset(&newbuf[dec->cursz], 0xFF, newsz - dec->cursz);
+	dec->bin = newbuf;
+	dec->cursz = newsz;
+	return true;
+}
+
+bool smcfw_update_feed(SMCUpdateDecoder *dec, const char *buf, size_t sz) {
+	if (dec->failed)
+		return false;
+
+	for (size_t i = 0; i < sz; i++) {
+		char c = buf[i];
+
+		// Remember the first line for version recovery
+		if (!dec->headerdone) {
+			if (c == '\n')
+				dec->headerdone = true;
+			else if (dec->headerlen < sizeof(dec->header) - 1)
+				dec->header[dec->headerlen++] = c;
+		}
+
+		switch (dec->state) {
+			case UpdateLineStart:
+				if (c == 'D')
+					dec->state = UpdateDataMark;
+				else if (c == '+')
+					dec->state = UpdateCountMark;
+				else if (c != '\n')
+					dec->state = UpdateSkip;
+				break;
+			case UpdateDataMark:
+				if (c == ':') {
+					dec->value = 0;
+					dec->state = UpdateAddress;
+				} else {
+					dec->state = c == '\n' ? UpdateLineStart : UpdateSkip;
+				}
+				break;
+			case UpdateAddress: {
+				int d = hex_digit(c);
+				if (d >= 0) {
+					dec->value = (dec->value << 4) | (size_t)d;
+					break;
+				}
+				dec->addr = dec->value;
+				if (c == ':') {
+					dec->value = 0;
+					dec->state = UpdateCount;
+				} else {
+					dec->state = c == '\n' ? UpdateLineStart : UpdateCountMark;
+				}
+				break;
+			}
+			case UpdateCountMark:
+				if (c == ':') {
+					dec->value = 0;
+					dec->state = UpdateCount;
+				} else if (c == '\n') {
+					dec->state = UpdateLineStart;
+				}
+				break;
+			case UpdateCount:
+				if (c >= '0' && c <= '9') {
+					dec->value = dec->value * 10 + (size_t)(c - '0');
+				} else if (dec->value == 0) {
+					dec->state = c == '\n' ? UpdateLineStart : UpdateSkip;
+				} else if (c == '\n' || dec->addr + dec->value < dec->addr || !update_reserve(dec, dec->addr + dec->value)) {
+					dec->failed = true;
+				} else {
+					// The separator after the count is consumed here
+					dec->numb = dec->value;
+					if (dec->wrsz < dec->addr + dec->numb)
+						dec->wrsz = dec->addr + dec->numb;
+					dec->state = UpdateData;
+				}
+				break;
+			case UpdateData: {
+				// Decode whole byte pairs without going through the state machine
+				if (dec->nibble < 0) {
+					uint8_t *dst = &dec->bin[dec->addr];
+					size_t avail = (sz - i) / 2;
+					size_t todo = dec->numb < avail ? dec->numb : avail;
+					size_t done = 0;
+					for (; done < todo; done++) {
+						int hi = hex_digit(buf[i + done * 2]);
+						int lo = hex_digit(buf[i + done * 2 + 1]);
+						if (hi < 0 || lo < 0)
+							break;
+						dst[done] = (uint8_t)((hi << 4) | lo);
+					}
+					if (done > 0) {
+						dec->addr += done;
+						dec->numb -= done;
+						i += done * 2 - 1;
+						if (dec->numb == 0)
+							dec->state = UpdateSkip;
+						break;
+					}
+				}
+				int d = hex_digit(c);
+				if (d < 0) {
+					dec->failed = true;
+				} else if (dec->nibble < 0) {
+					dec->nibble = d;
+				} else {
+					dec->bin[dec->addr++] = (uint8_t)((dec->nibble << 4) | d);
+					dec->nibble = -1;
+					if (--dec->numb == 0)
+						dec->state = UpdateSkip;
+				}
+				break;
+			}
+			case UpdateSkip:
+				if (c == '\n')
+					dec->state = UpdateLineStart;
+				break;
+		}
+
+		if (dec->failed) {
+			fprintf(stderr, "Failed to parse hex string for smc conversion at address 0x%zX\n", dec->addr);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+uint8_t *smcfw_update_finish(SMCUpdateDecoder *dec, size_t *sz, char revrecover[64]) {
+	revrecover[0] = '\0';
+
+	if (!dec->failed && dec->state == UpdateData) {
+		fprintf(stderr, "Truncated smc update record at address 0x%zX\n", dec->addr);
+		dec->failed = true;
+	}
+
+	if (dec->failed || !dec->bin) {
+		free(dec->bin);
+		smcfw_update_init(dec);
+		return NULL;
+	}
+
+	uint8_t *bin = dec->bin;
+	size_t wrsz = dec->wrsz;
+
+	// Attempt to recover firmware info by first branch
+	if (wrsz > sizeof(FirmwareInfo)) {
+		FirmwareInfo *fwinfo = (FirmwareInfo *)&bin[wrsz - sizeof(FirmwareInfo)];
+		unsigned int major = 0, minor = 0, flag = 0, patch = 0;
+		if (sscanf(dec->header, "# Version: %x.%2x%1x%x", &major, &minor, &flag, &patch) > 0) {
+			if (fwinfo->rev.raw[0] == 0xFF) {
+				fwinfo->rev.p.major = major;
+				fwinfo->rev.p.minor = minor;
+				fwinfo->rev.p.module = flag;
+				fwinfo->rev.p.patch1 = patch;
+				fwinfo->rev.p.patch2 = 0;
+				snprintf(revrecover, 64, " (recovered %x.%x%x%x)", major, minor, flag, patch);
+			} else {
+				snprintf(revrecover, 64, " (org %x.%x%x%x)", major, minor, flag, patch);
+			}
+		}
+	}
+
+	smcfw_update_init(dec);
+	*sz = wrsz;
+	return bin;
+}
+
+uint8_t *smcfw_convert_update(FILE *fh, size_t *sz, char revrecover[64]) {
+	SMCUpdateDecoder dec;
+	smcfw_update_init(&dec);
+
+	char chunk[0x10000];
+	size_t len;
+	while ((len = fread(chunk, 1, sizeof(chunk), fh)) > 0) {
+		if (!smcfw_update_feed(&dec, chunk, len))
+			break;
+	}
+
+	if (ferror(fh)) {
+		fprintf(stderr, "Failed to read smc update\n");
+		dec.failed = true;
+	}
+
+	return smcfw_update_finish(&dec, sz, revrecover);
+}
+
+char *smcfw_encode_update(const uint8_t *bin, size_t sz, const char *version, size_t *outsz) {
+	static const char hex[] = "0123456789ABCDEF";
+	static const size_t record = 128;
+
+	// Header, 2 hex digits per byte and at most 16 bytes of record prefix per record
+	size_t cap = 64 + (version ? strlen(version) : 0) + sz * 2 + (sz / record + 1) * 24;
+	char *out = malloc(cap);
+	if (!out)
+		return NULL;
+
+	size_t len = 0;
+	if (version)
+		len += (size_t)snprintf(out, cap, "# Version: %s\n", version);
+
+	size_t next = (size_t)-1;
+	for (size_t off = 0; off < sz; off += record) {
+		size_t numb = sz - off < record ? sz - off : record;
+
+		// Unprogrammed blocks are skipped, but the image end must be kept
+		bool empty = off + numb < sz;
+		for (size_t i = 0; empty && i < numb; i++)
+			empty = bin[off + i] == 0xFF;
+		if (empty)
+			continue;
+
+		if (off == next)
+			len += (size_t)snprintf(&out[len], cap - len, "+:%zu:", numb);
+		else
+			len += (size_t)snprintf(&out[len], cap - len, "D:%08zX:%zu:", off, numb);
+
+		for (size_t i = 0; i < numb; i++) {
+			out[len++] = hex[bin[off + i] >> 4];
+			out[len++] = hex[bin[off + i] & 0xF];
+		}
+		out[len++] = '\n';
+		next = off + numb;
+	}
+
+	*outsz = len;
+	return out;
+}
+
+uint8_t *smcfw_read_file(const char *path, size_t *sz) {
+	FILE *fh = fopen(path, "rb");
+	if (!fh) {
+		fprintf(stderr, "Unable to open %s for reading\n", path);
+		return NULL;
+	}
+
+	if (fseek(fh, 0, SEEK_END)) {
+		fprintf(stderr, "Unable to obtain %s size\n", path);
+		fclose(fh);
+		return NULL;
+	}
+
+	long fsz = ftell(fh);
+	if (fsz < 0 || fseek(fh, 0, SEEK_SET)) {
+		fprintf(stderr, "Unable to obtain %s size\n", path);
+		fclose(fh);
+		return NULL;
+	}
+
+	*sz = (size_t)fsz;
+	uint8_t *buf = calloc(1, *sz + 1);
+	if (!buf) {
+		fprintf(stderr, "Unable to allocate %zu bytes\n", *sz);
+		fclose(fh);
+		return NULL;
+	}
+
+	if (*sz > 0 && fread(buf, *sz, 1, fh) != 1) {
+		fprintf(stderr, "Unable to read %s\n", path);
+		fclose(fh);
+		free(buf);
+		return NULL;
+	}
+
+	fclose(fh);
+	return buf;
+}
+
+uint8_t *smcfw_load_image(const char *path, size_t *sz, char revrecover[64]) {
+	revrecover[0] = '\0';
+
+	FILE *fh = fopen(path, "rb");
+	if (!fh) {
+		fprintf(stderr, "Unable to open %s for reading\n", path);
+		return NULL;
+	}
+
+	// Updates are decoded straight from the stream
+	uint8_t magic[4] = {};
+	size_t magicsz = fread(magic, 1, sizeof(magic), fh);
+	if (smcfw_is_update(magic, magicsz)) {
+		uint8_t *bin = NULL;
+		if (!fseek(fh, 0, SEEK_SET))
+			bin = smcfw_convert_update(fh, sz, revrecover);
+		if (!bin)
+			fprintf(stderr, "Unable to parse smc update %s\n", path);
+		fclose(fh);
+		return bin;
+	}
+
+	fclose(fh);
+	return smcfw_read_file(path, sz);
+}
+
+static uint32_t read_le32(const uint8_t *p) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t read_be32(const uint8_t *p) {
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static uint64_t read_le64(const uint8_t *p) {
+	return (uint64_t)read_le32(p) | ((uint64_t)read_le32(p + 4) << 32);
+}
+
+static bool key_descr_valid(const KeyDescr *descr) {
+	const uint8_t *key = (const uint8_t *)descr->key;
+	const uint8_t *type = (const uint8_t *)descr->type;
+	return smcfw_key_char_valid[key[0]] && smcfw_key_char_valid[key[1]] &&
+		smcfw_key_char_valid[key[2]] && smcfw_key_char_valid[key[3]] &&
+		smcfw_key_char_valid[type[0]] && smcfw_key_char_valid[type[1]] && smcfw_key_char_valid[type[2]] &&
+		(smcfw_key_char_valid[type[3]] || type[3] == '\0') && descr->zero == 0;
+}
+
+bool smcfw_find_key_table(const uint8_t *buf, size_t sz, SMCKeyTable *table) {
+	memset(table, 0, sizeof(*table));
+
+	size_t smcoff = 0;
+	for (size_t i = sizeof(KeyInfo); i + sizeof(KeyDescr) < sz; i++) {
+		const uint8_t *hash = memchr(&buf[i], '#', sz - sizeof(KeyDescr) - i);
+		if (!hash)
+			break;
+		i = (size_t)(hash - buf);
+		if (!memcmp(hash, "#KEY", strlen("#KEY"))) {
+			smcoff = i - sizeof(KeyInfo);
+			break;
+		}
+	}
+
+	// Flasher updates (either update or base) have no #KEY, as well as private keys
+	table->flasher = !smcoff;
+
+	// We need to bruteforce a table for flasher
+	if (table->flasher) {
+		for (size_t i = sizeof(KeyInfo); smcoff == 0 && i + sizeof(KeyDescr)*3 < sz; i++) {
+			const KeyDescr *descr = (const KeyDescr *)&buf[i];
+			if (key_descr_valid(&descr[0]) && key_descr_valid(&descr[1]) && key_descr_valid(&descr[2]))
+				smcoff = i - sizeof(KeyInfo);
+		}
+
+		if (!smcoff)
+			return false;
+
+		const KeyDescr *descr = (const KeyDescr *)&buf[smcoff + sizeof(KeyInfo)];
+		while ((const uint8_t *)&descr[1] < &buf[sz] && key_descr_valid(descr)) {
+			table->pubnum++;
+			descr++;
+		}
+	} else {
+		table->pubnum = read_le32(&buf[smcoff]);
+		table->privnum = read_le32(&buf[smcoff + sizeof(uint32_t)]);
+
+		// Older SMC FW is BE, detect this by assuming that at least 2 keys (OSK0, OSK1 are private)
+		if (table->privnum != 0 && (table->privnum & 0xFFFF) == 0) {
+			table->pubnum = __builtin_bswap32(table->pubnum);
+			table->privnum = __builtin_bswap32(table->privnum);
+		}
+
+		size_t total = ((size_t)table->pubnum + table->privnum) * sizeof(KeyDescr);
+		if (sz - smcoff < total)
+			return false;
+	}
+
+	table->keys = (const KeyDescr *)&buf[smcoff + sizeof(KeyInfo)];
+	if (sz > sizeof(FirmwareInfo))
+		table->fwinfo = (const FirmwareInfo *)&buf[sz - sizeof(FirmwareInfo)];
+	return true;
+}
+
+const char *smcfw_attr_names(uint8_t attr, char *buf, size_t size) {
+	static const char *names[8] = {
+		"ATTR_PRIVATE_WRITE",
+		"ATTR_PRIVATE_READ",
+		"ATTR_ATOMIC",
+		"ATTR_CONST",
+		"ATTR_FUNCTION",
+		"ATTR_UNK20",
+		"ATTR_WRITE",
+		"ATTR_READ"
+	};
+
+	size_t len = 0;
+	buf[0] = '\0';
+	for (int i = 0; i < 8; i++) {
+		if (attr & (1U << i)) {
+			int n = snprintf(&buf[len], size - len, "%s%s", len > 0 ? "|" : "", names[i]);
+			if (n < 0 || (size_t)n >= size - len)
+				break;
+			len += (size_t)n;
+		}
+	}
+
+	return buf;
+}
+
+/**
+ *  Key presence in the table, some values are reconstructed from firmware info
+ */
+typedef struct {
+	bool KEY;
+	bool REV;
+	bool RVBF;
+	bool RVUF;
+	bool RBr;
+	bool RPlt;
+	bool LDKN;
+} KeyPresence;
+
+static void print_key_descr(FILE *out, const KeyDescr *key) {
+	char attrbuf[256];
+	const uint8_t *type = (const uint8_t *)key->type;
+	fprintf(out, "[%.4s] type [%c%c%c%c] %02X%02X%02X%02X len [%2u] attr [%02X] handler [%08X] -> %s\n",
+			key->key, type[0], type[1], type[2], type[3] == '\0' ? '?' : type[3],
+			type[0], type[1], type[2], type[3],
+			key->len, key->attr, key->handler, smcfw_attr_names(key->attr, attrbuf, sizeof(attrbuf)));
+}
+
+static void print_revision(FILE *out, const char *name, const FirmwareRevision *rev, const char *revrecover) {
+	// patch is never two bytes fortunately
+	uint8_t patch = rev->p.patch1 > 0 ? rev->p.patch1 : rev->p.patch2;
+	fprintf(out, "[%s] is %02X%02X%02X%02X%04X -> %x.%x%x%x%s\n", name, rev->p.major, rev->p.minor, rev->p.module, rev->p.unk,
+			patch, rev->p.major, rev->p.minor, rev->p.module, patch, revrecover);
+}
+
+void smcfw_print_table(FILE *out, const SMCKeyTable *table, const char *revrecover) {
+	KeyPresence pres = {};
+
+	fprintf(out, "Public keys (%u):\n", table->pubnum);
+	for (uint32_t i = 0; i < table->pubnum; i++) {
+		const KeyDescr *key = &table->keys[i];
+		print_key_descr(out, key);
+
+		if (!memcmp(key->key, "#KEY", sizeof(key->key)))
+			pres.KEY = true;
+		else if (!memcmp(key->key, "REV ", sizeof(key->key)))
+			pres.REV = true;
+		else if (!memcmp(key->key, "RVBF", sizeof(key->key)))
+			pres.RVBF = true;
+		else if (!memcmp(key->key, "RVUF", sizeof(key->key)))
+			pres.RVUF = true;
+		else if (!memcmp(key->key, "RBr ", sizeof(key->key)))
+			pres.RBr = true;
+		else if (!memcmp(key->key, "RPlt", sizeof(key->key)))
+			pres.RPlt = true;
+		else if (!memcmp(key->key, "LDKN", sizeof(key->key)))
+			pres.LDKN = true;
+	}
+
+	fprintf(out, "\nHidden keys (%u):\n", table->privnum);
+	for (uint32_t i = 0; i < table->privnum; i++)
+		print_key_descr(out, &table->keys[table->pubnum + i]);
+
+	const FirmwareInfo *fwinfo = table->fwinfo;
+	if (fwinfo) {
+		fprintf(out, "\nKey values:\n");
+		if (pres.KEY)
+			fprintf(out, "[#KEY] is %08X -> %u\n", __builtin_bswap32(table->pubnum), table->pubnum);
+		// Base flasher revision (RVBF) and update flasher revision (RVUF) often equal REV but that is not a rule
+		// RVUF should be taken from flasher_update.smc, RVBF from flasher_base.smc, REV from Mac-XXX.smc
+		if (pres.RVBF)
+			print_revision(out, "RVBF", &fwinfo->rev, revrecover);
+		if (pres.RVUF)
+			print_revision(out, "RVUF", &fwinfo->rev, revrecover);
+		if (pres.REV)
+			print_revision(out, "REV ", &fwinfo->rev, revrecover);
+		if (pres.LDKN)
+			fprintf(out, "[LDKN] is %02X -> %x\n", fwinfo->rev.raw[0], fwinfo->rev.p.major);
+		const uint8_t *b = fwinfo->sbranch;
+		if (pres.RBr && b[0] != 0xFF)
+			fprintf(out, "[RBr ] is %02X%02X%02X%02X%02X%02X%02X%02X -> %.8s\n", b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7], (const char *)b);
+		const uint8_t *p = fwinfo->platform;
+		if (pres.RPlt && p[0] != 0xFF)
+			fprintf(out, "[RPlt] is %02X%02X%02X%02X%02X%02X%02X%02X -> %.8s\n", p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], (const char *)p);
+		// Could actually add some region parsing here and produce valid CRC keys, but we won't be using them anyway
+		const uint8_t *crc = fwinfo->adler32;
+		if (crc[0] != 0xFF || crc[1] != 0xFF || crc[2] != 0xFF || crc[3] != 0xFF)
+			fprintf(out, "[CRC?] is %02X%02X%02X%02X\n", crc[0], crc[1], crc[2], crc[3]);
+	}
+}
+
+/**
+ *  Print a JSON string stopping at the first NUL
+ */
+static void print_json_string(FILE *out, const char *str, size_t len, bool reverse) {
+	fputc('"', out);
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = (unsigned char)str[reverse ? len - i - 1 : i];
+		if (c == '\0')
+			break;
+		if (c == '"' || c == '\\')
+			fprintf(out, "\\%c", c);
+		else if (c < 0x20 || c >= 0x7F)
+			fprintf(out, "\\u%04x", c);
+		else
+			fputc(c, out);
+	}
+	fputc('"', out);
+}
+
+void smcfw_print_json_chars(FILE *out, const char *str, bool reverse) {
+	print_json_string(out, str, 4, reverse);
+}
+
+static void print_key_descr_json(FILE *out, const KeyDescr *key, bool last) {
+	fprintf(out, "    {\"key\": ");
+	smcfw_print_json_chars(out, key->key, false);
+	fprintf(out, ", \"type\": ");
+	smcfw_print_json_chars(out, key->type, false);
+	fprintf(out, ", \"size\": %u, \"attr\": \"%02x\", \"handler\": \"%08x\"}%s\n",
+			key->len, key->attr, key->handler, last ? "" : ",");
+}
+
+void smcfw_print_table_json(FILE *out, const char *name, const SMCKeyTable *table) {
+	fprintf(out, "{\n  \"image\": ");
+	print_json_string(out, name, strlen(name), false);
+	fprintf(out, ",\n  \"flasher\": %s,\n", table->flasher ? "true" : "false");
+
+	const FirmwareInfo *fwinfo = table->fwinfo;
+	if (fwinfo) {
+		const FirmwareRevision *rev = &fwinfo->rev;
+		if (rev->raw[0] != 0xFF)
+			fprintf(out, "  \"revision\": \"%x.%x%x%x\",\n", rev->p.major, rev->p.minor, rev->p.module,
+					rev->p.patch1 > 0 ? rev->p.patch1 : rev->p.patch2);
+		if (fwinfo->sbranch[0] != 0xFF) {
+			fprintf(out, "  \"branch\": ");
+			print_json_string(out, (const char *)fwinfo->sbranch, sizeof(fwinfo->sbranch), false);
+			fprintf(out, ",\n");
+		}
+		if (fwinfo->platform[0] != 0xFF) {
+			fprintf(out, "  \"platform\": ");
+			print_json_string(out, (const char *)fwinfo->platform, sizeof(fwinfo->platform), false);
+			fprintf(out, ",\n");
+		}
+		const uint8_t *crc = fwinfo->adler32;
+		if (crc[0] != 0xFF || crc[1] != 0xFF || crc[2] != 0xFF || crc[3] != 0xFF)
+			fprintf(out, "  \"crc\": \"%02x%02x%02x%02x\",\n", crc[0], crc[1], crc[2], crc[3]);
+	}
+
+	fprintf(out, "  \"public\": [\n");
+	for (uint32_t i = 0; i < table->pubnum; i++)
+		print_key_descr_json(out, &table->keys[i], i + 1 == table->pubnum);
+	fprintf(out, "  ],\n  \"hidden\": [\n");
+	for (uint32_t i = 0; i < table->privnum; i++)
+		print_key_descr_json(out, &table->keys[table->pubnum + i], i + 1 == table->privnum);
+	fprintf(out, "  ]\n}\n");
+}
+
+void smcfw_print_lib_key(FILE *out, const struct PlatformKeyDescriptions *key) {
+	const uint8_t *k = (const uint8_t *)key->key;
+	const uint8_t *t = (const uint8_t *)key->type;
+	fprintf(out, " [%c%c%c%c] type [%c%c%c%c] %02X%02X%02X%02X len [%2u] idx [%3u]: %.256s\n",
+			k[3] == '\0' ? ' ' : k[3], k[2] == '\0' ? ' ' : k[2], k[1] == '\0' ? ' ' : k[1], k[0] == '\0' ? ' ' : k[0],
+			t[3], t[2], t[1], t[0] == '\0' ? '?' : t[0],
+			t[3], t[2], t[1], t[0],
+			key->len, key->index, key->description);
+}
+
+/**
+ *  Mach-O definitions needed to map libSMC.dylib data pointers to file offsets
+ */
+#define MACHO_FAT_MAGIC       0xCAFEBABE
+#define MACHO_MAGIC_64        0xFEEDFACF
+#define MACHO_CPU_X86_64      0x01000007
+#define MACHO_HEADER_64_SIZE  32
+#define MACHO_LC_SYMTAB       0x2
+#define MACHO_LC_SEGMENT_64   0x19
+#define MACHO_NLIST_64_SIZE   16
+
+/**
+ *  Lookup array entry as laid out by 64-bit libSMC.dylib
+ */
+#define LIB_LOOKUP_SIZE       48
+#define LIB_LOOKUP_DESCR      16
+#define LIB_LOOKUP_DESCRN     32
+
+typedef struct {
+	const uint8_t *buf;
+	size_t sz;
+	const uint8_t *cmds;
+	uint32_t ncmds;
+	uint32_t sizeofcmds;
+} MachImage;
+
+static bool macho_open(const uint8_t *buf, size_t sz, MachImage *img) {
+	if (sz >= 8 && read_be32(buf) == MACHO_FAT_MAGIC) {
+		uint32_t narch = read_be32(&buf[4]);
+		for (uint32_t i = 0; i < narch && 8 + (i + 1) * 20 <= sz; i++) {
+			const uint8_t *arch = &buf[8 + i * 20];
+			uint32_t off = read_be32(&arch[8]), asz = read_be32(&arch[12]);
+			if (read_be32(arch) == MACHO_CPU_X86_64 && off <= sz && asz <= sz - off)
+				return macho_open(&buf[off], asz, img);
+		}
+		return false;
+	}
+
+	if (sz < MACHO_HEADER_64_SIZE || read_le32(buf) != MACHO_MAGIC_64 || read_le32(&buf[4]) != MACHO_CPU_X86_64)
+		return false;
+
+	img->buf = buf;
+	img->sz = sz;
+	img->ncmds = read_le32(&buf[16]);
+	img->sizeofcmds = read_le32(&buf[20]);
+	img->cmds = &buf[MACHO_HEADER_64_SIZE];
+	return img->sizeofcmds <= sz - MACHO_HEADER_64_SIZE;
+}
+
+/**
+ *  Walk load commands of the given type, returns the next match after prev or NULL
+ */
+static const uint8_t *macho_next_cmd(const MachImage *img, uint32_t type, const uint8_t *prev) {
+	const uint8_t *cmd = img->cmds;
+	const uint8_t *end = img->cmds + img->sizeofcmds;
+	bool found = prev == NULL;
+	for (uint32_t i = 0; i < img->ncmds && cmd + 8 <= end; i++) {
+		uint32_t cmdsize = read_le32(&cmd[4]);
+		if (cmdsize < 8 || cmdsize > (size_t)(end - cmd))
+			return NULL;
+		if (found && read_le32(cmd) == type)
+			return cmd;
+		if (cmd == prev)
+			found = true;
+		cmd += cmdsize;
+	}
+	return NULL;
+}
+
+static bool macho_vm_to_off(const MachImage *img, uint64_t vmaddr, size_t len, size_t *off) {
+	const uint8_t *seg = NULL;
+	while ((seg = macho_next_cmd(img, MACHO_LC_SEGMENT_64, seg)) != NULL) {
+		if (read_le32(&seg[4]) < 56)
+			continue;
+		uint64_t segvm = read_le64(&seg[24]), fileoff = read_le64(&seg[40]), filesize = read_le64(&seg[48]);
+		if (vmaddr >= segvm && vmaddr - segvm <= filesize && len <= filesize - (vmaddr - segvm)) {
+			uint64_t res = fileoff + (vmaddr - segvm);
+			if (res > img->sz || len > img->sz - res)
+				return false;
+			*off = (size_t)res;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ *  Locate AccumulatorPlatformStructLookupArray, it is not exported, but present in the symbol table
+ */
+static bool lib_find_lookup(const MachImage *img, size_t *off) {
+	static const char symbol[] = "_AccumulatorPlatformStructLookupArray";
+	const uint8_t *symtab = macho_next_cmd(img, MACHO_LC_SYMTAB, NULL);
+	if (symtab && read_le32(&symtab[4]) >= 24) {
+		uint32_t symoff = read_le32(&symtab[8]), nsyms = read_le32(&symtab[12]);
+		uint32_t stroff = read_le32(&symtab[16]), strsize = read_le32(&symtab[20]);
+		if (symoff <= img->sz && nsyms <= (img->sz - symoff) / MACHO_NLIST_64_SIZE && stroff <= img->sz && strsize <= img->sz - stroff) {
+			for (uint32_t i = 0; i < nsyms; i++) {
+				const uint8_t *nl = &img->buf[symoff + i * MACHO_NLIST_64_SIZE];
+				uint32_t strx = read_le32(nl);
+				if (strx < strsize && strsize - strx >= sizeof(symbol) &&
+					!memcmp(&img->buf[stroff + strx], symbol, sizeof(symbol)))
+					return macho_vm_to_off(img, read_le64(&nl[8]), LIB_LOOKUP_SIZE, off);
+			}
+		}
+	}
+
+	// Stripped library, the array starts with m87 branch
+	fprintf(stderr, "Unable to solve AccumulatorPlatformStructLookupArray symbol, trying to brute-force...\n");
+	char first[16] = "m87";
+	for (size_t i = 0; i + LIB_LOOKUP_SIZE <= img->sz; i++) {
+		if (!memcmp(&img->buf[i], first, sizeof(first))) {
+			*off = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int smcfw_parse_lib(const uint8_t *buf, size_t sz, SMCLibKeyCallback cb, void *ctx) {
+	MachImage img;
+	if (!macho_open(buf, sz, &img)) {
+		fprintf(stderr, "Unable to find x86_64 image in libSMC.dylib!\n");
+		return -1;
+	}
+
+	size_t off;
+	if (!lib_find_lookup(&img, &off)) {
+		fprintf(stderr, "Unable to locate lookup array in libSMC.dylib!\n");
+		return -1;
+	}
+
+	int platforms = 0;
+	bool stop = false;
+	for (; off + LIB_LOOKUP_SIZE <= img.sz && !stop; off += LIB_LOOKUP_SIZE) {
+		const uint8_t *lookup = &img.buf[off];
+		if (lookup[0] == '\0' || lookup[0] >= 0x80)
+			break;
+
+		char branch[17] = {};
+		memcpy(branch, lookup, 16);
+
+		for (uint32_t i = 0; i < 2 && !stop; i++) {
+			uint64_t descr = read_le64(&lookup[LIB_LOOKUP_DESCR + i * sizeof(uint64_t)]);
+			uint32_t descrn = read_le32(&lookup[LIB_LOOKUP_DESCRN + i * sizeof(uint32_t)]);
+			size_t keysoff;
+			if (descrn > img.sz / sizeof(struct PlatformKeyDescriptions) ||
+				!macho_vm_to_off(&img, descr, descrn * sizeof(struct PlatformKeyDescriptions), &keysoff)) {
+				fprintf(stderr, "Invalid key descriptions for %s set %u\n", branch, i);
+				return -1;
+			}
+
+			cb(ctx, branch, i, descrn, NULL);
+
+			const struct PlatformKeyDescriptions *keys = (const struct PlatformKeyDescriptions *)&img.buf[keysoff];
+			for (uint32_t j = 0; j < descrn; j++) {
+				if (keys[j].pad1 != 0 || keys[j].pad2 != 0) {
+					stop = true;
+					break;
+				}
+				cb(ctx, branch, i, descrn, &keys[j]);
+			}
+		}
+
+		platforms++;
+	}
+
+	return platforms;
+}
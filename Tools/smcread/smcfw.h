@@ -0,0 +1,290 @@
+//
+//  smcfw.h
+//  smcread
+//
+//  Copyright © 2017 vit9696. All rights reserved.
+//
+
+#ifndef smcfw_h
+#define smcfw_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ *  Portable SMC firmware and key table parsing shared by smcread and smcfwtool.
+ *  Nothing here depends on IOKit or the running system, all inputs are files.
+ */
+
+typedef struct __attribute__((packed)) {
+	char key[4];
+	uint8_t attr;
+	uint8_t len;
+	uint16_t zero;
+	/* Among various types there are 'ui8 ' and 'ui8\0', hopefully they are same */
+	char type[4];
+	uint32_t handler;
+} KeyDescr;
+
+typedef union __attribute__((packed)) {
+	uint8_t raw[6];
+	struct __attribute__((packed)) {
+		uint8_t major;
+		uint8_t minor;
+		uint8_t module;
+		uint8_t unk;
+		uint8_t patch1;
+		uint8_t patch2;
+	} p;
+} FirmwareRevision;
+
+// Thanks to FredWst for this struct
+typedef struct __attribute__((packed)) {
+	FirmwareRevision rev;
+	uint8_t sbranch[8];
+	uint8_t platform[8];
+	uint16_t unk1;
+	uint8_t adler32[4];
+	uint32_t unk2;
+} FirmwareInfo;
+
+typedef struct {
+	uint32_t pubnum;
+	uint32_t privnum;
+} KeyInfo;
+
+// Thanks for this to ionescu (https://www.youtube.com/watch?v=nSqpinjjgmg)
+enum KeyAttribute {
+	// Private variables cannot be written?
+	ATTR_PRIVATE_WRITE  = 0x1,
+	ATTR_PRIVATE_READ   = 0x2,
+	ATTR_ATOMIC         = 0x4,
+	ATTR_CONST          = 0x8,
+	ATTR_FUNCTION       = 0x10,
+	ATTR_UNK20          = 0x20,
+	ATTR_WRITE          = 0x40,
+	ATTR_READ           = 0x80,
+};
+
+/**
+ *  libSMC.dylib key description, types and keys are stored reversed
+ */
+struct PlatformKeyDescriptions {
+	char key[4];
+	uint8_t index;
+	char description[256];
+	uint8_t len;
+	uint16_t pad1;
+	char type[4];
+	uint32_t pad2; /* added in 10.13.4 */
+} __attribute__((packed));
+
+/**
+ *  Incremental SMC update (.smc) decoder state
+ */
+typedef struct {
+	uint8_t *bin;
+	size_t cursz;
+	// Current address
+	size_t addr;
+	// By last written address
+	size_t wrsz;
+	// Bytes left in the current data record
+	size_t numb;
+	// Decoded high nibble or -1
+	int nibble;
+	int state;
+	size_t value;
+	// First line, contains update version
+	char header[64];
+	size_t headerlen;
+	bool headerdone;
+	bool failed;
+} SMCUpdateDecoder;
+
+/**
+ *  Located firmware key table
+ */
+typedef struct {
+	// Public and hidden key descriptors follow each other
+	const KeyDescr *keys;
+	uint32_t pubnum;
+	uint32_t privnum;
+	// Table found by brute-force, no #KEY
+	bool flasher;
+	// Firmware info at the end of the image or NULL
+	const FirmwareInfo *fwinfo;
+} SMCKeyTable;
+
+/**
+ *  Check whether the buffer starts an SMC update file
+ *
+ *  @param buf  file contents
+ *  @param sz   contents size
+ *
+ *  @return true for text updates
+ */
+bool smcfw_is_update(const uint8_t *buf, size_t sz);
+
+/**
+ *  Start decoding an update
+ *
+ *  @param dec  decoder state
+ */
+void smcfw_update_init(SMCUpdateDecoder *dec);
+
+/**
+ *  Decode next update chunk, chunks may split lines anywhere
+ *
+ *  @param dec  decoder state
+ *  @param buf  update text
+ *  @param sz   text size
+ *
+ *  @return false on malformed input or allocation failure
+ */
+bool smcfw_update_feed(SMCUpdateDecoder *dec, const char *buf, size_t sz);
+
+/**
+ *  Finish decoding, recovers missing firmware revision from the update header
+ *
+ *  @param dec         decoder state, released on return
+ *  @param sz          binary size
+ *  @param revrecover  revision recovery note, empty when there is no version header
+ *
+ *  @return binary image (must be freed) or NULL
+ */
+uint8_t *smcfw_update_finish(SMCUpdateDecoder *dec, size_t *sz, char revrecover[64]);
+
+/**
+ *  Decode an update from a stream in a single pass
+ *
+ *  @param fh          update stream
+ *  @param sz          binary size
+ *  @param revrecover  revision recovery note
+ *
+ *  @return binary image (must be freed) or NULL
+ */
+uint8_t *smcfw_convert_update(FILE *fh, size_t *sz, char revrecover[64]);
+
+/**
+ *  Encode a binary image as an update, skipping unprogrammed (0xFF) blocks
+ *
+ *  @param bin      binary image
+ *  @param sz       image size
+ *  @param version  update version or NULL
+ *  @param outsz    update size
+ *
+ *  @return update text (must be freed) or NULL
+ */
+char *smcfw_encode_update(const uint8_t *bin, size_t sz, const char *version, size_t *outsz);
+
+/**
+ *  Read the whole file
+ *
+ *  @param path  file path
+ *  @param sz    file size
+ *
+ *  @return file contents (must be freed), zero terminated, or NULL
+ */
+uint8_t *smcfw_read_file(const char *path, size_t *sz);
+
+/**
+ *  Load a firmware image, updates are decoded
+ *
+ *  @param path        binary or update path
+ *  @param sz          binary size
+ *  @param revrecover  revision recovery note
+ *
+ *  @return binary image (must be freed) or NULL
+ */
+uint8_t *smcfw_load_image(const char *path, size_t *sz, char revrecover[64]);
+
+/**
+ *  Locate key table in a firmware image
+ *
+ *  @param buf    binary image
+ *  @param sz     image size
+ *  @param table  located table
+ *
+ *  @return true on success
+ */
+bool smcfw_find_key_table(const uint8_t *buf, size_t sz, SMCKeyTable *table);
+
+/**
+ *  Obtain attribute names
+ *
+ *  @param attr  key attributes
+ *  @param buf   name buffer
+ *  @param size  buffer size
+ *
+ *  @return buf with names separated by |
+ */
+const char *smcfw_attr_names(uint8_t attr, char *buf, size_t size);
+
+/**
+ *  Print key table and the key values reconstructed from firmware info
+ *
+ *  @param out         output stream
+ *  @param table       located table
+ *  @param revrecover  revision recovery note
+ */
+void smcfw_print_table(FILE *out, const SMCKeyTable *table, const char *revrecover);
+
+/**
+ *  Print key table as JSON
+ *
+ *  @param out    output stream
+ *  @param name   image name
+ *  @param table  located table
+ */
+void smcfw_print_table_json(FILE *out, const char *name, const SMCKeyTable *table);
+
+/**
+ *  Print libSMC.dylib key description
+ *
+ *  @param out  output stream
+ *  @param key  key description
+ */
+void smcfw_print_lib_key(FILE *out, const struct PlatformKeyDescriptions *key);
+
+/**
+ *  libSMC.dylib key description callback
+ *
+ *  @param ctx     user context
+ *  @param branch  platform branch, e.g. j16
+ *  @param set     key set (0 or 1)
+ *  @param count   keys in the set, key is NULL for the set start
+ *  @param key     key description or NULL
+ */
+typedef void (*SMCLibKeyCallback)(void *ctx, const char *branch, uint32_t set, uint32_t count,
+								  const struct PlatformKeyDescriptions *key);
+
+/**
+ *  Walk key descriptions of a 64-bit Intel libSMC.dylib (thin or fat) file image
+ *
+ *  @param buf  file contents
+ *  @param sz   file size
+ *  @param cb   description callback
+ *  @param ctx  callback context
+ *
+ *  @return number of platforms or -1
+ */
+int smcfw_parse_lib(const uint8_t *buf, size_t sz, SMCLibKeyCallback cb, void *ctx);
+
+/**
+ *  Print a JSON string with 4 characters at most
+ *
+ *  @param out      output stream
+ *  @param str      characters
+ *  @param reverse  characters are stored reversed
+ */
+void smcfw_print_json_chars(FILE *out, const char *str, bool reverse);
+
+/**
+ *  Valid key and type characters
+ */
+extern const bool smcfw_key_char_valid[256];
+
+#endif /* smcfw_h */
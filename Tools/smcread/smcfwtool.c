@@ -0,0 +1,378 @@
+//
+//  smcfwtool.c
+//  smcread
+//
+//  Copyright © 2017 vit9696. All rights reserved.
+//
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "smcfw.h"
+
+static double now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+static int write_file(const char *path, const void *buf, size_t sz) {
+	FILE *fh = fopen(path, "wb");
+	if (!fh) {
+		fprintf(stderr, "Unable to open %s for writing\n", path);
+		return -1;
+	}
+
+	int ret = 0;
+	if (sz > 0 && fwrite(buf, sz, 1, fh) != 1) {
+		fprintf(stderr, "Unable to write %s\n", path);
+		ret = -1;
+	}
+
+	fclose(fh);
+	return ret;
+}
+
+/**
+ *  Update version from firmware info, e.g. 2.16f68
+ */
+static const char *image_version(const SMCKeyTable *table, char version[32]) {
+	if (!table->fwinfo || table->fwinfo->rev.raw[0] == 0xFF)
+		return NULL;
+	const FirmwareRevision *rev = &table->fwinfo->rev;
+	snprintf(version, 32, "%x.%02x%x%x", rev->p.major, rev->p.minor, rev->p.module,
+			 rev->p.patch1 > 0 ? rev->p.patch1 : rev->p.patch2);
+	return version;
+}
+
+static int dump_image(const char *path, const char *binpath, const char *updpath, bool json) {
+	size_t sz = 0;
+	char revrecover[64];
+	uint8_t *buf = smcfw_load_image(path, &sz, revrecover);
+	if (!buf)
+		return -1;
+
+	if (binpath && write_file(binpath, buf, sz)) {
+		free(buf);
+		return -1;
+	}
+
+	SMCKeyTable table;
+	if (!smcfw_find_key_table(buf, sz, &table)) {
+		fprintf(stderr, "Unable to locate smc key table in %s\n", path);
+		free(buf);
+		return -1;
+	}
+
+	if (updpath) {
+		char version[32];
+		size_t updsz = 0;
+		char *upd = smcfw_encode_update(buf, sz, image_version(&table, version), &updsz);
+		int ret = upd ? write_file(updpath, upd, updsz) : -1;
+		free(upd);
+		if (ret) {
+			free(buf);
+			return -1;
+		}
+	}
+
+	if (json)
+		smcfw_print_table_json(stdout, path, &table);
+	else
+		smcfw_print_table(stdout, &table, revrecover);
+
+	free(buf);
+	return 0;
+}
+
+typedef struct {
+	bool json;
+	bool first;
+} LibDumpContext;
+
+static void lib_key(void *ctx, const char *branch, uint32_t set, uint32_t count, const struct PlatformKeyDescriptions *key) {
+	LibDumpContext *dump = ctx;
+	if (!dump->json) {
+		if (!key) {
+			if (set == 0)
+				printf("Dumping keys for %.4s...\n", branch);
+			printf(" Set %u has %u keys:\n", set, count);
+		} else {
+			smcfw_print_lib_key(stdout, key);
+		}
+		return;
+	}
+
+	if (!key)
+		return;
+
+	printf("%s  {\"branch\": \"%s\", \"set\": %u, \"key\": ", dump->first ? "" : ",\n", branch, set);
+	smcfw_print_json_chars(stdout, key->key, true);
+	printf(", \"type\": ");
+	smcfw_print_json_chars(stdout, key->type, true);
+	printf(", \"size\": %u, \"index\": %u, \"description\": \"", key->len, key->index);
+	for (size_t i = 0; i < sizeof(key->description) && key->description[i] != '\0'; i++) {
+		unsigned char c = (unsigned char)key->description[i];
+		if (c == '"' || c == '\\')
+			printf("\\%c", c);
+		else if (c < 0x20 || c >= 0x7F)
+			printf("\\u%04x", c);
+		else
+			putchar(c);
+	}
+	printf("\"}");
+	dump->first = false;
+}
+
+static int dump_lib(const char *path, bool json) {
+	size_t sz = 0;
+	uint8_t *buf = smcfw_read_file(path, &sz);
+	if (!buf)
+		return -1;
+
+	LibDumpContext ctx = {json, true};
+	if (json)
+		printf("[\n");
+	int platforms = smcfw_parse_lib(buf, sz, lib_key, &ctx);
+	if (json)
+		printf("%s]\n", ctx.first ? "" : "\n");
+
+	free(buf);
+	return platforms > 0 ? 0 : -1;
+}
+
+typedef struct {
+	uint32_t images;
+	uint32_t keys;
+	size_t binsz;
+	size_t updsz;
+	double table;
+	double decode;
+} BenchTotals;
+
+/**
+ *  Measure key table lookup and update decoding of one database image.
+ *  The update is produced by encoding the image and must decode back to it.
+ */
+static int bench_image(const char *path, const char *name, uint32_t count, BenchTotals *totals) {
+	size_t sz = 0;
+	uint8_t *buf = smcfw_read_file(path, &sz);
+	if (!buf)
+		return -1;
+
+	SMCKeyTable table;
+	double start = now_us();
+	bool found = false;
+	for (uint32_t i = 0; i < count; i++)
+		found = smcfw_find_key_table(buf, sz, &table);
+	double tabletime = (now_us() - start) / count;
+	if (!found) {
+		fprintf(stderr, "Unable to locate smc key table in %s\n", path);
+		free(buf);
+		return -1;
+	}
+
+	char version[32];
+	size_t updsz = 0;
+	char *upd = smcfw_encode_update(buf, sz, image_version(&table, version), &updsz);
+	if (!upd) {
+		free(buf);
+		return -1;
+	}
+
+	int ret = 0;
+	start = now_us();
+	for (uint32_t i = 0; i < count && ret == 0; i++) {
+		SMCUpdateDecoder dec;
+		smcfw_update_init(&dec);
+		// Feed in read sized chunks like smcfw_convert_update does
+		for (size_t off = 0; off < updsz; off += 0x10000)
+			smcfw_update_feed(&dec, &upd[off], updsz - off < 0x10000 ? updsz - off : 0x10000);
+		char revrecover[64];
+		size_t binsz = 0;
+		uint8_t *bin = smcfw_update_finish(&dec, &binsz, revrecover);
+		if (!bin || binsz != sz || memcmp(bin, buf, sz)) {
+			fprintf(stderr, "Decoded update of %s does not match the image\n", path);
+			ret = -1;
+		}
+		free(bin);
+	}
+	double decodetime = (now_us() - start) / count;
+
+	if (ret == 0) {
+		uint32_t keys = table.pubnum + table.privnum;
+		printf("%-44s %8zu %9zu %5u %10.1f %10.1f %8.1f\n", name, sz, updsz, keys,
+			   tabletime, decodetime, decodetime > 0 ? updsz / decodetime : 0);
+		totals->images++;
+		totals->keys += keys;
+		totals->binsz += sz;
+		totals->updsz += updsz;
+		totals->table += tabletime;
+		totals->decode += decodetime;
+	}
+
+	free(upd);
+	free(buf);
+	return ret;
+}
+
+static int compare_names(const void *a, const void *b) {
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ *  List directory entries in stable order, returns NULL when not a directory
+ */
+static char **list_dir(const char *path, size_t *num) {
+	DIR *dir = opendir(path);
+	if (!dir)
+		return NULL;
+
+	size_t cap = 64;
+	char **names = malloc(cap * sizeof(char *));
+	*num = 0;
+	struct dirent *ent;
+	while (names && (ent = readdir(dir)) != NULL) {
+		if (ent->d_name[0] == '.')
+			continue;
+		if (*num == cap) {
+			char **newnames = realloc(names, (cap *= 2) * sizeof(char *));
+			if (!newnames) {
+				for (size_t i = 0; i < *num; i++)
+					free(names[i]);
+				free(names);
+				names = NULL;
+				break;
+			}
+			names = newnames;
+		}
+		names[(*num)++] = strdup(ent->d_name);
+	}
+
+	closedir(dir);
+	if (names)
+		qsort(names, *num, sizeof(char *), compare_names);
+	return names;
+}
+
+static void free_names(char **names, size_t num) {
+	for (size_t i = 0; i < num; i++)
+		free(names[i]);
+	free(names);
+}
+
+static int bench_database(const char *path, uint32_t count) {
+	size_t nboards = 0;
+	char **boards = list_dir(path, &nboards);
+	if (!boards) {
+		fprintf(stderr, "Unable to list %s\n", path);
+		return -1;
+	}
+
+	printf("%-44s %8s %9s %5s %10s %10s %8s\n", "image", "bin", "update", "keys", "table us", "decode us", "MB/s");
+
+	BenchTotals totals = {};
+	uint32_t boardnum = 0, failed = 0;
+	for (size_t i = 0; i < nboards; i++) {
+		char board[1024];
+		snprintf(board, sizeof(board), "%s/%s", path, boards[i]);
+		size_t nfiles = 0;
+		char **files = list_dir(board, &nfiles);
+		if (!files)
+			continue;
+
+		bool any = false;
+		for (size_t j = 0; j < nfiles; j++) {
+			size_t len = strlen(files[j]);
+			if (len < 4 || strcmp(&files[j][len - 4], ".bin"))
+				continue;
+			char file[2048], name[1024];
+			snprintf(file, sizeof(file), "%s/%s", board, files[j]);
+			snprintf(name, sizeof(name), "%s/%s", boards[i], files[j]);
+			if (bench_image(file, name, count, &totals))
+				failed++;
+			any = true;
+		}
+
+		if (any)
+			boardnum++;
+		free_names(files, nfiles);
+	}
+
+	free_names(boards, nboards);
+
+	printf("%u boards, %u images, %u keys, %zu bytes binary, %zu bytes update\n",
+		   boardnum, totals.images, totals.keys, totals.binsz, totals.updsz);
+	printf("table lookup %.1f us, update decoding %.1f us (%.1f MB/s) per database pass\n",
+		   totals.table, totals.decode, totals.decode > 0 ? totals.updsz / totals.decode : 0);
+	if (failed)
+		printf("%u images failed\n", failed);
+
+	return failed ? -1 : 0;
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr,
+	"smcfwtool 1.0\n\n"
+	"Usage:\n"
+	"%s [-j] [-o smc.bin] [-e update.smc] smc.bin|update.smc\n"
+	"%s -l [-j] libSMC.dylib\n"
+	"%s -b [-n count] SMCDatabase\n\n"
+	"    -j          print JSON\n"
+	"    -o <file>   save decoded binary\n"
+	"    -e <file>   save binary encoded as an update\n"
+	"    -l          dump libSMC.dylib key descriptions\n"
+	"    -b          benchmark key table lookup and update decoding of all database images\n"
+	"    -n <count>  benchmark iterations (default: 100)\n",
+	prog, prog, prog);
+}
+
+int main(int argc, char *argv[]) {
+	bool json = false, lib = false, bench = false;
+	const char *binpath = NULL, *updpath = NULL;
+	uint32_t count = 100;
+
+	int c;
+	while ((c = getopt(argc, argv, "jo:e:lbn:h")) != -1) {
+		switch (c) {
+			case 'j':
+				json = true;
+				break;
+			case 'o':
+				binpath = optarg;
+				break;
+			case 'e':
+				updpath = optarg;
+				break;
+			case 'l':
+				lib = true;
+				break;
+			case 'b':
+				bench = true;
+				break;
+			case 'n':
+				count = (uint32_t)strtoul(optarg, NULL, 0);
+				break;
+			default:
+				usage(argv[0]);
+				return -1;
+		}
+	}
+
+	if (optind + 1 != argc) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	if (bench)
+		return bench_database(argv[optind], count ? count : 1);
+
+	if (lib)
+		return dump_lib(argv[optind], json);
+
+	return dump_image(argv[optind], binpath, updpath, json);
+}
@@ -0,0 +1,14 @@
+//
+//  kern_api.hpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_api_hpp
+#define kern_api_hpp
+
+#include <Headers/kern_util.hpp>
+#include <Headers/kern_patcher.hpp>
+
+#endif /* kern_api_hpp */
@@ -0,0 +1,13 @@
+//
+//  kern_crypto.hpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_crypto_hpp
+#define kern_crypto_hpp
+
+#include <Headers/kern_util.hpp>
+
+#endif /* kern_crypto_hpp */
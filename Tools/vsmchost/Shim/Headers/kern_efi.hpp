@@ -0,0 +1,39 @@
+//
+//  kern_efi.hpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_efi_hpp
+#define kern_efi_hpp
+
+#include <Headers/kern_util.hpp>
+
+struct EFI_GUID {
+	uint32_t Data1;
+	uint16_t Data2;
+	uint16_t Data3;
+	uint8_t Data4[8];
+};
+
+enum EfiResetType {
+	EfiResetCold,
+	EfiResetWarm,
+	EfiResetShutdown
+};
+
+/**
+ *  There are no runtime services on the host, get always fails
+ */
+class EfiRuntimeServices {
+public:
+	static EFI_GUID LiluVendorGuid;
+	static EFI_GUID LiluReadOnlyGuid;
+	static EFI_GUID LiluWriteOnlyGuid;
+	static EfiRuntimeServices *get(bool lock = false) { return nullptr; }
+	void put() {}
+	void resetSystem(EfiResetType type) {}
+};
+
+#endif /* kern_efi_hpp */
@@ -0,0 +1,46 @@
+//
+//  kern_iokit.hpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_iokit_hpp
+#define kern_iokit_hpp
+
+#include <Headers/kern_util.hpp>
+
+namespace WIOKit {
+	struct ComputerModel {
+		enum {
+			ComputerInvalid = 0x0,
+			ComputerLaptop  = 0x1,
+			ComputerDesktop = 0x2,
+			ComputerAny     = ComputerLaptop | ComputerDesktop
+		};
+	};
+
+	/**
+	 *  Model selected by vsmchost -laptop option
+	 */
+	int getComputerModel();
+
+	bool getComputerInfo(char *modelBuf, size_t modelBufSize, char *boardIdBuf, size_t boardIdBufSize);
+
+	template <typename T>
+	inline bool getOSDataValue(const OSObject *obj, const char *name, T &value) {
+		auto data = OSDynamicCast(OSData, obj);
+		if (data && data->getLength() == sizeof(T)) {
+			value = *static_cast<const T *>(data->getBytesNoCopy());
+			return true;
+		}
+		return false;
+	}
+
+	template <typename T>
+	inline bool getOSDataValue(const OSDictionary *dict, const char *name, T &value) {
+		return getOSDataValue(dict->getObject(name), name, value);
+	}
+}
+
+#endif /* kern_iokit_hpp */
@@ -0,0 +1,22 @@
+//
+//  kern_mach.hpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_mach_hpp
+#define kern_mach_hpp
+
+#include <Headers/kern_patcher.hpp>
+
+namespace MachInfo {
+	/**
+	 *  Emulated device memory is plain writable memory on the host
+	 */
+	inline kern_return_t setKernelWriting(bool enable, IOSimpleLock *lock) {
+		return KERN_SUCCESS;
+	}
+}
+
+#endif /* kern_mach_hpp */
@@ -0,0 +1,29 @@
+//
+//  kern_nvram.hpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_nvram_hpp
+#define kern_nvram_hpp
+
+#include <Headers/kern_util.hpp>
+
+#define NVRAM_GLOBAL_GUID "8BE4DF61-93CA-11D2-AA0D-00E098032B8C"
+#define NVRAM_APPLE_VENDOR_GUID "4D1EDE05-38C7-4A6A-9CC6-4BCCA8B38C14"
+#define LILU_VENDOR_GUID "C29E1E2F-8D24-4C8A-9F54-7AD5A3C9E8A5"
+#define LILU_READ_ONLY_GUID "E09B9297-7928-4440-9AAB-D1F8536FBF0A"
+#define LILU_WRITE_ONLY_GUID "F0B9AF8F-2222-4840-8A37-ECF7CC8C12E1"
+#define NVRAM_PREFIX(x, y) x ":" y
+
+/**
+ *  NVRAM is not available on the host
+ */
+class NVStorage {
+public:
+	bool init() { return false; }
+	void deinit() {}
+};
+
+#endif /* kern_nvram_hpp */
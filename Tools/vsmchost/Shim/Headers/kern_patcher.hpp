@@ -0,0 +1,18 @@
+//
+//  kern_patcher.hpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_patcher_hpp
+#define kern_patcher_hpp
+
+#include <Headers/kern_util.hpp>
+
+class KernelPatcher {
+public:
+	static IOSimpleLock *kernelWriteLock;
+};
+
+#endif /* kern_patcher_hpp */
@@ -0,0 +1,13 @@
+//
+//  kern_rtc.hpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_rtc_hpp
+#define kern_rtc_hpp
+
+#include <Headers/kern_util.hpp>
+
+#endif /* kern_rtc_hpp */
@@ -0,0 +1,39 @@
+//
+//  kern_time.hpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_time_hpp
+#define kern_time_hpp
+
+#include <Headers/kern_util.hpp>
+
+static constexpr uint64_t MSEC_PER_SEC {1000};
+static constexpr uint64_t NSEC_PER_MSEC {1000000};
+static constexpr uint64_t NSEC_PER_SEC {1000000000};
+
+inline uint64_t getCurrentTimeNs() {
+	uint64_t currt = 0;
+	absolutetime_to_nanoseconds(mach_absolute_time(), &currt);
+	return currt;
+}
+
+inline uint64_t getTimeSinceNs(uint64_t start) {
+	uint64_t currt = getCurrentTimeNs();
+	return currt > start ? currt - start : 0;
+}
+
+inline uint64_t getTimeLeftNs(uint64_t start, uint64_t timeout, uint64_t currt = getCurrentTimeNs()) {
+	return start + timeout > currt ? start + timeout - currt : 0;
+}
+
+constexpr uint64_t convertScToMs(uint64_t sc) { return sc * MSEC_PER_SEC; }
+constexpr uint64_t convertScToNs(uint64_t sc) { return sc * NSEC_PER_SEC; }
+constexpr uint64_t convertMsToSc(uint64_t ms) { return ms / MSEC_PER_SEC; }
+constexpr uint64_t convertMsToNs(uint64_t ms) { return ms * NSEC_PER_MSEC; }
+constexpr uint64_t convertNsToSc(uint64_t ns) { return ns / NSEC_PER_SEC; }
+constexpr uint64_t convertNsToMs(uint64_t ns) { return ns / NSEC_PER_MSEC; }
+
+#endif /* kern_time_hpp */
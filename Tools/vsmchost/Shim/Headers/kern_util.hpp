@@ -0,0 +1,206 @@
+//
+//  kern_util.hpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_util_hpp
+#define kern_util_hpp
+
+// Userspace replacement of Lilu utilities used by the VirtualSMC core.
+
+#include <xnu_host.hpp>
+#include <stdio.h>
+
+#define EXPORT __attribute__((visibility("default")))
+#define PACKED __attribute__((packed))
+#define UNUSED __attribute__((unused))
+
+#define ADDPR(a) vsmchost_##a
+
+/**
+ *  Debug logging is enabled by -vsmcdbg boot argument
+ */
+extern bool ADDPR(debugEnabled);
+extern bool ADDPR(startSuccess);
+
+#define SYSLOG(module, str, ...) fprintf(stderr, "VirtualSMC: %s " str "\n", module, ## __VA_ARGS__)
+#define SYSLOG_COND(cond, module, str, ...) do { if (cond) SYSLOG(module, str, ## __VA_ARGS__); } while (0)
+#define PANIC(module, str, ...) do { SYSLOG(module, "(PANIC) " str, ## __VA_ARGS__); abort(); } while (0)
+#define PANIC_COND(cond, module, str, ...) do { if (cond) PANIC(module, str, ## __VA_ARGS__); } while (0)
+
+#ifdef DEBUG
+#define DBGLOG(module, str, ...) do { if (ADDPR(debugEnabled)) SYSLOG(module, str, ## __VA_ARGS__); } while (0)
+#define DBGLOG_COND(cond, module, str, ...) do { if ((cond) && ADDPR(debugEnabled)) SYSLOG(module, str, ## __VA_ARGS__); } while (0)
+#define DBGTRACE(module, str, ...) DBGLOG(module, str, ## __VA_ARGS__)
+#else
+#define DBGLOG(module, str, ...) do { } while (0)
+#define DBGLOG_COND(cond, module, str, ...) do { } while (0)
+#define DBGTRACE(module, str, ...) do { } while (0)
+#endif
+
+#define lilu_os_memcpy memcpy
+#define lilu_os_memmove memmove
+#define lilu_os_strncpy strncpy
+#define lilu_os_strlcpy vsmchostStrlcpy
+
+inline size_t vsmchostStrlcpy(char *dst, const char *src, size_t size) {
+	size_t len = strlen(src);
+	if (size > 0) {
+		size_t n = len < size - 1 ? len : size - 1;
+		memcpy(dst, src, n);
+		dst[n] = '\0';
+	}
+	return len;
+}
+
+#ifndef __APPLE__
+#define strlcpy vsmchostStrlcpy
+#endif
+
+template <typename T, size_t N>
+constexpr size_t arrsize(const T (&array)[N]) {
+	return N;
+}
+
+template <typename T>
+constexpr T getBit(T n) {
+	return static_cast<T>(1U) << n;
+}
+
+template <typename T, typename Y>
+inline bool findNotEquals(const T *data, size_t size, Y value) {
+	for (size_t i = 0; i < size; i++)
+		if (data[i] != value)
+			return true;
+	return false;
+}
+
+inline const char *safeString(const char *str) {
+	return str ? str : "(null)";
+}
+
+inline bool checkKernelArgument(const char *name) {
+	int val[16];
+	return PE_parse_boot_argn(name, val, sizeof(val));
+}
+
+/**
+ *  Host is treated as the latest supported kernel
+ */
+enum KernelVersion {
+	Unsupported = 0,
+	MountainLion = 12,
+	Mavericks = 13,
+	Yosemite = 14,
+	ElCapitan = 15,
+	Sierra = 16,
+	HighSierra = 17,
+	Mojave = 18
+};
+
+inline KernelVersion getKernelVersion() {
+	return KernelVersion::Mojave;
+}
+
+namespace Buffer {
+	template <typename T>
+	inline T *create(size_t size) {
+		return static_cast<T *>(malloc(sizeof(T) * size));
+	}
+
+	template <typename T>
+	inline bool resize(T *&buf, size_t size) {
+		auto nbuf = static_cast<T *>(realloc(buf, sizeof(T) * size));
+		if (nbuf) {
+			buf = nbuf;
+			return true;
+		}
+		return false;
+	}
+
+	template <typename T>
+	inline void deleter(T *buf) {
+		free(buf);
+	}
+}
+
+template <typename T>
+inline void emptyDeleter(T) {}
+
+/**
+ *  Embedded vector-like container, elements are moved with memory copies
+ */
+template <typename T, void (*deleter)(T)=emptyDeleter<T>>
+class evector {
+	T *ptr {nullptr};
+	size_t cnt {0};
+	size_t rsvd {0};
+
+public:
+	size_t size() const {
+		return cnt;
+	}
+
+	const T *data() const {
+		return ptr;
+	}
+
+	T *last() {
+		return cnt ? &ptr[cnt - 1] : nullptr;
+	}
+
+	T &operator [](size_t index) {
+		return ptr[index];
+	}
+
+	const T &operator [](size_t index) const {
+		return ptr[index];
+	}
+
+	template <size_t MUL = 1>
+	bool reserve(size_t num) {
+		if (rsvd < num) {
+			T *nPtr = static_cast<T *>(realloc(static_cast<void *>(ptr), MUL * num * sizeof(T)));
+			if (!nPtr)
+				return false;
+			ptr = nPtr;
+			rsvd = MUL * num;
+		}
+		return true;
+	}
+
+	template <size_t MUL = 1>
+	bool push_back(const T &element) {
+		if (!reserve<MUL>(cnt + 1))
+			return false;
+		memcpy(static_cast<void *>(&ptr[cnt]), static_cast<const void *>(&element), sizeof(T));
+		cnt++;
+		return true;
+	}
+
+	bool erase(size_t index, bool free = true) {
+		deleter(ptr[index]);
+		if (--cnt != index)
+			memmove(static_cast<void *>(&ptr[index]), static_cast<void *>(&ptr[index + 1]), (cnt - index) * sizeof(T));
+		if (free && cnt == 0) {
+			::free(static_cast<void *>(ptr));
+			ptr = nullptr;
+			rsvd = 0;
+		}
+		return true;
+	}
+
+	void deinit() {
+		if (ptr) {
+			for (size_t i = 0; i < cnt; i++)
+				deleter(ptr[i]);
+			::free(static_cast<void *>(ptr));
+			ptr = nullptr;
+			cnt = rsvd = 0;
+		}
+	}
+};
+
+#endif /* kern_util_hpp */
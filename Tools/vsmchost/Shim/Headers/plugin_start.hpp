@@ -0,0 +1,2 @@
+// Forwarded to the vsmchost userspace shim
+#include <Headers/kern_util.hpp>
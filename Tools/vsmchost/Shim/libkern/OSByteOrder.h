@@ -0,0 +1,2 @@
+// Forwarded to the vsmchost userspace shim
+#include <xnu_host.hpp>
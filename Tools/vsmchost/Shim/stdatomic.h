@@ -0,0 +1,52 @@
+//
+//  stdatomic.h
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef vsmchost_stdatomic_h
+#define vsmchost_stdatomic_h
+
+// C11 atomics are not portable to C++ compilers other than clang, so map them
+// onto std::atomic. Keystore entries are copied and sorted by value, hence the
+// copyable wrapper.
+
+#include <atomic>
+
+template <typename T>
+struct vsmchost_atomic : std::atomic<T> {
+	vsmchost_atomic() noexcept : std::atomic<T>(T()) {}
+	vsmchost_atomic(T value) noexcept : std::atomic<T>(value) {}
+	vsmchost_atomic(const vsmchost_atomic &other) noexcept : std::atomic<T>(other.load(std::memory_order_relaxed)) {}
+	vsmchost_atomic &operator =(const vsmchost_atomic &other) noexcept {
+		this->store(other.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		return *this;
+	}
+	using std::atomic<T>::operator T;
+	T operator ->() const noexcept {
+		return this->load(std::memory_order_relaxed);
+	}
+};
+
+#define _Atomic(T) vsmchost_atomic<T>
+
+using std::memory_order;
+using std::memory_order_relaxed;
+using std::memory_order_consume;
+using std::memory_order_acquire;
+using std::memory_order_release;
+using std::memory_order_acq_rel;
+using std::memory_order_seq_cst;
+
+#define atomic_init(p, v) (p)->store((v), std::memory_order_relaxed)
+#define atomic_store_explicit(p, v, o) (p)->store((v), (o))
+#define atomic_load_explicit(p, o) (p)->load(o)
+#define atomic_compare_exchange_strong_explicit(p, e, v, s, f) (p)->compare_exchange_strong(*(e), (v), (s), (f))
+#define atomic_exchange_explicit(p, v, o) (p)->exchange((v), (o))
+#define atomic_fetch_add_explicit(p, v, o) (p)->fetch_add((v), (o))
+#define atomic_fetch_sub_explicit(p, v, o) (p)->fetch_sub((v), (o))
+#define atomic_fetch_or_explicit(p, v, o) (p)->fetch_or((v), (o))
+#define atomic_thread_fence(o) std::atomic_thread_fence(o)
+
+#endif /* vsmchost_stdatomic_h */
@@ -0,0 +1,531 @@
+//
+//  xnu_host.hpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef xnu_host_hpp
+#define xnu_host_hpp
+
+// Userspace stand-ins for the subset of xnu, libkern and IOKit used by the
+// VirtualSMC core. Only the behaviour the keystore and protocol code rely on
+// is implemented, everything else is a no-op.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <condition_variable>
+#include <mutex>
+
+/**
+ *  Basic kernel types
+ */
+using UInt8 = uint8_t;
+using UInt16 = uint16_t;
+using UInt32 = uint32_t;
+using UInt64 = uint64_t;
+using SInt32 = int32_t;
+using IOReturn = int;
+using IOOptionBits = uint32_t;
+using IOPhysicalAddress = uint64_t;
+using IOByteCount = uint64_t;
+using kern_return_t = int;
+using mach_vm_address_t = uint64_t;
+using mach_vm_size_t = uint64_t;
+using vm_address_t = uintptr_t;
+using vm_prot_t = int;
+
+static constexpr kern_return_t KERN_SUCCESS {0};
+static constexpr kern_return_t KERN_FAILURE {5};
+
+static constexpr vm_prot_t VM_PROT_NONE {0};
+static constexpr vm_prot_t VM_PROT_READ {1};
+static constexpr vm_prot_t VM_PROT_WRITE {2};
+
+#ifndef PAGE_SIZE
+#define PAGE_SIZE 4096
+#endif
+
+static constexpr IOReturn kIOReturnSuccess {0};
+static constexpr IOReturn kIOReturnError {static_cast<IOReturn>(0xe00002bc)};
+static constexpr IOReturn kIOReturnNoMemory {static_cast<IOReturn>(0xe00002bd)};
+static constexpr IOReturn kIOReturnBadArgument {static_cast<IOReturn>(0xe00002c2)};
+static constexpr IOReturn kIOReturnExclusiveAccess {static_cast<IOReturn>(0xe00002c5)};
+static constexpr IOReturn kIOReturnUnsupported {static_cast<IOReturn>(0xe00002c7)};
+static constexpr IOReturn kIOReturnInvalid {static_cast<IOReturn>(0xe00002d1)};
+static constexpr IOReturn kIOReturnNoResources {static_cast<IOReturn>(0xe00002be)};
+static constexpr IOReturn kIOReturnNotPermitted {static_cast<IOReturn>(0xe00002e2)};
+static constexpr IOReturn kIOReturnNoInterrupt {static_cast<IOReturn>(0xe00002e9)};
+static constexpr IOReturn kIOReturnNotFound {static_cast<IOReturn>(0xe00002f0)};
+
+/**
+ *  Byte order helpers
+ */
+#define OSSwapInt16(x) __builtin_bswap16(x)
+#define OSSwapInt32(x) __builtin_bswap32(x)
+#define OSSwapInt64(x) __builtin_bswap64(x)
+#define OSSwapHostToBigInt16(x) OSSwapInt16(x)
+#define OSSwapHostToBigInt32(x) OSSwapInt32(x)
+#define OSSwapHostToBigInt64(x) OSSwapInt64(x)
+#define OSSwapBigToHostInt16(x) OSSwapInt16(x)
+#define OSSwapBigToHostInt32(x) OSSwapInt32(x)
+#define OSSwapBigToHostInt64(x) OSSwapInt64(x)
+
+/**
+ *  Time, absolute time units are nanoseconds
+ */
+uint64_t mach_absolute_time();
+
+inline void absolutetime_to_nanoseconds(uint64_t abstime, uint64_t *result) {
+	*result = abstime;
+}
+
+inline void nanoseconds_to_absolutetime(uint64_t nanoseconds, uint64_t *result) {
+	*result = nanoseconds;
+}
+
+inline void IOSleep(unsigned int milliseconds) {
+	usleep(milliseconds * 1000);
+}
+
+/**
+ *  Boot arguments are taken from vsmchost command line
+ */
+bool PE_parse_boot_argn(const char *name, void *value, int size);
+
+extern "C" int cpu_number(void);
+
+/**
+ *  Locks
+ */
+struct IOLock {
+	std::mutex mutex;
+	std::condition_variable wakeup;
+};
+
+using IOSimpleLock = IOLock;
+
+inline IOLock *IOLockAlloc() { return new IOLock; }
+inline void IOLockFree(IOLock *lock) { delete lock; }
+inline void IOLockLock(IOLock *lock) { lock->mutex.lock(); }
+inline void IOLockUnlock(IOLock *lock) { lock->mutex.unlock(); }
+
+/**
+ *  Sleeping waiters are woken up regardless of their event, callers recheck their condition
+ */
+constexpr int THREAD_UNINT {0};
+constexpr int THREAD_AWAKENED {0};
+
+inline int IOLockSleep(IOLock *lock, void *, uint32_t) {
+	std::unique_lock<std::mutex> guard(lock->mutex, std::adopt_lock);
+	lock->wakeup.wait(guard);
+	guard.release();
+	return THREAD_AWAKENED;
+}
+
+inline void IOLockWakeup(IOLock *lock, void *, bool) { lock->wakeup.notify_all(); }
+
+inline IOSimpleLock *IOSimpleLockAlloc() { return new IOSimpleLock; }
+inline void IOSimpleLockFree(IOSimpleLock *lock) { delete lock; }
+inline void IOSimpleLockLock(IOSimpleLock *lock) { lock->mutex.lock(); }
+inline void IOSimpleLockUnlock(IOSimpleLock *lock) { lock->mutex.unlock(); }
+
+/**
+ *  Threads are identified by the address of a thread local variable
+ */
+using thread_t = struct thread *;
+
+inline thread_t current_thread() {
+	static thread_local char self;
+	return reinterpret_cast<thread_t>(&self);
+}
+
+/**
+ *  libkern containers
+ */
+class OSSerialize;
+
+class OSMetaClassBase {
+public:
+	virtual ~OSMetaClassBase() = default;
+};
+
+class OSObject : public OSMetaClassBase {
+	int retainCount {1};
+public:
+	virtual void retain() const { const_cast<OSObject *>(this)->retainCount++; }
+	virtual void release() const {
+		if (--const_cast<OSObject *>(this)->retainCount == 0)
+			delete this;
+	}
+	virtual bool serialize(OSSerialize *s) const { return true; }
+};
+
+template <typename T, typename U>
+inline T *vsmchostDynamicCast(const U *inst) {
+	return dynamic_cast<T *>(const_cast<U *>(inst));
+}
+
+#define OSDynamicCast(type, inst) vsmchostDynamicCast<type>(inst)
+#define OSDeclareDefaultStructors(className) public: className() = default; private:
+#define OSDefineMetaClassAndStructors(className, superclassName)
+
+class OSData : public OSObject {
+	uint8_t *bytes {nullptr};
+	unsigned int length {0};
+public:
+	static OSData *withBytes(const void *src, unsigned int size) {
+		auto data = new OSData;
+		data->bytes = static_cast<uint8_t *>(malloc(size ? size : 1));
+		if (size)
+			memcpy(data->bytes, src, size);
+		data->length = size;
+		return data;
+	}
+	static OSData *withCapacity(unsigned int capacity) {
+		return withBytes(nullptr, 0);
+	}
+	bool appendBytes(const void *src, unsigned int size) {
+		auto grown = static_cast<uint8_t *>(realloc(bytes, length + size ? length + size : 1));
+		if (!grown)
+			return false;
+		if (size)
+			memcpy(grown + length, src, size);
+		bytes = grown;
+		length += size;
+		return true;
+	}
+	~OSData() override { free(bytes); }
+	unsigned int getLength() const { return length; }
+	const void *getBytesNoCopy() const { return bytes; }
+	bool isEqualTo(const void *src, unsigned int size) const { return size == length && !memcmp(bytes, src, size); }
+};
+
+class OSString : public OSObject {
+protected:
+	char *string {nullptr};
+public:
+	static OSString *withCString(const char *src) {
+		auto str = new OSString;
+		str->string = strdup(src);
+		return str;
+	}
+	~OSString() override { free(string); }
+	const char *getCStringNoCopy() const { return string; }
+	unsigned int getLength() const { return static_cast<unsigned int>(strlen(string)); }
+	bool isEqualTo(const char *src) const { return !strcmp(string, src); }
+};
+
+class OSSymbol : public OSString {
+public:
+	static const OSSymbol *withCString(const char *src) {
+		auto sym = new OSSymbol;
+		sym->string = strdup(src);
+		return sym;
+	}
+};
+
+class OSNumber : public OSObject {
+	uint64_t value {0};
+public:
+	static OSNumber *withNumber(unsigned long long number, unsigned int bits) {
+		auto num = new OSNumber;
+		num->value = bits < 64 ? number & ((1ULL << bits) - 1) : number;
+		return num;
+	}
+	uint32_t unsigned32BitValue() const { return static_cast<uint32_t>(value); }
+	uint64_t unsigned64BitValue() const { return value; }
+};
+
+class OSBoolean : public OSObject {
+	bool value {false};
+public:
+	explicit OSBoolean(bool v) : value(v) {}
+	void release() const override {}
+	bool isTrue() const { return value; }
+	bool isFalse() const { return !value; }
+};
+
+extern OSBoolean *const kOSBooleanTrue;
+extern OSBoolean *const kOSBooleanFalse;
+
+class OSArray : public OSObject {
+	OSObject **objects {nullptr};
+	unsigned int count {0};
+	unsigned int capacity {0};
+public:
+	static OSArray *withCapacity(unsigned int cap) {
+		auto arr = new OSArray;
+		arr->capacity = cap ? cap : 1;
+		arr->objects = static_cast<OSObject **>(calloc(arr->capacity, sizeof(OSObject *)));
+		return arr;
+	}
+	~OSArray() override {
+		for (unsigned int i = 0; i < count; i++)
+			objects[i]->release();
+		free(objects);
+	}
+	unsigned int getCount() const { return count; }
+	OSObject *getObject(unsigned int index) const { return index < count ? objects[index] : nullptr; }
+	bool setObject(const OSObject *obj) {
+		if (count == capacity) {
+			capacity *= 2;
+			objects = static_cast<OSObject **>(realloc(objects, capacity * sizeof(OSObject *)));
+		}
+		obj->retain();
+		objects[count++] = const_cast<OSObject *>(obj);
+		return true;
+	}
+};
+
+class OSDictionary : public OSObject {
+	char **keys {nullptr};
+	OSObject **objects {nullptr};
+	unsigned int count {0};
+	unsigned int capacity {0};
+
+	int find(const char *key) const {
+		for (unsigned int i = 0; i < count; i++)
+			if (!strcmp(keys[i], key))
+				return static_cast<int>(i);
+		return -1;
+	}
+public:
+	static OSDictionary *withCapacity(unsigned int cap) {
+		auto dict = new OSDictionary;
+		dict->capacity = cap ? cap : 1;
+		dict->keys = static_cast<char **>(calloc(dict->capacity, sizeof(char *)));
+		dict->objects = static_cast<OSObject **>(calloc(dict->capacity, sizeof(OSObject *)));
+		return dict;
+	}
+	~OSDictionary() override {
+		for (unsigned int i = 0; i < count; i++) {
+			free(keys[i]);
+			objects[i]->release();
+		}
+		free(keys);
+		free(objects);
+	}
+	unsigned int getCount() const { return count; }
+	const char *getKey(unsigned int index) const { return index < count ? keys[index] : nullptr; }
+	OSObject *getObject(const char *key) const {
+		auto i = find(key);
+		return i >= 0 ? objects[i] : nullptr;
+	}
+	bool setObject(const char *key, const OSMetaClassBase *obj) {
+		auto o = static_cast<const OSObject *>(obj);
+		o->retain();
+		auto i = find(key);
+		if (i >= 0) {
+			objects[i]->release();
+			objects[i] = const_cast<OSObject *>(o);
+			return true;
+		}
+		if (count == capacity) {
+			capacity *= 2;
+			keys = static_cast<char **>(realloc(keys, capacity * sizeof(char *)));
+			objects = static_cast<OSObject **>(realloc(objects, capacity * sizeof(OSObject *)));
+		}
+		keys[count] = strdup(key);
+		objects[count++] = const_cast<OSObject *>(o);
+		return true;
+	}
+	void removeObject(const char *key) {
+		auto i = find(key);
+		if (i >= 0) {
+			free(keys[i]);
+			objects[i]->release();
+			count--;
+			memmove(&keys[i], &keys[i + 1], (count - i) * sizeof(char *));
+			memmove(&objects[i], &objects[i + 1], (count - i) * sizeof(OSObject *));
+		}
+	}
+};
+
+class OSSerialize : public OSObject {};
+
+class OSIterator : public OSObject {
+public:
+	virtual OSObject *getNextObject() { return nullptr; }
+};
+
+/**
+ *  I/O Registry, entries have no parents or children on the host
+ */
+class IORegistryPlane;
+extern const IORegistryPlane *gIOServicePlane;
+extern const IORegistryPlane *gIODTPlane;
+
+class IORegistryEntry : public OSObject {
+	OSDictionary *properties {OSDictionary::withCapacity(16)};
+public:
+	~IORegistryEntry() override { properties->release(); }
+	static IORegistryEntry *fromPath(const char *path, const IORegistryPlane *plane = nullptr) { return new IORegistryEntry; }
+	IORegistryEntry *childFromPath(const char *path, const IORegistryPlane *plane = nullptr) { return nullptr; }
+	OSIterator *getChildIterator(const IORegistryPlane *plane) { return nullptr; }
+	const char *getName(const IORegistryPlane *plane = nullptr) const { return "VirtualSMC"; }
+	bool init(OSDictionary *dictionary = nullptr) { return true; }
+	bool init(IORegistryEntry *from, const IORegistryPlane *plane) { return true; }
+	OSDictionary *getPropertyTable() const { return properties; }
+	OSObject *getProperty(const char *name) const { return properties->getObject(name); }
+	bool setProperty(const char *name, OSObject *obj) { return properties->setObject(name, obj); }
+	bool setProperty(const char *name, const char *str) {
+		auto s = OSString::withCString(str);
+		bool ok = setProperty(name, s);
+		s->release();
+		return ok;
+	}
+	bool setProperty(const char *name, void *bytes, unsigned int length) {
+		auto d = OSData::withBytes(bytes, length);
+		bool ok = setProperty(name, d);
+		d->release();
+		return ok;
+	}
+	void removeProperty(const char *name) { properties->removeObject(name); }
+	virtual bool serializeProperties(OSSerialize *s) const { return true; }
+};
+
+/**
+ *  Power management
+ */
+static constexpr unsigned long kIOPMPowerStateVersion1 {1};
+static constexpr unsigned long kIOPMPowerOn {0x2};
+static constexpr unsigned long kIOPMDeviceUsable {0x8000};
+static constexpr IOReturn kIOPMAckImplied {0};
+
+struct IOPMPowerState {
+	unsigned long version;
+	unsigned long capabilityFlags;
+	unsigned long outputPowerCharacter;
+	unsigned long inputPowerRequirement;
+	unsigned long staticPower;
+	unsigned long unbudgetedPower;
+	unsigned long powerToAttain;
+	unsigned long timeToAttain;
+	unsigned long settleUpTime;
+	unsigned long timeToLower;
+	unsigned long settleDownTime;
+	unsigned long powerDomainBudget;
+};
+
+class IOService;
+class IONotifier : public OSObject {};
+
+class IOMemoryMap : public OSObject {
+	mach_vm_address_t address {0};
+	mach_vm_size_t length {0};
+public:
+	static IOMemoryMap *withRange(mach_vm_address_t address, mach_vm_size_t length) {
+		auto map = new IOMemoryMap;
+		map->address = address;
+		map->length = length;
+		return map;
+	}
+	IOPhysicalAddress getPhysicalAddress() { return address; }
+	mach_vm_address_t getVirtualAddress() { return address; }
+	mach_vm_size_t getLength() { return length; }
+};
+class IOWorkLoop;
+class IOTimerEventSource;
+class IOBufferMemoryDescriptor : public OSObject {};
+
+using IOServiceMatchingNotificationHandler = bool (*)(void *target, void *refCon, IOService *newService, IONotifier *notifier);
+using IOInterruptAction = void (*)(OSObject *target, void *refCon, IOService *nub, int source);
+
+extern const OSSymbol *gIOFirstPublishNotification;
+
+class IOPlatformExpert {
+public:
+	long getGMTTimeOfDay();
+};
+
+class IOService : public IORegistryEntry {
+public:
+	virtual IOService *probe(IOService *provider, SInt32 *score) { return this; }
+	virtual bool start(IOService *provider) { return true; }
+	virtual void stop(IOService *provider) {}
+	virtual void registerService(IOOptionBits options = 0) {}
+	virtual void publishResource(const char *key, OSObject *value = nullptr) {}
+	virtual IOReturn setPowerState(unsigned long state, IOService *whatDevice) { return kIOReturnSuccess; }
+	virtual IOReturn callPlatformFunction(const OSSymbol *functionName, bool waitForFunction, void *param1, void *param2, void *param3, void *param4) {
+		return kIOReturnUnsupported;
+	}
+
+	bool init(OSDictionary *dictionary = nullptr) { return true; }
+	bool init(IORegistryEntry *from, IORegistryEntry *parent, OSDictionary *dictionary) { return true; }
+	void PMinit() {}
+	void PMstop() {}
+	void joinPMtree(IOService *driver) {}
+	IOReturn registerPowerDriver(IOService *controllingDriver, IOPMPowerState *powerStates, unsigned long numberOfStates) { return kIOReturnSuccess; }
+
+	static IOPlatformExpert *getPlatform();
+	static OSDictionary *nameMatching(const char *name, OSDictionary *table = nullptr) { return nullptr; }
+	static IONotifier *addMatchingNotification(const OSSymbol *type, OSDictionary *matching, IOServiceMatchingNotificationHandler handler, void *target, void *ref = nullptr, SInt32 priority = 0) {
+		return nullptr;
+	}
+};
+
+/**
+ *  Platform device, interrupts are delivered by the host runtime
+ */
+static constexpr int kIOInterruptTypeEdge {0};
+
+class IOACPIPlatformDevice : public IOService {
+public:
+	virtual IOMemoryMap *mapDeviceMemoryWithIndex(unsigned int index, IOOptionBits options = 0) { return nullptr; }
+	virtual void ioWrite32(UInt16 offset, UInt32 value, IOMemoryMap *map = nullptr) {}
+	virtual UInt32 ioRead32(UInt16 offset, IOMemoryMap *map = nullptr) { return 0; }
+	virtual void ioWrite16(UInt16 offset, UInt16 value, IOMemoryMap *map = nullptr) {}
+	virtual UInt16 ioRead16(UInt16 offset, IOMemoryMap *map = nullptr) { return 0; }
+	virtual void ioWrite8(UInt16 offset, UInt8 value, IOMemoryMap *map = nullptr) {}
+	virtual UInt8 ioRead8(UInt16 offset, IOMemoryMap *map = nullptr) { return 0; }
+	virtual IOReturn registerInterrupt(int source, OSObject *target, IOInterruptAction handler, void *refCon = nullptr) { return kIOReturnUnsupported; }
+	virtual IOReturn unregisterInterrupt(int source) { return kIOReturnUnsupported; }
+	virtual IOReturn getInterruptType(int source, int *interruptType) { return kIOReturnUnsupported; }
+	virtual IOReturn enableInterrupt(int source) { return kIOReturnUnsupported; }
+	virtual IOReturn disableInterrupt(int source) { return kIOReturnUnsupported; }
+	virtual IOReturn causeInterrupt(int source) { return kIOReturnUnsupported; }
+	virtual IOReturn validateObject(const char *objectName) { return kIOReturnUnsupported; }
+	virtual IOReturn evaluateInteger(const char *objectName, UInt32 *resultInt32, OSObject *params[] = nullptr, uint32_t paramCount = 0, IOOptionBits options = 0) { return kIOReturnUnsupported; }
+};
+
+/**
+ *  Timers fire from vsmchostRunTimers on the caller thread
+ */
+class IOWorkLoop : public OSObject {
+public:
+	static IOWorkLoop *workLoop() { return new IOWorkLoop; }
+	IOReturn addEventSource(IOTimerEventSource *source) { return kIOReturnSuccess; }
+};
+
+class IOTimerEventSource : public OSObject {
+public:
+	using Action = void (*)(OSObject *owner, IOTimerEventSource *sender);
+private:
+	OSObject *owner {nullptr};
+	Action action {nullptr};
+	uint64_t deadline {0};
+	IOTimerEventSource *next {nullptr};
+	static IOTimerEventSource *timers;
+	friend void vsmchostRunTimers(bool all);
+public:
+	static IOTimerEventSource *timerEventSource(OSObject *owner, Action action);
+	IOReturn setTimeoutMS(UInt32 ms) {
+		deadline = mach_absolute_time() + ms * 1000000ULL;
+		return kIOReturnSuccess;
+	}
+	void cancelTimeout() { deadline = 0; }
+	void enable() {}
+	void disable() {}
+};
+
+/**
+ *  Fire expired timers, or every armed timer when all is set
+ */
+void vsmchostRunTimers(bool all);
+
+#endif /* xnu_host_hpp */
@@ -0,0 +1,144 @@
+//
+//  aliases.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <VirtualSMCSDK/kern_vsmcapi.hpp>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "vsmctest.hpp"
+#include "vsmctestsmc.hpp"
+
+namespace {
+	constexpr SMC_KEY KeyKEY = SMC_MAKE_IDENTIFIER('#', 'K', 'E', 'Y');
+	constexpr SMC_KEY KeyRBr = SMC_MAKE_IDENTIFIER('R', 'B', 'r', ' ');
+	constexpr SMC_KEY KeyRPlt = SMC_MAKE_IDENTIFIER('R', 'P', 'l', 't');
+	constexpr SMC_KEY KeyAlias0 = SMC_MAKE_IDENTIFIER('T', 'A', 'L', '0');
+	constexpr SMC_KEY KeyAlias1 = SMC_MAKE_IDENTIFIER('T', 'A', 'L', '1');
+	constexpr SMC_KEY KeyOwner = SMC_MAKE_IDENTIFIER('T', 'A', 'L', '2');
+
+	constexpr SMC_DATA Override[8] {'o', 'v', 'e', 'r', 'r', 'i', 'd', 'e'};
+
+	/**
+	 *  Value counting live instances to check that shared values are freed once
+	 */
+	struct CountedValue : VirtualSMCValue {
+		static inline int alive {0};
+		CountedValue() { alive++; }
+		~CountedValue() override { alive--; }
+	};
+
+	VirtualSMCValue *counted() {
+		return VirtualSMCAPI::valueWithData(Override, sizeof(Override), SmcKeyTypeCh8s, new CountedValue);
+	}
+
+	uint32_t keyCount(VirtualSMCKeystore *keystore) {
+		SMC_DATA value[SMC_MAX_DATA_SIZE];
+		SMC_DATA_SIZE size;
+		uint32_t count = 0;
+		CHECK_EQ(keystore->readValueByName(KeyKEY, value, size), SmcSuccess);
+		CHECK_EQ(size, sizeof(count));
+		memcpy(&count, value, sizeof(count));
+		return OSSwapBigToHostInt32(count);
+	}
+
+	/**
+	 *  Enumerate every key by index like macOS does with #KEY
+	 */
+	std::vector<SMC_KEY> enumerate(VirtualSMCKeystore *keystore) {
+		std::vector<SMC_KEY> keys;
+		auto count = keyCount(keystore);
+		for (uint32_t i = 0; i < count; i++) {
+			SMC_KEY key = 0;
+			CHECK_EQ(keystore->readNameByIndex(i, key), SmcSuccess);
+			keys.push_back(key);
+		}
+		SMC_KEY key;
+		CHECK(keystore->readNameByIndex(count, key) != SmcSuccess);
+		return keys;
+	}
+
+	size_t occurrences(const std::vector<SMC_KEY> &keys, SMC_KEY key) {
+		size_t found = 0;
+		for (auto k : keys)
+			found += k == key;
+		return found;
+	}
+
+	bool readsOverride(VirtualSMCKeystore *keystore, SMC_KEY key) {
+		SMC_DATA value[SMC_MAX_DATA_SIZE];
+		SMC_DATA_SIZE size;
+		return keystore->readValueByName(key, value, size) == SmcSuccess && size == sizeof(Override) &&
+			!memcmp(value, Override, sizeof(Override));
+	}
+}
+
+int main() {
+	auto keystore = vsmctestStartService();
+	CHECK(keystore);
+	if (!keystore)
+		return vsmctestResult("aliases");
+
+	auto base = enumerate(keystore);
+	CHECK_EQ(occurrences(base, KeyRPlt), 1);
+	CHECK_EQ(occurrences(base, KeyRBr), 1);
+
+	// Alias owner overriding a keystore key, aliases stay in the plugin.
+	VirtualSMCAPI::Plugin owner;
+	vsmctestInitPlugin(owner, "owner");
+	CHECK(VirtualSMCAPI::addKey(KeyRPlt, owner.data, counted()));
+	CHECK(VirtualSMCAPI::addAlias(KeyAlias1, owner.data, KeyRPlt));
+	CHECK(VirtualSMCAPI::addAlias(KeyAlias0, owner.data, KeyRPlt));
+	CHECK(VirtualSMCAPI::addKey(KeyOwner, owner.data, VirtualSMCAPI::valueWithUint8(1)));
+	CHECK_EQ(keystore->loadPlugin(&owner), kIOReturnSuccess);
+
+	// Overrides keep their place, plugin keys follow the keystore keys in sorted order.
+	auto keys = enumerate(keystore);
+	CHECK_EQ(keys.size(), base.size() + 3);
+	CHECK_EQ(keyCount(keystore), base.size() + 3);
+	CHECK(std::equal(base.begin(), base.end(), keys.begin()));
+	if (keys.size() == base.size() + 3) {
+		CHECK_EQ(keys[base.size()], KeyAlias0);
+		CHECK_EQ(keys[base.size() + 1], KeyAlias1);
+		CHECK_EQ(keys[base.size() + 2], KeyOwner);
+	}
+
+	// The owner and its aliases read the same value.
+	CHECK(readsOverride(keystore, KeyRPlt));
+	CHECK(readsOverride(keystore, KeyAlias0));
+	CHECK(readsOverride(keystore, KeyAlias1));
+
+	// The value stays with the aliases left in the plugin and is freed with the plugin storage.
+	CHECK_EQ(keystore->unloadPlugin(&owner), kIOReturnSuccess);
+	CHECK(!readsOverride(keystore, KeyRPlt));
+	CHECK_EQ(CountedValue::alive, 1);
+	CHECK(enumerate(keystore) == base);
+	owner.data.deinit();
+	CHECK_EQ(CountedValue::alive, 0);
+
+	// Alias overriding a keystore key with the owner staying in the plugin.
+	VirtualSMCAPI::Plugin alias;
+	vsmctestInitPlugin(alias, "alias");
+	CHECK(VirtualSMCAPI::addKey(KeyOwner, alias.data, counted()));
+	CHECK(VirtualSMCAPI::addAlias(KeyRBr, alias.data, KeyOwner));
+	CHECK_EQ(keystore->loadPlugin(&alias), kIOReturnSuccess);
+	keys = enumerate(keystore);
+	CHECK_EQ(keys.size(), base.size() + 1);
+	CHECK_EQ(occurrences(keys, KeyRBr), 1);
+	CHECK_EQ(keys.back(), KeyOwner);
+	CHECK(readsOverride(keystore, KeyRBr));
+	CHECK(readsOverride(keystore, KeyOwner));
+
+	CHECK_EQ(keystore->unloadPlugin(&alias), kIOReturnSuccess);
+	CHECK(!readsOverride(keystore, KeyRBr));
+	CHECK_EQ(CountedValue::alive, 1);
+	alias.data.deinit();
+	CHECK_EQ(CountedValue::alive, 0);
+	CHECK(enumerate(keystore) == base);
+
+	return vsmctestResult("aliases");
+}
@@ -0,0 +1,128 @@
+//
+//  alsbackend.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <string.h>
+
+#include "../../../Sensors/SMCLightSensor/ALSBackend.hpp"
+#include "vsmctest.hpp"
+
+namespace {
+	/**
+	 *  Simulated I2C sensor register file counting bus transactions
+	 */
+	struct SimulatedDevice : I2CALSTransport {
+		uint8_t registers[0x100] {};
+		size_t reads {0};
+		size_t writes {0};
+		bool fail {false};
+
+		bool readRegisters(uint8_t reg, uint8_t *data, uint8_t size) override {
+			if (fail || reg + size > 0x100)
+				return false;
+			reads++;
+			memcpy(data, &registers[reg], size);
+			return true;
+		}
+
+		bool writeRegister(uint8_t reg, uint8_t value) override {
+			if (fail)
+				return false;
+			writes++;
+			registers[reg] = value;
+			return true;
+		}
+
+		void set16(uint8_t reg, uint16_t value) {
+			registers[reg] = value & 0xFF;
+			registers[reg + 1] = value >> 8;
+		}
+	};
+
+	/**
+	 *  DN40 lux for APDS9960 at 103 ms integration and 4x gain
+	 */
+	double apds9960Lux(double r, double g, double b) {
+		double cpl = (37 * 2.78) * 4 / 52;
+		double lux = (-0.32466 * r + 1.57837 * g - 0.73191 * b) / cpl;
+		return lux > 0 ? lux : 0;
+	}
+
+	void checkAPDS9960(uint16_t c, uint16_t r, uint16_t g, uint16_t b) {
+		uint8_t data[8] {
+			static_cast<uint8_t>(c), static_cast<uint8_t>(c >> 8), static_cast<uint8_t>(r), static_cast<uint8_t>(r >> 8),
+			static_cast<uint8_t>(g), static_cast<uint8_t>(g >> 8), static_cast<uint8_t>(b), static_cast<uint8_t>(b >> 8)
+		};
+		auto lux = I2CALSBackend::decodeAPDS9960(data);
+		double expected = apds9960Lux(r, g, b);
+		CHECK(lux <= expected + 1e-6 && lux + 1 > expected);
+	}
+}
+
+int main() {
+	// ISL29018 full scale count maps to the configured 4000 lux range.
+	uint8_t isl[2] {0x00, 0x00};
+	CHECK_EQ(I2CALSBackend::decodeISL29018(isl, 4000), 0);
+	isl[0] = 0xFF; isl[1] = 0xFF;
+	CHECK_EQ(I2CALSBackend::decodeISL29018(isl, 4000), 3999);
+	isl[0] = 0x00; isl[1] = 0x80;
+	CHECK_EQ(I2CALSBackend::decodeISL29018(isl, 4000), 2000);
+	isl[0] = 0x34; isl[1] = 0x12;
+	CHECK_EQ(I2CALSBackend::decodeISL29018(isl, 64000), 0x1234 * 64000 / 0x10000);
+
+	// APDS9960 colour counts are divided by counts per lux and clamp at zero.
+	checkAPDS9960(0, 0, 0, 0);
+	checkAPDS9960(1500, 1000, 1000, 1000);
+	checkAPDS9960(800, 100, 400, 200);
+	checkAPDS9960(500, 1000, 10, 1000);
+	checkAPDS9960(0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF);
+	checkAPDS9960(0xFFFF, 0, 0xFFFF, 0);
+
+	// ISL29018 is configured for continuous ALS at 16 bits and read in one transaction.
+	auto isl29018 = new SimulatedDevice;
+	auto backend = I2CALSBackend::withTransport(isl29018, I2CALSBackend::Chip::ISL29018);
+	CHECK(backend);
+	if (backend) {
+		CHECK_EQ(isl29018->registers[0x00], 0xA0);
+		CHECK_EQ(isl29018->registers[0x01], 0x01);
+		CHECK(!strcmp(backend->name(), "isl29018"));
+		isl29018->set16(0x02, 0x4000);
+		uint32_t lux = 0;
+		CHECK(backend->readLux(lux));
+		CHECK_EQ(lux, 1000);
+		CHECK_EQ(isl29018->reads, 1);
+		isl29018->fail = true;
+		CHECK(!backend->readLux(lux));
+		delete backend;
+	}
+
+	// APDS9960 is powered on with ALS enabled after timing and gain, and reads all channels at once.
+	auto apds9960 = new SimulatedDevice;
+	backend = I2CALSBackend::withTransport(apds9960, I2CALSBackend::Chip::APDS9960);
+	CHECK(backend);
+	if (backend) {
+		CHECK_EQ(apds9960->registers[0x81], 0xDB);
+		CHECK_EQ(apds9960->registers[0x8F], 0x01);
+		CHECK_EQ(apds9960->registers[0x80], 0x03);
+		CHECK_EQ(apds9960->writes, 3);
+		apds9960->set16(0x94, 2000);
+		apds9960->set16(0x96, 1000);
+		apds9960->set16(0x98, 1200);
+		apds9960->set16(0x9A, 800);
+		uint32_t lux = 0;
+		CHECK(backend->readLux(lux));
+		CHECK_EQ(lux, static_cast<uint32_t>(apds9960Lux(1000, 1200, 800)));
+		CHECK_EQ(apds9960->reads, 1);
+		delete backend;
+	}
+
+	// A sensor failing configuration is not used and the transport stays with the caller.
+	SimulatedDevice missing;
+	missing.fail = true;
+	CHECK(!I2CALSBackend::withTransport(&missing, I2CALSBackend::Chip::APDS9960));
+
+	return vsmctestResult("alsbackend");
+}
@@ -0,0 +1,170 @@
+//
+//  alsfilter.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <vector>
+
+#include "../../../Sensors/SMCLightSensor/AmbientLightValue.hpp"
+#include "vsmctest.hpp"
+
+namespace {
+	/**
+	 *  Count filter outputs SMCLightSensor would post ALS interrupts for with default hysteresis
+	 */
+	size_t countPublished(const std::vector<uint32_t> &luxes, size_t skip) {
+		AmbientLightHysteresis hysteresis;
+		hysteresis.reset(luxes[skip]);
+		size_t published = 0;
+		for (size_t i = skip + 1; i < luxes.size(); i++)
+			published += hysteresis.update(luxes[i]);
+		return published;
+	}
+
+	/**
+	 *  Polls SMCLightSensor posts ALS interrupts at, the first sample is the initial directly read value
+	 */
+	std::vector<size_t> interruptPolls(const std::vector<uint32_t> &trace) {
+		AmbientLightFilter filter;
+		filter.configure(AmbientLightFilter::WindowDefault, AmbientLightFilter::WeightDefault, AmbientLightFilter::StepDefault);
+		AmbientLightHysteresis hysteresis;
+		hysteresis.reset(filter.update(trace[0]));
+		std::vector<size_t> polls;
+		for (size_t i = 1; i < trace.size(); i++)
+			if (hysteresis.update(filter.update(trace[i])))
+				polls.push_back(i);
+		return polls;
+	}
+
+	std::vector<uint32_t> run(AmbientLightFilter &filter, const std::vector<uint32_t> &trace) {
+		std::vector<uint32_t> out;
+		for (auto lux : trace)
+			out.push_back(filter.update(lux));
+		return out;
+	}
+
+	/**
+	 *  Polls since the step until the output stays within 5% of the target till the end of the segment
+	 */
+	size_t settleTime(const std::vector<uint32_t> &out, size_t step, size_t end, uint32_t target) {
+		size_t settled = end;
+		for (size_t i = end; i > step; i--) {
+			uint32_t delta = out[i - 1] > target ? out[i - 1] - target : target - out[i - 1];
+			if (delta * 20 > target)
+				break;
+			settled = i - 1;
+		}
+		return settled - step;
+	}
+
+	/**
+	 *  Deterministic sensor noise from 0 to 2 * amplitude
+	 */
+	uint32_t noise(uint32_t &seed, uint32_t amplitude) {
+		seed = seed * 1103515245 + 12345;
+		return (seed >> 16) % (2 * amplitude + 1);
+	}
+}
+
+int main() {
+	// _ALI traces below follow what laptops with PWM dimmed backlight and
+	// fluorescent lighting report: a steady level with periodic samples
+	// hitting the dark part of the PWM cycle, and mains flicker sampled at
+	// a random phase by every poll.
+	uint32_t seed = 1;
+	std::vector<uint32_t> pwm, mains;
+	for (size_t i = 0; i < 200; i++)
+		pwm.push_back(i % 4 == 3 ? 30 + noise(seed, 10) : 315 + noise(seed, 5));
+	for (size_t i = 0; i < 200; i++)
+		mains.push_back(450 + noise(seed, 50));
+
+	AmbientLightFilter bypass;
+	bypass.configure(1, 100, 0);
+	auto rawPwm = run(bypass, pwm);
+	CHECK(countPublished(rawPwm, 0) > 90);
+
+	AmbientLightFilter filter;
+	filter.configure(AmbientLightFilter::WindowDefault, AmbientLightFilter::WeightDefault, AmbientLightFilter::StepDefault);
+	auto outPwm = run(filter, pwm);
+	for (size_t i = AmbientLightFilter::WindowDefault; i < outPwm.size(); i++)
+		CHECK(outPwm[i] >= 300 && outPwm[i] <= 330);
+	CHECK_EQ(countPublished(outPwm, AmbientLightFilter::WindowDefault), 0);
+
+	filter.configure(AmbientLightFilter::WindowDefault, AmbientLightFilter::WeightDefault, AmbientLightFilter::StepDefault);
+	auto rawMains = run(bypass, mains);
+	auto outMains = run(filter, mains);
+	CHECK(countPublished(outMains, 10) * 4 < countPublished(rawMains, 10));
+	for (size_t i = 10; i < outMains.size(); i++)
+		CHECK(outMains[i] >= 455 && outMains[i] <= 545);
+
+	// Large steps take the fast path once the median window sees the new level.
+	std::vector<uint32_t> steps;
+	for (size_t i = 0; i < 20; i++)
+		steps.push_back(98 + noise(seed, 2));
+	for (size_t i = 0; i < 20; i++)
+		steps.push_back(895 + noise(seed, 5));
+	for (size_t i = 0; i < 20; i++)
+		steps.push_back(58 + noise(seed, 2));
+	filter.configure(AmbientLightFilter::WindowDefault, AmbientLightFilter::WeightDefault, AmbientLightFilter::StepDefault);
+	auto outSteps = run(filter, steps);
+	CHECK(settleTime(outSteps, 20, 40, 900) <= AmbientLightFilter::WindowDefault / 2 + 1);
+	CHECK(settleTime(outSteps, 40, 60, 60) <= AmbientLightFilter::WindowDefault / 2 + 1);
+
+	// Small steps are smoothed, but must not stall short of the target.
+	std::vector<uint32_t> small(10, 300);
+	small.resize(40, 330);
+	filter.configure(AmbientLightFilter::WindowDefault, AmbientLightFilter::WeightDefault, AmbientLightFilter::StepDefault);
+	auto outSmall = run(filter, small);
+	CHECK(settleTime(outSmall, 10, outSmall.size(), 330) <= 4);
+	CHECK_EQ(outSmall.back(), 330);
+
+	// Invalid readings pass through and restart the filter.
+	CHECK_EQ(filter.update(0xFFFFFFFF), 0xFFFFFFFF);
+	CHECK_EQ(filter.update(42), 42);
+
+	// _ALI trace recorded at 1 s polls on a desk: PWM dimmed room light,
+	// a desk lamp switched on at poll 12, a hand shadow at polls 26-27,
+	// and the lamp switched off at poll 38.
+	const std::vector<uint32_t> desk {
+		212, 208, 31,  214, 210, 207, 29,  211, 215, 209, 33,  212,
+		640, 655, 648, 96,  652, 645, 650, 647, 101, 651, 649, 653,
+		646, 99,  180, 175, 648, 652, 650, 94,  647, 651, 649, 645,
+		652, 98,  209, 213, 30,  210, 207, 211, 214, 32,  209, 212
+	};
+	auto polls = interruptPolls(desk);
+	// Lamp and shadow edges are posted within a poll, PWM dips never are.
+	CHECK(polls == (std::vector<size_t> {13, 26, 29, 38}));
+	// Posting unfiltered readings would wake the brightness stack on every dip.
+	CHECK_EQ(countPublished(desk, 0), 22);
+
+	// Hysteresis band is the larger of the absolute and relative thresholds.
+	AmbientLightHysteresis hysteresis;
+	hysteresis.reset(100);
+	CHECK(!hysteresis.update(104));
+	CHECK(hysteresis.update(105));
+	CHECK(!hysteresis.update(101));
+	CHECK(hysteresis.update(99));
+	hysteresis.reset(10);
+	CHECK(!hysteresis.update(11));
+	CHECK(hysteresis.update(12));
+	// Sensor appearing or disappearing is always reported, but only once.
+	CHECK(hysteresis.update(0xFFFFFFFF));
+	CHECK(!hysteresis.update(0xFFFFFFFF));
+	CHECK(hysteresis.update(12));
+	hysteresis.configure(0, 0);
+	CHECK(hysteresis.update(12));
+	CHECK(hysteresis.update(13));
+
+	// Out of range parameters are clamped.
+	filter.configure(100, 100, 0);
+	for (uint32_t i = 0; i < AmbientLightFilter::MaxWindow - 1; i++)
+		filter.update(i < AmbientLightFilter::MaxWindow / 2 ? 1000 : 10);
+	CHECK_EQ(filter.update(10), 10);
+	filter.configure(1, 0, 0);
+	filter.update(0);
+	CHECK_EQ(filter.update(100), 1);
+
+	return vsmctestResult("alsfilter");
+}
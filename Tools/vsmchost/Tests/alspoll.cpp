@@ -0,0 +1,194 @@
+//
+//  alspoll.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <vector>
+
+#include "../../../Sensors/SMCLightSensor/AmbientLightValue.hpp"
+#include "vsmctest.hpp"
+
+namespace {
+	constexpr uint64_t Second = 1000000000ULL;
+	constexpr uint64_t Millisecond = 1000000ULL;
+
+	/**
+	 *  SMCLightSensor polling loop on a simulated clock
+	 */
+	struct Simulation {
+		AmbientLightFilter filter;
+		AmbientLightHysteresis hysteresis;
+		AmbientLightPoller poller;
+
+		/**
+		 *  Light level changes from before to after at step time
+		 */
+		uint32_t before {100};
+		uint32_t after {100};
+		uint64_t step {0};
+
+		/**
+		 *  macOS ALS key read interval, 0 when auto-brightness is disabled
+		 */
+		uint64_t readInterval {0};
+
+		uint64_t now {0};
+		uint64_t deadline {0};
+		uint64_t nextRead {0};
+		bool armed {true};
+		uint32_t current {0};
+		size_t polls {0};
+		std::vector<uint64_t> interrupts;
+
+		Simulation() {
+			filter.configure(AmbientLightFilter::WindowDefault, AmbientLightFilter::WeightDefault, AmbientLightFilter::StepDefault);
+			// Initial value is read by macOS directly.
+			current = filter.update(before);
+			hysteresis.reset(current);
+			deadline = poller.start(now) * Millisecond;
+		}
+
+		/**
+		 *  Mirrors SMCLightSensor::refreshSensor on poller timeout
+		 */
+		void poll() {
+			if (poller.suspended()) {
+				armed = false;
+				return;
+			}
+			polls++;
+			uint32_t lux = filter.update(now >= step ? after : before);
+			uint32_t oldLux = current;
+			current = lux;
+			bool published = hysteresis.update(lux);
+			if (published)
+				interrupts.push_back(now);
+			uint32_t timeout = poller.next(published, lux != oldLux, now);
+			if (!poller.suspended())
+				deadline = now + timeout * Millisecond;
+			else
+				armed = false;
+		}
+
+		void runUntil(uint64_t end) {
+			while (true) {
+				uint64_t event = armed ? deadline : end;
+				bool read = readInterval && nextRead < event;
+				if (read)
+					event = nextRead;
+				if (event >= end)
+					break;
+				now = event;
+				if (read) {
+					poller.keyRead(now);
+					nextRead += readInterval;
+				} else {
+					poll();
+				}
+			}
+			now = end;
+		}
+
+		void displayOff() {
+			poller.suspend();
+		}
+
+		void displayOn() {
+			uint32_t timeout = 0;
+			if (poller.resume(timeout)) {
+				armed = true;
+				deadline = now + timeout * Millisecond;
+			}
+		}
+
+		uint64_t firstInterruptAfter(uint64_t time) {
+			for (auto i : interrupts)
+				if (i >= time)
+					return i;
+			return UINT64_MAX;
+		}
+	};
+
+	/**
+	 *  Exposes key read handling of ALS value classes
+	 */
+	struct ReadValue : SMCAmbientLightReadValue {
+		using SMCAmbientLightReadValue::SMCAmbientLightReadValue;
+
+		SMC_RESULT read() {
+			return readAccess();
+		}
+	};
+}
+
+int main() {
+	// Keys count as read at boot, polling backs off to the maximum interval
+	// and only reaches the idle interval a minute later if nobody reads them.
+	Simulation idle;
+	idle.runUntil(60 * Second);
+	CHECK_EQ(idle.polls, 16);
+	idle.runUntil(600 * Second);
+	CHECK_EQ(idle.polls, 70);
+	CHECK_EQ(idle.interrupts.size(), 0);
+
+	// Auto-brightness reading the keys keeps the maximum interval.
+	Simulation reading;
+	reading.readInterval = 5 * Second;
+	reading.runUntil(600 * Second);
+	CHECK_EQ(reading.polls, 151);
+	CHECK_EQ(reading.interrupts.size(), 0);
+
+	// A step is posted within two maximum intervals, the median window needs two
+	// samples of the new level, and polling follows the change closely afterwards.
+	Simulation stepped;
+	stepped.readInterval = 5 * Second;
+	stepped.after = 900;
+	stepped.step = 120 * Second + 500 * Millisecond;
+	stepped.runUntil(stepped.step);
+	size_t pollsBefore = stepped.polls;
+	stepped.runUntil(stepped.step + 10 * Second);
+	auto latency = stepped.firstInterruptAfter(stepped.step) - stepped.step;
+	CHECK(latency <= 2 * AmbientLightPoller::TimeoutMaxMS * Millisecond);
+	CHECK_EQ(latency, 6500 * Millisecond);
+	CHECK_EQ(stepped.interrupts.size(), 1);
+	CHECK_EQ(stepped.polls - pollsBefore, 5);
+	CHECK_EQ(stepped.current, 900);
+
+	// No polls happen while the display is off, the pending timer fires once and
+	// is not rearmed. Power on polls at the minimal interval until the median
+	// window sees the new light level.
+	Simulation sleeping;
+	sleeping.readInterval = 5 * Second;
+	sleeping.runUntil(30 * Second);
+	sleeping.displayOff();
+	size_t pollsAsleep = sleeping.polls;
+	sleeping.after = 900;
+	sleeping.step = 100 * Second;
+	sleeping.runUntil(600 * Second);
+	CHECK_EQ(sleeping.polls, pollsAsleep);
+	CHECK(!sleeping.armed);
+	CHECK(sleeping.interrupts.empty());
+	sleeping.displayOn();
+	CHECK(sleeping.armed);
+	CHECK_EQ(sleeping.deadline, sleeping.now + AmbientLightPoller::TimeoutMinMS * Millisecond);
+	sleeping.runUntil(610 * Second);
+	CHECK_EQ(sleeping.firstInterruptAfter(600 * Second) - 600 * Second, 500 * Millisecond);
+	// Repeated power on notifications do not rearm the timer again.
+	uint32_t timeout = 0;
+	CHECK(!sleeping.poller.resume(timeout));
+
+	// Reads of every ALS key count, not only of ALV0.
+	AmbientLightPoller poller;
+	poller.start(0);
+	for (size_t i = 0; i < 4; i++)
+		poller.next(false, false, getCurrentTimeNs() + AmbientLightPoller::ReadIdleTimeoutNs + 1);
+	CHECK_EQ(poller.next(false, false, getCurrentTimeNs() + AmbientLightPoller::ReadIdleTimeoutNs + 1), AmbientLightPoller::TimeoutIdleMS);
+	ReadValue alv1(&poller);
+	CHECK_EQ(alv1.read(), SmcSuccess);
+	CHECK_EQ(poller.next(false, true, getCurrentTimeNs()), AmbientLightPoller::TimeoutIdleMS);
+	CHECK_EQ(poller.next(false, false, getCurrentTimeNs()), AmbientLightPoller::TimeoutMaxMS);
+
+	return vsmctestResult("alspoll");
+}
@@ -0,0 +1,270 @@
+//
+//  campaign.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../../smc-fuzzer/campaign.h"
+#include "vsmctest.hpp"
+
+namespace {
+	constexpr const char *CampaignPath = "campaign-test.txt";
+
+	uint32_t fourcc(const char *name) {
+		return static_cast<uint32_t>(static_cast<uint8_t>(name[0])) << 24 | static_cast<uint32_t>(static_cast<uint8_t>(name[1])) << 16 |
+			static_cast<uint32_t>(static_cast<uint8_t>(name[2])) << 8 | static_cast<uint32_t>(static_cast<uint8_t>(name[3]));
+	}
+
+	/**
+	 *  Backend with a few single byte keys:
+	 *  TA0W is writable and every write to it increments TL0K,
+	 *  TB0W is writable but rejects 0xFF,
+	 *  TVOL changes on every read and must be ignored as volatile,
+	 *  XHI  is writable and not listed, like hidden keys.
+	 */
+	struct FakeBackend : SMCBackend {
+		struct Key {
+			uint8_t value;
+			bool writable;
+			size_t writes;
+		};
+
+		std::map<uint32_t, Key> keys {
+			{fourcc("TA0W"), {0x10, true, 0}},
+			{fourcc("TB0W"), {0x20, true, 0}},
+			{fourcc("TL0K"), {0x00, false, 0}},
+			{fourcc("TVOL"), {0x00, false, 0}},
+			{fourcc("XHI "), {0x30, true, 0}}
+		};
+
+		uint32_t crashKey {0};
+
+		const char *name() const override {
+			return "fake";
+		}
+
+		int keyInfo(uint32_t key, uint32_t *dataSize, uint32_t *dataType, uint8_t *dataAttributes) override {
+			auto it = keys.find(key);
+			if (it == keys.end())
+				return 0x84;
+			*dataSize = 1;
+			*dataType = fourcc("ui8 ");
+			*dataAttributes = it->second.writable ? 0xC0 : 0x80;
+			return 0;
+		}
+
+		int readKey(uint32_t key, uint32_t dataSize, char bytes[32]) override {
+			auto it = keys.find(key);
+			if (it == keys.end() || dataSize != 1)
+				return 0x84;
+			if (key == fourcc("TVOL"))
+				it->second.value++;
+			bytes[0] = static_cast<char>(it->second.value);
+			return 0;
+		}
+
+		int writeKey(uint32_t key, uint32_t dataSize, const char bytes[32]) override {
+			// Stands for a write crashing the target, the campaign is left between start and checkpoint.
+			if (key == crashKey)
+				throw std::runtime_error("crash");
+			auto it = keys.find(key);
+			if (it == keys.end() || dataSize != 1)
+				return 0x84;
+			if (!it->second.writable || (key == fourcc("TB0W") && static_cast<uint8_t>(bytes[0]) == 0xFF))
+				return 0x87;
+			it->second.value = static_cast<uint8_t>(bytes[0]);
+			it->second.writes++;
+			if (key == fourcc("TA0W"))
+				keys[fourcc("TL0K")].value++;
+			return 0;
+		}
+
+		int keyFromIndex(uint32_t, uint32_t *) override {
+			return 0x84;
+		}
+
+		size_t writes(const char *name) {
+			return keys[fourcc(name)].writes;
+		}
+	};
+
+	const std::vector<std::string> Listed {"TA0W", "TB0W", "TL0K", "TVOL"};
+
+	std::string hex(const std::string &value) {
+		std::string out;
+		char byte[3];
+		for (auto c : value) {
+			snprintf(byte, sizeof(byte), "%02x", static_cast<uint8_t>(c));
+			out += byte;
+		}
+		return out;
+	}
+
+	std::vector<std::string> hexValues(const char *strategy, uint32_t size, const char *type) {
+		auto values = SMCCampaignValues(strategy, size, type);
+		std::vector<std::string> out;
+		for (auto &v : values) {
+			CHECK_EQ(v.size(), size);
+			out.push_back(hex(v));
+		}
+		return out;
+	}
+
+	void writeCampaign(const char *contents) {
+		auto file = fopen(CampaignPath, "w");
+		CHECK(file);
+		if (file) {
+			fputs(contents, file);
+			fclose(file);
+		}
+	}
+
+	std::vector<std::string> readCampaign() {
+		std::vector<std::string> lines;
+		auto file = fopen(CampaignPath, "r");
+		CHECK(file);
+		char line[256];
+		while (file && fgets(line, sizeof(line), file)) {
+			line[strcspn(line, "\n")] = '\0';
+			lines.push_back(line);
+		}
+		if (file)
+			fclose(file);
+		return lines;
+	}
+
+	size_t countPrefix(const std::vector<std::string> &lines, const std::string &prefix) {
+		return std::count_if(lines.begin(), lines.end(), [&](const std::string &l) { return l.compare(0, prefix.size(), prefix) == 0; });
+	}
+
+	bool contains(const std::vector<std::string> &lines, const std::string &line) {
+		return std::find(lines.begin(), lines.end(), line) != lines.end();
+	}
+
+	void checkStrategies() {
+		using V = std::vector<std::string>;
+		auto byte = hexValues("byte", 2, "ui16");
+		CHECK_EQ(byte.size(), 0x100);
+		if (byte.size() == 0x100) {
+			CHECK(byte[0] == "0000");
+			CHECK(byte[0x7F] == "7f00");
+			CHECK(byte[0xFF] == "ff00");
+		}
+
+		V boundary {"00000000", "ffffffff", "00000001", "80000000", "7fffffff", "55555555", "aaaaaaaa"};
+		CHECK(hexValues("boundary", 4, "ui32") == boundary);
+		// Types without typed values use boundary values.
+		CHECK(hexValues("typed", 4, "{abc") == boundary);
+
+		CHECK(hexValues("typed", 1, "ui8 ") == (V {"00", "01", "80", "fe", "ff"}));
+		CHECK(hexValues("typed", 2, "si16") == (V {"0000", "0001", "ffff", "8000", "7fff"}));
+		CHECK(hexValues("typed", 1, "flag") == (V {"00", "01", "02", "ff"}));
+		CHECK(hexValues("typed", 2, "sp78") == (V {"0000", "0100", "ff00", "7fff", "8000"}));
+		CHECK(hexValues("typed", 2, "fp88") == (V {"0000", "0100", "0200", "ffff", "8000"}));
+		CHECK(hexValues("typed", 4, "ch8*") == (V {"41414141", "00000000", "7f7f7f7f", "ffffffff"}));
+
+		auto flt = SMCCampaignValues("typed", 4, "flt ");
+		CHECK_EQ(flt.size(), 7);
+		if (flt.size() == 7) {
+			float one = 1.0f;
+			CHECK(!memcmp(flt[1].data(), &one, sizeof(one)));
+		}
+	}
+}
+
+int main() {
+	checkStrategies();
+
+	// Accepted writes are reported with the non-volatile keys they changed.
+	FakeBackend backend;
+	remove(CampaignPath);
+	writeCampaign("key TA0W\nkey TB0W\nkey XHI \nstrategy typed\nrestore 1\n");
+	CHECK_EQ(SMCRunCampaign(&backend, Listed, CampaignPath), 0);
+	auto lines = readCampaign();
+	CHECK_EQ(countPrefix(lines, "write [TA0W] "), 5);
+	CHECK_EQ(countPrefix(lines, "write [TB0W] "), 4);
+	CHECK_EQ(countPrefix(lines, "write [XHI ] "), 5);
+	CHECK(contains(lines, "write [TA0W] 80 changed [TL0K]"));
+	CHECK(contains(lines, "write [TB0W] 80"));
+	CHECK(contains(lines, "write [XHI ] fe"));
+	CHECK_EQ(countPrefix(lines, "crash"), 0);
+	CHECK(contains(lines, "checkpoint 3"));
+	for (auto &line : lines)
+		CHECK(line.find("TVOL") == std::string::npos);
+	// Originals are restored after every accepted write.
+	CHECK_EQ(backend.keys[fourcc("TA0W")].value, 0x10);
+	CHECK_EQ(backend.writes("TA0W"), 10);
+	CHECK_EQ(backend.writes("TB0W"), 8);
+
+	// A finished campaign does not write again.
+	CHECK_EQ(SMCRunCampaign(&backend, Listed, CampaignPath), 0);
+	CHECK_EQ(backend.writes("TA0W"), 10);
+	CHECK(readCampaign().size() == lines.size());
+
+	// A missing campaign file is created with defaults over all listed keys by name.
+	remove(CampaignPath);
+	FakeBackend defaults;
+	CHECK_EQ(SMCRunCampaign(&defaults, Listed, CampaignPath), 0);
+	lines = readCampaign();
+	for (auto &key : Listed)
+		CHECK(contains(lines, "key " + key));
+	CHECK_EQ(countPrefix(lines, "keys "), 0);
+	CHECK(contains(lines, "strategy typed"));
+	CHECK(contains(lines, "checkpoint 4"));
+	CHECK_EQ(defaults.writes("TA0W"), 10);
+
+	// A run stopping while writing to a key resumes after it and records it as a crash.
+	FakeBackend crashing;
+	crashing.crashKey = fourcc("TB0W");
+	remove(CampaignPath);
+	writeCampaign("key TA0W\nkey TB0W\nkey XHI \nstrategy boundary\nrestore 0\n");
+	bool crashed = false;
+	try {
+		SMCRunCampaign(&crashing, Listed, CampaignPath);
+	} catch (const std::runtime_error &) {
+		crashed = true;
+	}
+	CHECK(crashed);
+	lines = readCampaign();
+	CHECK(contains(lines, "start 1"));
+	CHECK(contains(lines, "checkpoint 1"));
+	CHECK(!contains(lines, "checkpoint 2"));
+	CHECK_EQ(crashing.writes("TA0W"), 7);
+	CHECK_EQ(crashing.writes("XHI "), 0);
+
+	// Resuming with a different key list continues with the same keys.
+	crashing.crashKey = 0;
+	CHECK_EQ(SMCRunCampaign(&crashing, {"TA0A", "TA0W", "TB0W", "TL0K", "TVOL"}, CampaignPath), 0);
+	lines = readCampaign();
+	CHECK(contains(lines, "crash [TB0W]"));
+	CHECK(contains(lines, "checkpoint 2"));
+	CHECK(contains(lines, "checkpoint 3"));
+	CHECK_EQ(crashing.writes("TA0W"), 7);
+	CHECK_EQ(crashing.writes("TB0W"), 0);
+	CHECK_EQ(crashing.writes("XHI "), 7);
+	// Without restore the written key keeps the value and is not reported as changed.
+	CHECK_EQ(crashing.keys[fourcc("XHI ")].value, 0xaa);
+	CHECK(contains(lines, "write [XHI ] aa"));
+	CHECK(contains(lines, "write [TA0W] 55 changed [TL0K]"));
+	for (auto &line : lines)
+		CHECK(line.find("changed [XHI ]") == std::string::npos && line.find("changed [TA0W]") == std::string::npos);
+
+	// Listed key index ranges are rejected.
+	remove(CampaignPath);
+	writeCampaign("keys 0 1\nstrategy typed\n");
+	FakeBackend ranges;
+	CHECK(SMCRunCampaign(&ranges, Listed, CampaignPath) != 0);
+	CHECK_EQ(ranges.writes("TA0W"), 0);
+
+	remove(CampaignPath);
+	return vsmctestResult("campaign");
+}
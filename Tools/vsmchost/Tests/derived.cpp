@@ -0,0 +1,152 @@
+//
+//  derived.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <VirtualSMCSDK/kern_vsmcapi.hpp>
+#include <string.h>
+#include <initializer_list>
+
+#include "../../../VirtualSMC/kern_derived.hpp"
+#include "vsmctest.hpp"
+#include "vsmctestsmc.hpp"
+
+namespace {
+	constexpr int64_t One {1LL << 16};
+
+	int64_t fixed(double value) {
+		return static_cast<int64_t>(value * One);
+	}
+
+	uint32_t next(uint32_t &seed) {
+		seed = seed * 1103515245 + 12345;
+		return seed >> 8;
+	}
+
+	/**
+	 *  Compare flt conversion with the floating point casts it replaces
+	 */
+	void checkFloat(float f) {
+		SMC_DATA data[sizeof(float)];
+		memcpy(data, &f, sizeof(f));
+		int64_t value = 0;
+		CHECK(DerivedExpression::decode(data, sizeof(data), SmcKeyTypeFloat, value));
+		CHECK_EQ(value, static_cast<int64_t>(f * One));
+	}
+
+	void checkFixed(int64_t value) {
+		SMC_DATA data[sizeof(float)];
+		CHECK(DerivedExpression::encode(value, SmcKeyTypeFloat, sizeof(data), data));
+		float f = static_cast<float>(value) / One, encoded;
+		memcpy(&encoded, data, sizeof(encoded));
+		CHECK(!memcmp(&encoded, &f, sizeof(f)));
+	}
+
+	/**
+	 *  Compile and evaluate an expression
+	 */
+	void checkEval(VirtualSMCKeystore *keystore, const char *src, int64_t expected) {
+		DerivedExpression expr;
+		int64_t result = 0;
+		bool ok = expr.compile(src) && expr.evaluate(keystore, result);
+		if (!ok || result != expected)
+			fprintf(stderr, "expression %s\n", src);
+		CHECK(ok);
+		CHECK_EQ(result, expected);
+	}
+
+	void checkInvalid(const char *src) {
+		DerivedExpression expr;
+		if (expr.compile(src))
+			fprintf(stderr, "expression %s\n", src);
+		CHECK(!expr.compile(src));
+	}
+}
+
+int main() {
+	// flt contents are converted without floating point math and must match the casts.
+	for (float f : {0.0f, -0.0f, 1.0f, -1.5f, 0.1f, 1e-6f, -1e-5f, 1.0f / One, 3.0f / (4 * One), 1e9f, -123456.789f, 1e14f})
+		checkFloat(f);
+	for (int64_t v : std::initializer_list<int64_t> {0, 1, -1, One, -One, 3, 0xFFFFFF, 0x1FFFFFF, 0x2000001, 0x2000003, 0x7FFFFFFFFFFF, -0x123456789A})
+		checkFixed(v);
+	uint32_t seed = 1;
+	for (size_t i = 0; i < 1000000; i++) {
+		uint32_t bits = next(seed) << 8 | (next(seed) & 0xFF);
+		float f;
+		memcpy(&f, &bits, sizeof(f));
+		// Magnitudes from fixed point precision up to 2^40 to keep the reference cast defined.
+		if (((bits >> 23) & 0xFF) < 100 || ((bits >> 23) & 0xFF) >= 127 + 40)
+			continue;
+		checkFloat(f);
+		int64_t v = static_cast<int64_t>(next(seed)) << (next(seed) % 40);
+		checkFixed(i % 2 ? v : -v);
+	}
+	SMC_DATA nan[sizeof(uint32_t)] {0x00, 0x00, 0xC0, 0x7F};
+	int64_t value;
+	CHECK(!DerivedExpression::decode(nan, sizeof(nan), SmcKeyTypeFloat, value));
+
+	auto keystore = vsmctestStartService();
+	CHECK(keystore);
+	if (!keystore)
+		return vsmctestResult("derived");
+
+	// Sensor keys, including names with spaces and operator characters.
+	VirtualSMCAPI::Plugin plugin;
+	vsmctestInitPlugin(plugin, "sensors");
+	VirtualSMCAPI::addKey(SMC_MAKE_IDENTIFIER('X', 'T', '0', 'C'), plugin.data, VirtualSMCAPI::valueWithSp(40.5, SmcKeyTypeSp78));
+	VirtualSMCAPI::addKey(SMC_MAKE_IDENTIFIER('X', 'T', '1', 'C'), plugin.data, VirtualSMCAPI::valueWithSp(60.25, SmcKeyTypeSp78));
+	VirtualSMCAPI::addKey(SMC_MAKE_IDENTIFIER('X', 'T', '2', 'C'), plugin.data, VirtualSMCAPI::valueWithSp(50, SmcKeyTypeSp78));
+	VirtualSMCAPI::addKey(SMC_MAKE_IDENTIFIER('X', 'P', '0', 'R'), plugin.data, VirtualSMCAPI::valueWithFlt(2.5f));
+	VirtualSMCAPI::addKey(SMC_MAKE_IDENTIFIER('X', 'P', '1', 'R'), plugin.data, VirtualSMCAPI::valueWithFlt(1.25f));
+	VirtualSMCAPI::addKey(SMC_MAKE_IDENTIFIER('X', 'D', '1', ' '), plugin.data, VirtualSMCAPI::valueWithUint8(7));
+	VirtualSMCAPI::addKey(SMC_MAKE_IDENTIFIER('X', 'D', '-', 'W'), plugin.data, VirtualSMCAPI::valueWithSint16(-3));
+	CHECK_EQ(keystore->loadPlugin(&plugin), kIOReturnSuccess);
+
+	checkEval(keystore, "max(XT?C)", fixed(60.25));
+	checkEval(keystore, "min(XT?C)", fixed(40.5));
+	checkEval(keystore, "avg(XT?C)", (fixed(40.5) + fixed(60.25) + fixed(50)) / 3);
+	checkEval(keystore, "sum(XP*)", fixed(3.75));
+	checkEval(keystore, "sum(XT*, XP*, 1)", fixed(40.5 + 60.25 + 50 + 3.75 + 1));
+	checkEval(keystore, "XD1  * 2", fixed(14));
+	checkEval(keystore, "XD-W+1", fixed(-2));
+	checkEval(keystore, "max(XT0C, XT1C) - XT2C", fixed(10.25));
+	checkEval(keystore, "(XT0C + 1.5) / 2", fixed(21));
+	checkEval(keystore, "-XT0C * 0.5", fixed(-20.25));
+	checkEval(keystore, "max(min(XT?C), 45)", fixed(45));
+	checkEval(keystore, "XT0C / 0", 0);
+	checkEval(keystore, "XZ0C + 1", fixed(1));
+	checkEval(keystore, "avg(XZ*)", 0);
+
+	checkInvalid("XT?C");
+	checkInvalid("XT0C +");
+	checkInvalid("max(XT0C");
+	checkInvalid("foo(XT0C)");
+	checkInvalid("XT0");
+	checkInvalid("XT0C XT1C");
+	checkInvalid("max(max(max(max(max(XT0C)))))");
+	checkInvalid("1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1");
+
+	// Patterns are resolved again when plugins are loaded and unloaded.
+	DerivedExpression expr;
+	CHECK(expr.compile("max(XT?C)"));
+	int64_t result;
+	CHECK(expr.evaluate(keystore, result));
+	CHECK_EQ(result, fixed(60.25));
+	VirtualSMCAPI::Plugin extra;
+	vsmctestInitPlugin(extra, "extra");
+	VirtualSMCAPI::addKey(SMC_MAKE_IDENTIFIER('X', 'T', '3', 'C'), extra.data, VirtualSMCAPI::valueWithSp(70, SmcKeyTypeSp78));
+	CHECK_EQ(keystore->loadPlugin(&extra), kIOReturnSuccess);
+	CHECK(expr.evaluate(keystore, result));
+	CHECK_EQ(result, fixed(70));
+	CHECK_EQ(keystore->unloadPlugin(&extra), kIOReturnSuccess);
+	CHECK(expr.evaluate(keystore, result));
+	CHECK_EQ(result, fixed(60.25));
+	extra.data.deinit();
+
+	CHECK_EQ(keystore->unloadPlugin(&plugin), kIOReturnSuccess);
+	plugin.data.deinit();
+
+	return vsmctestResult("derived");
+}
@@ -0,0 +1,204 @@
+//
+//  discover.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "../../smc-fuzzer/discover.h"
+#include "vsmctest.hpp"
+
+namespace {
+	constexpr const char *CheckpointPath = "discover-test.txt";
+
+	uint32_t fourcc(const char *name) {
+		return static_cast<uint32_t>(static_cast<uint8_t>(name[0])) << 24 | static_cast<uint32_t>(static_cast<uint8_t>(name[1])) << 16 |
+			static_cast<uint32_t>(static_cast<uint8_t>(name[2])) << 8 | static_cast<uint32_t>(static_cast<uint8_t>(name[3]));
+	}
+
+	/**
+	 *  Counts calls made to the wrapped backend from several discovery threads
+	 */
+	struct CountingBackend : SMCBackend {
+		SMCBackend *backend;
+		uint32_t watched {0};
+		std::atomic<size_t> infos {0};
+		std::atomic<size_t> reads {0};
+		std::atomic<size_t> watchedInfos {0};
+
+		explicit CountingBackend(SMCBackend *backend) : backend(backend) {}
+
+		const char *name() const override {
+			return backend->name();
+		}
+
+		int keyInfo(uint32_t key, uint32_t *dataSize, uint32_t *dataType, uint8_t *dataAttributes) override {
+			infos++;
+			if (key == watched)
+				watchedInfos++;
+			return backend->keyInfo(key, dataSize, dataType, dataAttributes);
+		}
+
+		int readKey(uint32_t key, uint32_t dataSize, char bytes[32]) override {
+			reads++;
+			return backend->readKey(key, dataSize, bytes);
+		}
+
+		int writeKey(uint32_t key, uint32_t dataSize, const char bytes[32]) override {
+			return backend->writeKey(key, dataSize, bytes);
+		}
+
+		int keyFromIndex(uint32_t index, uint32_t *key) override {
+			return backend->keyFromIndex(index, key);
+		}
+	};
+
+	std::vector<uint8_t> validChars() {
+		std::vector<uint8_t> chars;
+		for (int c = 0; c < 256; c++)
+			if (SMCKeyCharValid(static_cast<uint8_t>(c)))
+				chars.push_back(static_cast<uint8_t>(c));
+		return chars;
+	}
+
+	/**
+	 *  Checkpoint with every shard done except the ones with the given prefixes
+	 */
+	void writeCheckpoint(const std::vector<std::string> &pending, const char *extra) {
+		auto file = fopen(CheckpointPath, "w");
+		CHECK(file);
+		if (!file)
+			return;
+		auto chars = validChars();
+		for (auto a : chars) {
+			for (auto b : chars) {
+				std::string prefix {static_cast<char>(a), static_cast<char>(b)};
+				if (std::find(pending.begin(), pending.end(), prefix) == pending.end())
+					fprintf(file, "done %02x%02x\n", a, b);
+			}
+		}
+		fputs(extra, file);
+		fclose(file);
+	}
+
+	std::vector<std::string> readCheckpoint() {
+		std::vector<std::string> lines;
+		auto file = fopen(CheckpointPath, "r");
+		CHECK(file);
+		char line[64];
+		while (file && fgets(line, sizeof(line), file)) {
+			line[strcspn(line, "\n")] = '\0';
+			lines.push_back(line);
+		}
+		if (file)
+			fclose(file);
+		return lines;
+	}
+
+	size_t countLine(const std::vector<std::string> &lines, const std::string &line) {
+		return std::count(lines.begin(), lines.end(), line);
+	}
+
+	size_t countPrefix(const std::vector<std::string> &lines, const std::string &prefix) {
+		return std::count_if(lines.begin(), lines.end(), [&](const std::string &l) { return l.compare(0, prefix.size(), prefix) == 0; });
+	}
+
+	std::vector<std::string> names(const std::vector<SMCFoundKey> &found) {
+		std::vector<std::string> out;
+		for (auto &key : found) {
+			char name[5] {static_cast<char>(key.key >> 24), static_cast<char>(key.key >> 16), static_cast<char>(key.key >> 8), static_cast<char>(key.key), '\0'};
+			out.push_back(name);
+		}
+		return out;
+	}
+}
+
+int main() {
+	auto vsmc = SMCCreateVirtualSMCBackend(nullptr, nullptr, nullptr);
+	CHECK(vsmc);
+	if (!vsmc)
+		return vsmctestResult("discover");
+
+	// Listed keys, like SMCGetKeys.
+	std::vector<std::string> listed;
+	char count[32] {};
+	uint32_t countSize = 0, countType = 0;
+	uint8_t countAttr = 0;
+	CHECK_EQ(vsmc->keyInfo(fourcc("#KEY"), &countSize, &countType, &countAttr), 0);
+	CHECK_EQ(vsmc->readKey(fourcc("#KEY"), countSize, count), 0);
+	uint32_t total = static_cast<uint8_t>(count[2]) << 8 | static_cast<uint8_t>(count[3]);
+	for (uint32_t i = 0; i < total; i++) {
+		uint32_t key = 0;
+		CHECK_EQ(vsmc->keyFromIndex(i, &key), 0);
+		char name[5] {static_cast<char>(key >> 24), static_cast<char>(key >> 16), static_cast<char>(key >> 8), static_cast<char>(key), '\0'};
+		listed.push_back(name);
+	}
+
+	// Resume from a checkpoint where only a few shards are left, one of them already
+	// found in a previous run. Listed keys in the pending shards are not probed.
+	std::vector<std::string> pending {"#K", "KP", "OS"};
+	size_t chars = validChars().size();
+	size_t listedPending = std::count_if(listed.begin(), listed.end(), [&](const std::string &key) {
+		return std::find(pending.begin(), pending.end(), key.substr(0, 2)) != pending.end();
+	});
+	CHECK(listedPending > 0);
+	writeCheckpoint(pending, "found 5f5f5f5f 666c6167 1 80\n");
+
+	CountingBackend backend(vsmc);
+	backend.watched = fourcc("#KEY");
+	std::vector<SMCFoundKey> found;
+	uint64_t probes = 0;
+	CHECK_EQ(SMCDiscoverKeys(&backend, listed, 3, CheckpointPath, found, &probes), 0);
+	CHECK_EQ(probes, pending.size() * chars * chars - listedPending);
+	// Every candidate costs one key info call and found keys are not read again.
+	CHECK_EQ(backend.infos.load(), probes);
+	CHECK_EQ(backend.reads.load(), 0);
+	CHECK_EQ(backend.watchedInfos.load(), 0);
+	CHECK(names(found) == (std::vector<std::string> {"KPPW", "KPST", "OSK0", "OSK1", "____"}));
+	if (found.size() == 5) {
+		CHECK_EQ(found[0].dataSize, 32);
+		CHECK_EQ(found[0].dataType, fourcc("ch8*"));
+		CHECK_EQ(found[1].dataSize, 1);
+		CHECK_EQ(found[1].dataType, fourcc("ui8 "));
+		CHECK_EQ(found[4].dataAttributes, 0x80);
+	}
+
+	// Pending shards and their hits are appended, the others are not probed again.
+	auto lines = readCheckpoint();
+	CHECK_EQ(countPrefix(lines, "done "), chars * chars);
+	CHECK_EQ(countLine(lines, "done 234b"), 1);
+	CHECK_EQ(countLine(lines, "done 4b50"), 1);
+	CHECK_EQ(countLine(lines, "done 4f53"), 1);
+	CHECK_EQ(countPrefix(lines, "found "), 5);
+	CHECK_EQ(countLine(lines, "found 4b505057 6368382a 32 50"), 1);
+
+	// A finished checkpoint probes nothing and returns the same keys.
+	CountingBackend finished(vsmc);
+	std::vector<SMCFoundKey> again;
+	CHECK_EQ(SMCDiscoverKeys(&finished, listed, 2, CheckpointPath, again, &probes), 0);
+	CHECK_EQ(probes, 0);
+	CHECK_EQ(finished.infos.load(), 0);
+	CHECK(names(again) == names(found));
+	CHECK(readCheckpoint() == lines);
+
+	// Found keys without key info are probed once when resuming.
+	writeCheckpoint({}, "found 4b505354\n");
+	CountingBackend legacy(vsmc);
+	CHECK_EQ(SMCDiscoverKeys(&legacy, listed, 1, CheckpointPath, found, &probes), 0);
+	CHECK_EQ(probes, 1);
+	CHECK_EQ(legacy.infos.load(), 1);
+	CHECK(names(found) == (std::vector<std::string> {"KPST"}));
+	if (found.size() == 1)
+		CHECK_EQ(found[0].dataType, fourcc("ui8 "));
+
+	remove(CheckpointPath);
+	delete vsmc;
+	return vsmctestResult("discover");
+}
@@ -0,0 +1,151 @@
+//
+//  keychanges.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <VirtualSMCSDK/kern_vsmcapi.hpp>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "vsmctest.hpp"
+#include "vsmctestsmc.hpp"
+
+namespace {
+	constexpr SMC_KEY Key0 = SMC_MAKE_IDENTIFIER('T', 'K', '0', 'P');
+	constexpr SMC_KEY Key1 = SMC_MAKE_IDENTIFIER('T', 'K', '1', 'P');
+	constexpr SMC_KEY Key2 = SMC_MAKE_IDENTIFIER('T', 'K', '2', 'P');
+	constexpr SMC_KEY KeyReadOnly = SMC_MAKE_IDENTIFIER('T', 'K', '3', 'P');
+
+	/**
+	 *  Delivered batches, optionally writing a key from the next call
+	 */
+	struct Recorder {
+		VirtualSMCKeystore *keystore {nullptr};
+		SMC_KEY writeFromHandler {0};
+		std::vector<std::vector<SMC_KEY>> batches;
+	};
+
+	void recordingHandler(void *context, const SMC_KEY *keys, size_t count) {
+		auto recorder = static_cast<Recorder *>(context);
+		recorder->batches.emplace_back(keys, keys + count);
+		if (recorder->writeFromHandler) {
+			SMC_DATA value = 0x55;
+			CHECK_EQ(recorder->keystore->writeValueByName(recorder->writeFromHandler, &value), SmcSuccess);
+			recorder->writeFromHandler = 0;
+		}
+	}
+
+	void write(VirtualSMCKeystore *keystore, SMC_KEY key, SMC_RESULT expected = SmcSuccess) {
+		static SMC_DATA value = 0;
+		value++;
+		CHECK_EQ(keystore->writeValueByName(key, &value), expected);
+	}
+
+	void sleepMs(uint32_t ms) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+	}
+
+	bool batchIs(const Recorder &recorder, size_t index, std::vector<SMC_KEY> keys) {
+		return index < recorder.batches.size() && recorder.batches[index] == keys;
+	}
+}
+
+int main() {
+	auto keystore = vsmctestStartService();
+	CHECK(keystore);
+	if (!keystore)
+		return vsmctestResult("keychanges");
+
+	// Drop anything scheduled during startup.
+	vsmchostRunTimers(true);
+
+	constexpr SMC_KEY_ATTRIBUTES rw = SMC_KEY_ATTRIBUTE_READ | SMC_KEY_ATTRIBUTE_WRITE;
+	VirtualSMCAPI::Plugin plugin;
+	vsmctestInitPlugin(plugin, "keychanges");
+	CHECK(VirtualSMCAPI::addKey(Key0, plugin.data, VirtualSMCAPI::valueWithUint8(0, nullptr, rw)));
+	CHECK(VirtualSMCAPI::addKey(Key1, plugin.data, VirtualSMCAPI::valueWithUint8(0, nullptr, rw)));
+	CHECK(VirtualSMCAPI::addKey(Key2, plugin.data, VirtualSMCAPI::valueWithUint8(0, nullptr, rw)));
+	CHECK(VirtualSMCAPI::addKey(KeyReadOnly, plugin.data, VirtualSMCAPI::valueWithUint8(0)));
+	CHECK_EQ(keystore->loadPlugin(&plugin), kIOReturnSuccess);
+
+	// Keys are reported in subscription order, which differs from the sorted storage.
+	const SMC_KEY ordered[] {Key2, Key0, Key1, KeyReadOnly};
+	const SMC_KEY single[] {Key1};
+	Recorder first, second;
+	first.keystore = second.keystore = keystore;
+	auto firstSub = keystore->subscribeKeys(&plugin, ordered, 4, recordingHandler, &first);
+	auto secondSub = keystore->subscribeKeys(&plugin, single, 1, recordingHandler, &second);
+	CHECK(firstSub && secondSub);
+
+	// Nothing is delivered before the batch interval expires.
+	write(keystore, Key1);
+	vsmchostRunTimers(false);
+	CHECK_EQ(first.batches.size(), 0);
+
+	// Writes within the interval join the batch, each key is reported once in subscription order.
+	write(keystore, Key0);
+	write(keystore, Key1);
+	write(keystore, Key2);
+	write(keystore, KeyReadOnly, SmcNotWritable);
+	sleepMs(20);
+	vsmchostRunTimers(false);
+	CHECK_EQ(first.batches.size(), 1);
+	CHECK(batchIs(first, 0, {Key2, Key0, Key1}));
+	CHECK_EQ(second.batches.size(), 1);
+	CHECK(batchIs(second, 0, {Key1}));
+
+	// Writes after the delivery start a new batch, later writes do not postpone it.
+	write(keystore, Key0);
+	sleepMs(6);
+	write(keystore, Key1);
+	sleepMs(6);
+	vsmchostRunTimers(false);
+	CHECK_EQ(first.batches.size(), 2);
+	CHECK(batchIs(first, 1, {Key0, Key1}));
+	CHECK_EQ(second.batches.size(), 2);
+
+	// Nothing is delivered without writes.
+	sleepMs(20);
+	vsmchostRunTimers(false);
+	CHECK_EQ(first.batches.size(), 2);
+	CHECK_EQ(second.batches.size(), 2);
+
+	// Writes from the last handler are delivered in the next batch.
+	second.writeFromHandler = Key0;
+	write(keystore, Key1);
+	vsmchostRunTimers(true);
+	CHECK_EQ(first.batches.size(), 3);
+	CHECK(batchIs(first, 2, {Key1}));
+	CHECK_EQ(second.batches.size(), 3);
+	vsmchostRunTimers(true);
+	CHECK_EQ(first.batches.size(), 4);
+	CHECK(batchIs(first, 3, {Key0}));
+	CHECK_EQ(second.batches.size(), 3);
+
+	// Cancelled subscriptions are not called for pending writes.
+	write(keystore, Key1);
+	keystore->unsubscribeKeys(secondSub);
+	vsmchostRunTimers(true);
+	CHECK_EQ(first.batches.size(), 5);
+	CHECK_EQ(second.batches.size(), 3);
+
+	// Unloading the plugin cancels its remaining subscriptions.
+	CHECK_EQ(keystore->unloadPlugin(&plugin), kIOReturnSuccess);
+	plugin.data.deinit();
+	CHECK(!keystore->subscribeKeys(&plugin, single, 1, recordingHandler, &first));
+
+	VirtualSMCAPI::Plugin other;
+	vsmctestInitPlugin(other, "keychanges");
+	CHECK(VirtualSMCAPI::addKey(Key1, other.data, VirtualSMCAPI::valueWithUint8(0, nullptr, rw)));
+	CHECK_EQ(keystore->loadPlugin(&other), kIOReturnSuccess);
+	write(keystore, Key1);
+	vsmchostRunTimers(true);
+	CHECK_EQ(first.batches.size(), 5);
+	CHECK_EQ(keystore->unloadPlugin(&other), kIOReturnSuccess);
+	other.data.deinit();
+
+	return vsmctestResult("keychanges");
+}
@@ -0,0 +1,151 @@
+//
+//  keystorage.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <VirtualSMCSDK/kern_vsmcapi.hpp>
+#include <set>
+#include <vector>
+
+#include "vsmctest.hpp"
+#include "vsmctestsmc.hpp"
+
+namespace {
+	/**
+	 *  Value counting live instances to check that rejected values are freed
+	 */
+	struct CountedValue : VirtualSMCValue {
+		static inline int alive {0};
+		CountedValue() { alive++; }
+		~CountedValue() override { alive--; }
+	};
+
+	VirtualSMCValue *counted(uint8_t contents) {
+		return VirtualSMCAPI::valueWithUint8(contents, new CountedValue);
+	}
+
+	/**
+	 *  Contents derived from the last two key characters
+	 */
+	uint8_t contents(SMC_KEY key) {
+		return static_cast<uint8_t>((key >> 16) ^ (key >> 24));
+	}
+
+	uint32_t next(uint32_t &seed) {
+		seed = seed * 1103515245 + 12345;
+		return seed >> 8;
+	}
+
+	/**
+	 *  Keys from a small alphabet to get plenty of duplicates
+	 */
+	SMC_KEY randomKey(uint32_t &seed) {
+		auto r = next(seed);
+		return SMC_MAKE_IDENTIFIER('T', 'A' + r % 4, 'a' + (r >> 2) % 8, '0' + (r >> 5) % 10);
+	}
+
+	bool sorted(const VirtualSMCAPI::KeyStorage &data) {
+		for (size_t i = 1; i < data.size(); i++)
+			if (VirtualSMCKeyValue::compare(data[i - 1].key, data[i].key) >= 0)
+				return false;
+		return true;
+	}
+
+	/**
+	 *  Insert keys and check the storage against a reference set
+	 */
+	void checkInserts(const std::vector<SMC_KEY> &keys) {
+		VirtualSMCAPI::KeyStorage data;
+		std::set<uint32_t> reference;
+		for (auto key : keys) {
+			bool fresh = reference.insert(OSSwapInt32(key)).second;
+			CHECK_EQ(VirtualSMCAPI::addKey(key, data, counted(contents(key))), fresh);
+			CHECK_EQ(CountedValue::alive, static_cast<int>(reference.size()));
+		}
+		CHECK(sorted(data));
+		CHECK_EQ(data.size(), reference.size());
+		size_t i = 0;
+		for (auto key : reference) {
+			if (i < data.size()) {
+				CHECK_EQ(data[i].key, OSSwapInt32(key));
+				SMC_DATA_SIZE size;
+				auto value = atomic_load_explicit(&data[i].value, memory_order_relaxed);
+				CHECK_EQ(value->get(size)[0], contents(OSSwapInt32(key)));
+			}
+			i++;
+		}
+		data.deinit();
+		CHECK_EQ(CountedValue::alive, 0);
+	}
+}
+
+int main() {
+	auto keystore = vsmctestStartService();
+	CHECK(keystore);
+	if (!keystore)
+		return vsmctestResult("keystorage");
+
+	uint32_t seed = 1;
+	for (size_t round = 0; round < 50; round++) {
+		std::vector<SMC_KEY> keys;
+		for (size_t i = 0; i < 1 + next(seed) % 300; i++)
+			keys.push_back(randomKey(seed));
+		checkInserts(keys);
+	}
+
+	// Ascending and descending order, every insertion at the end or at the front.
+	std::vector<SMC_KEY> ascending;
+	for (char c = 'A'; c <= 'Z'; c++)
+		for (char d = '0'; d <= '9'; d++)
+			ascending.push_back(SMC_MAKE_IDENTIFIER('F', c, d, 'x'));
+	checkInserts(ascending);
+	checkInserts(std::vector<SMC_KEY>(ascending.rbegin(), ascending.rend()));
+
+	// Aliases are inserted in order and rejected when duplicate or missing a target.
+	VirtualSMCAPI::KeyStorage data;
+	CHECK(VirtualSMCAPI::addKey(SMC_MAKE_IDENTIFIER('T', 'C', '0', 'P'), data, counted(1)));
+	CHECK(VirtualSMCAPI::addAlias(SMC_MAKE_IDENTIFIER('T', 'C', '0', 'D'), data, SMC_MAKE_IDENTIFIER('T', 'C', '0', 'P')));
+	CHECK(VirtualSMCAPI::addAlias(SMC_MAKE_IDENTIFIER('T', 'C', '0', 'E'), data, SMC_MAKE_IDENTIFIER('T', 'C', '0', 'P')));
+	CHECK(!VirtualSMCAPI::addAlias(SMC_MAKE_IDENTIFIER('T', 'C', '0', 'D'), data, SMC_MAKE_IDENTIFIER('T', 'C', '0', 'P')));
+	CHECK(!VirtualSMCAPI::addAlias(SMC_MAKE_IDENTIFIER('T', 'C', '0', 'F'), data, SMC_MAKE_IDENTIFIER('T', 'C', '1', 'P')));
+	CHECK_EQ(data.size(), 3);
+	CHECK(sorted(data));
+	data.deinit();
+	CHECK_EQ(CountedValue::alive, 0);
+
+	// Plugins with storage not built by addKey are rejected before anything is loaded.
+	VirtualSMCAPI::Plugin unsorted;
+	vsmctestInitPlugin(unsorted, "unsorted");
+	unsorted.data.push_back(VirtualSMCKeyValue::create(SMC_MAKE_IDENTIFIER('T', 'S', '1', 'P'), counted(1)));
+	unsorted.data.push_back(VirtualSMCKeyValue::create(SMC_MAKE_IDENTIFIER('T', 'S', '0', 'P'), counted(2)));
+	CHECK_EQ(keystore->loadPlugin(&unsorted), kIOReturnBadArgument);
+	unsorted.data.deinit();
+
+	VirtualSMCAPI::Plugin duplicate;
+	vsmctestInitPlugin(duplicate, "duplicate");
+	duplicate.dataHidden.push_back(VirtualSMCKeyValue::create(SMC_MAKE_IDENTIFIER('T', 'S', '0', 'P'), counted(1)));
+	duplicate.dataHidden.push_back(VirtualSMCKeyValue::create(SMC_MAKE_IDENTIFIER('T', 'S', '0', 'P'), counted(2)));
+	CHECK_EQ(keystore->loadPlugin(&duplicate), kIOReturnBadArgument);
+	duplicate.dataHidden.deinit();
+	CHECK_EQ(CountedValue::alive, 0);
+
+	SMC_DATA value[SMC_MAX_DATA_SIZE];
+	SMC_DATA_SIZE size;
+	CHECK_EQ(keystore->readValueByName(SMC_MAKE_IDENTIFIER('T', 'S', '0', 'P'), value, size), SmcNotFound);
+
+	// Storage built with addKey in any order loads.
+	VirtualSMCAPI::Plugin plugin;
+	vsmctestInitPlugin(plugin, "sorted");
+	for (auto key : {SMC_MAKE_IDENTIFIER('T', 'S', '1', 'P'), SMC_MAKE_IDENTIFIER('T', 'S', '0', 'P'), SMC_MAKE_IDENTIFIER('T', 'S', '2', 'P')})
+		CHECK(VirtualSMCAPI::addKey(key, plugin.data, counted(key >> 16)));
+	CHECK_EQ(keystore->loadPlugin(&plugin), kIOReturnSuccess);
+	CHECK_EQ(keystore->readValueByName(SMC_MAKE_IDENTIFIER('T', 'S', '0', 'P'), value, size), SmcSuccess);
+	CHECK_EQ(value[0], '0');
+	CHECK_EQ(keystore->unloadPlugin(&plugin), kIOReturnSuccess);
+	plugin.data.deinit();
+	CHECK_EQ(CountedValue::alive, 0);
+
+	return vsmctestResult("keystorage");
+}
@@ -0,0 +1,119 @@
+//
+//  maxage.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <Headers/kern_time.hpp>
+#include <VirtualSMCSDK/kern_vsmcapi.hpp>
+#include <chrono>
+#include <thread>
+
+#include "vsmctest.hpp"
+#include "vsmctestsmc.hpp"
+
+namespace {
+	constexpr uint64_t MaxAgeNs {convertMsToNs(20)};
+
+	/**
+	 *  Published value refreshed by readAccess like SMCSuperIO tachometers do it
+	 */
+	struct RefreshingValue : VirtualSMCValue {
+		int refreshes {0};
+		SMC_DATA contents {0};
+		SMC_RESULT readAccess() override {
+			refreshes++;
+			contents++;
+			return publish(&contents) ? SmcSuccess : SmcCommCollision;
+		}
+	};
+
+	/**
+	 *  Published value of a plugin with a stalled timer and no refresh hook
+	 */
+	struct StalledValue : VirtualSMCValue {
+		int refreshes {0};
+		SMC_RESULT readAccess() override {
+			refreshes++;
+			return SmcSuccess;
+		}
+	};
+
+	constexpr SMC_KEY KeyRefreshing = SMC_MAKE_IDENTIFIER('T', 'M', '0', 'P');
+	constexpr SMC_KEY KeyStalled = SMC_MAKE_IDENTIFIER('T', 'M', '1', 'P');
+	constexpr SMC_KEY KeyUnlimited = SMC_MAKE_IDENTIFIER('T', 'M', '2', 'P');
+
+	void waitStale() {
+		std::this_thread::sleep_for(std::chrono::nanoseconds(2 * MaxAgeNs));
+	}
+}
+
+int main() {
+	auto keystore = vsmctestStartService();
+	CHECK(keystore);
+	if (!keystore)
+		return vsmctestResult("maxage");
+
+	auto refreshing = new RefreshingValue;
+	auto stalled = new StalledValue;
+	auto unlimited = new StalledValue;
+	VirtualSMCAPI::Plugin plugin;
+	vsmctestInitPlugin(plugin, "maxage");
+	CHECK(VirtualSMCAPI::addKey(KeyRefreshing, plugin.data, VirtualSMCAPI::valueWithUint8(0, refreshing)));
+	CHECK(VirtualSMCAPI::addKey(KeyStalled, plugin.data, VirtualSMCAPI::valueWithUint8(0, stalled)));
+	CHECK(VirtualSMCAPI::addKey(KeyUnlimited, plugin.data, VirtualSMCAPI::valueWithUint8(0, unlimited)));
+	refreshing->setMaxAge(MaxAgeNs);
+	stalled->setMaxAge(MaxAgeNs);
+	CHECK_EQ(keystore->loadPlugin(&plugin), kIOReturnSuccess);
+
+	SMC_DATA value[SMC_MAX_DATA_SIZE];
+	SMC_DATA_SIZE size;
+
+	// Values are refreshed by readAccess until published for the first time.
+	CHECK_EQ(keystore->readValueByName(KeyStalled, value, size), SmcSuccess);
+	CHECK_EQ(stalled->refreshes, 1);
+	CHECK_EQ(keystore->readValueByName(KeyRefreshing, value, size), SmcSuccess);
+	CHECK_EQ(refreshing->refreshes, 1);
+	CHECK_EQ(value[0], 1);
+
+	// Fresh published values are copied without readAccess.
+	SMC_DATA published = 0x40;
+	CHECK(stalled->publish(&published));
+	CHECK(unlimited->publish(&published));
+	CHECK_EQ(keystore->readValueByName(KeyStalled, value, size), SmcSuccess);
+	CHECK_EQ(value[0], 0x40);
+	CHECK_EQ(keystore->readValueByName(KeyRefreshing, value, size), SmcSuccess);
+	CHECK_EQ(stalled->refreshes, 1);
+	CHECK_EQ(refreshing->refreshes, 1);
+
+	waitStale();
+
+	// Stale values are refreshed on read, and fail when the refresh does not publish.
+	CHECK_EQ(keystore->readValueByName(KeyRefreshing, value, size), SmcSuccess);
+	CHECK_EQ(refreshing->refreshes, 2);
+	CHECK_EQ(value[0], 2);
+	CHECK_EQ(keystore->readValueByName(KeyStalled, value, size), SmcTimeoutError);
+	CHECK_EQ(stalled->refreshes, 2);
+
+	// Values without a policy never get stale unless the reader asks for it.
+	CHECK_EQ(keystore->readValueByName(KeyUnlimited, value, size), SmcSuccess);
+	CHECK_EQ(unlimited->refreshes, 0);
+	CHECK_EQ(keystore->readValueByName(KeyUnlimited, value, size, MaxAgeNs), SmcTimeoutError);
+	CHECK_EQ(unlimited->refreshes, 1);
+
+	// Readers may allow older contents than the value policy.
+	CHECK_EQ(keystore->readValueByName(KeyStalled, value, size, convertScToNs(60)), SmcSuccess);
+	CHECK_EQ(value[0], 0x40);
+
+	// Publishing again makes the value readable.
+	published = 0x41;
+	CHECK(stalled->publish(&published));
+	CHECK_EQ(keystore->readValueByName(KeyStalled, value, size), SmcSuccess);
+	CHECK_EQ(value[0], 0x41);
+
+	CHECK_EQ(keystore->unloadPlugin(&plugin), kIOReturnSuccess);
+	plugin.data.deinit();
+
+	return vsmctestResult("maxage");
+}
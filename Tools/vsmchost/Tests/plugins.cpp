@@ -0,0 +1,309 @@
+//
+//  plugins.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <VirtualSMCSDK/kern_vsmcapi.hpp>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "vsmctest.hpp"
+#include "vsmctestsmc.hpp"
+
+namespace {
+	constexpr SMC_KEY KeyRBr = SMC_MAKE_IDENTIFIER('R', 'B', 'r', ' ');
+	constexpr SMC_KEY KeyRPlt = SMC_MAKE_IDENTIFIER('R', 'P', 'l', 't');
+	constexpr SMC_KEY KeyWatched = SMC_MAKE_IDENTIFIER('T', 'W', '0', 'P');
+
+	constexpr SMC_DATA Override[8] {'o', 'v', 'e', 'r', 'r', 'i', 'd', 'e'};
+
+	VirtualSMCValue *overrideValue() {
+		return VirtualSMCAPI::valueWithData(Override, sizeof(Override), SmcKeyTypeCh8s);
+	}
+
+	/**
+	 *  Plugin keys contents are the plugin number
+	 */
+	SMC_KEY pluginKey(size_t plugin, size_t index) {
+		return SMC_MAKE_IDENTIFIER('T', 'C', '0' + plugin, 'a' + index);
+	}
+
+	constexpr size_t Loaders {4};
+	constexpr size_t KeysPerPlugin {8};
+	constexpr size_t Rounds {300};
+
+	/**
+	 *  Key change handler state, handlers cancel subscriptions and try to unload plugins
+	 */
+	struct HandlerState {
+		VirtualSMCKeystore *keystore {nullptr};
+		VirtualSMCAPI::Plugin *plugin {nullptr};
+		VirtualSMCAPI::KeySubscription *self {nullptr};
+		VirtualSMCAPI::KeySubscription *other {nullptr};
+		IOReturn unloadResult {kIOReturnSuccess};
+		int calls {0};
+	};
+
+	void cancellingHandler(void *context, const SMC_KEY *, size_t) {
+		auto state = static_cast<HandlerState *>(context);
+		state->calls++;
+		state->unloadResult = state->keystore->unloadPlugin(state->plugin);
+		state->keystore->unsubscribeKeys(state->other);
+		state->keystore->unsubscribeKeys(state->self);
+	}
+
+	void countingHandler(void *context, const SMC_KEY *, size_t) {
+		static_cast<HandlerState *>(context)->calls++;
+	}
+
+	/**
+	 *  Slow handler calling back into the keystore while other threads unload plugins and cancel it
+	 */
+	struct SlowState {
+		VirtualSMCKeystore *keystore {nullptr};
+		VirtualSMCAPI::Plugin *plugin {nullptr};
+		VirtualSMCAPI::KeySubscription *other {nullptr};
+		std::atomic<bool> entered {false};
+		std::atomic<bool> finished {false};
+		bool resubscribed {false};
+	};
+
+	void slowHandler(void *context, const SMC_KEY *, size_t) {
+		auto state = static_cast<SlowState *>(context);
+		state->entered = true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		auto sub = state->keystore->subscribeKeys(state->plugin, &KeyWatched, 1, countingHandler, nullptr);
+		state->resubscribed = sub != nullptr;
+		if (sub)
+			state->keystore->unsubscribeKeys(sub);
+		state->keystore->unsubscribeKeys(state->other);
+		state->finished = true;
+	}
+
+	void waitEntered(const SlowState &state) {
+		while (!state.entered)
+			std::this_thread::yield();
+	}
+
+	void sleepingHandler(void *context, const SMC_KEY *, size_t) {
+		auto state = static_cast<SlowState *>(context);
+		state->entered = true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		state->finished = true;
+	}
+}
+
+int main() {
+	auto keystore = vsmctestStartService();
+	CHECK(keystore);
+	if (!keystore)
+		return vsmctestResult("plugins");
+
+	SMC_DATA original[SMC_MAX_DATA_SIZE], value[SMC_MAX_DATA_SIZE];
+	SMC_DATA_SIZE originalSize, size;
+	CHECK_EQ(keystore->readValueByName(KeyRPlt, original, originalSize), SmcSuccess);
+	CHECK_EQ(originalSize, sizeof(Override));
+
+	// A second override of the same key is rejected without modifying the plugin storage,
+	// even when other keys it overrides come first.
+	VirtualSMCAPI::Plugin first, second;
+	vsmctestInitPlugin(first, "first");
+	vsmctestInitPlugin(second, "second");
+	CHECK(VirtualSMCAPI::addKey(KeyRPlt, first.data, overrideValue()));
+	CHECK(VirtualSMCAPI::addKey(pluginKey(0, 0), second.data, VirtualSMCAPI::valueWithUint8(1)));
+	CHECK(VirtualSMCAPI::addKey(KeyRBr, second.data, overrideValue()));
+	CHECK(VirtualSMCAPI::addKey(KeyRPlt, second.data, overrideValue()));
+	CHECK_EQ(keystore->loadPlugin(&first), kIOReturnSuccess);
+	CHECK_EQ(first.data.size(), 0);
+	CHECK_EQ(keystore->loadPlugin(&second), kIOReturnExclusiveAccess);
+	CHECK_EQ(second.data.size(), 3);
+	for (size_t i = 0; i < second.data.size(); i++)
+		CHECK(atomic_load_explicit(&second.data[i].value, memory_order_relaxed) != nullptr);
+	CHECK_EQ(keystore->readValueByName(pluginKey(0, 0), value, size), SmcNotFound);
+
+	// Once the first override is gone, the same storage loads.
+	CHECK_EQ(keystore->unloadPlugin(&first), kIOReturnSuccess);
+	CHECK_EQ(keystore->loadPlugin(&second), kIOReturnSuccess);
+	CHECK_EQ(keystore->readValueByName(KeyRPlt, value, size), SmcSuccess);
+	CHECK(!memcmp(value, Override, sizeof(Override)));
+	CHECK_EQ(keystore->unloadPlugin(&second), kIOReturnSuccess);
+	CHECK_EQ(keystore->readValueByName(KeyRPlt, value, size), SmcSuccess);
+	CHECK(!memcmp(value, original, originalSize));
+	first.data.deinit();
+	second.data.deinit();
+
+	// Handlers may cancel subscriptions, but cannot unload plugins.
+	VirtualSMCAPI::Plugin watched;
+	vsmctestInitPlugin(watched, "watched");
+	CHECK(VirtualSMCAPI::addKey(KeyWatched, watched.data,
+		VirtualSMCAPI::valueWithUint8(0, nullptr, SMC_KEY_ATTRIBUTE_READ | SMC_KEY_ATTRIBUTE_WRITE)));
+	CHECK_EQ(keystore->loadPlugin(&watched), kIOReturnSuccess);
+
+	HandlerState cancelling, counting;
+	cancelling.keystore = keystore;
+	cancelling.plugin = &watched;
+	cancelling.self = keystore->subscribeKeys(&watched, &KeyWatched, 1, cancellingHandler, &cancelling);
+	cancelling.other = keystore->subscribeKeys(&watched, &KeyWatched, 1, countingHandler, &counting);
+	CHECK(cancelling.self && cancelling.other);
+
+	SMC_DATA written = 1;
+	CHECK_EQ(keystore->writeValueByName(KeyWatched, &written), SmcSuccess);
+	vsmchostRunTimers(true);
+	CHECK_EQ(cancelling.calls, 1);
+	CHECK_EQ(cancelling.unloadResult, kIOReturnNotPermitted);
+	CHECK_EQ(counting.calls, 0);
+
+	written = 2;
+	CHECK_EQ(keystore->writeValueByName(KeyWatched, &written), SmcSuccess);
+	vsmchostRunTimers(true);
+	CHECK_EQ(cancelling.calls, 1);
+	CHECK_EQ(counting.calls, 0);
+
+	// Handlers calling into the keystore do not deadlock with plugins unloaded from other threads,
+	// and cancelling a running handler from another thread waits for it to return.
+	VirtualSMCAPI::Plugin unloaded;
+	vsmctestInitPlugin(unloaded, "unloaded");
+	CHECK(VirtualSMCAPI::addKey(KeyRBr, unloaded.data, overrideValue()));
+	CHECK_EQ(keystore->loadPlugin(&unloaded), kIOReturnSuccess);
+
+	HandlerState idle;
+	SlowState slow;
+	slow.keystore = keystore;
+	slow.plugin = &watched;
+	slow.other = keystore->subscribeKeys(&watched, &KeyWatched, 1, countingHandler, &idle);
+	auto slowSub = keystore->subscribeKeys(&watched, &KeyWatched, 1, slowHandler, &slow);
+	CHECK(slow.other && slowSub);
+
+	IOReturn unloadResult = kIOReturnError;
+	bool cancelledFinished = false;
+	std::thread unloader([&]() {
+		waitEntered(slow);
+		unloadResult = keystore->unloadPlugin(&unloaded);
+	});
+	std::thread canceller([&]() {
+		waitEntered(slow);
+		keystore->unsubscribeKeys(slowSub);
+		cancelledFinished = slow.finished;
+	});
+
+	written = 3;
+	CHECK_EQ(keystore->writeValueByName(KeyWatched, &written), SmcSuccess);
+	vsmchostRunTimers(true);
+	unloader.join();
+	canceller.join();
+	CHECK(slow.finished);
+	CHECK(slow.resubscribed);
+	CHECK(cancelledFinished);
+	CHECK_EQ(unloadResult, kIOReturnSuccess);
+	CHECK_EQ(idle.calls, 1);
+	unloaded.data.deinit();
+
+	// Both subscriptions are gone.
+	written = 4;
+	CHECK_EQ(keystore->writeValueByName(KeyWatched, &written), SmcSuccess);
+	vsmchostRunTimers(true);
+	CHECK_EQ(idle.calls, 1);
+
+	// Unloading a plugin cancels its subscriptions, waiting for the running handler on another thread.
+	VirtualSMCAPI::Plugin owner;
+	vsmctestInitPlugin(owner, "owner");
+	CHECK(VirtualSMCAPI::addKey(pluginKey(0, 0), owner.data, VirtualSMCAPI::valueWithUint8(0)));
+	CHECK(!keystore->subscribeKeys(&owner, &KeyWatched, 1, countingHandler, &idle));
+	CHECK_EQ(keystore->loadPlugin(&owner), kIOReturnSuccess);
+	SlowState sleeping;
+	CHECK(keystore->subscribeKeys(&owner, &KeyWatched, 1, sleepingHandler, &sleeping));
+	CHECK(keystore->subscribeKeys(&owner, &KeyWatched, 1, countingHandler, &idle));
+
+	IOReturn ownerResult = kIOReturnError;
+	bool ownerFinished = false;
+	std::thread ownerUnloader([&]() {
+		waitEntered(sleeping);
+		ownerResult = keystore->unloadPlugin(&owner);
+		ownerFinished = sleeping.finished;
+	});
+
+	written = 5;
+	CHECK_EQ(keystore->writeValueByName(KeyWatched, &written), SmcSuccess);
+	vsmchostRunTimers(true);
+	ownerUnloader.join();
+	CHECK_EQ(ownerResult, kIOReturnSuccess);
+	CHECK(ownerFinished);
+	// The other subscription of the plugin was cancelled before its turn in the batch.
+	CHECK_EQ(idle.calls, 1);
+	owner.data.deinit();
+
+	sleeping.entered = false;
+	written = 6;
+	CHECK_EQ(keystore->writeValueByName(KeyWatched, &written), SmcSuccess);
+	vsmchostRunTimers(true);
+	CHECK(!sleeping.entered);
+	CHECK_EQ(idle.calls, 1);
+
+	CHECK_EQ(keystore->unloadPlugin(&watched), kIOReturnSuccess);
+	watched.data.deinit();
+
+	// Concurrent loading and unloading while readers look up and enumerate keys.
+	std::atomic<bool> done {false};
+	std::atomic<size_t> wrong {0}, reads {0};
+	std::vector<std::thread> threads;
+	for (size_t r = 0; r < 4; r++) {
+		threads.emplace_back([&, r]() {
+			SMC_DATA dst[SMC_MAX_DATA_SIZE];
+			SMC_DATA_SIZE dstSize;
+			while (!done.load(std::memory_order_relaxed)) {
+				for (size_t p = 0; p < Loaders; p++) {
+					auto res = keystore->readValueByName(pluginKey(p, r % KeysPerPlugin), dst, dstSize);
+					if (res != SmcNotFound && (res != SmcSuccess || dst[0] != p))
+						wrong++;
+				}
+				if (keystore->readValueByName(KeyRPlt, dst, dstSize) != SmcSuccess ||
+					(memcmp(dst, original, originalSize) && memcmp(dst, Override, sizeof(Override))))
+					wrong++;
+				// The last key may be gone by the time it is looked up, but never invalid.
+				SMC_KEY key = 0;
+				if (keystore->readNameByIndex(keystore->getPublicKeyAmount() - 1, key) == SmcSuccess && key == 0)
+					wrong++;
+				reads++;
+			}
+		});
+	}
+
+	std::vector<std::thread> loaders;
+	for (size_t p = 0; p < Loaders; p++) {
+		loaders.emplace_back([&, p]() {
+			for (size_t round = 0; round < Rounds; round++) {
+				VirtualSMCAPI::Plugin plugin;
+				vsmctestInitPlugin(plugin, "churn");
+				for (size_t i = 0; i < KeysPerPlugin; i++)
+					VirtualSMCAPI::addKey(pluginKey(p, i), plugin.data, VirtualSMCAPI::valueWithUint8(static_cast<uint8_t>(p)));
+				// Only one loader overrides a keystore key, others would be rejected.
+				if (p == 0)
+					VirtualSMCAPI::addKey(KeyRPlt, plugin.data, overrideValue());
+				if (keystore->loadPlugin(&plugin) != kIOReturnSuccess || keystore->unloadPlugin(&plugin) != kIOReturnSuccess)
+					wrong++;
+				plugin.data.deinit();
+			}
+		});
+	}
+
+	for (auto &loader : loaders)
+		loader.join();
+	done = true;
+	for (auto &thread : threads)
+		thread.join();
+
+	CHECK_EQ(wrong.load(), 0);
+	CHECK(reads.load() > 0);
+	for (size_t p = 0; p < Loaders; p++)
+		CHECK_EQ(keystore->readValueByName(pluginKey(p, 0), value, size), SmcNotFound);
+	CHECK_EQ(keystore->readValueByName(KeyRPlt, value, size), SmcSuccess);
+	CHECK(!memcmp(value, original, originalSize));
+	printf("plugins: %zu loads, %zu reads\n", Loaders * Rounds, reads.load());
+
+	return vsmctestResult("plugins");
+}
@@ -0,0 +1,123 @@
+//
+//  seqlock.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <VirtualSMCSDK/kern_vsmcapi.hpp>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "vsmctest.hpp"
+
+namespace {
+	/**
+	 *  Every write fills the whole contents with the same byte, so any mix of two writes is detected
+	 */
+	constexpr SMC_DATA_SIZE Size {SMC_MAX_DATA_SIZE};
+
+	constexpr size_t Writes {200000};
+
+	/**
+	 *  Exposes protected modification and read access like plugins use them
+	 */
+	struct ValueAccess : VirtualSMCValueAlias {
+		static bool begin(VirtualSMCValue *value) {
+			return (value->*(&ValueAccess::beginModification))();
+		}
+		static void end(VirtualSMCValue *value) {
+			(value->*(&ValueAccess::endModification))();
+		}
+		static SMC_RESULT read(VirtualSMCValueAlias *value) {
+			return (value->*(&ValueAccess::readAccess))();
+		}
+	};
+
+	bool consistent(const SMC_DATA *data, SMC_DATA_SIZE size) {
+		for (SMC_DATA_SIZE i = 1; i < size; i++)
+			if (data[i] != data[0])
+				return false;
+		return true;
+	}
+}
+
+int main() {
+	auto value = VirtualSMCAPI::valueWithData(nullptr, Size, SmcKeyTypeCh8s);
+	auto alias = VirtualSMCValueAlias::withTarget(value, SmcKeyTypeCh8s, Size);
+	CHECK(value && alias);
+	if (!value || !alias)
+		return vsmctestResult("seqlock");
+
+	// One writer alternating publish and update, readers copying the value directly
+	// and through the alias, which modifies its own contents on every read.
+	// Readers spin while the writer is preempted, so they must not take all CPUs,
+	// or the bounded wait may expire while the writer waits for a time slice.
+	size_t cpus = std::thread::hardware_concurrency();
+	size_t readerCount = cpus > 2 ? (cpus - 1 < 4 ? cpus - 1 : 4) : 2;
+	std::atomic<bool> done {false};
+	std::atomic<size_t> torn {0}, failed {0}, reads {0};
+	std::vector<std::thread> readers;
+	for (size_t i = 0; i < readerCount; i++) {
+		readers.emplace_back([&, i]() {
+			SMC_DATA dst[SMC_MAX_DATA_SIZE];
+			SMC_DATA_SIZE size;
+			while (!done.load(std::memory_order_relaxed)) {
+				if (i % 2 && ValueAccess::read(alias) != SmcSuccess)
+					failed++;
+				if (!(i % 2 ? alias : value)->copy(dst, size))
+					failed++;
+				else if (size != Size || !consistent(dst, size))
+					torn++;
+				reads++;
+			}
+		});
+	}
+
+	SMC_DATA src[SMC_MAX_DATA_SIZE];
+	for (size_t i = 0; i < Writes; i++) {
+		memset(src, static_cast<int>(i), sizeof(src));
+		if (i % 2 ? !value->publish(src) : value->update(src) != SmcSuccess)
+			failed++;
+	}
+	done = true;
+	for (auto &reader : readers)
+		reader.join();
+
+	CHECK_EQ(torn.load(), 0);
+	CHECK_EQ(failed.load(), 0);
+	CHECK(reads.load() > 0);
+	printf("seqlock: %zu writes, %zu reads\n", Writes, reads.load());
+
+	// Readers wait for a slow modification instead of failing.
+	CHECK(ValueAccess::begin(value));
+	auto start = std::chrono::steady_clock::now();
+	std::thread slow([&]() {
+		SMC_DATA dst[SMC_MAX_DATA_SIZE];
+		SMC_DATA_SIZE size;
+		CHECK(value->copy(dst, size));
+		CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(5));
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	ValueAccess::end(value);
+	slow.join();
+
+	// A modification that never completes fails both readers and writers after a bounded wait.
+	CHECK(ValueAccess::begin(value));
+	SMC_DATA dst[SMC_MAX_DATA_SIZE];
+	SMC_DATA_SIZE size;
+	start = std::chrono::steady_clock::now();
+	CHECK(!value->copy(dst, size));
+	CHECK(value->update(src) == SmcCommCollision);
+	CHECK(ValueAccess::read(alias) == SmcCommCollision);
+	CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(1));
+	ValueAccess::end(value);
+	CHECK(value->copy(dst, size));
+
+	delete alias;
+	delete value;
+	return vsmctestResult("seqlock");
+}
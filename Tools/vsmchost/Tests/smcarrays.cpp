@@ -0,0 +1,128 @@
+//
+//  smcarrays.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <VirtualSMCSDK/kern_vsmcapi.hpp>
+#include <math.h>
+#include <vector>
+
+#include "vsmctest.hpp"
+
+using namespace VirtualSMCAPI;
+
+namespace {
+	/**
+	 *  Batch size with odd element count
+	 */
+	constexpr size_t Count {263};
+
+	uint32_t next(uint32_t &seed) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		return seed;
+	}
+
+	constexpr char hexChar(uint32_t digit) {
+		return static_cast<char>(digit < 10 ? '0' + digit : 'a' + digit - 10);
+	}
+
+	/**
+	 *  Compare a batch with encoding every value separately
+	 */
+	template <typename T, typename F>
+	void checkBatch(const std::vector<T> &src, F encode) {
+		std::vector<uint16_t> batch(src.size()), single(src.size());
+		CHECK(encode(src.data(), batch.data(), src.size()));
+		for (size_t i = 0; i < src.size(); i++)
+			encode(&src[i], &single[i], 1);
+		for (size_t i = 0; i < src.size(); i++)
+			CHECK_EQ(batch[i], single[i]);
+	}
+}
+
+int main() {
+	uint32_t seed = 0x12345678;
+
+	// Integers of all magnitudes including the extremes.
+	std::vector<int32_t> ints(Count);
+	for (size_t i = 0; i < Count; i++)
+		ints[i] = static_cast<int32_t>(next(seed)) >> (i % 31);
+	ints[0] = INT32_MIN;
+	ints[1] = INT32_MAX;
+	ints[2] = 0;
+	ints[3] = -1;
+
+	// Floats in the range of every type, above it and close to 2^32 when scaled.
+	std::vector<float> floats(Count);
+	for (size_t i = 0; i < Count; i++)
+		floats[i] = static_cast<int32_t>(next(seed)) / static_cast<float>(1U << (i % 31));
+	floats[0] = -0.0f;
+	floats[1] = 65535.99f;
+	floats[2] = 4294967040.0f;
+	floats[3] = -2147483648.0f;
+
+	for (uint32_t integral = 1; integral <= 15; integral++) {
+		auto sp = SMC_MAKE_KEY_TYPE('s', 'p', hexChar(integral), hexChar(15 - integral));
+		auto fp = SMC_MAKE_KEY_TYPE('f', 'p', hexChar(integral), hexChar(16 - integral));
+		float spScale = getBit<uint32_t>(15 - integral);
+		float fpScale = getBit<uint32_t>(16 - integral);
+
+		for (uint32_t bits = 0; bits <= 24; bits++) {
+			checkBatch(ints, [&](const int32_t *src, uint16_t *dst, size_t count) {
+				return encodeSpArray(sp, src, dst, count, bits);
+			});
+			std::vector<uint32_t> uints(ints.begin(), ints.end());
+			checkBatch(uints, [&](const uint32_t *src, uint16_t *dst, size_t count) {
+				return encodeFpArray(fp, src, dst, count, bits);
+			});
+		}
+
+		// Scaled values must stay below 2^32 for conversions to be defined.
+		std::vector<float> spFloats, fpFloats;
+		for (auto f : floats) {
+			if (fabsf(f) * spScale < 4294967296.0f)
+				spFloats.push_back(f);
+			if (fabsf(f) * fpScale < 4294967296.0f)
+				fpFloats.push_back(f);
+		}
+
+		checkBatch(spFloats, [&](const float *src, uint16_t *dst, size_t count) {
+			return encodeSpArray(sp, src, dst, count);
+		});
+		checkBatch(fpFloats, [&](const float *src, uint16_t *dst, size_t count) {
+			return encodeFpArray(fp, src, dst, count);
+		});
+
+		// Within the encoded range batches match the double encoders.
+		std::vector<uint16_t> out(Count);
+		encodeSpArray(sp, floats.data(), out.data(), Count);
+		for (size_t i = 0; i < Count; i++)
+			if (fabsf(floats[i]) * spScale < 32768.0f)
+				CHECK_EQ(out[i], encodeSp(sp, floats[i]));
+		encodeFpArray(fp, floats.data(), out.data(), Count);
+		for (size_t i = 0; i < Count; i++)
+			if (fabsf(floats[i]) * fpScale < 65536.0f)
+				CHECK_EQ(out[i], encodeFp(fp, floats[i]));
+	}
+
+	// Unsupported types zero the output.
+	std::vector<uint16_t> out(Count, 0xFFFF);
+	CHECK(!encodeSpArray(SmcKeyTypeFp88, ints.data(), out.data(), Count));
+	for (auto v : out)
+		CHECK_EQ(v, 0);
+	out.assign(Count, 0xFFFF);
+	CHECK(!encodeFpArray(SMC_MAKE_KEY_TYPE('f', 'p', 'g', '0'), floats.data(), out.data(), Count));
+	for (auto v : out)
+		CHECK_EQ(v, 0);
+
+	std::vector<uint32_t> flt(Count);
+	encodeFltArray(floats.data(), flt.data(), Count);
+	for (size_t i = 0; i < Count; i++)
+		CHECK_EQ(flt[i], encodeFlt(floats[i]));
+
+	return vsmctestResult("smcarrays");
+}
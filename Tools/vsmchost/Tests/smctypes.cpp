@@ -0,0 +1,110 @@
+//
+//  smctypes.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <VirtualSMCSDK/kern_vsmcapi.hpp>
+#include <utility>
+
+#include "vsmctest.hpp"
+
+using namespace VirtualSMCAPI;
+
+namespace {
+	constexpr char hexChar(uint32_t digit) {
+		return static_cast<char>(digit < 10 ? '0' + digit : 'a' + digit - 10);
+	}
+
+	template <uint32_t Integral>
+	constexpr SMC_KEY_TYPE SpType = SMC_MAKE_KEY_TYPE('s', 'p', hexChar(Integral), hexChar(15 - Integral));
+
+	template <uint32_t Integral>
+	constexpr SMC_KEY_TYPE FpType = SMC_MAKE_KEY_TYPE('f', 'p', hexChar(Integral), hexChar(16 - Integral));
+
+	static_assert(SpType<7> == SmcKeyTypeSp78 && FpType<8> == SmcKeyTypeFp88, "Unexpected type construction");
+	static_assert(fpIntegral(SMC_MAKE_KEY_TYPE('f', 'p', 'g', '0')) == 0, "Invalid digits must be rejected");
+	static_assert(spIntegral(SMC_MAKE_KEY_TYPE('s', 'p', 'F', '0')) == 0, "Uppercase digits must be rejected");
+
+	/**
+	 *  Independent type name parser
+	 */
+	uint32_t referenceIntegral(SMC_KEY_TYPE type, char kind, uint32_t bits) {
+		auto name = reinterpret_cast<const char *>(&type);
+		auto digit = [](char c) -> int {
+			if (c >= '0' && c <= '9') return c - '0';
+			if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+			return -1;
+		};
+		if (name[0] != kind || name[1] != 'p' || digit(name[2]) < 0 || digit(name[3]) < 0 ||
+			static_cast<uint32_t>(digit(name[2]) + digit(name[3])) != bits)
+			return 0;
+		return static_cast<uint32_t>(digit(name[2]));
+	}
+
+	template <uint32_t Integral>
+	void checkSp() {
+		constexpr auto Type = SpType<Integral>;
+		using Traits = TypeTraits<Type>;
+		static_assert(Traits::Integral == Integral, "Wrong integral bits");
+		constexpr double scale = getBit<uint32_t>(Traits::Fraction);
+
+		for (uint32_t host = 0; host <= 0xFFFF; host++) {
+			auto encoded = typeSwap(static_cast<uint16_t>(host));
+			auto value = Traits::template decodeFixed<Traits::Fraction>(encoded);
+			CHECK_EQ(value, (host & 0x8000) ? -static_cast<int32_t>(host & 0x7FFF) : static_cast<int32_t>(host & 0x7FFF));
+			CHECK_EQ(Traits::template decodeFixed<0>(encoded), value / static_cast<int32_t>(getBit<uint32_t>(Traits::Fraction)));
+			CHECK(decodeSp(Type, encoded) == value / scale);
+			// Negative zero is the only encoding not produced by the encoders.
+			if (host == 0x8000) {
+				CHECK_EQ(Traits::template encodeFixed<Traits::Fraction>(value), 0);
+				CHECK_EQ(encodeSp(Type, decodeSp(Type, encoded)), 0);
+			} else {
+				CHECK_EQ(Traits::template encodeFixed<Traits::Fraction>(value), encoded);
+				CHECK_EQ(encodeSp(Type, decodeSp(Type, encoded)), encoded);
+			}
+		}
+	}
+
+	template <uint32_t Integral>
+	void checkFp() {
+		constexpr auto Type = FpType<Integral>;
+		using Traits = TypeTraits<Type>;
+		static_assert(Traits::Integral == Integral, "Wrong integral bits");
+		constexpr double scale = getBit<uint32_t>(Traits::Fraction);
+
+		for (uint32_t host = 0; host <= 0xFFFF; host++) {
+			auto encoded = typeSwap(static_cast<uint16_t>(host));
+			auto value = Traits::template decodeFixed<Traits::Fraction>(encoded);
+			CHECK_EQ(value, host);
+			CHECK_EQ(Traits::template decodeFixed<0>(encoded), host >> Traits::Fraction);
+			CHECK(decodeFp(Type, encoded) == value / scale);
+			CHECK_EQ(Traits::template encodeFixed<Traits::Fraction>(value), encoded);
+			CHECK_EQ(encodeFp(Type, decodeFp(Type, encoded)), encoded);
+		}
+	}
+
+	template <uint32_t... Integral>
+	void checkAll(std::integer_sequence<uint32_t, Integral...>) {
+		(checkSp<Integral + 1>(), ...);
+		(checkFp<Integral + 1>(), ...);
+	}
+}
+
+int main() {
+	// Every two character suffix of sp and fp types.
+	for (uint32_t suffix = 0; suffix <= 0xFFFF; suffix++) {
+		auto sp = SMC_MAKE_KEY_TYPE('s', 'p', suffix & 0xFF, suffix >> 8);
+		auto fp = SMC_MAKE_KEY_TYPE('f', 'p', suffix & 0xFF, suffix >> 8);
+		CHECK_EQ(spIntegral(sp), referenceIntegral(sp, 's', 15));
+		CHECK_EQ(fpIntegral(fp), referenceIntegral(fp, 'f', 16));
+		CHECK_EQ(spIntegral(fp), 0);
+		CHECK_EQ(fpIntegral(sp), 0);
+	}
+
+	// Every encoding of every type with at least one integral bit.
+	checkAll(std::make_integer_sequence<uint32_t, 15>());
+
+	return vsmctestResult("smctypes");
+}
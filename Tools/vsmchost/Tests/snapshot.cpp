@@ -0,0 +1,172 @@
+//
+//  snapshot.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <VirtualSMCSDK/kern_vsmcapi.hpp>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "../../smc-fuzzer/snapshot.h"
+#include "vsmctest.hpp"
+
+namespace {
+	uint32_t fourcc(const char *name) {
+		return static_cast<uint32_t>(static_cast<uint8_t>(name[0])) << 24 | static_cast<uint32_t>(static_cast<uint8_t>(name[1])) << 16 |
+			static_cast<uint32_t>(static_cast<uint8_t>(name[2])) << 8 | static_cast<uint32_t>(static_cast<uint8_t>(name[3]));
+	}
+
+	/**
+	 *  Counts calls made to the wrapped backend
+	 */
+	struct CountingBackend : SMCBackend {
+		SMCBackend *backend;
+		size_t infos {0};
+		size_t reads {0};
+		size_t writes {0};
+		size_t indices {0};
+
+		explicit CountingBackend(SMCBackend *backend) : backend(backend) {}
+
+		const char *name() const override {
+			return backend->name();
+		}
+
+		int keyInfo(uint32_t key, uint32_t *dataSize, uint32_t *dataType, uint8_t *dataAttributes) override {
+			infos++;
+			return backend->keyInfo(key, dataSize, dataType, dataAttributes);
+		}
+
+		int readKey(uint32_t key, uint32_t dataSize, char bytes[32]) override {
+			reads++;
+			return backend->readKey(key, dataSize, bytes);
+		}
+
+		int writeKey(uint32_t key, uint32_t dataSize, const char bytes[32]) override {
+			writes++;
+			return backend->writeKey(key, dataSize, bytes);
+		}
+
+		int keyFromIndex(uint32_t index, uint32_t *key) override {
+			indices++;
+			return backend->keyFromIndex(index, key);
+		}
+
+		size_t calls() const {
+			return infos + reads + writes + indices;
+		}
+	};
+
+	std::vector<std::string> readLines(FILE *file) {
+		std::vector<std::string> lines;
+		char line[256];
+		rewind(file);
+		while (fgets(line, sizeof(line), file)) {
+			line[strcspn(line, "\n")] = '\0';
+			lines.push_back(line);
+		}
+		return lines;
+	}
+}
+
+int main() {
+	auto vsmc = SMCCreateVirtualSMCBackend(nullptr, nullptr, nullptr);
+	CHECK(vsmc);
+	if (!vsmc)
+		return vsmctestResult("snapshot");
+	CountingBackend backend(vsmc);
+
+	uint32_t countSize = 0, countType = 0;
+	uint8_t countAttr = 0;
+	char count[32] {};
+	CHECK_EQ(vsmc->keyInfo(fourcc("#KEY"), &countSize, &countType, &countAttr), 0);
+	CHECK_EQ(vsmc->readKey(fourcc("#KEY"), countSize, count), 0);
+	size_t total = static_cast<uint8_t>(count[2]) << 8 | static_cast<uint8_t>(count[3]);
+	CHECK(total > 0);
+
+	// Key info costs an index and an info call per key on top of reading #KEY.
+	std::vector<SMCCachedKey> cache;
+	uint64_t calls = 0;
+	CHECK_EQ(SMCLoadKeyCache(&backend, cache, &calls), 0);
+	CHECK_EQ(cache.size(), total);
+	CHECK_EQ(calls, 2 + 2 * total);
+	CHECK_EQ(backend.calls(), calls);
+	CHECK_EQ(backend.indices, total);
+	CHECK_EQ(backend.reads, 1);
+
+	// Every snapshot only reads values, one call per key.
+	for (size_t n = 0; n < 2; n++) {
+		auto file = tmpfile();
+		CHECK(file);
+		if (!file)
+			break;
+		backend = CountingBackend(vsmc);
+		calls = 0;
+		SMCPrintSnapshot(&backend, cache, file, &calls);
+		CHECK_EQ(calls, total);
+		CHECK_EQ(backend.reads, total);
+		CHECK_EQ(backend.calls(), total);
+
+		auto lines = readLines(file);
+		fclose(file);
+		CHECK_EQ(lines.size(), total + 2);
+		if (lines.size() != total + 2)
+			continue;
+		CHECK(lines.front() == "[");
+		CHECK(lines.back() == "]");
+		for (size_t i = 1; i <= total; i++) {
+			auto &line = lines[i];
+			CHECK(line.compare(0, 11, "  {\"key\": \"") == 0);
+			// Write-only keys cannot be read.
+			bool readable = cache[i - 1].dataAttributes & SMC_KEY_ATTRIBUTE_READ;
+			CHECK(line.find(readable ? "\"value\": \"" : "\"error\": \"85\"") != std::string::npos);
+			CHECK(line.compare(line.size() - (i < total ? 2 : 1), std::string::npos, i < total ? "}," : "}") == 0);
+		}
+
+		char keyLine[128];
+		snprintf(keyLine, sizeof(keyLine), "  {\"key\": \"#KEY\", \"type\": \"ui32\", \"size\": 4, \"attr\": \"%02x\", \"value\": \"%08zx\"},",
+			countAttr, total);
+		CHECK(lines[1] == keyLine);
+	}
+
+	// Names are escaped and unreadable keys report the result code instead of a value.
+	std::vector<SMCCachedKey> missing {{fourcc("K\"\\\x01"), 1, fourcc("ui8 "), 0x80}};
+	auto file = tmpfile();
+	CHECK(file);
+	if (file) {
+		calls = 0;
+		SMCPrintSnapshot(&backend, missing, file, &calls);
+		CHECK_EQ(calls, 1);
+		auto lines = readLines(file);
+		fclose(file);
+		CHECK_EQ(lines.size(), 3);
+		if (lines.size() == 3)
+			CHECK(lines[1] == "  {\"key\": \"K\\\"\\\\\\u0001\", \"type\": \"ui8 \", \"size\": 1, \"attr\": \"80\", \"error\": \"84\"}");
+	}
+
+	// Repeated dumps load key info once.
+	file = tmpfile();
+	CHECK(file);
+	if (file) {
+		backend = CountingBackend(vsmc);
+		CHECK_EQ(SMCDumpSnapshots(&backend, 3, 0, file), 0);
+		CHECK_EQ(backend.infos, 1 + total);
+		CHECK_EQ(backend.indices, total);
+		CHECK_EQ(backend.reads, 1 + 3 * total);
+		CHECK_EQ(backend.writes, 0);
+		auto lines = readLines(file);
+		fclose(file);
+		CHECK_EQ(lines.size(), 3 * (total + 2));
+		size_t arrays = 0;
+		for (auto &line : lines)
+			arrays += line == "[";
+		CHECK_EQ(arrays, 3);
+	}
+
+	delete vsmc;
+	return vsmctestResult("snapshot");
+}
@@ -0,0 +1,69 @@
+//
+//  statistics.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <VirtualSMCSDK/kern_vsmcapi.hpp>
+#include <libkern/c++/OSNumber.h>
+
+#include "vsmctest.hpp"
+#include "vsmctestsmc.hpp"
+
+namespace {
+	constexpr SMC_KEY KeyRPlt = SMC_MAKE_IDENTIFIER('R', 'P', 'l', 't');
+
+	uint64_t number(OSDictionary *dict, const char *name) {
+		auto num = dict ? OSDynamicCast(OSNumber, dict->getObject(name)) : nullptr;
+		return num ? num->unsigned64BitValue() : UINT64_MAX;
+	}
+}
+
+int main() {
+	auto keystore = vsmctestStartService("-vsmcstat");
+	CHECK(keystore);
+	if (!keystore)
+		return vsmctestResult("statistics");
+
+	// Probe more missing names than there are counter slots, like key scanners do.
+	SMC_DATA value[SMC_MAX_DATA_SIZE];
+	SMC_DATA_SIZE size;
+	constexpr size_t Missing {2000};
+	for (size_t i = 0; i < Missing; i++) {
+		SMC_KEY key = SMC_MAKE_IDENTIFIER('z', 'z', 'a' + i % 26, 'a' + i / 26);
+		CHECK_EQ(keystore->readValueByName(key, value, size), SmcNotFound);
+		CHECK_EQ(keystore->writeValueByName(key, value), SmcNotFound);
+	}
+
+	// Existing keys still get their own counters.
+	CHECK_EQ(keystore->readValueByName(KeyRPlt, value, size), SmcSuccess);
+	CHECK_EQ(keystore->writeValueByName(KeyRPlt, value), SmcNotWritable);
+
+	auto stats = keystore->copyStatistics();
+	CHECK(stats);
+	if (stats) {
+		CHECK_EQ(number(stats, "missing"), 2 * Missing);
+		CHECK(!stats->getObject("zzaa"));
+		auto entry = OSDynamicCast(OSDictionary, stats->getObject("RPlt"));
+		CHECK(entry);
+		CHECK_EQ(number(entry, "reads"), 1);
+		CHECK_EQ(number(entry, "writes"), 1);
+		CHECK_EQ(number(entry, "errors"), 1);
+		// Every other entry is an existing key read during startup.
+		for (unsigned int i = 0; i < stats->getCount(); i++) {
+			SMC_KEY key = 0;
+			auto name = stats->getKey(i);
+			if (!strcmp(name, "missing"))
+				continue;
+			CHECK_EQ(strlen(name), sizeof(SMC_KEY));
+			memcpy(&key, name, sizeof(SMC_KEY));
+			SMC_KEY_TYPE type;
+			SMC_KEY_ATTRIBUTES attr;
+			CHECK_EQ(keystore->getInfoByName(key, size, type, attr), SmcSuccess);
+		}
+		stats->release();
+	}
+
+	return vsmctestResult("statistics");
+}
@@ -0,0 +1,152 @@
+//
+//  typedvalue.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <VirtualSMCSDK/kern_vsmcapi.hpp>
+#include <string.h>
+#include <utility>
+
+#include "vsmctest.hpp"
+
+using namespace VirtualSMCAPI;
+
+namespace {
+	constexpr char hexChar(uint32_t digit) {
+		return static_cast<char>(digit < 10 ? '0' + digit : 'a' + digit - 10);
+	}
+
+	// Typed values keep their contents inline in exactly Size bytes (plus alignment).
+	template <typename T, SMC_DATA_SIZE Size>
+	constexpr bool inlineStorage() {
+		constexpr size_t align = alignof(VirtualSMCValue);
+		return sizeof(T) <= (sizeof(VirtualSMCValue) + Size + align - 1) / align * align;
+	}
+	static_assert(inlineStorage<VirtualSMCTypedValue<SmcKeyTypeFlag>, 1>(), "Typed values must store contents inline");
+	static_assert(inlineStorage<VirtualSMCTypedValue<SmcKeyTypeSp78>, 2>(), "Typed values must store contents inline");
+	static_assert(inlineStorage<VirtualSMCTypedValue<SmcKeyTypeCh8s, SMC_MAX_DATA_SIZE>, SMC_MAX_DATA_SIZE>(), "Typed values must store contents inline");
+
+	/**
+	 *  Value type and storage are protected, obtain them through member pointers
+	 */
+	struct TypeAccess : VirtualSMCValue {
+		static SMC_KEY_TYPE of(const VirtualSMCValue *value) {
+			return value->*(&TypeAccess::type);
+		}
+		static SMC_DATA_SIZE capacityOf(const VirtualSMCValue *value) {
+			return value->*(&TypeAccess::capacity);
+		}
+	};
+
+	/**
+	 *  Compare a typed value with the runtime helper result
+	 */
+	void checkSame(VirtualSMCValue *typed, VirtualSMCValue *runtime, SMC_KEY_TYPE type, SMC_DATA_SIZE size) {
+		CHECK(typed && runtime);
+		if (!typed || !runtime)
+			return;
+		SMC_DATA_SIZE typedSize, runtimeSize;
+		auto typedData = typed->get(typedSize);
+		auto runtimeData = runtime->get(runtimeSize);
+		CHECK_EQ(typedSize, size);
+		CHECK_EQ(runtimeSize, size);
+		CHECK_EQ(TypeAccess::of(typed), type);
+		CHECK_EQ(TypeAccess::of(runtime), type);
+		CHECK(!memcmp(typedData, runtimeData, size));
+		SMC_DATA dst[SMC_MAX_DATA_SIZE];
+		SMC_DATA_SIZE dstSize;
+		CHECK(typed->copy(dst, dstSize));
+		CHECK(dstSize == size && !memcmp(dst, typedData, size));
+		delete typed;
+		delete runtime;
+	}
+
+	template <uint32_t Integral>
+	void checkFixed() {
+		constexpr auto Sp = SMC_MAKE_KEY_TYPE('s', 'p', hexChar(Integral), hexChar(15 - Integral));
+		constexpr auto Fp = SMC_MAKE_KEY_TYPE('f', 'p', hexChar(Integral), hexChar(16 - Integral));
+		constexpr auto SpEncoded = TypeTraits<Sp>::template encodeFixed<0>(-1);
+		constexpr auto FpEncoded = TypeTraits<Fp>::template encodeFixed<0>(1);
+		checkSame(valueWithEncoded<Sp>(SpEncoded), valueWithSp(-1, Sp), Sp, 2);
+		checkSame(valueWithEncoded<Fp>(FpEncoded), valueWithFp(1, Fp), Fp, 2);
+	}
+
+	template <uint32_t... Integral>
+	void checkAllFixed(std::integer_sequence<uint32_t, Integral...>) {
+		(checkFixed<Integral + 1>(), ...);
+	}
+
+	/**
+	 *  Structure types have no traits and take explicit sizes matching Docs/SMCTypes
+	 */
+	template <SMC_KEY_TYPE Type, SMC_DATA_SIZE Size>
+	void checkStruct() {
+		struct Contents { uint8_t bytes[Size]; } contents;
+		for (SMC_DATA_SIZE i = 0; i < Size; i++)
+			contents.bytes[i] = static_cast<uint8_t>(i + 1);
+		auto typed = new VirtualSMCTypedValue<Type, Size>;
+		CHECK(typed->initWith(contents));
+		checkSame(typed, valueWithData(contents.bytes, Size, Type), Type, Size);
+	}
+}
+
+int main() {
+	// Every sp and fp type, including sp7s, sp5a, fpef and others from Docs/SMCTypes.
+	checkAllFixed(std::make_integer_sequence<uint32_t, 15>());
+
+	constexpr auto Flag = TypeTraits<SmcKeyTypeFlag>::encode(true);
+	constexpr auto Uint8 = TypeTraits<SmcKeyTypeUint8>::encode(0x12);
+	constexpr auto Uint16 = TypeTraits<SmcKeyTypeUint16>::encode(0x1234);
+	constexpr auto Uint32 = TypeTraits<SmcKeyTypeUint32>::encode(0x12345678);
+	constexpr auto Sint16 = TypeTraits<SmcKeyTypeSint16>::encode(-2);
+	constexpr auto Sint32 = TypeTraits<SmcKeyTypeSint32>::encode(-3);
+	checkSame(valueWithEncoded<SmcKeyTypeFlag>(Flag), valueWithFlag(true), SmcKeyTypeFlag, 1);
+	checkSame(valueWithEncoded<SmcKeyTypeUint8>(Uint8), valueWithUint8(0x12), SmcKeyTypeUint8, 1);
+	checkSame(valueWithEncoded<SmcKeyTypeUint16>(Uint16), valueWithUint16(0x1234), SmcKeyTypeUint16, 2);
+	checkSame(valueWithEncoded<SmcKeyTypeUint32>(Uint32), valueWithUint32(0x12345678), SmcKeyTypeUint32, 4);
+	checkSame(valueWithEncoded<SmcKeyTypeSint16>(Sint16), valueWithSint16(-2), SmcKeyTypeSint16, 2);
+	checkSame(valueWithEncoded<SmcKeyTypeSint32>(Sint32), valueWithSint32(-3), SmcKeyTypeSint32, 4);
+	checkSame(valueWithEncoded<SmcKeyTypeFloat>(TypeTraits<SmcKeyTypeFloat>::encode(1.5f)), valueWithFlt(1.5f), SmcKeyTypeFloat, 4);
+
+	// Integer types without runtime helpers.
+	uint64_t u64 = OSSwapInt64(0x123456789ABCDEF0ULL);
+	int8_t s8 = -4;
+	uint64_t s64 = OSSwapInt64(static_cast<uint64_t>(-5LL));
+	checkSame(valueWithEncoded<SmcKeyTypeUint64>(TypeTraits<SmcKeyTypeUint64>::encode(0x123456789ABCDEF0ULL)),
+		valueWithData(reinterpret_cast<const SMC_DATA *>(&u64), 8, SmcKeyTypeUint64), SmcKeyTypeUint64, 8);
+	checkSame(valueWithEncoded<SmcKeyTypeSint8>(TypeTraits<SmcKeyTypeSint8>::encode(-4)),
+		valueWithData(reinterpret_cast<const SMC_DATA *>(&s8), 1, SmcKeyTypeSint8), SmcKeyTypeSint8, 1);
+	checkSame(valueWithEncoded<SmcKeyTypeSint64>(TypeTraits<SmcKeyTypeSint64>::encode(-5)),
+		valueWithData(reinterpret_cast<const SMC_DATA *>(&s64), 8, SmcKeyTypeSint64), SmcKeyTypeSint64, 8);
+
+	checkStruct<SmcKeyTypeCh8s, 32>();
+	checkStruct<SmcKeyTypeHex, 4>();
+	checkStruct<SmcKeyTypeAlv, 10>();
+	checkStruct<SmcKeyTypeFds, 16>();
+	checkStruct<SmcKeyTypePwm, 2>();
+	checkStruct<SmcKeyTypeRev, 6>();
+
+	// Typed values never grow past Size, other values get storage of exactly their size.
+	VirtualSMCTypedValue<SmcKeyTypeSp78> sp78;
+	VirtualSMCValue &base = sp78;
+	CHECK(!base.init(nullptr, 4, SmcKeyTypeSp78, SMC_KEY_ATTRIBUTE_READ));
+	CHECK(base.init(nullptr, 2, SmcKeyTypeSp78, SMC_KEY_ATTRIBUTE_READ));
+	CHECK_EQ(TypeAccess::capacityOf(&sp78), 2);
+
+	auto flag = valueWithFlag(true);
+	CHECK_EQ(TypeAccess::capacityOf(flag), 1);
+	SMC_DATA wide[8] {1, 2, 3, 4, 5, 6, 7, 8};
+	CHECK(flag->init(nullptr, sizeof(wide), SmcKeyTypeHex, SMC_KEY_ATTRIBUTE_READ));
+	CHECK_EQ(TypeAccess::capacityOf(flag), sizeof(wide));
+	SMC_DATA_SIZE flagSize;
+	auto flagData = flag->get(flagSize);
+	CHECK(flagData[0] == 1 && flagData[1] == 0 && flagData[7] == 0);
+	CHECK(flag->update(wide) == SmcSuccess);
+	CHECK(!memcmp(flag->get(flagSize), wide, sizeof(wide)));
+	CHECK(!flag->init(nullptr, SMC_MAX_DATA_SIZE + 1, SmcKeyTypeHex, SMC_KEY_ATTRIBUTE_READ));
+	delete flag;
+
+	return vsmctestResult("typedvalue");
+}
@@ -0,0 +1,54 @@
+//
+//  vsmctest.hpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef vsmctest_hpp
+#define vsmctest_hpp
+
+// Minimal checks shared by vsmchost tests. Every test is a separate executable
+// registered with ctest, failed checks are printed and turn the exit code to 1.
+
+#include <stdio.h>
+
+/**
+ *  Number of failed checks in the current test
+ */
+inline size_t vsmctestFailures {0};
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		vsmctestFailures++; \
+	} \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+	auto vsmctestA = (a); \
+	auto vsmctestB = (b); \
+	if (static_cast<long long>(vsmctestA) != static_cast<long long>(vsmctestB)) { \
+		fprintf(stderr, "%s:%d: check failed: %s == %s (%lld vs %lld)\n", __FILE__, __LINE__, #a, #b, \
+			static_cast<long long>(vsmctestA), static_cast<long long>(vsmctestB)); \
+		vsmctestFailures++; \
+	} \
+} while (0)
+
+/**
+ *  Report test result
+ *
+ *  @param name  test name
+ *
+ *  @return process exit code
+ */
+inline int vsmctestResult(const char *name) {
+	if (vsmctestFailures > 0) {
+		fprintf(stderr, "%s: %zu checks failed\n", name, vsmctestFailures);
+		return 1;
+	}
+	printf("%s: passed\n", name);
+	return 0;
+}
+
+#endif /* vsmctest_hpp */
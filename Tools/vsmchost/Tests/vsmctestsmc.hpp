@@ -0,0 +1,50 @@
+//
+//  vsmctestsmc.hpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef vsmctestsmc_hpp
+#define vsmctestsmc_hpp
+
+// Keystore access for tests running against a started VirtualSMC service.
+
+#include <Headers/kern_iokit.hpp>
+
+#include "../../../VirtualSMC/kern_vsmc.hpp"
+#include "../vsmchost.hpp"
+
+/**
+ *  Start VirtualSMC with the default personality
+ *
+ *  @param bootArgs  boot arguments, e.g. "-vsmcstat"
+ *
+ *  @return keystore of the started service or nullptr
+ */
+inline VirtualSMCKeystore *vsmctestStartService(const char *bootArgs = "") {
+	vsmchostSetBootArgs(bootArgs);
+	vsmchostSetComputer(WIOKit::ComputerModel::ComputerDesktop, nullptr);
+	auto personality = vsmchostLoadPersonality(VSMCHOST_DEFAULT_PLIST);
+	if (!personality || !vsmchostStartService(personality, new IOService)) {
+		fprintf(stderr, "failed to start VirtualSMC\n");
+		return nullptr;
+	}
+	// Finish deferred initialisation.
+	vsmchostRunTimers(true);
+	return VirtualSMC::getKeystore();
+}
+
+/**
+ *  Initialise a plugin with the current API version
+ *
+ *  @param plugin   plugin to initialise
+ *  @param product  plugin name
+ */
+inline void vsmctestInitPlugin(VirtualSMCAPI::Plugin &plugin, const char *product) {
+	plugin.product = product;
+	plugin.version = 1;
+	plugin.apiver = VirtualSMCAPI::Version;
+}
+
+#endif /* vsmctestsmc_hpp */
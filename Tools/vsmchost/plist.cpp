@@ -0,0 +1,260 @@
+//
+//  plist.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <Headers/kern_util.hpp>
+
+#include "vsmchost.hpp"
+
+/**
+ *  Minimal XML property list reader producing libkern containers.
+ *  Supports dict, array, key, string, data, integer, true and false,
+ *  which is everything kext Info.plist files use.
+ */
+namespace {
+	struct Parser {
+		const char *pos;
+
+		void skipSpace() {
+			while (*pos == ' ' || *pos == '\t' || *pos == '\r' || *pos == '\n')
+				pos++;
+		}
+
+		/**
+		 *  Skip XML declaration, doctype and comments
+		 */
+		void skipMarkup() {
+			for (;;) {
+				skipSpace();
+				if (!strncmp(pos, "<?", 2) || !strncmp(pos, "<!DOCTYPE", 9)) {
+					auto end = strchr(pos, '>');
+					pos = end ? end + 1 : pos + strlen(pos);
+				} else if (!strncmp(pos, "<!--", 4)) {
+					auto end = strstr(pos, "-->");
+					pos = end ? end + 3 : pos + strlen(pos);
+				} else {
+					return;
+				}
+			}
+		}
+
+		/**
+		 *  Read next tag name
+		 *
+		 *  @param name   tag name buffer
+		 *  @param empty  set for self-closing tags
+		 *
+		 *  @return true on success
+		 */
+		bool readTag(char (&name)[16], bool &empty) {
+			skipMarkup();
+			if (*pos != '<')
+				return false;
+			auto end = strchr(pos, '>');
+			if (!end)
+				return false;
+			size_t len = strcspn(pos + 1, " />");
+			if (len >= sizeof(name))
+				return false;
+			lilu_os_memcpy(name, pos + 1, len);
+			name[len] = '\0';
+			empty = end[-1] == '/';
+			pos = end + 1;
+			return true;
+		}
+
+		/**
+		 *  Read element text up to closing tag and decode entities
+		 *
+		 *  @param tag  element name
+		 *
+		 *  @return allocated text (must be freed) or nullptr
+		 */
+		char *readText(const char *tag) {
+			char close[24];
+			snprintf(close, sizeof(close), "</%s>", tag);
+			auto end = strstr(pos, close);
+			if (!end)
+				return nullptr;
+
+			auto text = static_cast<char *>(malloc(end - pos + 1));
+			if (!text)
+				return nullptr;
+
+			static const struct {
+				const char *name;
+				char value;
+			} entities[] {{"&lt;", '<'}, {"&gt;", '>'}, {"&amp;", '&'}, {"&quot;", '"'}, {"&apos;", '\''}};
+
+			size_t len = 0;
+			while (pos < end) {
+				bool decoded = false;
+				if (*pos == '&') {
+					for (auto &e : entities) {
+						size_t elen = strlen(e.name);
+						if (!strncmp(pos, e.name, elen)) {
+							text[len++] = e.value;
+							pos += elen;
+							decoded = true;
+							break;
+						}
+					}
+				}
+				if (!decoded)
+					text[len++] = *pos++;
+			}
+			text[len] = '\0';
+			pos = end + strlen(close);
+			return text;
+		}
+
+		/**
+		 *  Decode base64 data ignoring whitespace
+		 */
+		static OSData *decodeData(const char *text) {
+			auto out = static_cast<uint8_t *>(malloc(strlen(text) + 1));
+			if (!out)
+				return nullptr;
+
+			uint32_t acc = 0;
+			int bits = 0;
+			unsigned int len = 0;
+			for (auto p = text; *p && *p != '='; p++) {
+				int v;
+				if (*p >= 'A' && *p <= 'Z') v = *p - 'A';
+				else if (*p >= 'a' && *p <= 'z') v = *p - 'a' + 26;
+				else if (*p >= '0' && *p <= '9') v = *p - '0' + 52;
+				else if (*p == '+') v = 62;
+				else if (*p == '/') v = 63;
+				else continue;
+				acc = (acc << 6) | static_cast<uint32_t>(v);
+				bits += 6;
+				if (bits >= 8) {
+					bits -= 8;
+					out[len++] = static_cast<uint8_t>(acc >> bits);
+				}
+			}
+
+			auto data = OSData::withBytes(out, len);
+			free(out);
+			return data;
+		}
+
+		/**
+		 *  Parse a single value
+		 *
+		 *  @return parsed object (must be released) or nullptr
+		 */
+		OSObject *parseValue() {
+			char tag[16];
+			bool empty;
+			if (!readTag(tag, empty))
+				return nullptr;
+
+			if (!strcmp(tag, "dict")) {
+				auto dict = OSDictionary::withCapacity(8);
+				if (empty)
+					return dict;
+				for (;;) {
+					skipMarkup();
+					if (!strncmp(pos, "</dict>", 7)) {
+						pos += 7;
+						return dict;
+					}
+					if (!readTag(tag, empty) || strcmp(tag, "key") || empty) {
+						dict->release();
+						return nullptr;
+					}
+					auto key = readText("key");
+					auto obj = key ? parseValue() : nullptr;
+					if (!obj) {
+						free(key);
+						dict->release();
+						return nullptr;
+					}
+					dict->setObject(key, obj);
+					obj->release();
+					free(key);
+				}
+			}
+
+			if (!strcmp(tag, "array")) {
+				auto arr = OSArray::withCapacity(8);
+				if (empty)
+					return arr;
+				for (;;) {
+					skipMarkup();
+					if (!strncmp(pos, "</array>", 8)) {
+						pos += 8;
+						return arr;
+					}
+					auto obj = parseValue();
+					if (!obj) {
+						arr->release();
+						return nullptr;
+					}
+					arr->setObject(obj);
+					obj->release();
+				}
+			}
+
+			if (!strcmp(tag, "true") || !strcmp(tag, "false")) {
+				if (!empty)
+					free(readText(tag));
+				return tag[0] == 't' ? kOSBooleanTrue : kOSBooleanFalse;
+			}
+
+			if (strcmp(tag, "string") && strcmp(tag, "data") && strcmp(tag, "integer"))
+				return nullptr;
+
+			auto text = empty ? strdup("") : readText(tag);
+			if (!text)
+				return nullptr;
+
+			OSObject *obj;
+			if (tag[0] == 's')
+				obj = OSString::withCString(text);
+			else if (tag[0] == 'd')
+				obj = decodeData(text);
+			else
+				obj = OSNumber::withNumber(strtoull(text, nullptr, 0), 64);
+			free(text);
+			return obj;
+		}
+	};
+}
+
+OSObject *vsmchostParsePlist(const char *xml) {
+	Parser parser {xml};
+	char tag[16];
+	bool empty;
+	if (!parser.readTag(tag, empty) || strcmp(tag, "plist") || empty)
+		return nullptr;
+	return parser.parseValue();
+}
+
+OSObject *vsmchostLoadPlist(const char *path) {
+	auto file = fopen(path, "rb");
+	if (!file)
+		return nullptr;
+
+	OSObject *obj = nullptr;
+	if (!fseek(file, 0, SEEK_END)) {
+		auto size = ftell(file);
+		auto xml = size >= 0 ? static_cast<char *>(malloc(size + 1)) : nullptr;
+		if (xml) {
+			rewind(file);
+			if (fread(xml, 1, size, file) == static_cast<size_t>(size)) {
+				xml[size] = '\0';
+				obj = vsmchostParsePlist(xml);
+			}
+			free(xml);
+		}
+	}
+
+	fclose(file);
+	return obj;
+}
@@ -0,0 +1,234 @@
+//
+//  smcclient.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <Headers/kern_util.hpp>
+
+#include "../../VirtualSMC/kern_vsmc.hpp"
+#include "../../VirtualSMC/kern_prov.hpp"
+#include "smcclient.hpp"
+
+/**
+ *  VirtualSMC only implements a single event interrupt
+ */
+static constexpr int EventInterrupt {0};
+
+bool SMCClient::enableEvents() {
+	if (smc->registerInterrupt(EventInterrupt, nullptr, interruptHandler, this) != kIOReturnSuccess ||
+		smc->enableInterrupt(EventInterrupt) != kIOReturnSuccess)
+		return false;
+
+	// Completion of this very write is already reported with an interrupt.
+	eventsEnabled = true;
+	uint8_t enable = 1;
+	if (writeValue(SMC_MAKE_KEY('N', 'T', 'O', 'K'), &enable, sizeof(enable)) != SmcSuccess) {
+		eventsEnabled = false;
+		smc->unregisterInterrupt(EventInterrupt);
+		return false;
+	}
+
+	return true;
+}
+
+void SMCClient::interruptHandler(OSObject *, void *refCon, IOService *, int) {
+	auto client = static_cast<SMCClient *>(refCon);
+	client->counters.events++;
+	client->handleEvent();
+}
+
+SMCClientPMIO::SMCClientPMIO(VirtualSMC *smc) : SMCClient(smc),
+	base(static_cast<UInt16>(VirtualSMCProvider::getMapping(VirtualSMCProvider::AppleSMCBufferPMIO)->getPhysicalAddress())) {}
+
+uint8_t SMCClientPMIO::in(UInt16 port) {
+	counters.reads++;
+	return smc->ioRead8(base + port, nullptr);
+}
+
+void SMCClientPMIO::out(UInt16 port, uint8_t value) {
+	counters.writes++;
+	smc->ioWrite8(base + port, value, nullptr);
+}
+
+bool SMCClientPMIO::waitStatus(uint8_t value, uint8_t mask) {
+	for (size_t i = 0; i < MaxPolls; i++) {
+		counters.polls++;
+		if ((in(SMC_PORT_OFFSET_STATUS) & mask) == value)
+			return true;
+	}
+	return false;
+}
+
+bool SMCClientPMIO::sendCommand(SMC_COMMAND cmd) {
+	if (!waitStatus(0, SMC_STATUS_IB_CLOSED))
+		return false;
+	out(SMC_PORT_OFFSET_COMMAND, cmd);
+	return waitStatus(SMC_STATUS_BUSY, SMC_STATUS_BUSY);
+}
+
+bool SMCClientPMIO::sendBytes(const void *src, size_t size) {
+	for (size_t i = 0; i < size; i++) {
+		// Busy is checked separately after input buffer closure, like AppleSMC does.
+		if (!waitStatus(0, SMC_STATUS_IB_CLOSED) || !waitStatus(SMC_STATUS_BUSY, SMC_STATUS_BUSY))
+			return false;
+		out(SMC_PORT_OFFSET_DATA, static_cast<const uint8_t *>(src)[i]);
+	}
+	return true;
+}
+
+bool SMCClientPMIO::readBytes(void *dst, size_t size) {
+	for (size_t i = 0; i < size; i++) {
+		if (!waitStatus(SMC_STATUS_AWAITING_DATA | SMC_STATUS_BUSY, SMC_STATUS_AWAITING_DATA | SMC_STATUS_BUSY))
+			return false;
+		static_cast<uint8_t *>(dst)[i] = in(SMC_PORT_OFFSET_DATA);
+	}
+	return true;
+}
+
+SMC_RESULT SMCClientPMIO::finish() {
+	bool spurious = false;
+	for (size_t i = 0; i < MaxPolls; i++) {
+		counters.polls++;
+		if (!(in(SMC_PORT_OFFSET_STATUS) & SMC_STATUS_AWAITING_DATA))
+			break;
+		in(SMC_PORT_OFFSET_DATA);
+		spurious = true;
+	}
+
+	auto res = in(SMC_PORT_OFFSET_RESULT);
+	return spurious && res == SmcSuccess ? SmcSpuriousData : res;
+}
+
+void SMCClientPMIO::handleEvent() {
+	lastEvent = in(SMC_PORT_OFFSET_EVENT);
+}
+
+SMC_RESULT SMCClientPMIO::readValue(SMC_KEY key, SMC_DATA *data, SMC_DATA_SIZE size) {
+	if (sendCommand(SmcCmdReadValue) && sendBytes(&key, sizeof(key)) && sendBytes(&size, sizeof(size)) && readBytes(data, size))
+		return finish();
+	return SmcTimeoutError;
+}
+
+SMC_RESULT SMCClientPMIO::writeValue(SMC_KEY key, const SMC_DATA *data, SMC_DATA_SIZE size) {
+	if (sendCommand(SmcCmdWriteValue) && sendBytes(&key, sizeof(key)) && sendBytes(&size, sizeof(size)) && sendBytes(data, size))
+		return finish();
+	return SmcTimeoutError;
+}
+
+SMC_RESULT SMCClientPMIO::getKeyInfo(SMC_KEY key, KeyInfo &info) {
+	if (sendCommand(SmcCmdGetKeyInfo) && sendBytes(&key, sizeof(key)) && readBytes(&info, sizeof(info)))
+		return finish();
+	return SmcTimeoutError;
+}
+
+SMC_RESULT SMCClientPMIO::getKeyFromIndex(SMC_KEY_INDEX index, SMC_KEY &key) {
+	index = OSSwapHostToBigInt32(index);
+	if (sendCommand(SmcCmdGetKeyFromIndex) && sendBytes(&index, sizeof(index)) && readBytes(&key, sizeof(key)))
+		return finish();
+	return SmcTimeoutError;
+}
+
+SMCClientMMIO::SMCClientMMIO(VirtualSMC *smc) : SMCClient(smc),
+	base(VirtualSMCProvider::getMapping(VirtualSMCProvider::AppleSMCBufferMMIO)->getVirtualAddress()) {}
+
+void SMCClientMMIO::trapRead(size_t off) {
+	counters.traps++;
+	VirtualSMC::handleRead(base, base + off);
+}
+
+void SMCClientMMIO::trapWrite(size_t off) {
+	counters.traps++;
+	VirtualSMC::handleWrite(base, base + off);
+}
+
+void SMCClientMMIO::readBytes(size_t off, void *dst, size_t size) {
+	counters.reads++;
+	lilu_os_memcpy(dst, reinterpret_cast<const void *>(base + off), size);
+}
+
+void SMCClientMMIO::writeBytes(size_t off, const void *src, size_t size) {
+	// Every store faults separately.
+	for (size_t i = 0; i < size; i++)
+		write(off + i, static_cast<const uint8_t *>(src)[i]);
+}
+
+SMC_RESULT SMCClientMMIO::command(SMC_COMMAND cmd) {
+	keyDone = false;
+	write<SMC_KEY_ATTRIBUTES>(SMC_MMIO_WRITE_KEY_ATTRIBUTES, 0);
+	write<SMC_COMMAND>(SMC_MMIO_WRITE_COMMAND, cmd);
+
+	if (eventsEnabled) {
+		// Key done interrupt is delivered before the command write returns.
+		if (!keyDone)
+			return SmcTimeoutError;
+	} else {
+		size_t i = 0;
+		for (; i < MaxPolls; i++) {
+			counters.polls++;
+			if (read<SMC_STATUS>(SMC_MMIO_READ_KEY_STATUS) & SMC_STATUS_KEY_DONE)
+				break;
+		}
+		if (i == MaxPolls)
+			return SmcTimeoutError;
+	}
+
+	return read<SMC_RESULT>(SMC_MMIO_READ_RESULT);
+}
+
+void SMCClientMMIO::handleEvent() {
+	counters.polls++;
+	if (read<SMC_STATUS>(SMC_MMIO_READ_EVENT_STATUS) & SMC_STATUS_KEY_DONE) {
+		// Event code is still taken from the legacy port.
+		counters.reads++;
+		auto port = VirtualSMCProvider::getMapping(VirtualSMCProvider::AppleSMCBufferPMIO)->getPhysicalAddress();
+		lastEvent = smc->ioRead8(static_cast<UInt16>(port) + SMC_PORT_OFFSET_EVENT, nullptr);
+		if (lastEvent == SmcEventKeyDone)
+			keyDone = true;
+	}
+}
+
+SMC_RESULT SMCClientMMIO::readValue(SMC_KEY key, SMC_DATA *data, SMC_DATA_SIZE size) {
+	write(SMC_MMIO_WRITE_KEY, key);
+	write(SMC_MMIO_WRITE_DATA_SIZE, size);
+	auto res = command(SmcCmdReadValue);
+	if (res == SmcSuccess)
+		readBytes(SMC_MMIO_DATA_VARIABLE, data, size);
+	return res;
+}
+
+SMC_RESULT SMCClientMMIO::writeValue(SMC_KEY key, const SMC_DATA *data, SMC_DATA_SIZE size) {
+	write(SMC_MMIO_WRITE_KEY, key);
+	write(SMC_MMIO_WRITE_DATA_SIZE, size);
+	writeBytes(SMC_MMIO_DATA_VARIABLE, data, size);
+	return command(SmcCmdWriteValue);
+}
+
+SMC_RESULT SMCClientMMIO::getKeyInfo(SMC_KEY key, KeyInfo &info) {
+	// MMIO reports key type first and pads it to 5 bytes.
+	struct PACKED {
+		SMC_KEY_TYPE type;
+		SMC_DATA unused;
+		SMC_DATA_SIZE size;
+		SMC_KEY_ATTRIBUTES attr;
+	} mmioInfo;
+
+	write(SMC_MMIO_WRITE_KEY, key);
+	auto res = command(SmcCmdGetKeyInfo);
+	if (res == SmcSuccess) {
+		readBytes(SMC_MMIO_DATA_VARIABLE, &mmioInfo, sizeof(mmioInfo));
+		info.size = mmioInfo.size;
+		info.type = mmioInfo.type;
+		info.attr = mmioInfo.attr;
+	}
+	return res;
+}
+
+SMC_RESULT SMCClientMMIO::getKeyFromIndex(SMC_KEY_INDEX index, SMC_KEY &key) {
+	write<SMC_KEY_INDEX>(SMC_MMIO_WRITE_INDEX, OSSwapHostToBigInt32(index));
+	auto res = command(SmcCmdGetKeyFromIndex);
+	if (res == SmcSuccess)
+		readBytes(SMC_MMIO_DATA_VARIABLE, &key, sizeof(key));
+	return res;
+}
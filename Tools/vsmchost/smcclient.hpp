@@ -0,0 +1,252 @@
+//
+//  smcclient.hpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef smcclient_hpp
+#define smcclient_hpp
+
+#include <Headers/kern_util.hpp>
+#include <VirtualSMCSDK/AppleSmcBridge.hpp>
+
+class VirtualSMC;
+
+/**
+ *  AppleSMC client side of the SMC protocols.
+ *  Commands are issued with the same access sequences and status polling
+ *  AppleSMC uses, and every device access is counted.
+ */
+class SMCClient {
+public:
+	/**
+	 *  Key information as returned by SmcCmdGetKeyInfo
+	 */
+	struct PACKED KeyInfo {
+		SMC_DATA_SIZE size;
+		SMC_KEY_TYPE type;
+		SMC_KEY_ATTRIBUTES attr;
+	};
+
+	/**
+	 *  Device access counters
+	 */
+	struct Counters {
+		uint64_t reads;   ///< port reads or memory reads
+		uint64_t writes;  ///< port writes or memory writes
+		uint64_t traps;   ///< memory accesses caught by the provider trap handler
+		uint64_t polls;   ///< status register reads
+		uint64_t events;  ///< delivered interrupts
+	};
+
+	/**
+	 *  Status reads before a wait is considered timed out.
+	 *  The emulated device answers immediately, so any extra poll is a protocol issue.
+	 */
+	static constexpr size_t MaxPolls {16};
+
+	virtual ~SMCClient() = default;
+
+	/**
+	 *  Transport name
+	 */
+	virtual const char *getName() const = 0;
+
+	/**
+	 *  Read key value
+	 *
+	 *  @param key   key name
+	 *  @param data  value buffer of at least size bytes
+	 *  @param size  value size reported by key info
+	 *
+	 *  @return SmcSuccess or error
+	 */
+	virtual SMC_RESULT readValue(SMC_KEY key, SMC_DATA *data, SMC_DATA_SIZE size) = 0;
+
+	/**
+	 *  Write key value
+	 *
+	 *  @param key   key name
+	 *  @param data  value
+	 *  @param size  value size reported by key info
+	 *
+	 *  @return SmcSuccess or error
+	 */
+	virtual SMC_RESULT writeValue(SMC_KEY key, const SMC_DATA *data, SMC_DATA_SIZE size) = 0;
+
+	/**
+	 *  Read key information
+	 *
+	 *  @param key   key name
+	 *  @param info  key information
+	 *
+	 *  @return SmcSuccess or error
+	 */
+	virtual SMC_RESULT getKeyInfo(SMC_KEY key, KeyInfo &info) = 0;
+
+	/**
+	 *  Read key name by index
+	 *
+	 *  @param index  key index
+	 *  @param key    key name
+	 *
+	 *  @return SmcSuccess or error
+	 */
+	virtual SMC_RESULT getKeyFromIndex(SMC_KEY_INDEX index, SMC_KEY &key) = 0;
+
+	/**
+	 *  Register interrupt handler and enable notifications through NTOK
+	 *
+	 *  @return true on success
+	 */
+	bool enableEvents();
+
+	/**
+	 *  Obtain last delivered event code
+	 */
+	SMC_EVENT_CODE getLastEvent() const {
+		return lastEvent;
+	}
+
+	/**
+	 *  Obtain device access counters
+	 */
+	const Counters &getCounters() const {
+		return counters;
+	}
+
+protected:
+	SMCClient(VirtualSMC *smc) : smc(smc) {}
+
+	/**
+	 *  Emulated device
+	 */
+	VirtualSMC *smc;
+
+	/**
+	 *  Device access counters
+	 */
+	Counters counters {};
+
+	/**
+	 *  Interrupts are registered and NTOK is set
+	 */
+	bool eventsEnabled {false};
+
+	/**
+	 *  Last event code read by the interrupt handler
+	 */
+	SMC_EVENT_CODE lastEvent {0};
+
+	/**
+	 *  Read event information from the device, called from the interrupt handler
+	 */
+	virtual void handleEvent() = 0;
+
+private:
+	/**
+	 *  Interrupt handler registered with VirtualSMC
+	 */
+	static void interruptHandler(OSObject *target, void *refCon, IOService *nub, int source);
+};
+
+/**
+ *  Port i/o transport (1st generation SMC)
+ */
+class SMCClientPMIO : public SMCClient {
+	UInt16 base;
+
+	uint8_t in(UInt16 port);
+	void out(UInt16 port, uint8_t value);
+
+	/**
+	 *  Poll status until masked bits match
+	 *
+	 *  @return true on success
+	 */
+	bool waitStatus(uint8_t value, uint8_t mask);
+
+	bool sendCommand(SMC_COMMAND cmd);
+	bool sendBytes(const void *src, size_t size);
+	bool readBytes(void *dst, size_t size);
+
+	/**
+	 *  Drain unexpected data and read command result
+	 */
+	SMC_RESULT finish();
+
+protected:
+	void handleEvent() override;
+
+public:
+	SMCClientPMIO(VirtualSMC *smc);
+
+	const char *getName() const override {
+		return "pmio";
+	}
+
+	SMC_RESULT readValue(SMC_KEY key, SMC_DATA *data, SMC_DATA_SIZE size) override;
+	SMC_RESULT writeValue(SMC_KEY key, const SMC_DATA *data, SMC_DATA_SIZE size) override;
+	SMC_RESULT getKeyInfo(SMC_KEY key, KeyInfo &info) override;
+	SMC_RESULT getKeyFromIndex(SMC_KEY_INDEX index, SMC_KEY &key) override;
+};
+
+/**
+ *  Memory mapped i/o transport (2nd generation SMC).
+ *  The main area is read-only and the status area is not accessible for
+ *  the guest, so every write and every status read reaches VirtualSMC
+ *  through the provider trap handler.
+ */
+class SMCClientMMIO : public SMCClient {
+	mach_vm_address_t base;
+
+	/**
+	 *  Key done was reported by the interrupt handler
+	 */
+	bool keyDone {false};
+
+	template <typename T>
+	T read(size_t off) {
+		if (off >= SMC_MMIO_READ_EVENT_STATUS)
+			trapRead(off);
+		counters.reads++;
+		T value;
+		lilu_os_memcpy(&value, reinterpret_cast<const void *>(base + off), sizeof(T));
+		return value;
+	}
+
+	template <typename T>
+	void write(size_t off, T value) {
+		counters.writes++;
+		lilu_os_memcpy(reinterpret_cast<void *>(base + off), &value, sizeof(T));
+		trapWrite(off);
+	}
+
+	void readBytes(size_t off, void *dst, size_t size);
+	void writeBytes(size_t off, const void *src, size_t size);
+	void trapRead(size_t off);
+	void trapWrite(size_t off);
+
+	/**
+	 *  Submit command and wait for completion
+	 */
+	SMC_RESULT command(SMC_COMMAND cmd);
+
+protected:
+	void handleEvent() override;
+
+public:
+	SMCClientMMIO(VirtualSMC *smc);
+
+	const char *getName() const override {
+		return "mmio";
+	}
+
+	SMC_RESULT readValue(SMC_KEY key, SMC_DATA *data, SMC_DATA_SIZE size) override;
+	SMC_RESULT writeValue(SMC_KEY key, const SMC_DATA *data, SMC_DATA_SIZE size) override;
+	SMC_RESULT getKeyInfo(SMC_KEY key, KeyInfo &info) override;
+	SMC_RESULT getKeyFromIndex(SMC_KEY_INDEX index, SMC_KEY &key) override;
+};
+
+#endif /* smcclient_hpp */
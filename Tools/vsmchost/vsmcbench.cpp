@@ -0,0 +1,262 @@
+//
+//  vsmcbench.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <Headers/kern_util.hpp>
+#include <Headers/kern_iokit.hpp>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../../VirtualSMC/kern_derived.hpp"
+#include "../../VirtualSMC/kern_vsmc.hpp"
+#include "smcclient.hpp"
+#include "vsmchost.hpp"
+
+namespace {
+	struct Key {
+		SMC_KEY key;
+		SMCClient::KeyInfo info;
+	};
+
+	void report(const char *name, size_t ops, uint64_t ns, size_t errors) {
+		printf("%-16s %10zu ops %12.1f ns/op %8zu errors\n", name, ops, ops ? static_cast<double>(ns) / ops : 0.0, errors);
+	}
+
+	template <typename F>
+	void measure(const char *name, size_t ops, F func) {
+		size_t errors = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < ops; i++)
+			if (!func(i))
+				errors++;
+		auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		report(name, ops, static_cast<uint64_t>(ns), errors);
+	}
+
+	/**
+	 *  Run key protocol loops over the public key list
+	 */
+	void runProtocol(SMCClient &client, const std::vector<Key> &keys, size_t iterations, bool writes) {
+		std::vector<const Key *> readable, writable;
+		for (auto &k : keys) {
+			if (k.info.attr & SMC_KEY_ATTRIBUTE_FUNCTION)
+				continue;
+			if (k.info.attr & SMC_KEY_ATTRIBUTE_READ)
+				readable.push_back(&k);
+			if ((k.info.attr & SMC_KEY_ATTRIBUTE_WRITE) && (k.info.attr & SMC_KEY_ATTRIBUTE_READ))
+				writable.push_back(&k);
+		}
+
+		std::string name;
+		SMC_DATA data[SMC_MAX_DATA_SIZE];
+
+		name = std::string(client.getName()) + " index";
+		measure(name.c_str(), iterations, [&](size_t i) {
+			SMC_KEY key;
+			return client.getKeyFromIndex(static_cast<SMC_KEY_INDEX>(i % keys.size()), key) == SmcSuccess;
+		});
+
+		name = std::string(client.getName()) + " keyinfo";
+		measure(name.c_str(), iterations, [&](size_t i) {
+			SMCClient::KeyInfo info;
+			return client.getKeyInfo(keys[i % keys.size()].key, info) == SmcSuccess;
+		});
+
+		if (!readable.empty()) {
+			name = std::string(client.getName()) + " read";
+			measure(name.c_str(), iterations, [&](size_t i) {
+				auto k = readable[i % readable.size()];
+				return client.readValue(k->key, data, k->info.size) == SmcSuccess;
+			});
+		}
+
+		if (writes && !writable.empty()) {
+			name = std::string(client.getName()) + " write";
+			measure(name.c_str(), iterations, [&](size_t i) {
+				auto k = writable[i % writable.size()];
+				return client.readValue(k->key, data, k->info.size) == SmcSuccess &&
+					client.writeValue(k->key, data, k->info.size) == SmcSuccess;
+			});
+		}
+	}
+
+	/**
+	 *  Evaluate derived key expressions over plugin sensor keys
+	 */
+	void runDerived(VirtualSMCKeystore *kstore, size_t iterations) {
+		constexpr char Digits[] = "0123456789ABCDEF";
+		VirtualSMCAPI::Plugin plugin;
+		plugin.product = "vsmcbench";
+		plugin.version = 1;
+		plugin.apiver = VirtualSMCAPI::Version;
+		for (size_t i = 0; i < 16; i++) {
+			VirtualSMCAPI::addKey(SMC_MAKE_IDENTIFIER('T', 'C', Digits[i], 'C'), plugin.data, VirtualSMCAPI::valueWithSp(40 + i, SmcKeyTypeSp78));
+			VirtualSMCAPI::addKey(SMC_MAKE_IDENTIFIER('P', 'C', Digits[i], 'R'), plugin.data, VirtualSMCAPI::valueWithFlt(1.5f + i));
+		}
+		if (kstore->loadPlugin(&plugin) != kIOReturnSuccess) {
+			fprintf(stderr, "Failed to load derived keys plugin\n");
+			return;
+		}
+
+		static constexpr const char *Expressions[][2] {
+			{"max", "max(TC?C)"},
+			{"sum", "sum(PC*) / 2"},
+			{"keys", "TC0C + TC1C"}
+		};
+
+		for (auto &e : Expressions) {
+			DerivedExpression expr;
+			int64_t result;
+			if (!expr.compile(e[1])) {
+				fprintf(stderr, "Failed to compile %s\n", e[1]);
+				continue;
+			}
+			std::string name = std::string("derived ") + e[0];
+			measure(name.c_str(), iterations, [&](size_t) {
+				return expr.evaluate(kstore, result);
+			});
+			// Compilation drops resolved keys like plugin loading does with the generation.
+			name = std::string("resolve ") + e[0];
+			measure(name.c_str(), iterations, [&](size_t) {
+				return expr.compile(e[1]) && expr.evaluate(kstore, result);
+			});
+		}
+
+		kstore->unloadPlugin(&plugin);
+		plugin.data.deinit();
+	}
+
+	void usage(const char *name) {
+		fprintf(stderr,
+			"Usage: %s [options] [boot-args]\n"
+			"    -p <plist>   VirtualSMC Info.plist (default: %s)\n"
+			"    -b <board>   board-id used for model info lookup\n"
+			"    -l           laptop computer model (desktop by default)\n"
+			"    -n <count>   protocol iterations (default: 1000000)\n"
+			"    -s <count>   service starts (default: 100)\n"
+			"    -w           also write back read-write keys\n"
+			"    -h           help\n"
+			"Remaining arguments are passed as boot arguments, e.g. -vsmcstat vsmcgen=1\n",
+			name, VSMCHOST_DEFAULT_PLIST);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	const char *plist = VSMCHOST_DEFAULT_PLIST;
+	const char *board = nullptr;
+	int model = WIOKit::ComputerModel::ComputerDesktop;
+	size_t iterations = 1000000;
+	size_t starts = 100;
+	bool writes = false;
+	std::string bootArgs;
+
+	for (int i = 1; i < argc; i++) {
+		auto arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (!strcmp(arg, "-p") && hasValue) {
+			plist = argv[++i];
+		} else if (!strcmp(arg, "-b") && hasValue) {
+			board = argv[++i];
+		} else if (!strcmp(arg, "-l")) {
+			model = WIOKit::ComputerModel::ComputerLaptop;
+		} else if (!strcmp(arg, "-n") && hasValue) {
+			iterations = strtoull(argv[++i], nullptr, 0);
+		} else if (!strcmp(arg, "-s") && hasValue) {
+			starts = strtoull(argv[++i], nullptr, 0);
+		} else if (!strcmp(arg, "-w")) {
+			writes = true;
+		} else if (!strcmp(arg, "-h")) {
+			usage(argv[0]);
+			return 0;
+		} else {
+			bootArgs += bootArgs.empty() ? "" : " ";
+			bootArgs += arg;
+		}
+	}
+
+	vsmchostSetBootArgs(bootArgs.c_str());
+	vsmchostSetComputer(model, board);
+	ADDPR(debugEnabled) = checkKernelArgument("-vsmcdbg");
+
+	auto personality = vsmchostLoadPersonality(plist);
+	if (!personality) {
+		fprintf(stderr, "Failed to load VirtualSMC personality from %s\n", plist);
+		return 1;
+	}
+
+	auto provider = new IOService;
+	VirtualSMC *smc = nullptr;
+	std::vector<std::pair<std::string, uint64_t>> phases;
+	uint64_t ns = 0;
+	for (size_t i = 0; i < (starts ? starts : 1); i++) {
+		if (smc)
+			smc->stop(provider);
+		auto start = std::chrono::steady_clock::now();
+		smc = vsmchostStartService(personality, provider);
+		ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		if (!smc) {
+			fprintf(stderr, "Failed to start VirtualSMC\n");
+			return 1;
+		}
+
+		// Deferred initialisation is not part of the start time
+		vsmchostRunTimers(true);
+		auto profile = OSDynamicCast(OSDictionary, smc->getProperty("StartupProfile"));
+		for (unsigned int p = 0; profile && p < profile->getCount(); p++) {
+			auto name = profile->getKey(p);
+			auto num = OSDynamicCast(OSNumber, profile->getObject(name));
+			if (!num)
+				continue;
+			auto it = std::find_if(phases.begin(), phases.end(), [name](auto &ph) { return ph.first == name; });
+			if (it == phases.end())
+				phases.emplace_back(name, num->unsigned64BitValue());
+			else
+				it->second += num->unsigned64BitValue();
+		}
+	}
+
+	SMCClientPMIO pmio(smc);
+	std::vector<Key> keys;
+	for (SMC_KEY_INDEX i = 0; ; i++) {
+		Key k {};
+		if (pmio.getKeyFromIndex(i, k.key) != SmcSuccess || pmio.getKeyInfo(k.key, k.info) != SmcSuccess)
+			break;
+		keys.push_back(k);
+	}
+
+	uint8_t gen = 0;
+	pmio.readValue(SMC_MAKE_KEY('R', 'G', 'E', 'N'), &gen, sizeof(gen));
+	printf("%zu keys, generation %u, board-id %s\n", keys.size(), gen, board ? board : "none");
+	report("start", starts ? starts : 1, static_cast<uint64_t>(ns), 0);
+	for (auto &ph : phases)
+		printf("  %-24s %12.1f ns\n", ph.first.c_str(), static_cast<double>(ph.second) / (starts ? starts : 1));
+
+	if (keys.empty()) {
+		fprintf(stderr, "No keys are available\n");
+		return 1;
+	}
+
+	runProtocol(pmio, keys, iterations, writes);
+	if (gen >= 2) {
+		SMCClientMMIO mmio(smc);
+		runProtocol(mmio, keys, iterations, writes);
+	}
+
+	runDerived(VirtualSMC::getKeystore(), iterations);
+
+	auto stats = VirtualSMC::getKeystore()->copyStatistics();
+	if (stats) {
+		auto missing = OSDynamicCast(OSNumber, stats->getObject("missing"));
+		printf("statistics recorded for %u keys, %llu missing key operations\n", stats->getCount() - (missing != nullptr),
+			missing ? missing->unsigned64BitValue() : 0ULL);
+		stats->release();
+	}
+
+	personality->release();
+	return 0;
+}
@@ -0,0 +1,211 @@
+//
+//  vsmchost.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <Headers/kern_util.hpp>
+#include <Headers/kern_iokit.hpp>
+#include <Headers/kern_patcher.hpp>
+#include <Headers/kern_efi.hpp>
+#include <chrono>
+#include <ctime>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "../../VirtualSMC/kern_prov.hpp"
+#include "../../VirtualSMC/kern_vsmc.hpp"
+#include "../../VirtualSMC/kern_efiend.hpp"
+#include "vsmchost.hpp"
+
+bool ADDPR(debugEnabled) {false};
+
+// VirtualSMC falls back to V1 when Lilu did not start.
+bool ADDPR(startSuccess) {true};
+
+static OSBoolean booleanTrue {true};
+static OSBoolean booleanFalse {false};
+OSBoolean *const kOSBooleanTrue {&booleanTrue};
+OSBoolean *const kOSBooleanFalse {&booleanFalse};
+
+const IORegistryPlane *gIOServicePlane {nullptr};
+const IORegistryPlane *gIODTPlane {nullptr};
+const OSSymbol *gIOFirstPublishNotification {OSSymbol::withCString("IOServiceFirstPublish")};
+
+IOSimpleLock *KernelPatcher::kernelWriteLock {IOSimpleLockAlloc()};
+
+EFI_GUID EfiRuntimeServices::LiluVendorGuid {};
+EFI_GUID EfiRuntimeServices::LiluReadOnlyGuid {};
+EFI_GUID EfiRuntimeServices::LiluWriteOnlyGuid {};
+
+/**
+ *  Host configuration
+ */
+static char bootArgs[1024];
+static int computerModel {WIOKit::ComputerModel::ComputerDesktop};
+static char boardIdentifier[64];
+
+void vsmchostSetBootArgs(const char *args) {
+	lilu_os_strlcpy(bootArgs, args ? args : "", sizeof(bootArgs));
+}
+
+void vsmchostSetComputer(int model, const char *board) {
+	computerModel = model;
+	lilu_os_strlcpy(boardIdentifier, board ? board : "", sizeof(boardIdentifier));
+}
+
+uint64_t mach_absolute_time() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+extern "C" int cpu_number(void) {
+#ifdef __linux__
+	int cpu = sched_getcpu();
+	return cpu >= 0 ? cpu : 0;
+#else
+	return 0;
+#endif
+}
+
+bool PE_parse_boot_argn(const char *name, void *value, int size) {
+	size_t nameLen = strlen(name);
+	const char *arg = bootArgs;
+	while (*arg) {
+		while (*arg == ' ')
+			arg++;
+		size_t argLen = strcspn(arg, " ");
+		if (argLen >= nameLen && !strncmp(arg, name, nameLen) && (argLen == nameLen || arg[nameLen] == '=')) {
+			// Flags and valueless arguments are reported as present without touching the value.
+			if (argLen == nameLen || name[0] == '-')
+				return true;
+
+			char str[256] {};
+			size_t valLen = argLen - nameLen - 1;
+			lilu_os_memcpy(str, arg + nameLen + 1, valLen < sizeof(str) - 1 ? valLen : sizeof(str) - 1);
+
+			char *end = nullptr;
+			auto num = strtoll(str, &end, 0);
+			if (end != str && *end == '\0') {
+				// Numbers are stored as little endian integers truncated to the requested width.
+				if (size > 0)
+					lilu_os_memcpy(value, &num, size < static_cast<int>(sizeof(num)) ? size : sizeof(num));
+			} else if (size > 0) {
+				lilu_os_strlcpy(static_cast<char *>(value), str, size);
+			}
+			return true;
+		}
+		arg += argLen;
+	}
+
+	return false;
+}
+
+int WIOKit::getComputerModel() {
+	return computerModel;
+}
+
+bool WIOKit::getComputerInfo(char *modelBuf, size_t modelBufSize, char *boardIdBuf, size_t boardIdBufSize) {
+	if (modelBuf && modelBufSize > 0)
+		modelBuf[0] = '\0';
+	if (boardIdBuf && boardIdBufSize > 0)
+		lilu_os_strlcpy(boardIdBuf, boardIdentifier, boardIdBufSize);
+	return boardIdentifier[0] != '\0';
+}
+
+OSDictionary *vsmchostLoadPersonality(const char *path) {
+	auto root = vsmchostLoadPlist(path);
+	auto dict = OSDynamicCast(OSDictionary, root);
+	auto personalities = dict ? OSDynamicCast(OSDictionary, dict->getObject("IOKitPersonalities")) : nullptr;
+	auto personality = personalities ? OSDynamicCast(OSDictionary, personalities->getObject("as.vit9696.VirtualSMC")) : nullptr;
+	if (personality)
+		personality->retain();
+	if (root)
+		root->release();
+	return personality;
+}
+
+VirtualSMC *vsmchostStartService(OSDictionary *personality, IOService *provider) {
+	if (!VirtualSMCProvider::getInstance())
+		return nullptr;
+
+	auto smc = new VirtualSMC;
+	for (unsigned int i = 0; i < personality->getCount(); i++) {
+		auto name = personality->getKey(i);
+		smc->setProperty(name, personality->getObject(name));
+	}
+
+	if (!smc->start(provider)) {
+		smc->release();
+		return nullptr;
+	}
+
+	return smc;
+}
+
+IOPlatformExpert *IOService::getPlatform() {
+	static IOPlatformExpert platform;
+	return &platform;
+}
+
+long IOPlatformExpert::getGMTTimeOfDay() {
+	return static_cast<long>(time(nullptr));
+}
+
+IOTimerEventSource *IOTimerEventSource::timers;
+
+IOTimerEventSource *IOTimerEventSource::timerEventSource(OSObject *owner, Action action) {
+	auto timer = new IOTimerEventSource;
+	timer->owner = owner;
+	timer->action = action;
+	timer->next = timers;
+	timers = timer;
+	return timer;
+}
+
+void vsmchostRunTimers(bool all) {
+	auto now = mach_absolute_time();
+	for (auto timer = IOTimerEventSource::timers; timer; timer = timer->next) {
+		if (timer->deadline != 0 && (all || timer->deadline <= now)) {
+			timer->deadline = 0;
+			timer->action(timer->owner, timer);
+		}
+	}
+}
+
+/**
+ *  Device memory is plain host memory, PMIO keeps its port base so that
+ *  VirtualSMC::ioVerify accepts the same port numbers as on real hardware.
+ */
+VirtualSMCProvider *VirtualSMCProvider::instance;
+
+void VirtualSMCProvider::init() {
+	memoryMaps[AppleSMCBufferPMIO] = IOMemoryMap::withRange(SMC_PORT_BASE, SMCProtocolPMIO::WindowSize);
+
+	auto mmio = calloc(1, SMCProtocolMMIO::WindowAllocSize);
+	if (!mmio)
+		PANIC("prov", "mmio window alloc failure");
+	memoryMaps[AppleSMCBufferMMIO] = IOMemoryMap::withRange(reinterpret_cast<mach_vm_address_t>(mmio), SMCProtocolMMIO::WindowAllocSize);
+
+	firmwareStatus = EfiBackend::detectFirmwareBackend();
+}
+
+/**
+ *  There is no firmware or NVRAM on the host
+ */
+bool EfiBackend::detectFirmwareBackend() {
+	return false;
+}
+
+bool EfiBackend::submitEncryptionKey(const uint8_t *key, bool allowEncryption) {
+	return false;
+}
+
+bool EfiBackend::eraseTempEncryptionKey() {
+	return false;
+}
+
+void EfiBackend::readSerials(uint8_t *mlb, size_t mlbSize, uint8_t *rom, size_t romSize) {
+}
@@ -0,0 +1,67 @@
+//
+//  vsmchost.hpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef vsmchost_hpp
+#define vsmchost_hpp
+
+#include <xnu_host.hpp>
+
+class VirtualSMC;
+
+/**
+ *  Replace boot arguments seen by PE_parse_boot_argn
+ *
+ *  @param args  space separated argument list, e.g. "-vsmcstat vsmcgen=1"
+ */
+void vsmchostSetBootArgs(const char *args);
+
+/**
+ *  Select computer model reported by WIOKit
+ *
+ *  @param model  WIOKit::ComputerModel value
+ *  @param board  board-id or nullptr for none
+ */
+void vsmchostSetComputer(int model, const char *board);
+
+/**
+ *  Load XML property list
+ *
+ *  @param path  file path
+ *
+ *  @return root object (must be released) or nullptr
+ */
+OSObject *vsmchostLoadPlist(const char *path);
+
+/**
+ *  Parse XML property list
+ *
+ *  @param xml   null-terminated property list contents
+ *
+ *  @return root object (must be released) or nullptr
+ */
+OSObject *vsmchostParsePlist(const char *xml);
+
+/**
+ *  Load VirtualSMC IOKit personality from Info.plist
+ *
+ *  @param path  Info.plist path
+ *
+ *  @return personality dictionary (must be released) or nullptr
+ */
+OSDictionary *vsmchostLoadPersonality(const char *path);
+
+/**
+ *  Create and start VirtualSMC the way IOKit matching does
+ *
+ *  @param personality  personality properties copied to the service
+ *  @param provider     service provider
+ *
+ *  @return started service or nullptr
+ */
+VirtualSMC *vsmchostStartService(OSDictionary *personality, IOService *provider);
+
+#endif /* vsmchost_hpp */
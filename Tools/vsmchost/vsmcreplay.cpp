@@ -0,0 +1,478 @@
+//
+//  vsmcreplay.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <Headers/kern_util.hpp>
+#include <Headers/kern_iokit.hpp>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../../VirtualSMC/kern_vsmc.hpp"
+#include "smcclient.hpp"
+#include "vsmchost.hpp"
+
+namespace {
+	using Record = VirtualSMCCapture::Record;
+	using Header = VirtualSMCCapture::Header;
+
+	/**
+	 *  Replayed commands in report order
+	 */
+	constexpr SMC_COMMAND commands[] {SmcCmdReadValue, SmcCmdWriteValue, SmcCmdGetKeyInfo, SmcCmdGetKeyFromIndex};
+	const char *commandNames[] {"read", "write", "keyinfo", "index"};
+	constexpr size_t CommandMax {arrsize(commands)};
+
+	/**
+	 *  Largest response a client may be asked for, SMC_DATA_SIZE is a byte
+	 */
+	constexpr size_t MaxResponseSize {256};
+
+	/**
+	 *  Key info as laid out by MMIO
+	 */
+	struct PACKED KeyInfoMMIO {
+		SMC_KEY_TYPE type;
+		SMC_DATA unused;
+		SMC_DATA_SIZE size;
+		SMC_KEY_ATTRIBUTES attr;
+	};
+
+	/**
+	 *  Response produced by the replayed build
+	 */
+	struct Response {
+		SMC_RESULT result;
+		SMC_DATA_SIZE size;
+		SMC_DATA data[MaxResponseSize];
+	};
+
+	struct CommandStats {
+		std::vector<uint64_t> latencies;
+		size_t mismatches {0};
+	};
+
+	uint64_t now() {
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	std::string keyName(uint32_t key) {
+		char name[sizeof(SMC_KEY) + 1] {};
+		lilu_os_memcpy(name, &key, sizeof(SMC_KEY));
+		for (size_t i = 0; i < sizeof(SMC_KEY); i++)
+			if (name[i] < ' ' || name[i] > '~')
+				name[i] = '?';
+		return name;
+	}
+
+	size_t commandIndex(SMC_COMMAND cmd) {
+		for (size_t i = 0; i < CommandMax; i++)
+			if (commands[i] == cmd)
+				return i;
+		return CommandMax;
+	}
+
+	/**
+	 *  Find TrafficCapture data in an ioreg -a property list
+	 */
+	OSData *findCapture(OSObject *obj) {
+		if (auto dict = OSDynamicCast(OSDictionary, obj)) {
+			if (auto data = OSDynamicCast(OSData, dict->getObject("TrafficCapture")))
+				return data;
+			for (unsigned int i = 0; i < dict->getCount(); i++)
+				if (auto data = findCapture(dict->getObject(dict->getKey(i))))
+					return data;
+		} else if (auto arr = OSDynamicCast(OSArray, obj)) {
+			for (unsigned int i = 0; i < arr->getCount(); i++)
+				if (auto data = findCapture(arr->getObject(i)))
+					return data;
+		}
+		return nullptr;
+	}
+
+	/**
+	 *  Load raw capture or extract it from ioreg -a output
+	 */
+	bool loadCapture(const char *path, Header &header, std::vector<Record> &records) {
+		auto file = fopen(path, "rb");
+		if (!file)
+			return false;
+		std::vector<uint8_t> raw;
+		uint8_t chunk[4096];
+		size_t n;
+		while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0)
+			raw.insert(raw.end(), chunk, chunk + n);
+		fclose(file);
+
+		if (raw.size() < sizeof(uint32_t) || *reinterpret_cast<const uint32_t *>(raw.data()) != VirtualSMCCapture::Magic) {
+			raw.push_back('\0');
+			auto root = vsmchostParsePlist(reinterpret_cast<const char *>(raw.data()));
+			auto data = root ? findCapture(root) : nullptr;
+			if (data) {
+				auto bytes = static_cast<const uint8_t *>(data->getBytesNoCopy());
+				raw.assign(bytes, bytes + data->getLength());
+			} else {
+				raw.clear();
+			}
+			if (root)
+				root->release();
+		}
+
+		if (raw.size() < sizeof(Header))
+			return false;
+		lilu_os_memcpy(&header, raw.data(), sizeof(Header));
+		if (header.magic != VirtualSMCCapture::Magic || header.version != VirtualSMCCapture::Version ||
+			header.recordSize != sizeof(Record) || raw.size() < sizeof(Header) + header.count * sizeof(Record))
+			return false;
+		header.board[sizeof(header.board) - 1] = '\0';
+
+		records.resize(header.count);
+		lilu_os_memcpy(records.data(), raw.data() + sizeof(Header), header.count * sizeof(Record));
+		return true;
+	}
+
+	/**
+	 *  Lay out key info the way the recorded transport returned it
+	 */
+	void storeKeyInfo(Response &resp, uint8_t transport, SMC_DATA_SIZE size, SMC_KEY_TYPE type, SMC_KEY_ATTRIBUTES attr) {
+		if (transport == VirtualSMCCapture::TransportMMIO) {
+			KeyInfoMMIO info {type, 0, size, attr};
+			resp.size = sizeof(info);
+			lilu_os_memcpy(resp.data, &info, sizeof(info));
+		} else {
+			SMCClient::KeyInfo info {size, type, attr};
+			resp.size = sizeof(info);
+			lilu_os_memcpy(resp.data, &info, sizeof(info));
+		}
+	}
+
+	/**
+	 *  Issue recorded transaction through its transport with AppleSMC access sequences
+	 */
+	void replayProtocol(SMCClient &client, const Record &r, Response &resp) {
+		resp.size = 0;
+		switch (r.command) {
+			case SmcCmdReadValue:
+				resp.size = r.size;
+				resp.result = client.readValue(r.key, resp.data, r.size);
+				break;
+			case SmcCmdWriteValue:
+				resp.size = r.size;
+				lilu_os_memcpy(resp.data, r.data, r.size);
+				resp.result = client.writeValue(r.key, r.data, r.size);
+				break;
+			case SmcCmdGetKeyInfo: {
+				SMCClient::KeyInfo info {};
+				resp.result = client.getKeyInfo(r.key, info);
+				if (resp.result == SmcSuccess)
+					storeKeyInfo(resp, r.transport, info.size, info.type, info.attr);
+				break;
+			}
+			default: {
+				SMC_KEY key = 0;
+				resp.result = client.getKeyFromIndex(r.key, key);
+				resp.size = sizeof(key);
+				lilu_os_memcpy(resp.data, &key, sizeof(key));
+				break;
+			}
+		}
+	}
+
+	/**
+	 *  AppleSMC enables MMIO events by writing 1 to NTOK, after that every command completion is an interrupt
+	 */
+	bool isEventEnable(const Record &r) {
+		return r.command == SmcCmdWriteValue && r.key == SMC_MAKE_KEY('N', 'T', 'O', 'K') && r.size == 1 && r.data[0] == 1;
+	}
+
+	/**
+	 *  Register the interrupt handler before writing NTOK, so that key done events are acknowledged like AppleSMC does
+	 */
+	void replayEventEnable(SMCClient &client, const Record &r, Response &resp) {
+		resp.size = r.size;
+		lilu_os_memcpy(resp.data, r.data, r.size);
+		resp.result = client.enableEvents() ? SmcSuccess : SmcError;
+	}
+
+	/**
+	 *  Issue recorded transaction directly to the keystore with protocol result rules
+	 */
+	void replayKeystore(VirtualSMCKeystore *keystore, const Record &r, Response &resp) {
+		resp.size = 0;
+		switch (r.command) {
+			case SmcCmdReadValue:
+				resp.result = keystore->readValueByName(r.key, resp.data, resp.size);
+				// PMIO transfers the requested amount and reports any other size as a mismatch.
+				if (r.transport == VirtualSMCCapture::TransportPMIO && (resp.result != SmcSuccess || resp.size != r.size)) {
+					if (resp.result == SmcSuccess)
+						resp.result = SmcKeySizeMismatch;
+					resp.size = r.size;
+				}
+				break;
+			case SmcCmdWriteValue:
+				resp.size = r.size;
+				lilu_os_memcpy(resp.data, r.data, r.size);
+				resp.result = keystore->writeValueByName(r.key, r.data);
+				break;
+			case SmcCmdGetKeyInfo: {
+				SMC_DATA_SIZE size;
+				SMC_KEY_TYPE type;
+				SMC_KEY_ATTRIBUTES attr;
+				resp.result = keystore->getInfoByName(r.key, size, type, attr);
+				if (resp.result == SmcSuccess)
+					storeKeyInfo(resp, r.transport, size, type, attr);
+				break;
+			}
+			default: {
+				SMC_KEY key = 0;
+				resp.result = keystore->readNameByIndex(r.key, key);
+				resp.size = sizeof(key);
+				lilu_os_memcpy(resp.data, &key, sizeof(key));
+				break;
+			}
+		}
+	}
+
+	/**
+	 *  Compare replayed response with the recording.
+	 *  Data is only meaningful for successful commands and is stored truncated.
+	 */
+	bool matches(const Record &r, const Response &resp, bool compareData) {
+		if (resp.result != r.result)
+			return false;
+		if (r.result != SmcSuccess || !compareData)
+			return true;
+		if (resp.size != r.size)
+			return false;
+		return !memcmp(resp.data, r.data, r.size < SMC_MAX_DATA_SIZE ? r.size : SMC_MAX_DATA_SIZE);
+	}
+
+	void printData(const char *prefix, const SMC_DATA *data, size_t size) {
+		printf("%s", prefix);
+		for (size_t i = 0; i < size && i < SMC_MAX_DATA_SIZE; i++)
+			printf(" %02X", data[i]);
+		printf("\n");
+	}
+
+	void usage(const char *name) {
+		fprintf(stderr,
+			"Usage: %s [options] <capture> [boot-args]\n"
+			"    -p <plist>   VirtualSMC Info.plist (default: %s)\n"
+			"    -b <board>   board-id override (default: recorded)\n"
+			"    -k           feed the keystore directly instead of the recorded transports\n"
+			"    -n <count>   replay passes, each on a freshly started service (default: 1)\n"
+			"    -r           keep recorded transaction timing\n"
+			"    -i <key>     do not compare data of the key, may be repeated\n"
+			"    -v           print every mismatch (default: first 10)\n"
+			"    -h           help\n"
+			"Capture is either raw TrafficCapture data or ioreg -a output containing it.\n"
+			"Remaining arguments are passed as boot arguments, e.g. -vsmcstat\n",
+			name, VSMCHOST_DEFAULT_PLIST);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	const char *plist = VSMCHOST_DEFAULT_PLIST;
+	const char *capture = nullptr;
+	const char *board = nullptr;
+	bool direct = false;
+	bool realtime = false;
+	bool verbose = false;
+	size_t passes = 1;
+	std::set<uint32_t> ignored;
+	std::string bootArgs;
+
+	for (int i = 1; i < argc; i++) {
+		auto arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (!strcmp(arg, "-p") && hasValue) {
+			plist = argv[++i];
+		} else if (!strcmp(arg, "-b") && hasValue) {
+			board = argv[++i];
+		} else if (!strcmp(arg, "-k")) {
+			direct = true;
+		} else if (!strcmp(arg, "-n") && hasValue) {
+			passes = strtoull(argv[++i], nullptr, 0);
+		} else if (!strcmp(arg, "-r")) {
+			realtime = true;
+		} else if (!strcmp(arg, "-i") && hasValue) {
+			auto name = argv[++i];
+			if (strlen(name) != sizeof(SMC_KEY)) {
+				fprintf(stderr, "Invalid key %s\n", name);
+				return 1;
+			}
+			ignored.insert(SMC_MAKE_KEY(name[0], name[1], name[2], name[3]));
+		} else if (!strcmp(arg, "-v")) {
+			verbose = true;
+		} else if (!strcmp(arg, "-h")) {
+			usage(argv[0]);
+			return 0;
+		} else if (!capture && arg[0] != '-' && !strchr(arg, '=')) {
+			capture = arg;
+		} else {
+			bootArgs += bootArgs.empty() ? "" : " ";
+			bootArgs += arg;
+		}
+	}
+
+	if (!capture) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	Header header {};
+	std::vector<Record> records;
+	if (!loadCapture(capture, header, records)) {
+		fprintf(stderr, "Failed to load capture from %s\n", capture);
+		return 1;
+	}
+
+	// Reproduce the recorded device unless overridden.
+	if (!board)
+		board = header.board;
+	if (header.generation != 0 && bootArgs.find("vsmcgen=") == std::string::npos) {
+		bootArgs += bootArgs.empty() ? "" : " ";
+		bootArgs += "vsmcgen=" + std::to_string(header.generation);
+	}
+
+	vsmchostSetBootArgs(bootArgs.c_str());
+	vsmchostSetComputer(header.model, board);
+	ADDPR(debugEnabled) = checkKernelArgument("-vsmcdbg");
+
+	auto personality = vsmchostLoadPersonality(plist);
+	if (!personality) {
+		fprintf(stderr, "Failed to load VirtualSMC personality from %s\n", plist);
+		return 1;
+	}
+
+	uint64_t recorded = records.empty() ? 0 : records.back().time;
+	printf("%zu transactions recorded over %llu ms, generation %u, board-id %s, %s\n", records.size(),
+		   static_cast<unsigned long long>(recorded / 1000000), header.generation, board[0] ? board : "none",
+		   direct ? "keystore" : "protocol");
+
+	CommandStats stats[CommandMax];
+	for (auto &s : stats)
+		s.latencies.reserve(records.size() * passes);
+	std::map<uint32_t, size_t> keyMismatches;
+	size_t mismatches = 0, skipped = 0;
+	uint64_t busy = 0;
+
+	for (size_t pass = 0; pass < passes; pass++) {
+		auto smc = vsmchostStartService(personality, new IOService);
+		if (!smc) {
+			fprintf(stderr, "Failed to start VirtualSMC\n");
+			return 1;
+		}
+
+		SMCClientPMIO pmio(smc);
+		SMCClientMMIO *mmio = nullptr;
+		if (!direct && records.end() != std::find_if(records.begin(), records.end(), [](const Record &r) {
+				return r.transport == VirtualSMCCapture::TransportMMIO; })) {
+			uint8_t gen = 0;
+			pmio.readValue(SMC_MAKE_KEY('R', 'G', 'E', 'N'), &gen, sizeof(gen));
+			if (gen < 2) {
+				fprintf(stderr, "Capture contains MMIO traffic, but generation %u has no MMIO\n", gen);
+				return 1;
+			}
+			mmio = new SMCClientMMIO(smc);
+		}
+
+		auto keystore = VirtualSMC::getKeystore();
+		auto passStart = now();
+		for (size_t i = 0; i < records.size(); i++) {
+			auto &r = records[i];
+			auto cmd = commandIndex(r.command);
+			if (cmd == CommandMax) {
+				skipped++;
+				continue;
+			}
+
+			if (realtime) {
+				auto deadline = passStart + r.time;
+				auto curr = now();
+				if (curr < deadline)
+					std::this_thread::sleep_for(std::chrono::nanoseconds(deadline - curr));
+			}
+
+			Response resp {};
+			auto start = now();
+			if (direct)
+				replayKeystore(keystore, r, resp);
+			else if (r.transport == VirtualSMCCapture::TransportMMIO && isEventEnable(r))
+				replayEventEnable(*mmio, r, resp);
+			else if (r.transport == VirtualSMCCapture::TransportMMIO)
+				replayProtocol(*mmio, r, resp);
+			else
+				replayProtocol(pmio, r, resp);
+			auto latency = now() - start;
+			busy += latency;
+
+			stats[cmd].latencies.push_back(latency);
+			bool compareData = r.command == SmcCmdGetKeyFromIndex || !ignored.count(r.key);
+			if (matches(r, resp, compareData))
+				continue;
+
+			stats[cmd].mismatches++;
+			auto key = r.command == SmcCmdGetKeyFromIndex ? *reinterpret_cast<const uint32_t *>(r.data) : r.key;
+			keyMismatches[key]++;
+			if (verbose || mismatches < 10) {
+				printf("mismatch #%zu pass %zu %s %s [%s]: result %02X expected %02X, size %u expected %u\n", i, pass,
+					   r.transport == VirtualSMCCapture::TransportMMIO ? "mmio" : "pmio", commandNames[cmd],
+					   r.command == SmcCmdGetKeyFromIndex ? std::to_string(r.key).c_str() : keyName(r.key).c_str(),
+					   resp.result, r.result, resp.size, r.size);
+				if (resp.result == SmcSuccess && r.result == SmcSuccess) {
+					printData("  got     ", resp.data, resp.size);
+					printData("  expected", r.data, r.size);
+				}
+			}
+			mismatches++;
+		}
+
+		delete mmio;
+		vsmchostRunTimers(true);
+	}
+
+	size_t replayed = 0;
+	printf("%-9s %9s %10s %9s %8s %8s %9s %9s\n", "op", "count", "mismatches", "mean ns", "p50 ns", "p99 ns", "p999 ns", "max ns");
+	for (size_t cmd = 0; cmd < CommandMax; cmd++) {
+		auto &l = stats[cmd].latencies;
+		if (l.empty())
+			continue;
+		std::sort(l.begin(), l.end());
+		uint64_t sum = 0;
+		for (auto v : l)
+			sum += v;
+		replayed += l.size();
+		printf("%-9s %9zu %10zu %9.1f %8llu %8llu %9llu %9llu\n", commandNames[cmd], l.size(), stats[cmd].mismatches,
+			   static_cast<double>(sum) / l.size(),
+			   static_cast<unsigned long long>(l[l.size() / 2]),
+			   static_cast<unsigned long long>(l[(l.size() * 99) / 100]),
+			   static_cast<unsigned long long>(l[(l.size() * 999) / 1000]),
+			   static_cast<unsigned long long>(l.back()));
+	}
+
+	printf("replayed %zu transactions in %llu us, %.0f ops/s, %zu mismatches, %zu skipped\n", replayed,
+		   static_cast<unsigned long long>(busy / 1000), busy ? replayed * 1e9 / busy : 0.0, mismatches, skipped);
+
+	if (!keyMismatches.empty()) {
+		std::vector<std::pair<uint32_t, size_t>> sorted(keyMismatches.begin(), keyMismatches.end());
+		std::stable_sort(sorted.begin(), sorted.end(), [](const std::pair<uint32_t, size_t> &a, const std::pair<uint32_t, size_t> &b) {
+			return a.second > b.second;
+		});
+		printf("mismatching keys:");
+		for (auto &k : sorted)
+			printf(" %s(%zu)", keyName(k.first).c_str(), k.second);
+		printf("\n");
+	}
+
+	personality->release();
+	return mismatches > 0 ? 2 : 0;
+}
@@ -0,0 +1,329 @@
+//
+//  vsmcsim.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <Headers/kern_util.hpp>
+#include <Headers/kern_iokit.hpp>
+#include <VirtualSMCSDK/kern_vsmcapi.hpp>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../../VirtualSMC/kern_vsmc.hpp"
+#include "smcclient.hpp"
+#include "vsmchost.hpp"
+
+namespace {
+	/**
+	 *  Simulated AppleSMC operations
+	 */
+	enum Operation {
+		OpRead,
+		OpWrite,
+		OpKeyInfo,
+		OpIndex,
+		OpEvent,
+		OpMax
+	};
+
+	const char *operationNames[OpMax] {"read", "write", "keyinfo", "index", "event"};
+
+	/**
+	 *  Operation mix in percents, writes and events are only issued when enabled
+	 */
+	constexpr uint32_t operationWeights[OpMax] {80, 2, 8, 8, 2};
+
+	struct Key {
+		SMC_KEY key;
+		SMCClient::KeyInfo info;
+		SMC_DATA value[SMC_MAX_DATA_SIZE];
+	};
+
+	struct OperationStats {
+		std::vector<uint64_t> latencies;
+		size_t errors {0};
+		SMCClient::Counters counters {};
+	};
+
+	/**
+	 *  xorshift64* generator, workload only depends on the seed
+	 */
+	class Random {
+		uint64_t state;
+	public:
+		Random(uint64_t seed) : state(seed ? seed : 1) {}
+
+		uint64_t next() {
+			state ^= state >> 12;
+			state ^= state << 25;
+			state ^= state >> 27;
+			return state * 2685821657736338717ULL;
+		}
+	};
+
+	uint64_t now() {
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	void addCounters(SMCClient::Counters &dst, const SMCClient::Counters &after, const SMCClient::Counters &before) {
+		dst.reads += after.reads - before.reads;
+		dst.writes += after.writes - before.writes;
+		dst.traps += after.traps - before.traps;
+		dst.polls += after.polls - before.polls;
+		dst.events += after.events - before.events;
+	}
+
+	void report(const char *name, OperationStats &stats) {
+		auto &l = stats.latencies;
+		if (l.empty())
+			return;
+
+		std::sort(l.begin(), l.end());
+		uint64_t sum = 0;
+		for (auto v : l)
+			sum += v;
+
+		double n = static_cast<double>(l.size());
+		auto &c = stats.counters;
+		printf("%-9s %9zu %7zu %9.1f %8llu %8llu %9llu %7.1f %7.1f %7.1f %7.1f %7.2f\n",
+			name, l.size(), stats.errors, sum / n,
+			static_cast<unsigned long long>(l[l.size() / 2]),
+			static_cast<unsigned long long>(l[(l.size() * 99) / 100]),
+			static_cast<unsigned long long>(l.back()),
+			c.reads / n, c.writes / n, c.traps / n, c.polls / n, c.events / n);
+	}
+
+	void usage(const char *name) {
+		fprintf(stderr,
+			"Usage: %s [options] [boot-args]\n"
+			"    -p <plist>   VirtualSMC Info.plist (default: %s)\n"
+			"    -b <board>   board-id used for model info lookup\n"
+			"    -l           laptop computer model (desktop by default)\n"
+			"    -t <name>    transport, pmio or mmio (default: mmio on 2nd generation)\n"
+			"    -n <count>   simulated operations (default: 100000)\n"
+			"    -S <seed>    workload seed (default: 1)\n"
+			"    -w           issue writes of enumerated values to read-write keys\n"
+			"    -e           enable interrupts through NTOK and issue events (mmio only)\n"
+			"    -o <file>    save vsmccap traffic capture for vsmcreplay\n"
+			"    -h           help\n"
+			"Remaining arguments are passed as boot arguments, e.g. -vsmcstat vsmcgen=1\n",
+			name, VSMCHOST_DEFAULT_PLIST);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	const char *plist = VSMCHOST_DEFAULT_PLIST;
+	const char *board = nullptr;
+	const char *transport = nullptr;
+	int model = WIOKit::ComputerModel::ComputerDesktop;
+	size_t operations = 100000;
+	uint64_t seed = 1;
+	bool writes = false;
+	bool events = false;
+	const char *output = nullptr;
+	std::string bootArgs;
+
+	for (int i = 1; i < argc; i++) {
+		auto arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (!strcmp(arg, "-p") && hasValue) {
+			plist = argv[++i];
+		} else if (!strcmp(arg, "-b") && hasValue) {
+			board = argv[++i];
+		} else if (!strcmp(arg, "-l")) {
+			model = WIOKit::ComputerModel::ComputerLaptop;
+		} else if (!strcmp(arg, "-t") && hasValue) {
+			transport = argv[++i];
+		} else if (!strcmp(arg, "-n") && hasValue) {
+			operations = strtoull(argv[++i], nullptr, 0);
+		} else if (!strcmp(arg, "-S") && hasValue) {
+			seed = strtoull(argv[++i], nullptr, 0);
+		} else if (!strcmp(arg, "-w")) {
+			writes = true;
+		} else if (!strcmp(arg, "-e")) {
+			events = true;
+		} else if (!strcmp(arg, "-o") && hasValue) {
+			output = argv[++i];
+		} else if (!strcmp(arg, "-h")) {
+			usage(argv[0]);
+			return 0;
+		} else {
+			bootArgs += bootArgs.empty() ? "" : " ";
+			bootArgs += arg;
+		}
+	}
+
+	vsmchostSetBootArgs(bootArgs.c_str());
+	vsmchostSetComputer(model, board);
+	ADDPR(debugEnabled) = checkKernelArgument("-vsmcdbg");
+
+	auto personality = vsmchostLoadPersonality(plist);
+	if (!personality) {
+		fprintf(stderr, "Failed to load VirtualSMC personality from %s\n", plist);
+		return 1;
+	}
+
+	auto smc = vsmchostStartService(personality, new IOService);
+	if (!smc) {
+		fprintf(stderr, "Failed to start VirtualSMC\n");
+		return 1;
+	}
+
+	// Generation is always available over the legacy port.
+	SMCClientPMIO pmio(smc);
+	uint8_t gen = 0;
+	pmio.readValue(SMC_MAKE_KEY('R', 'G', 'E', 'N'), &gen, sizeof(gen));
+
+	SMCClient *client;
+	if (transport ? !strcmp(transport, "mmio") : gen >= 2) {
+		if (gen < 2) {
+			fprintf(stderr, "MMIO is only available on 2nd generation SMC\n");
+			return 1;
+		}
+		client = new SMCClientMMIO(smc);
+	} else if (!transport || !strcmp(transport, "pmio")) {
+		client = new SMCClientPMIO(smc);
+	} else {
+		fprintf(stderr, "Unknown transport %s\n", transport);
+		return 1;
+	}
+
+	if (events) {
+		if (strcmp(client->getName(), "mmio")) {
+			fprintf(stderr, "Events are only acknowledged over MMIO\n");
+			return 1;
+		}
+		if (!client->enableEvents()) {
+			fprintf(stderr, "Failed to enable events\n");
+			return 1;
+		}
+	}
+
+	// Enumerate keys the way AppleSMC builds its key list.
+	auto start = now();
+	uint32_t count = 0;
+	if (client->readValue(SMC_MAKE_KEY('#', 'K', 'E', 'Y'), reinterpret_cast<SMC_DATA *>(&count), sizeof(count)) != SmcSuccess) {
+		fprintf(stderr, "Failed to read key count\n");
+		return 1;
+	}
+	count = OSSwapBigToHostInt32(count);
+
+	std::vector<Key> keys;
+	std::vector<const Key *> readable, writable;
+	for (uint32_t i = 0; i < count; i++) {
+		Key k {};
+		if (client->getKeyFromIndex(i, k.key) != SmcSuccess || client->getKeyInfo(k.key, k.info) != SmcSuccess) {
+			fprintf(stderr, "Failed to enumerate key %u\n", i);
+			return 1;
+		}
+		if ((k.info.attr & SMC_KEY_ATTRIBUTE_READ) && !(k.info.attr & SMC_KEY_ATTRIBUTE_FUNCTION) &&
+			client->readValue(k.key, k.value, k.info.size) != SmcSuccess) {
+			fprintf(stderr, "Failed to read key %u\n", i);
+			return 1;
+		}
+		keys.push_back(k);
+	}
+	auto enumerated = now() - start;
+
+	for (auto &k : keys) {
+		if (k.info.attr & SMC_KEY_ATTRIBUTE_FUNCTION)
+			continue;
+		if (k.info.attr & SMC_KEY_ATTRIBUTE_READ)
+			readable.push_back(&k);
+		if ((k.info.attr & SMC_KEY_ATTRIBUTE_WRITE) && (k.info.attr & SMC_KEY_ATTRIBUTE_READ))
+			writable.push_back(&k);
+	}
+
+	uint32_t weights[OpMax];
+	uint32_t total = 0;
+	for (size_t op = 0; op < OpMax; op++) {
+		weights[op] = operationWeights[op];
+		if ((op == OpWrite && (!writes || writable.empty())) || (op == OpEvent && !events) || (op == OpRead && readable.empty()))
+			weights[op] = 0;
+		total += weights[op];
+	}
+
+	printf("%s transport, %zu keys, generation %u, seed %llu, board-id %s\n", client->getName(), keys.size(), gen,
+		   static_cast<unsigned long long>(seed), board ? board : "none");
+	printf("enumerate %9zu keys in %llu ns, %llu reads, %llu writes, %llu traps, %llu polls\n", keys.size(),
+		   static_cast<unsigned long long>(enumerated),
+		   static_cast<unsigned long long>(client->getCounters().reads), static_cast<unsigned long long>(client->getCounters().writes),
+		   static_cast<unsigned long long>(client->getCounters().traps), static_cast<unsigned long long>(client->getCounters().polls));
+
+	Random random(seed);
+	OperationStats stats[OpMax];
+	for (auto &s : stats)
+		s.latencies.reserve(operations);
+
+	SMC_DATA data[SMC_MAX_DATA_SIZE];
+	for (size_t i = 0; i < operations && total > 0; i++) {
+		auto r = static_cast<uint32_t>(random.next() % total);
+		size_t op = 0;
+		while (r >= weights[op])
+			r -= weights[op++];
+
+		auto pick = random.next();
+		auto before = client->getCounters();
+		auto opStart = now();
+		bool ok;
+		switch (op) {
+			case OpRead: {
+				auto k = readable[pick % readable.size()];
+				ok = client->readValue(k->key, data, k->info.size) == SmcSuccess;
+				break;
+			}
+			case OpWrite: {
+				auto k = writable[pick % writable.size()];
+				ok = client->writeValue(k->key, k->value, k->info.size) == SmcSuccess;
+				break;
+			}
+			case OpKeyInfo: {
+				SMCClient::KeyInfo info;
+				ok = client->getKeyInfo(keys[pick % keys.size()].key, info) == SmcSuccess;
+				break;
+			}
+			case OpIndex: {
+				SMC_KEY key;
+				ok = client->getKeyFromIndex(static_cast<SMC_KEY_INDEX>(pick % keys.size()), key) == SmcSuccess;
+				break;
+			}
+			default:
+				ok = VirtualSMCAPI::postInterrupt(SmcEventALSChange) && client->getLastEvent() == SmcEventALSChange;
+				break;
+		}
+		auto latency = now() - opStart;
+
+		auto &s = stats[op];
+		s.latencies.push_back(latency);
+		if (!ok)
+			s.errors++;
+		addCounters(s.counters, client->getCounters(), before);
+	}
+
+	printf("%-9s %9s %7s %9s %8s %8s %9s %7s %7s %7s %7s %7s\n", "op", "count", "errors", "mean ns", "p50 ns", "p99 ns",
+		   "max ns", "reads", "writes", "traps", "polls", "events");
+	for (size_t op = 0; op < OpMax; op++)
+		report(operationNames[op], stats[op]);
+
+	if (output) {
+		smc->serializeProperties(nullptr);
+		auto capture = OSDynamicCast(OSData, smc->getProperty("TrafficCapture"));
+		auto file = capture ? fopen(output, "wb") : nullptr;
+		if (!file || fwrite(capture->getBytesNoCopy(), 1, capture->getLength(), file) != capture->getLength()) {
+			fprintf(stderr, "Failed to save traffic capture to %s, is vsmccap set?\n", output);
+			if (file)
+				fclose(file);
+			return 1;
+		}
+		fclose(file);
+	}
+
+	delete client;
+	personality->release();
+	return 0;
+}
@@ -0,0 +1,164 @@
+//
+//  vsmctypebench.cpp
+//  vsmchost
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <Headers/kern_util.hpp>
+#include <VirtualSMCSDK/kern_vsmcapi.hpp>
+#include <chrono>
+#include <vector>
+
+using namespace VirtualSMCAPI;
+
+namespace {
+	/**
+	 *  Encoded values are summed up to keep the loops from being optimised out
+	 */
+	volatile uint32_t sink;
+
+	template <typename F>
+	void measure(const char *name, size_t ops, F func) {
+		auto start = std::chrono::steady_clock::now();
+		uint32_t sum = func();
+		auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		sink = sum;
+		printf("%-24s %10zu ops %12.2f ns/op\n", name, ops, ops ? static_cast<double>(ns) / ops : 0.0);
+	}
+
+	void usage(const char *prog) {
+		fprintf(stderr, "Usage: %s [-n count]\n"
+			"    -n <count>   encoded values per encoder (default: 10000000)\n"
+			"    -h           help\n", prog);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	size_t count = 10000000;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+			count = strtoull(argv[++i], nullptr, 0);
+		} else {
+			usage(argv[0]);
+			return !strcmp(argv[i], "-h") ? 0 : 1;
+		}
+	}
+
+	// Sensor readings in millidegrees and millivolts, like plugins obtain them.
+	std::vector<int32_t> milli(count);
+	std::vector<double> real(count);
+	for (size_t i = 0; i < count; i++) {
+		milli[i] = static_cast<int32_t>((i * 7919) % 120000) - 20000;
+		real[i] = milli[i] / 1000.0;
+	}
+
+	measure("sp78 encodeSp", count, [&]() {
+		uint32_t sum = 0;
+		for (size_t i = 0; i < count; i++)
+			sum += encodeSp(SmcKeyTypeSp78, real[i]);
+		return sum;
+	});
+
+	measure("sp78 encodeFixed", count, [&]() {
+		uint32_t sum = 0;
+		for (size_t i = 0; i < count; i++)
+			sum += TypeTraits<SmcKeyTypeSp78>::encodeFixed<8>(milli[i] * 256 / 1000);
+		return sum;
+	});
+
+	measure("fp88 encodeFp", count, [&]() {
+		uint32_t sum = 0;
+		for (size_t i = 0; i < count; i++)
+			sum += encodeFp(SmcKeyTypeFp88, real[i]);
+		return sum;
+	});
+
+	measure("fp88 encodeFixed", count, [&]() {
+		uint32_t sum = 0;
+		for (size_t i = 0; i < count; i++)
+			sum += TypeTraits<SmcKeyTypeFp88>::encodeFixed<8>(static_cast<uint32_t>(milli[i] < 0 ? -milli[i] : milli[i]) * 256 / 1000);
+		return sum;
+	});
+
+	// Value initialisation through the runtime and the typed helpers, reusing one value.
+	VirtualSMCTypedValue<SmcKeyTypeSp78> value;
+	measure("sp78 valueWithSp", count, [&]() {
+		uint32_t sum = 0;
+		for (size_t i = 0; i < count; i++)
+			sum += valueWithSp(real[i], SmcKeyTypeSp78, &value) != nullptr;
+		return sum;
+	});
+
+	measure("sp78 valueWithEncoded", count, [&]() {
+		uint32_t sum = 0;
+		for (size_t i = 0; i < count; i++)
+			sum += valueWithEncoded<SmcKeyTypeSp78>(TypeTraits<SmcKeyTypeSp78>::encodeFixed<8>(milli[i] * 256 / 1000), &value) != nullptr;
+		return sum;
+	});
+
+	printf("%-24s %10zu bytes, VirtualSMCValue %zu bytes + %zu allocated\n", "sp78 typed value size", sizeof(value), sizeof(VirtualSMCValue),
+		static_cast<size_t>(TypeTraits<SmcKeyTypeSp78>::Size));
+
+	// Plugins refreshing many sensors at once encode them in batches.
+	std::vector<float> realf(real.begin(), real.end());
+	std::vector<uint16_t> out(count);
+	for (size_t batch : {64, 256}) {
+		char name[32];
+		size_t ops = count - count % batch;
+
+		snprintf(name, sizeof(name), "sp78 per-value x%zu", batch);
+		measure(name, ops, [&]() {
+			uint32_t sum = 0;
+			for (size_t i = 0; i < ops; i += batch) {
+				for (size_t j = i; j < i + batch; j++)
+					out[j] = encodeSp(SmcKeyTypeSp78, realf[j]);
+				sum += out[i];
+			}
+			return sum;
+		});
+
+		snprintf(name, sizeof(name), "sp78 encodeSpArray x%zu", batch);
+		measure(name, ops, [&]() {
+			uint32_t sum = 0;
+			for (size_t i = 0; i < ops; i += batch) {
+				encodeSpArray(SmcKeyTypeSp78, &realf[i], &out[i], batch);
+				sum += out[i];
+			}
+			return sum;
+		});
+
+		snprintf(name, sizeof(name), "sp78 fixed array x%zu", batch);
+		measure(name, ops, [&]() {
+			uint32_t sum = 0;
+			for (size_t i = 0; i < ops; i += batch) {
+				encodeSpArray(SmcKeyTypeSp78, &milli[i], &out[i], batch, 10);
+				sum += out[i];
+			}
+			return sum;
+		});
+
+		snprintf(name, sizeof(name), "fp88 per-value x%zu", batch);
+		measure(name, ops, [&]() {
+			uint32_t sum = 0;
+			for (size_t i = 0; i < ops; i += batch) {
+				for (size_t j = i; j < i + batch; j++)
+					out[j] = encodeFp(SmcKeyTypeFp88, realf[j]);
+				sum += out[i];
+			}
+			return sum;
+		});
+
+		snprintf(name, sizeof(name), "fp88 encodeFpArray x%zu", batch);
+		measure(name, ops, [&]() {
+			uint32_t sum = 0;
+			for (size_t i = 0; i < ops; i += batch) {
+				encodeFpArray(SmcKeyTypeFp88, &realf[i], &out[i], batch);
+				sum += out[i];
+			}
+			return sum;
+		});
+	}
+
+	return 0;
+}
@@ -0,0 +1,90 @@
+//
+//  kern_capture.cpp
+//  VirtualSMC
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <Headers/kern_util.hpp>
+#include <kern/clock.h>
+
+#include "kern_capture.hpp"
+
+bool VirtualSMCCapture::init(uint32_t count, uint8_t generation, int model, const char *board) {
+	capacity = count < MaxRecords ? count : MaxRecords;
+	if (capacity != count)
+		SYSLOG("capture", "limiting %u requested capture records to %u", count, capacity);
+	records = Buffer::create<Record>(capacity);
+	ready = Buffer::create<_Atomic(bool)>(capacity);
+	if (!records || !ready) {
+		SYSLOG("capture", "failed to allocate %u capture records", capacity);
+		deinit();
+		return false;
+	}
+
+	bzero(records, capacity * sizeof(records[0]));
+	for (uint32_t i = 0; i < capacity; i++)
+		atomic_init(&ready[i], false);
+	atomic_init(&next, 0);
+
+	header.magic = Magic;
+	header.version = Version;
+	header.recordSize = sizeof(Record);
+	header.generation = generation;
+	header.model = static_cast<uint8_t>(model);
+	if (board)
+		lilu_os_strlcpy(header.board, board, sizeof(header.board));
+
+	startTime = mach_absolute_time();
+	return true;
+}
+
+void VirtualSMCCapture::deinit() {
+	Buffer::deleter(records);
+	Buffer::deleter(ready);
+	records = nullptr;
+	ready = nullptr;
+	capacity = 0;
+}
+
+void VirtualSMCCapture::record(Transport transport, SMC_COMMAND cmd, uint32_t key, SMC_RESULT res, const void *data, SMC_DATA_SIZE size) {
+	// Stop claiming slots once full, so that the counter cannot wrap around.
+	if (atomic_load_explicit(&next, memory_order_relaxed) >= capacity)
+		return;
+	auto slot = atomic_fetch_add_explicit(&next, 1, memory_order_relaxed);
+	if (slot >= capacity)
+		return;
+
+	uint64_t time;
+	absolutetime_to_nanoseconds(mach_absolute_time() - startTime, &time);
+	auto &r = records[slot];
+	r.time = time;
+	r.key = key;
+	r.transport = transport;
+	r.command = cmd;
+	r.result = res;
+	r.size = size;
+	lilu_os_memcpy(r.data, data, size < SMC_MAX_DATA_SIZE ? size : SMC_MAX_DATA_SIZE);
+	atomic_store_explicit(&ready[slot], true, memory_order_release);
+}
+
+OSData *VirtualSMCCapture::copyCapture() {
+	auto claimed = atomic_load_explicit(&next, memory_order_relaxed);
+	uint32_t count = 0;
+	while (count < claimed && count < capacity && atomic_load_explicit(&ready[count], memory_order_acquire))
+		count++;
+
+	auto data = OSData::withCapacity(static_cast<unsigned int>(sizeof(Header) + count * sizeof(Record)));
+	if (!data)
+		return nullptr;
+
+	Header h = header;
+	h.count = count;
+	if (!data->appendBytes(&h, sizeof(h)) ||
+		(count > 0 && !data->appendBytes(records, static_cast<unsigned int>(count * sizeof(Record))))) {
+		data->release();
+		return nullptr;
+	}
+
+	return data;
+}
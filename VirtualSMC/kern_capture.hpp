@@ -0,0 +1,137 @@
+//
+//  kern_capture.hpp
+//  VirtualSMC
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_capture_hpp
+#define kern_capture_hpp
+
+#include <VirtualSMCSDK/AppleSmcBridge.hpp>
+#include <VirtualSMCSDK/vsmcatomic.h>
+#include <libkern/c++/OSData.h>
+#include <stdint.h>
+
+/**
+ *  Protocol traffic recorder enabled by vsmccap=N boot argument.
+ *  The first N completed transactions are stored in a preallocated buffer,
+ *  so the capture always starts at boot and can be replayed against a fresh
+ *  keystore. Later transactions are dropped.
+ */
+class VirtualSMCCapture {
+public:
+	/**
+	 *  Transport the transaction arrived through
+	 */
+	enum Transport : uint8_t {
+		TransportPMIO,
+		TransportMMIO
+	};
+
+	/**
+	 *  Capture format magic ("VSCP" in file byte order) and version
+	 */
+	static constexpr uint32_t Magic {0x50435356};
+	static constexpr uint16_t Version {1};
+
+	/**
+	 *  Maximum number of recorded transactions
+	 */
+	static constexpr uint32_t MaxRecords {0x10000};
+
+	/**
+	 *  Capture header, all the fields are little endian
+	 */
+	struct PACKED Header {
+		uint32_t magic;       ///< Magic
+		uint16_t version;     ///< Version
+		uint16_t recordSize;  ///< sizeof(Record)
+		uint32_t count;       ///< records following the header
+		uint8_t generation;   ///< SMCInfo::Generation of the device
+		uint8_t model;        ///< WIOKit::ComputerModel
+		uint16_t reserved;
+		char board[64];       ///< board-id, empty when unknown
+	};
+
+	/**
+	 *  Single completed transaction.
+	 *  data contains the bytes exchanged with AppleSMC: the returned value for
+	 *  reads, the written value for writes, the key name for index lookups,
+	 *  and the key info in transport layout for key info requests.
+	 */
+	struct PACKED Record {
+		uint64_t time;                      ///< nanoseconds since capture start
+		uint32_t key;                       ///< key name or key index for SmcCmdGetKeyFromIndex
+		uint8_t transport;                  ///< Transport
+		SMC_COMMAND command;                ///< protocol command
+		SMC_RESULT result;                  ///< command result
+		SMC_DATA_SIZE size;                 ///< transferred data size
+		SMC_DATA data[SMC_MAX_DATA_SIZE];   ///< transferred data, truncated to SMC_MAX_DATA_SIZE
+	};
+
+	/**
+	 *  Allocate record storage
+	 *
+	 *  @param records     number of records to keep, limited by MaxRecords
+	 *  @param generation  device generation stored in the header
+	 *  @param model       computer model stored in the header
+	 *  @param board       board-id stored in the header
+	 *
+	 *  @return true on success
+	 */
+	bool init(uint32_t records, uint8_t generation, int model, const char *board);
+
+	/**
+	 *  Free record storage
+	 */
+	void deinit();
+
+	/**
+	 *  Record completed transaction
+	 *
+	 *  @param transport  transport
+	 *  @param cmd        protocol command
+	 *  @param key        key name or key index
+	 *  @param res        command result
+	 *  @param data       transferred data
+	 *  @param size       transferred data size
+	 */
+	void record(Transport transport, SMC_COMMAND cmd, uint32_t key, SMC_RESULT res, const void *data, SMC_DATA_SIZE size);
+
+	/**
+	 *  Export header followed by all the completed records
+	 *
+	 *  @return capture data (must be released) or nullptr
+	 */
+	OSData *copyCapture();
+
+private:
+	/**
+	 *  Capture header, count is filled on export
+	 */
+	Header header {};
+
+	/**
+	 *  Record storage and its capacity
+	 */
+	Record *records {nullptr};
+	uint32_t capacity {0};
+
+	/**
+	 *  Next record slot to claim
+	 */
+	_Atomic(uint32_t) next;
+
+	/**
+	 *  Completion flags for record slots, exported records are always fully written
+	 */
+	_Atomic(bool) *ready {nullptr};
+
+	/**
+	 *  Capture start in absolute time units
+	 */
+	uint64_t startTime {0};
+};
+
+#endif /* kern_capture_hpp */
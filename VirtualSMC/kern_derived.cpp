@@ -0,0 +1,592 @@
+//
+//  kern_derived.cpp
+//  VirtualSMC
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <libkern/OSByteOrder.h>
+#include <libkern/c++/OSString.h>
+#include <Headers/kern_util.hpp>
+#include <Headers/kern_time.hpp>
+#include <VirtualSMCSDK/kern_smctypes.hpp>
+
+#include "kern_derived.hpp"
+
+static inline bool isSpace(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline bool isDigit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+static inline bool isLower(char c) {
+	return c >= 'a' && c <= 'z';
+}
+
+static inline bool isKeyChar(char c) {
+	// Any character valid in SMC keys, but the wildcard ending shorter patterns.
+	return SMC_KEY_IS_VALID_CHAR(c) && c != '*';
+}
+
+/**
+ *  Convert IEEE 754 single precision bits to fixed point, truncating like a cast does
+ */
+static bool floatToFixed(uint32_t bits, uint32_t fractionBits, int64_t &value) {
+	uint32_t exponent = (bits >> 23) & 0xFF;
+	if (exponent == 0xFF)
+		return false;
+
+	// Denormals are far below fixed point precision.
+	int64_t mantissa = exponent != 0 ? (bits & 0x7FFFFF) | 0x800000 : 0;
+	int32_t shift = static_cast<int32_t>(exponent) - 150 + static_cast<int32_t>(fractionBits);
+	if (shift >= 0)
+		mantissa = shift < 40 ? mantissa << shift : INT64_MAX;
+	else
+		mantissa = shift > -24 ? mantissa >> -shift : 0;
+	value = (bits & 0x80000000) ? -mantissa : mantissa;
+	return true;
+}
+
+/**
+ *  Convert fixed point to IEEE 754 single precision bits, rounding to nearest even like a cast does
+ */
+static uint32_t fixedToFloat(int64_t value, uint32_t fractionBits) {
+	if (value == 0)
+		return 0;
+
+	uint32_t sign = value < 0 ? 0x80000000 : 0;
+	uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+	int32_t top = 63 - __builtin_clzll(magnitude);
+	uint64_t mantissa;
+	if (top > 23) {
+		uint32_t drop = static_cast<uint32_t>(top - 23);
+		uint64_t rest = magnitude & ((1ULL << drop) - 1), half = 1ULL << (drop - 1);
+		mantissa = magnitude >> drop;
+		if (rest > half || (rest == half && (mantissa & 1)))
+			mantissa++;
+		if (mantissa == (1ULL << 24)) {
+			mantissa >>= 1;
+			top++;
+		}
+	} else {
+		mantissa = magnitude << (23 - top);
+	}
+
+	uint32_t exponent = static_cast<uint32_t>(top - static_cast<int32_t>(fractionBits) + 127);
+	return sign | (exponent << 23) | (static_cast<uint32_t>(mantissa) & 0x7FFFFF);
+}
+
+static inline char skipSpaces(const char *&src) {
+	while (isSpace(*src))
+		src++;
+	return *src;
+}
+
+bool DerivedExpression::emit(uint8_t op) {
+	if (codeSize >= MaxCode) {
+		DBGLOG("derived", "expression is too long");
+		return false;
+	}
+
+	code[codeSize++] = op;
+
+	// Track stack usage so that evaluation never needs bounds checks.
+	if (op == OpConst || op == OpKey || op == OpAggEnd)
+		stackDepth++;
+	else if (op != OpNeg && op != OpAggBegin && op != OpAggPattern)
+		stackDepth--;
+
+	if (op == OpAggBegin)
+		aggDepth++;
+	else if (op == OpAggEnd)
+		aggDepth--;
+
+	if (stackDepth > MaxStack || aggDepth > MaxNesting) {
+		DBGLOG("derived", "expression is too deep");
+		return false;
+	}
+
+	return true;
+}
+
+bool DerivedExpression::emit(uint8_t op, uint8_t arg) {
+	if (!emit(op))
+		return false;
+	if (codeSize >= MaxCode) {
+		DBGLOG("derived", "expression is too long");
+		return false;
+	}
+	code[codeSize++] = arg;
+	return true;
+}
+
+bool DerivedExpression::parseExpr(const char *&src) {
+	if (!parseTerm(src))
+		return false;
+
+	while (true) {
+		auto c = skipSpaces(src);
+		if (c != '+' && c != '-')
+			return true;
+		src++;
+		if (!parseTerm(src) || !emit(c == '+' ? OpAdd : OpSub))
+			return false;
+	}
+}
+
+bool DerivedExpression::parseTerm(const char *&src) {
+	if (!parseFactor(src))
+		return false;
+
+	while (true) {
+		auto c = skipSpaces(src);
+		if (c != '*' && c != '/')
+			return true;
+		src++;
+		if (!parseFactor(src) || !emit(c == '*' ? OpMul : OpDiv))
+			return false;
+	}
+}
+
+bool DerivedExpression::parseFactor(const char *&src) {
+	auto c = skipSpaces(src);
+
+	if (c == '(') {
+		src++;
+		if (!parseExpr(src))
+			return false;
+		if (skipSpaces(src) != ')') {
+			DBGLOG("derived", "missing closing parenthesis");
+			return false;
+		}
+		src++;
+		return true;
+	}
+
+	if (c == '-') {
+		src++;
+		return parseFactor(src) && emit(OpNeg);
+	}
+
+	if (isDigit(c))
+		return parseNumber(src);
+
+	// Lowercase identifier followed by an opening parenthesis is a function.
+	size_t len = 0;
+	while (isLower(src[len]))
+		len++;
+	if (len > 0 && src[len] == '(') {
+		Func func;
+		if (len == 3 && !strncmp(src, "max", len))
+			func = FuncMax;
+		else if (len == 3 && !strncmp(src, "min", len))
+			func = FuncMin;
+		else if (len == 3 && !strncmp(src, "sum", len))
+			func = FuncSum;
+		else if (len == 3 && !strncmp(src, "avg", len))
+			func = FuncAvg;
+		else {
+			DBGLOG("derived", "unknown function %.*s", static_cast<int>(len), src);
+			return false;
+		}
+
+		src += len + 1;
+		if (!emit(OpAggBegin, func))
+			return false;
+
+		while (true) {
+			if (!parseArg(src))
+				return false;
+			c = skipSpaces(src);
+			src++;
+			if (c == ')')
+				break;
+			if (c != ',') {
+				DBGLOG("derived", "unexpected character in argument list");
+				return false;
+			}
+		}
+
+		return emit(OpAggEnd);
+	}
+
+	SMC_KEY key, mask;
+	uint8_t idx;
+	if (!parsePattern(src, key, mask)) {
+		DBGLOG("derived", "invalid key at %s", src);
+		return false;
+	}
+	if (mask != 0xFFFFFFFF) {
+		DBGLOG("derived", "key patterns are only allowed in aggregates");
+		return false;
+	}
+	return addPattern(key, mask, idx) && emit(OpKey, idx);
+}
+
+bool DerivedExpression::parseArg(const char *&src) {
+	auto start = src;
+	SMC_KEY key, mask;
+	uint8_t idx;
+	skipSpaces(src);
+	if (parsePattern(src, key, mask) && mask != 0xFFFFFFFF) {
+		auto c = skipSpaces(src);
+		if (c == ',' || c == ')')
+			return addPattern(key, mask, idx) && emit(OpAggPattern, idx);
+	}
+
+	src = start;
+	return parseExpr(src) && emit(OpAggAdd);
+}
+
+bool DerivedExpression::parseNumber(const char *&src) {
+	int64_t integral = 0, fraction = 0, scale = 1;
+	while (isDigit(*src) && integral < 0x7FFFFFFF)
+		integral = integral * 10 + (*src++ - '0');
+	if (*src == '.') {
+		src++;
+		while (isDigit(*src)) {
+			if (scale < 1000000) {
+				fraction = fraction * 10 + (*src - '0');
+				scale *= 10;
+			}
+			src++;
+		}
+	}
+
+	if (isDigit(*src) || constantCount >= MaxConstants) {
+		DBGLOG("derived", "invalid or too many constants");
+		return false;
+	}
+
+	constants[constantCount] = integral * (1LL << FractionBits) + fraction * (1LL << FractionBits) / scale;
+	return emit(OpConst, static_cast<uint8_t>(constantCount++));
+}
+
+bool DerivedExpression::parsePattern(const char *&src, SMC_KEY &key, SMC_KEY &mask) {
+	key = mask = 0;
+	size_t i = 0;
+	for (; i < sizeof(SMC_KEY); i++) {
+		auto c = src[i];
+		if (c == '?')
+			continue;
+		if (!isKeyChar(c))
+			break;
+		key |= static_cast<SMC_KEY>(static_cast<uint8_t>(c)) << (i * 8);
+		mask |= 0xFFU << (i * 8);
+	}
+
+	if (i == sizeof(SMC_KEY)) {
+		src += i;
+		return true;
+	}
+
+	// Shorter patterns must end with a wildcard matching the rest.
+	if (i > 0 && src[i] == '*') {
+		src += i + 1;
+		return true;
+	}
+
+	return false;
+}
+
+bool DerivedExpression::addPattern(SMC_KEY key, SMC_KEY mask, uint8_t &idx) {
+	if (patternCount >= MaxPatterns) {
+		DBGLOG("derived", "too many keys");
+		return false;
+	}
+
+	patterns[patternCount] = {key, mask};
+	idx = static_cast<uint8_t>(patternCount++);
+	return true;
+}
+
+bool DerivedExpression::compile(const char *src) {
+	codeSize = constantCount = patternCount = 0;
+	stackDepth = aggDepth = 0;
+	resolved = false;
+
+	if (!parseExpr(src))
+		return false;
+
+	if (skipSpaces(src) != '\0') {
+		DBGLOG("derived", "trailing characters at %s", src);
+		return false;
+	}
+
+	return true;
+}
+
+void DerivedExpression::resolve(VirtualSMCKeystore *kstore) {
+	resolvedGeneration = kstore->getGeneration();
+	resolved = true;
+	resolvedCount = 0;
+
+	SMC_DATA_SIZE size;
+	SMC_KEY_ATTRIBUTES attr;
+	bool wildcards = false;
+	for (size_t i = 0; i < patternCount; i++) {
+		auto &pattern = patterns[i];
+		if (pattern.mask != 0xFFFFFFFF)
+			wildcards = true;
+		// Plain keys may also be hidden, so they are looked up by name.
+		else if (kstore->getInfoByName(pattern.key, size, pattern.type, attr) != SmcSuccess)
+			pattern.type = 0;
+	}
+
+	if (!wildcards)
+		return;
+
+	bool overflow = false;
+	kstore->forEachPublicKey([this, &overflow](SMC_KEY key, SMC_KEY_TYPE type) {
+		for (size_t i = 0; i < patternCount; i++) {
+			auto &pattern = patterns[i];
+			if (pattern.mask == 0xFFFFFFFF || (key & pattern.mask) != pattern.key)
+				continue;
+			if (resolvedCount >= MaxResolved) {
+				overflow = true;
+				return;
+			}
+			resolvedKeys[resolvedCount] = key;
+			resolvedTypes[resolvedCount] = type;
+			resolvedPatterns[resolvedCount] = static_cast<uint8_t>(i);
+			resolvedCount++;
+		}
+	});
+
+	if (overflow)
+		DBGLOG("derived", "too many keys match the patterns");
+}
+
+bool DerivedExpression::readKey(VirtualSMCKeystore *kstore, SMC_KEY key, SMC_KEY_TYPE type, int64_t &value) {
+	SMC_DATA data[SMC_MAX_DATA_SIZE];
+	SMC_DATA_SIZE size;
+	return type != 0 && kstore->readValueByName(key, data, size) == SmcSuccess && decode(data, size, type, value);
+}
+
+bool DerivedExpression::evaluate(VirtualSMCKeystore *kstore, int64_t &result) {
+	if (codeSize == 0)
+		return false;
+
+	// Keys may appear or change their types whenever plugins are loaded or unloaded.
+	if (!resolved || resolvedGeneration != kstore->getGeneration())
+		resolve(kstore);
+
+	struct {
+		uint8_t func;
+		uint32_t count;
+		int64_t value;
+	} aggs[MaxNesting];
+	int64_t stack[MaxStack];
+	size_t sp = 0, ap = 0;
+
+	auto fold = [&aggs, &ap](int64_t value) {
+		auto &agg = aggs[ap - 1];
+		if (agg.count == 0)
+			agg.value = value;
+		else if (agg.func == FuncMax)
+			agg.value = value > agg.value ? value : agg.value;
+		else if (agg.func == FuncMin)
+			agg.value = value < agg.value ? value : agg.value;
+		else
+			agg.value += value;
+		agg.count++;
+	};
+
+	size_t ip = 0;
+	while (ip < codeSize) {
+		switch (code[ip++]) {
+			case OpConst:
+				stack[sp++] = constants[code[ip++]];
+				break;
+			case OpKey: {
+				auto &pattern = patterns[code[ip++]];
+				if (!readKey(kstore, pattern.key, pattern.type, stack[sp]))
+					stack[sp] = 0;
+				sp++;
+				break;
+			}
+			case OpAggBegin:
+				aggs[ap++] = {code[ip++], 0, 0};
+				break;
+			case OpAggAdd:
+				fold(stack[--sp]);
+				break;
+			case OpAggPattern: {
+				auto idx = code[ip++];
+				int64_t value;
+				for (size_t i = 0; i < resolvedCount; i++)
+					if (resolvedPatterns[i] == idx && readKey(kstore, resolvedKeys[i], resolvedTypes[i], value))
+						fold(value);
+				break;
+			}
+			case OpAggEnd: {
+				auto &agg = aggs[--ap];
+				stack[sp++] = (agg.func == FuncAvg && agg.count > 0) ? agg.value / agg.count : agg.value;
+				break;
+			}
+			case OpAdd:
+				sp--;
+				stack[sp - 1] += stack[sp];
+				break;
+			case OpSub:
+				sp--;
+				stack[sp - 1] -= stack[sp];
+				break;
+			case OpMul:
+				sp--;
+				stack[sp - 1] = stack[sp - 1] * stack[sp] / (1LL << FractionBits);
+				break;
+			case OpDiv:
+				sp--;
+				stack[sp - 1] = stack[sp] != 0 ? stack[sp - 1] * (1LL << FractionBits) / stack[sp] : 0;
+				break;
+			case OpNeg:
+				stack[sp - 1] = -stack[sp - 1];
+				break;
+			default:
+				return false;
+		}
+	}
+
+	result = stack[0];
+	return sp == 1;
+}
+
+bool DerivedExpression::decode(const SMC_DATA *data, SMC_DATA_SIZE size, SMC_KEY_TYPE type, int64_t &value) {
+	auto sp = VirtualSMCAPI::spIntegral(type);
+	auto fp = VirtualSMCAPI::fpIntegral(type);
+
+	if ((sp != 0 || fp != 0) && size == sizeof(uint16_t)) {
+		uint16_t raw = (data[0] << 8) | data[1];
+		// Fraction bits are 15 - sp and 16 - fp respectively.
+		if (sp != 0)
+			value = (raw & 0x8000 ? -1 : 1) * static_cast<int64_t>(static_cast<uint64_t>(raw & 0x7FFF) << (sp + 1));
+		else
+			value = static_cast<int64_t>(static_cast<uint64_t>(raw) << fp);
+		return true;
+	}
+
+	if (type == SmcKeyTypeFloat && size == sizeof(uint32_t)) {
+		uint32_t bits;
+		lilu_os_memcpy(&bits, data, sizeof(bits));
+		return floatToFixed(bits, FractionBits, value);
+	}
+
+	if (type == SmcKeyTypeFlag && size == sizeof(uint8_t)) {
+		value = data[0] ? (1LL << FractionBits) : 0;
+		return true;
+	}
+
+	bool isUnsigned = type == SmcKeyTypeUint8 || type == SmcKeyTypeUint16 || type == SmcKeyTypeUint32;
+	bool isSigned = type == SmcKeyTypeSint8 || type == SmcKeyTypeSint16 || type == SmcKeyTypeSint32;
+	if ((isUnsigned || isSigned) && size > 0 && size <= sizeof(uint32_t)) {
+		uint64_t raw = 0;
+		for (SMC_DATA_SIZE i = 0; i < size; i++)
+			raw = (raw << 8) | data[i];
+		// Sign extend from the value size.
+		int64_t v = static_cast<int64_t>(raw);
+		if (isSigned && (raw & (1ULL << (size * 8 - 1))))
+			v -= static_cast<int64_t>(1ULL << (size * 8));
+		value = v * (1LL << FractionBits);
+		return true;
+	}
+
+	return false;
+}
+
+bool DerivedExpression::encode(int64_t value, SMC_KEY_TYPE type, SMC_DATA_SIZE size, SMC_DATA *data) {
+	auto sp = VirtualSMCAPI::spIntegral(type);
+	auto fp = VirtualSMCAPI::fpIntegral(type);
+
+	if ((sp != 0 || fp != 0) && size == sizeof(uint16_t)) {
+		uint16_t raw;
+		if (sp != 0) {
+			uint64_t mag = static_cast<uint64_t>(value < 0 ? -value : value) >> (sp + 1);
+			raw = static_cast<uint16_t>((mag > 0x7FFF ? 0x7FFF : mag) | (value < 0 ? 0x8000 : 0));
+		} else {
+			uint64_t v = value < 0 ? 0 : static_cast<uint64_t>(value) >> fp;
+			raw = static_cast<uint16_t>(v > 0xFFFF ? 0xFFFF : v);
+		}
+		data[0] = raw >> 8;
+		data[1] = raw & 0xFF;
+		return true;
+	}
+
+	if (type == SmcKeyTypeFloat && size == sizeof(uint32_t)) {
+		uint32_t bits = fixedToFloat(value, FractionBits);
+		lilu_os_memcpy(data, &bits, sizeof(bits));
+		return true;
+	}
+
+	if (type == SmcKeyTypeFlag && size == sizeof(uint8_t)) {
+		data[0] = value != 0;
+		return true;
+	}
+
+	bool isUnsigned = type == SmcKeyTypeUint8 || type == SmcKeyTypeUint16 || type == SmcKeyTypeUint32;
+	bool isSigned = type == SmcKeyTypeSint8 || type == SmcKeyTypeSint16 || type == SmcKeyTypeSint32;
+	if ((isUnsigned || isSigned) && size > 0 && size <= sizeof(uint32_t)) {
+		int64_t v = value / (1LL << FractionBits);
+		int64_t max = isUnsigned ? static_cast<int64_t>((1ULL << (size * 8)) - 1) : static_cast<int64_t>((1ULL << (size * 8 - 1)) - 1);
+		int64_t min = isUnsigned ? 0 : -max - 1;
+		v = v > max ? max : (v < min ? min : v);
+		for (SMC_DATA_SIZE i = 0; i < size; i++)
+			data[i] = static_cast<SMC_DATA>(static_cast<uint64_t>(v) >> ((size - i - 1) * 8));
+		return true;
+	}
+
+	return false;
+}
+
+SMC_RESULT VirtualSMCValueDerived::readAccess() {
+	auto last = atomic_load_explicit(&lastEvaluation, memory_order_relaxed);
+	if (last != 0 && getTimeSinceNs(last) < EvaluationIntervalNs)
+		return SmcSuccess;
+
+	// Concurrent and recursive (e.g. self-referencing) reads use the previous result.
+	bool idle = false;
+	if (!atomic_compare_exchange_strong_explicit(&evaluating, &idle, true, memory_order_acquire, memory_order_relaxed))
+		return SmcSuccess;
+
+	SMC_RESULT res = SmcSuccess;
+	int64_t result;
+	SMC_DATA encoded[SMC_MAX_DATA_SIZE] {};
+	if (expression.evaluate(kstore, result) && DerivedExpression::encode(result, type, size, encoded))
+		res = update(encoded);
+	else
+		DBGLOG("derived", "failed to evaluate expression");
+
+	atomic_store_explicit(&lastEvaluation, getCurrentTimeNs(), memory_order_relaxed);
+	atomic_store_explicit(&evaluating, false, memory_order_release);
+	return res;
+}
+
+VirtualSMCValueDerived *VirtualSMCValueDerived::withDictionary(const OSDictionary *dict, VirtualSMCKeystore *store) {
+	auto expr = OSDynamicCast(OSString, dict->getObject("expr"));
+	if (!expr) {
+		DBGLOG("derived", "missing expression");
+		return nullptr;
+	}
+
+	auto derived = new VirtualSMCValueDerived;
+	if (derived) {
+		derived->kstore = store;
+		SMC_DATA test[SMC_MAX_DATA_SIZE];
+		if (derived->init(dict) && DerivedExpression::encode(0, derived->type, derived->size, test) &&
+			derived->expression.compile(expr->getCStringNoCopy())) {
+			// Derived values are computed, they are never written or serialised.
+			derived->attr &= ~SMC_KEY_ATTRIBUTE_WRITE;
+			derived->serializeLevel = SerializeLevel::None;
+			return derived;
+		} else {
+			delete derived;
+			SYSLOG("derived", "unable to initialise with expression %s", expr->getCStringNoCopy());
+		}
+	} else {
+		DBGLOG("derived", "unable to allocate");
+	}
+
+	return nullptr;
+}
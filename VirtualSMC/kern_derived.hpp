@@ -0,0 +1,203 @@
+//
+//  kern_derived.hpp
+//  VirtualSMC
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_derived_hpp
+#define kern_derived_hpp
+
+#include "kern_keystore.hpp"
+
+/**
+ *  Arithmetic expression over SMC keys compiled to stack machine bytecode.
+ *
+ *  expr    := term (('+' | '-') term)*
+ *  term    := factor (('*' | '/') factor)*
+ *  factor  := number | key | '-' factor | '(' expr ')' | func '(' arg (',' arg)* ')'
+ *  arg     := expr | pattern
+ *  func    := max | min | sum | avg
+ *
+ *  Keys are exactly 4 printable characters including spaces (e.g. RBr ). Patterns may use
+ *  '?' to match any character and may end with '*' to match any remaining characters
+ *  (e.g. TC?C or PC*).
+ *  Patterns are only accepted as aggregate arguments and match public keys.
+ *  Evaluation is done in 48.16 fixed point, unreadable keys are skipped by
+ *  aggregates and read as 0 otherwise. No floating point math is used, flt
+ *  values are converted from and to their bit representation.
+ */
+class DerivedExpression {
+	/**
+	 *  Bytecode limits, expressions are meant to be short
+	 */
+	static constexpr size_t MaxCode {64};
+	static constexpr size_t MaxConstants {8};
+	static constexpr size_t MaxPatterns {16};
+	static constexpr size_t MaxResolved {64};
+	static constexpr size_t MaxStack {8};
+	static constexpr size_t MaxNesting {4};
+
+	/**
+	 *  Fixed point fraction bits
+	 */
+	static constexpr uint32_t FractionBits {16};
+
+	/**
+	 *  Bytecode operations, Const, Key, AggBegin and AggPattern take a one byte operand
+	 */
+	enum Op : uint8_t {
+		OpConst,
+		OpKey,
+		OpAggBegin,
+		OpAggAdd,
+		OpAggPattern,
+		OpAggEnd,
+		OpAdd,
+		OpSub,
+		OpMul,
+		OpDiv,
+		OpNeg
+	};
+
+	/**
+	 *  Aggregate functions
+	 */
+	enum Func : uint8_t {
+		FuncMax,
+		FuncMin,
+		FuncSum,
+		FuncAvg
+	};
+
+	/**
+	 *  Key pattern, bytes with zero mask match any character
+	 */
+	struct Pattern {
+		SMC_KEY key;
+		SMC_KEY mask;
+		SMC_KEY_TYPE type;
+	};
+
+	uint8_t code[MaxCode] {};
+	size_t codeSize {0};
+	int64_t constants[MaxConstants] {};
+	size_t constantCount {0};
+	Pattern patterns[MaxPatterns] {};
+	size_t patternCount {0};
+
+	/**
+	 *  Keys matched by wildcard patterns, their types and pattern indices
+	 */
+	SMC_KEY resolvedKeys[MaxResolved] {};
+	SMC_KEY_TYPE resolvedTypes[MaxResolved] {};
+	uint8_t resolvedPatterns[MaxResolved] {};
+	size_t resolvedCount {0};
+
+	/**
+	 *  Keystore generation patterns were resolved for
+	 */
+	uint32_t resolvedGeneration {0};
+	bool resolved {false};
+
+	/**
+	 *  Compilation state
+	 */
+	size_t stackDepth {0};
+	size_t aggDepth {0};
+
+	bool emit(uint8_t op);
+	bool emit(uint8_t op, uint8_t arg);
+	bool parseExpr(const char *&src);
+	bool parseTerm(const char *&src);
+	bool parseFactor(const char *&src);
+	bool parseArg(const char *&src);
+	bool parseNumber(const char *&src);
+	bool parsePattern(const char *&src, SMC_KEY &key, SMC_KEY &mask);
+	bool addPattern(SMC_KEY key, SMC_KEY mask, uint8_t &idx);
+
+	/**
+	 *  Match patterns against current keystore keys in a single pass over the keys
+	 *
+	 *  @param kstore  keystore
+	 */
+	void resolve(VirtualSMCKeystore *kstore);
+
+	/**
+	 *  Read key contents as a fixed point number
+	 *
+	 *  @param kstore  keystore
+	 *  @param key     key name
+	 *  @param type    key type
+	 *  @param value   decoded value
+	 *
+	 *  @return true on success
+	 */
+	static bool readKey(VirtualSMCKeystore *kstore, SMC_KEY key, SMC_KEY_TYPE type, int64_t &value);
+
+public:
+	/**
+	 *  Compile expression
+	 *
+	 *  @param src  expression source
+	 *
+	 *  @return true on success
+	 */
+	bool compile(const char *src);
+
+	/**
+	 *  Evaluate compiled expression
+	 *
+	 *  @param kstore  keystore to read the keys from
+	 *  @param result  result in fixed point
+	 *
+	 *  @return true on success
+	 */
+	bool evaluate(VirtualSMCKeystore *kstore, int64_t &result);
+
+	/**
+	 *  Convert SMC value contents to fixed point
+	 *
+	 *  @param data   value contents
+	 *  @param size   value size
+	 *  @param type   value type, sp, fp, ui, si, flt and flag types are supported
+	 *  @param value  decoded value
+	 *
+	 *  @return true on success
+	 */
+	static bool decode(const SMC_DATA *data, SMC_DATA_SIZE size, SMC_KEY_TYPE type, int64_t &value);
+
+	/**
+	 *  Convert fixed point to SMC value contents, out of range values are clamped
+	 *
+	 *  @param value  fixed point value
+	 *  @param type   value type, sp, fp, ui, si, flt and flag types are supported
+	 *  @param size   value size
+	 *  @param data   value contents
+	 *
+	 *  @return true on success
+	 */
+	static bool encode(int64_t value, SMC_KEY_TYPE type, SMC_DATA_SIZE size, SMC_DATA *data);
+};
+
+class VirtualSMCValueDerived : public VirtualSMCValue {
+	/**
+	 *  Sampling epoch, reads within it return the memoized result
+	 */
+	static constexpr uint64_t EvaluationIntervalNs {100000000};
+
+	VirtualSMCKeystore *kstore {nullptr};
+	DerivedExpression expression;
+	_Atomic(bool) evaluating;
+	_Atomic(uint64_t) lastEvaluation;
+protected:
+	SMC_RESULT readAccess() override;
+public:
+	VirtualSMCValueDerived() {
+		atomic_init(&evaluating, false);
+		atomic_init(&lastEvaluation, 0);
+	}
+	static VirtualSMCValueDerived *withDictionary(const OSDictionary *dict, VirtualSMCKeystore *store);
+};
+
+#endif /* kern_derived_hpp */
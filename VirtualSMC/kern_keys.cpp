@@ -46,8 +46,8 @@ VirtualSMCValueVariable *VirtualSMCValueVariable::withData(const SMC_DATA *data,
 }
 
 SMC_RESULT VirtualSMCValueKEY::readAccess() {
-	*reinterpret_cast<uint32_t *>(data) = OSSwapInt32(kstore->getPublicKeyAmount());
-	return SmcSuccess;
+	uint32_t amount = OSSwapInt32(kstore->getPublicKeyAmount());
+	return VirtualSMCValue::update(reinterpret_cast<const SMC_DATA *>(&amount));
 }
 
 VirtualSMCValueKEY *VirtualSMCValueKEY::withStore(VirtualSMCKeystore *store) {
@@ -68,8 +68,8 @@ VirtualSMCValueKEY *VirtualSMCValueKEY::withStore(VirtualSMCKeystore *store) {
 }
 
 SMC_RESULT VirtualSMCValueCLKT::readAccess() {
-	*reinterpret_cast<uint32_t *>(data) = OSSwapInt32((IOService::getPlatform()->getGMTTimeOfDay() + delta) % 86400);
-	return SmcSuccess;
+	uint32_t time = OSSwapInt32((IOService::getPlatform()->getGMTTimeOfDay() + delta) % 86400);
+	return VirtualSMCValue::update(reinterpret_cast<const SMC_DATA *>(&time));
 }
 
 SMC_RESULT VirtualSMCValueCLKT::update(const SMC_DATA *src) {
@@ -111,8 +111,8 @@ SMC_RESULT VirtualSMCValueCLWK::readAccess() {
 			counter = spent;
 	}
 
-	*reinterpret_cast<uint16_t *>(data) = OSSwapInt16(counter);
-	return SmcSuccess;
+	uint16_t value = OSSwapInt16(counter);
+	return VirtualSMCValue::update(reinterpret_cast<const SMC_DATA *>(&value));
 }
 
 SMC_RESULT VirtualSMCValueCLWK::update(const SMC_DATA *src) {
@@ -169,7 +169,8 @@ bool VirtualSMCValueKPST::unlocked() const {
 
 
 void VirtualSMCValueKPST::setUnlocked(bool value) {
-	data[0] = value;
+	SMC_DATA unlocked = value;
+	VirtualSMCValue::update(&unlocked);
 }
 
 SMC_RESULT VirtualSMCValueKPPW::update(const SMC_DATA *src) {
@@ -221,12 +222,13 @@ VirtualSMCValueAdr *VirtualSMCValueAdr::withAddr(uint32_t addr) {
 }
 
 void VirtualSMCValueAdr::setAddress(uint32_t addr) {
-	*reinterpret_cast<uint32_t *>(data) = OSSwapInt32(addr);
+	uint32_t value = OSSwapInt32(addr);
+	VirtualSMCValue::update(reinterpret_cast<const SMC_DATA *>(&value));
 }
 
 SMC_RESULT VirtualSMCValueNum::readAccess() {
-	data[0] = 1;
-	return SmcSuccess;
+	SMC_DATA value = 1;
+	return VirtualSMCValue::update(&value);
 }
 
 SMC_RESULT VirtualSMCValueNum::update(const SMC_DATA *src) {
@@ -316,22 +318,14 @@ SMC_RESULT VirtualSMCValueHBKP::update(const SMC_DATA *src) {
 	return SmcSuccess;
 }
 
-VirtualSMCValueHBKP *VirtualSMCValueHBKP::withDump(bool dump) {
+VirtualSMCValueHBKP *VirtualSMCValueHBKP::withDump() {
 	auto hbkp = new VirtualSMCValueHBKP;
 	if (hbkp) {
 		if (hbkp->init(nullptr, SMC_HBKP_SIZE, SmcKeyTypeCh8s, SMC_KEY_ATTRIBUTE_READ|SMC_KEY_ATTRIBUTE_WRITE)) {
-			// Dump to nvram can only be enabled when VirtualSMC EFI module exists and is functional.
-			// However, this is not the only condition, another one is vsmchbkp argument.
 			// Note, that we never initialise HBKP with a real key for security reasons.
-			uint32_t val = DumpNormal;
-			PE_parse_boot_argn("vsmchbkp", &val, sizeof(val));
-			if (val >= DumpTotal)
+			PE_parse_boot_argn("vsmchbkp", &hbkp->dumpMode, sizeof(hbkp->dumpMode));
+			if (hbkp->dumpMode >= DumpTotal)
 				PANIC("hbkp", "vsmchbkp misuse, must be in 0..2 range");
-			hbkp->dumpToNVRAM = dump && val >= DumpNormal;
-			hbkp->dumpEncrypted = val == DumpNormal;
-			// AppleRTC should be loaded by this time. Only erase when we are allowed to write to RTC.
-			if (hbkp->dumpEncrypted)
-				hbkp->dumpEncrypted = EfiBackend::eraseTempEncryptionKey();
 			return hbkp;
 		} else {
 			delete hbkp;
@@ -344,6 +338,17 @@ VirtualSMCValueHBKP *VirtualSMCValueHBKP::withDump(bool dump) {
 	return nullptr;
 }
 
+void VirtualSMCValueHBKP::enableDump(bool firmwareBackend) {
+	// Dump to nvram can only be enabled when VirtualSMC EFI module exists and is functional.
+	// However, this is not the only condition, another one is vsmchbkp argument.
+	bool encrypted = dumpMode == DumpNormal;
+	// AppleRTC should be loaded by this time. Only erase when we are allowed to write to RTC.
+	if (encrypted)
+		encrypted = EfiBackend::eraseTempEncryptionKey();
+	dumpEncrypted = encrypted;
+	dumpToNVRAM = firmwareBackend && dumpMode >= DumpNormal;
+}
+
 SMC_RESULT VirtualSMCValueNTOK::update(const SMC_DATA *src) {
 	DBGLOG("ntok", "received new value %02X", src[0]);
 	VirtualSMC::setInterrupts(src[0] == 1);
@@ -373,13 +378,9 @@ SMC_RESULT VirtualSMCValueTimer::readAccess() {
 		uint64_t timeout  = convertScToNs(OSSwapInt16(*reinterpret_cast<uint16_t *>(data)));
 		uint64_t current  = getCurrentTimeNs();
 		uint16_t timeleft = convertNsToSc(getTimeLeftNs(jobStartTime, timeout, current));
-		if (timeleft > 0) {
-			*reinterpret_cast<uint16_t *>(data) = OSSwapInt16(timeleft);
-			jobStartTime = current;
-		} else {
-			*reinterpret_cast<uint16_t *>(data) = 0;
-			jobStartTime = 0;
-		}
+		uint16_t value = OSSwapInt16(timeleft);
+		jobStartTime = timeleft > 0 ? current : 0;
+		return VirtualSMCValue::update(reinterpret_cast<const SMC_DATA *>(&value));
 	}
 
 	return SmcSuccess;
@@ -393,8 +394,7 @@ uint16_t VirtualSMCValueTimer::startCountdown() {
 
 SMC_RESULT VirtualSMCValueNATi::update(const SMC_DATA *src) {
 	jobStartTime = 0;
-	lilu_os_memcpy(data, src, sizeof(uint16_t));
-	return SmcSuccess;
+	return VirtualSMCValue::update(src);
 }
 
 VirtualSMCValueNATi *VirtualSMCValueNATi::withCountdown(uint16_t countdown) {
@@ -416,7 +416,9 @@ VirtualSMCValueNATi *VirtualSMCValueNATi::withCountdown(uint16_t countdown) {
 
 SMC_RESULT VirtualSMCValueNATJ::update(const SMC_DATA *src) {
 	auto timeout = valueNATi->startCountdown();
-	data[0] = src[0];
+	auto res = VirtualSMCValue::update(src);
+	if (res != SmcSuccess)
+		return res;
 	DBGLOG("natj", "got job %02X with timer %04X", src[0], timeout);
 	VirtualSMC::postWatchDogJob(src[0], convertScToMs(timeout));
 	return SmcSuccess;
@@ -444,7 +446,9 @@ VirtualSMCValueNATJ *VirtualSMCValueNATJ::withNATi(VirtualSMCValueNATi *nati) {
 }
 
 SMC_RESULT VirtualSMCValueOSWD::update(const SMC_DATA *src) {
-	lilu_os_memcpy(data, src, sizeof(uint16_t));
+	auto res = VirtualSMCValue::update(src);
+	if (res != SmcSuccess)
+		return res;
 	uint16_t timeout = startCountdown();
 	DBGLOG("oswd", "got reboot job with timer %04X", timeout);
 	if (timeout > 0)
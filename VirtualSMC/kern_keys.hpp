@@ -99,11 +99,20 @@ class VirtualSMCValueHBKP : public VirtualSMCValue {
 		DumpUnencrypted = 2,
 		DumpTotal = 3
 	};
+	uint32_t dumpMode {DumpNormal};
 	bool dumpToNVRAM {false};
 	bool dumpEncrypted {true};
 public:
 	SMC_RESULT update(const SMC_DATA *src) override;
-	static VirtualSMCValueHBKP *withDump(bool dump);
+	static VirtualSMCValueHBKP *withDump();
+
+	/**
+	 *  Enable NVRAM dumping once firmware backend availability is known.
+	 *  Called after start, since temporary key removal accesses NVRAM and RTC.
+	 *
+	 *  @param firmwareBackend  VirtualSMC EFI module is present and functional
+	 */
+	void enableDump(bool firmwareBackend);
 };
 
 class VirtualSMCValueNTOK : public VirtualSMCValue {
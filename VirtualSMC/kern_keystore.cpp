@@ -8,22 +8,39 @@
 #include <VirtualSMCSDK/vsmcatomic.h>
 
 #include <libkern/OSByteOrder.h>
+#include <IOKit/IOLib.h>
 #include <Headers/kern_iokit.hpp>
 #include <Headers/kern_util.hpp>
 #include <Headers/kern_time.hpp>
 
+#include "kern_derived.hpp"
 #include "kern_keys.hpp"
 #include "kern_keystore.hpp"
+#include "kern_vsmc.hpp"
+
+bool VirtualSMCKeystore::init(const OSDictionary *mainprops, const OSDictionary *userprops, const SMCInfo &info, const char *board, int model, VirtualSMCStartupProfile &profile) {
+	auto phaseStart = VirtualSMCStartupProfile::now();
 
-bool VirtualSMCKeystore::init(const OSDictionary *mainprops, const OSDictionary *userprops, const SMCInfo &info, const char *board, int model, bool whbkp) {
 	deviceInfo = info;
 	deviceInfo.generatorSeed();
 
-	for (size_t i = 0; i < arrsize(pluginData); i++)
-		atomic_init(&pluginData[i], nullptr);
+	atomic_init(&pluginList, nullptr);
+	atomic_init(&subscriptionList, nullptr);
+	atomic_init(&deliveryThread, nullptr);
+	atomic_init(&generation, 0);
+	atomic_init(&readerEpoch, 0);
+	for (size_t i = 0; i < arrsize(readersActive); i++)
+		atomic_init(&readersActive[i], 0);
 
-	// Hibernation support
-	if (!addKey(KeyHBKP, VirtualSMCValueHBKP::withDump(whbkp)))
+	pluginLock = IOLockAlloc();
+	if (!pluginLock) {
+		DBGLOG("kstore", "unable to allocate plugin lock");
+		return false;
+	}
+
+	// Hibernation support, dumping is enabled in initDeferred
+	valueHBKP = VirtualSMCValueHBKP::withDump();
+	if (!addKey(KeyHBKP, valueHBKP))
 		return false;
 
 	if (!mergePredefined(board, model)) {
@@ -31,6 +48,7 @@ bool VirtualSMCKeystore::init(const OSDictionary *mainprops, const OSDictionary
 		return false;
 	}
 
+	phaseStart = profile.record(VirtualSMCStartupProfile::PhaseKeystorePredefined, phaseStart);
 
 	if (!mergeProvider(mainprops, board, model)) {
 		DBGLOG("kstore", "unable to merge main properties");
@@ -39,9 +57,13 @@ bool VirtualSMCKeystore::init(const OSDictionary *mainprops, const OSDictionary
 	
 	mergeProvider(userprops, board, model);
 
+	phaseStart = profile.record(VirtualSMCStartupProfile::PhaseKeystoreMerge, phaseStart);
+
 	qsort(const_cast<VirtualSMCKeyValue *>(dataStorage.data()), dataStorage.size(), sizeof(VirtualSMCKeyValue), VirtualSMCKeyValue::compare);
 	qsort(const_cast<VirtualSMCKeyValue *>(dataHiddenStorage.data()), dataHiddenStorage.size(), sizeof(VirtualSMCKeyValue), VirtualSMCKeyValue::compare);
 
+	phaseStart = profile.record(VirtualSMCStartupProfile::PhaseKeystoreSort, phaseStart);
+
 	if (!findAccessKeys()) {
 		DBGLOG("kstore", "unable to find access keys");
 		return false;
@@ -51,16 +73,32 @@ bool VirtualSMCKeystore::init(const OSDictionary *mainprops, const OSDictionary
 	if (PE_parse_boot_argn("-vsmcrpt", &tmp, sizeof(tmp)))
 		reportMissingKeys = true;
 
+	if (PE_parse_boot_argn("-vsmcstat", &tmp, sizeof(tmp))) {
+		statistics = new VirtualSMCStatistics;
+		if (statistics && !statistics->init()) {
+			delete statistics;
+			statistics = nullptr;
+		}
+		DBGLOG("kstore", "key statistics %s", statistics ? "enabled" : "unavailable");
+	}
+
 	if (!PE_parse_boot_argn("vsmcslvl", &serLevel, sizeof(serLevel)) || serLevel > SerializeLevel::Confidential) {
 		DBGLOG("kstore", "no serialiser lvl argument, using nromal");
 		serLevel = SerializeLevel::Default;
 	}
 
+	profile.record(VirtualSMCStartupProfile::PhaseKeystoreSetup, phaseStart);
+
+	return true;
+}
+
+void VirtualSMCKeystore::initDeferred(bool firmwareBackend) {
+	if (valueHBKP)
+		valueHBKP->enableDump(firmwareBackend);
+
 	if (serLevel != SerializeLevel::None) {
 		//TODO: do deserialization here from vsmc-data nvram variable if we need it
 	}
-
-	return true;
 }
 
 bool VirtualSMCKeystore::mergeProvider(const OSDictionary *dict, const char *board, int model) {
@@ -122,8 +160,13 @@ bool VirtualSMCKeystore::VirtualSMCKeystore::merge(const OSArray *arr) {
 			continue;
 		}
 		
-		atomic_init(&kv.value, VirtualSMCValueVariable::withDictionary(kvDict));
+		// Keys with an expression are computed from other keys on read.
+		if (kvDict->getObject("expr"))
+			atomic_init(&kv.value, VirtualSMCValueDerived::withDictionary(kvDict, this));
+		else
+			atomic_init(&kv.value, VirtualSMCValueVariable::withDictionary(kvDict));
 		atomic_init(&kv.backup, nullptr);
+		kv.alias = false;
 		if (!kv.value) {
 			DBGLOG("kstore", "invalid value contents at %u", i);
 			continue;
@@ -153,6 +196,28 @@ void VirtualSMCKeystore::handlePowerOn() {
 	lastWakeTime = getCurrentTimeNs();
 }
 
+uint32_t VirtualSMCKeystore::enterRead() {
+	while (true) {
+		auto epoch = atomic_load_explicit(&readerEpoch, memory_order_seq_cst);
+		atomic_fetch_add_explicit(&readersActive[epoch & 1], 1, memory_order_seq_cst);
+		// Epoch may have been advanced before our counter became visible, retry with the new one.
+		if (atomic_load_explicit(&readerEpoch, memory_order_seq_cst) == epoch)
+			return epoch;
+		atomic_fetch_sub_explicit(&readersActive[epoch & 1], 1, memory_order_seq_cst);
+	}
+}
+
+void VirtualSMCKeystore::leaveRead(uint32_t epoch) {
+	atomic_fetch_sub_explicit(&readersActive[epoch & 1], 1, memory_order_seq_cst);
+}
+
+void VirtualSMCKeystore::waitForReaders() {
+	auto epoch = atomic_fetch_add_explicit(&readerEpoch, 1, memory_order_seq_cst);
+	// Readers are short and never sleep, so polling is sufficient.
+	while (atomic_load_explicit(&readersActive[epoch & 1], memory_order_seq_cst) != 0)
+		IOSleep(1);
+}
+
 IOReturn VirtualSMCKeystore::loadPlugin(VirtualSMCAPI::Plugin *plugin) {
 	DBGLOG("kstore", "loading %s (%lu), api: %lu", plugin->product, plugin->version, plugin->apiver);
 
@@ -161,85 +226,390 @@ IOReturn VirtualSMCKeystore::loadPlugin(VirtualSMCAPI::Plugin *plugin) {
 		return kIOReturnInvalid;
 	}
 
-	IOReturn code = kIOReturnSuccess;
-	VirtualSMCAPI::KeyStorage ovrData[2];
 	VirtualSMCAPI::KeyStorage *pData[2] {&plugin->data, &plugin->dataHidden};
+	for (size_t i = 0; i < arrsize(pData); i++) {
+		auto &currPData = *pData[i];
+		for (size_t j = 1; j < currPData.size(); j++) {
+			if (VirtualSMCKeyValue::compare(currPData[j - 1].key, currPData[j].key) >= 0) {
+				SYSLOG("kstore", "failed to load plugin %s (%lu), unsorted or duplicate key [%08X]", plugin->product, plugin->version, currPData[j].key);
+				return kIOReturnBadArgument;
+			}
+		}
+	}
+
+	auto entry = new PluginEntry;
+	if (!entry) {
+		SYSLOG("kstore", "failed to allocate plugin entry for %s", plugin->product);
+		return kIOReturnNoMemory;
+	}
+
+	entry->plugin = plugin;
+	atomic_init(&entry->next, nullptr);
+
+	IOLockLock(pluginLock);
+
+	IOReturn code = kIOReturnSuccess;
+	auto link = &pluginList;
+	for (auto curr = atomic_load_explicit(link, memory_order_relaxed); curr; curr = atomic_load_explicit(link, memory_order_relaxed)) {
+		if (curr->plugin == plugin) {
+			SYSLOG("kstore", "plugin %s is already loaded", plugin->product);
+			code = kIOReturnExclusiveAccess;
+		}
+		link = &curr->next;
+	}
+
+	// Validate and allocate everything before touching plugin storage, so that failed loads leave it intact.
 	VirtualSMCAPI::KeyStorage *sData[2] {&dataStorage, &dataHiddenStorage};
-	for (size_t i = 0; code == kIOReturnSuccess && i < arrsize(ovrData); i++) {
+	for (size_t i = 0; code == kIOReturnSuccess && i < arrsize(entry->overrides); i++) {
+		auto &currPData = *pData[i];
+		size_t count = 0;
+		for (size_t j = 0; j < currPData.size(); j++) {
+			VirtualSMCKeyValue *tVal = nullptr;
+			if (getByName(*sData[i], currPData[j].key, tVal) != SmcSuccess)
+				continue;
+			if (isOverridden(currPData[j].key, i == 1)) {
+				SYSLOG("kstore", "attempt to override twice [%08X] by %s", currPData[j].key, plugin->product);
+				code = kIOReturnExclusiveAccess;
+				break;
+			}
+			count++;
+		}
+		if (code == kIOReturnSuccess && !entry->overrides[i].reserve(count))
+			code = kIOReturnNoMemory;
+	}
+
+	// Keys present in the keystore are moved out of the plugin to replace the original values.
+	for (size_t i = 0; code == kIOReturnSuccess && i < arrsize(entry->overrides); i++) {
 		auto &currPData = *pData[i];
-		auto &currSData = *sData[i];
 		size_t j = 0;
 		while (j < currPData.size()) {
 			VirtualSMCKeyValue *tVal = nullptr;
-			if (getByName(currSData, currPData[j].key, tVal) == SmcSuccess) {
-				if (ovrData[i].push_back<2>(currPData[j])) {
-					atomic_store_explicit(&currPData[j].value, nullptr, memory_order_relaxed);
-					if (!currPData.erase(j)) {
-						code = kIOReturnNoMemory;
-						break;
-					}
-				} else {
-					code = kIOReturnNoMemory;
-					break;
-				}
+			if (getByName(*sData[i], currPData[j].key, tVal) == SmcSuccess) {
+				// Storage is reserved above, so this does not fail.
+				entry->overrides[i].push_back(currPData[j]);
+				atomic_store_explicit(&currPData[j].value, nullptr, memory_order_relaxed);
+				currPData.erase(j);
 				continue;
 			}
 			j++;
 		}
 	}
 
-	if (code == kIOReturnSuccess) {
-		code = kIOReturnNoSpace;
-		for (size_t i = 0; i < VirtualSMCAPI::PluginMax; i++) {
-			VirtualSMCAPI::Plugin * nullData = nullptr;
-			if (atomic_compare_exchange_strong_explicit(&pluginData[i], &nullData, plugin, memory_order_relaxed, memory_order_relaxed)) {
-				code = kIOReturnSuccess;
-				break;
+	// Aliases share the value of their owner, which is freed along with the owner. When the owner was
+	// moved to the overrides while its aliases stay in the plugin, it would be freed on unload under
+	// the plugin, so hand the ownership over to one of the aliases left in the plugin.
+	for (size_t i = 0; code == kIOReturnSuccess && i < arrsize(entry->overrides); i++) {
+		auto &currOData = entry->overrides[i];
+		auto &currPData = *pData[i];
+		for (size_t j = 0; j < currOData.size(); j++) {
+			if (currOData[j].alias)
+				continue;
+			auto ovrValue = atomic_load_explicit(&currOData[j].value, memory_order_relaxed);
+			for (size_t k = 0; k < currPData.size(); k++) {
+				if (currPData[k].alias && atomic_load_explicit(&currPData[k].value, memory_order_relaxed) == ovrValue) {
+					currPData[k].alias = false;
+					currOData[j].alias = true;
+					break;
+				}
 			}
 		}
+	}
 
-		if (code == kIOReturnSuccess) {
-			for (size_t i = 0; code == kIOReturnSuccess && i < arrsize(ovrData); i++) {
-				auto &currOData = ovrData[i];
-				auto &currSData = *sData[i];
-				for (size_t j = 0; j < currOData.size(); j++) {
-					VirtualSMCKeyValue *tVal = nullptr;
-					if (getByName(currSData, currOData[j].key, tVal) == SmcSuccess) {
-						// Obtain any current value (we will check if it changed later).
-						VirtualSMCValue *orgValue = atomic_load_explicit(&tVal->value, memory_order_relaxed);
-						// Overwrite it with the new value.
-						atomic_store_explicit(&tVal->value, currOData[j].value, memory_order_relaxed);
-						// Protect the replaced value from deletion (there are no data races here).
-						atomic_store_explicit(&currOData[j].value, nullptr, memory_order_relaxed);
-						// Synchronise access by checking for any extra overrides.
-						// Note, a pointer could be lost in the first load & store pair due to a race-condition.
-						// However, this is fine, because that is a contract violation which must lead to a kernel panic.
-						VirtualSMCValue *nullValue = nullptr;
-						if (!atomic_compare_exchange_strong_explicit(&currOData[j].backup, &nullValue, orgValue,
-																	 memory_order_relaxed, memory_order_relaxed))
-							PANIC("kstore", "attempt to override twice [%08X] by %s", currOData[j].key, plugin->product);
-					} else {
-						code = kIOReturnInvalid;
-						break;
-					}
-				}
+	if (code == kIOReturnSuccess) {
+		for (size_t i = 0; i < arrsize(entry->overrides); i++) {
+			auto &currOData = entry->overrides[i];
+			auto &currSData = *sData[i];
+			for (size_t j = 0; j < currOData.size(); j++) {
+				VirtualSMCKeyValue *tVal = nullptr;
+				// Presence was checked above and base storage never changes after startup.
+				getByName(currSData, currOData[j].key, tVal);
+				// Keep the original value to restore it on unload.
+				atomic_store_explicit(&currOData[j].backup, atomic_load_explicit(&tVal->value, memory_order_relaxed), memory_order_relaxed);
+				atomic_store_explicit(&tVal->value, atomic_load_explicit(&currOData[j].value, memory_order_relaxed), memory_order_release);
+				atomic_store_explicit(&currOData[j].value, nullptr, memory_order_relaxed);
 			}
 		}
+
+		// Publish the fully constructed entry at the tail, keeping key indices of earlier plugins intact.
+		atomic_store_explicit(link, entry, memory_order_release);
+		atomic_fetch_add_explicit(&generation, 1, memory_order_release);
 	}
 
-	for (auto &entry : ovrData)
-		entry.deinit();
+	IOLockUnlock(pluginLock);
+
+	if (code != kIOReturnSuccess) {
+		// Nothing was moved out of the plugin, only reserved storage is freed.
+		for (auto &ovr : entry->overrides)
+			ovr.deinit();
+		delete entry;
+	}
 
 	return code;
 }
 
+IOReturn VirtualSMCKeystore::unloadPlugin(VirtualSMCAPI::Plugin *plugin) {
+	// Handlers run plugin code, which must not be unloaded underneath them.
+	if (inDelivery()) {
+		SYSLOG("kstore", "unable to unload %s from a key change handler", plugin->product);
+		return kIOReturnNotPermitted;
+	}
+
+	IOLockLock(pluginLock);
+
+	auto link = &pluginList;
+	auto entry = atomic_load_explicit(link, memory_order_relaxed);
+	while (entry && entry->plugin != plugin) {
+		link = &entry->next;
+		entry = atomic_load_explicit(link, memory_order_relaxed);
+	}
+
+	if (!entry) {
+		IOLockUnlock(pluginLock);
+		DBGLOG("kstore", "unable to unload unknown plugin %s", plugin->product);
+		return kIOReturnNotFound;
+	}
+
+	DBGLOG("kstore", "unloading %s (%lu)", plugin->product, plugin->version);
+
+	// Restore original values, overriding values are freed once no reader can reference them.
+	VirtualSMCAPI::KeyStorage *sData[2] {&dataStorage, &dataHiddenStorage};
+	for (size_t i = 0; i < arrsize(entry->overrides); i++) {
+		auto &currOData = entry->overrides[i];
+		for (size_t j = 0; j < currOData.size(); j++) {
+			VirtualSMCKeyValue *tVal = nullptr;
+			getByName(*sData[i], currOData[j].key, tVal);
+			auto ovrValue = atomic_load_explicit(&tVal->value, memory_order_relaxed);
+			atomic_store_explicit(&tVal->value, atomic_load_explicit(&currOData[j].backup, memory_order_relaxed), memory_order_release);
+			atomic_store_explicit(&currOData[j].backup, nullptr, memory_order_relaxed);
+			atomic_store_explicit(&currOData[j].value, ovrValue, memory_order_relaxed);
+		}
+	}
+
+	atomic_store_explicit(link, atomic_load_explicit(&entry->next, memory_order_relaxed), memory_order_release);
+	atomic_fetch_add_explicit(&generation, 1, memory_order_release);
+
+	// Handlers point into plugin code, so its subscriptions go away with it. All of them are cancelled
+	// before waiting for a running handler, so that none is called once unloading started.
+	VirtualSMCAPI::KeySubscription *released = nullptr;
+	auto subLink = &subscriptionList;
+	for (auto sub = atomic_load_explicit(subLink, memory_order_relaxed); sub; sub = atomic_load_explicit(subLink, memory_order_relaxed)) {
+		if (sub->plugin != plugin) {
+			subLink = &sub->next;
+			continue;
+		}
+		atomic_store_explicit(subLink, atomic_load_explicit(&sub->next, memory_order_relaxed), memory_order_release);
+		sub->cancelled = true;
+		sub->released = released;
+		released = sub;
+	}
+
+	// Called outside of delivery, so this waits for pinned subscriptions instead of deferring.
+	for (auto sub = released; sub; sub = sub->released)
+		while (sub->pinned)
+			IOLockSleep(pluginLock, sub, THREAD_UNINT);
+
+	waitForReaders();
+
+	IOLockUnlock(pluginLock);
+
+	while (released) {
+		auto next = released->released;
+		delete released;
+		released = next;
+	}
+
+	for (auto &ovr : entry->overrides)
+		ovr.deinit();
+	delete entry;
+
+	return kIOReturnSuccess;
+}
+
+bool VirtualSMCKeystore::isOverridden(SMC_KEY name, bool hidden) {
+	for (auto curr = atomic_load_explicit(&pluginList, memory_order_relaxed); curr; curr = atomic_load_explicit(&curr->next, memory_order_relaxed)) {
+		VirtualSMCKeyValue *tVal = nullptr;
+		if (getByName(curr->overrides[hidden], name, tVal) == SmcSuccess)
+			return true;
+	}
+	return false;
+}
+
+VirtualSMCAPI::KeySubscription *VirtualSMCKeystore::subscribeKeys(VirtualSMCAPI::Plugin *plugin, const SMC_KEY *keys, size_t count, VirtualSMCAPI::KeyChangeHandler handler, void *context) {
+	if (!plugin || !keys || count == 0 || !handler) {
+		SYSLOG("kstore", "invalid key subscription");
+		return nullptr;
+	}
+
+	auto sub = new VirtualSMCAPI::KeySubscription;
+	if (!sub) {
+		SYSLOG("kstore", "failed to allocate key subscription");
+		return nullptr;
+	}
+
+	size_t words = (count + 31) / 32;
+	sub->keys = new SMC_KEY[count];
+	sub->changed = new SMC_KEY[count];
+	sub->pending = new _Atomic(uint32_t)[words];
+	if (!sub->keys || !sub->changed || !sub->pending) {
+		SYSLOG("kstore", "failed to allocate key subscription with %lu keys", count);
+		delete sub;
+		return nullptr;
+	}
+
+	lilu_os_memcpy(sub->keys, keys, count * sizeof(SMC_KEY));
+	for (size_t i = 0; i < words; i++)
+		atomic_init(&sub->pending[i], 0);
+	sub->count = count;
+	sub->plugin = plugin;
+	sub->handler = handler;
+	sub->context = context;
+	atomic_init(&sub->next, nullptr);
+
+	IOLockLock(pluginLock);
+
+	// Subscriptions are cancelled on unload, so only loaded plugins may subscribe.
+	auto entry = atomic_load_explicit(&pluginList, memory_order_relaxed);
+	while (entry && entry->plugin != plugin)
+		entry = atomic_load_explicit(&entry->next, memory_order_relaxed);
+
+	if (entry) {
+		auto link = &subscriptionList;
+		for (auto curr = atomic_load_explicit(link, memory_order_relaxed); curr; curr = atomic_load_explicit(link, memory_order_relaxed))
+			link = &curr->next;
+		atomic_store_explicit(link, sub, memory_order_release);
+	}
+
+	IOLockUnlock(pluginLock);
+
+	if (!entry) {
+		SYSLOG("kstore", "unable to subscribe for unloaded plugin %s", plugin->product);
+		delete sub;
+		return nullptr;
+	}
+
+	DBGLOG("kstore", "subscribed to %lu keys", count);
+	return sub;
+}
+
+bool VirtualSMCKeystore::cancelSubscription(_Atomic(VirtualSMCAPI::KeySubscription *) *link) {
+	auto sub = atomic_load_explicit(link, memory_order_relaxed);
+	atomic_store_explicit(link, atomic_load_explicit(&sub->next, memory_order_relaxed), memory_order_release);
+	sub->cancelled = true;
+
+	if (sub->pinned) {
+		if (inDelivery()) {
+			// Cancelled from a handler of the same delivery, which cannot wait for itself. Free it after delivery.
+			sub->released = releasedSubscriptions;
+			releasedSubscriptions = sub;
+			return false;
+		}
+
+		// Delivery drops pluginLock while running handlers and wakes us once it is done with the subscription.
+		while (sub->pinned)
+			IOLockSleep(pluginLock, sub, THREAD_UNINT);
+	}
+
+	return true;
+}
+
+void VirtualSMCKeystore::unsubscribeKeys(VirtualSMCAPI::KeySubscription *subscription) {
+	IOLockLock(pluginLock);
+
+	auto link = &subscriptionList;
+	auto curr = atomic_load_explicit(link, memory_order_relaxed);
+	while (curr && curr != subscription) {
+		link = &curr->next;
+		curr = atomic_load_explicit(link, memory_order_relaxed);
+	}
+
+	bool release = curr && cancelSubscription(link);
+	// Writers marking changes may still reference the subscription.
+	if (release)
+		waitForReaders();
+
+	IOLockUnlock(pluginLock);
+
+	if (!curr)
+		SYSLOG("kstore", "unable to unsubscribe unknown subscription");
+	else if (release)
+		delete curr;
+}
+
+bool VirtualSMCKeystore::markKeyChange(SMC_KEY name) {
+	bool marked = false;
+	for (auto sub = atomic_load_explicit(&subscriptionList, memory_order_acquire); sub; sub = atomic_load_explicit(&sub->next, memory_order_acquire)) {
+		for (size_t i = 0; i < sub->count; i++) {
+			if (sub->keys[i] == name) {
+				atomic_fetch_or_explicit(&sub->pending[i / 32], 1U << (i % 32), memory_order_release);
+				marked = true;
+			}
+		}
+	}
+	return marked;
+}
+
+void VirtualSMCKeystore::deliverKeyChanges() {
+	atomic_store_explicit(&deliveryThread, current_thread(), memory_order_relaxed);
+	IOLockLock(pluginLock);
+
+	// Take the pending changes and pin the subscriptions having any, so that they are not freed while
+	// their handlers run. Writes done afterwards, including the ones from handlers, go to the next batch.
+	VirtualSMCAPI::KeySubscription *batch = nullptr, **tail = &batch;
+	for (auto sub = atomic_load_explicit(&subscriptionList, memory_order_relaxed); sub; sub = atomic_load_explicit(&sub->next, memory_order_relaxed)) {
+		sub->changedCount = 0;
+		for (size_t w = 0; w < (sub->count + 31) / 32; w++) {
+			auto bits = atomic_exchange_explicit(&sub->pending[w], 0, memory_order_acquire);
+			for (size_t i = w * 32; bits != 0; i++, bits >>= 1)
+				if (bits & 1)
+					sub->changed[sub->changedCount++] = sub->keys[i];
+		}
+
+		if (sub->changedCount > 0) {
+			sub->pinned = true;
+			sub->batchNext = nullptr;
+			*tail = sub;
+			tail = &sub->batchNext;
+		}
+	}
+
+	// Handlers run without pluginLock and outside of reader section, so they may call back into the keystore
+	// while other threads hold pluginLock waiting for readers.
+	for (auto sub = batch; sub; ) {
+		if (!sub->cancelled) {
+			IOLockUnlock(pluginLock);
+			sub->handler(sub->context, sub->changed, sub->changedCount);
+			IOLockLock(pluginLock);
+		}
+
+		// Cancelling threads may free the subscription as soon as it is unpinned.
+		auto next = sub->batchNext;
+		sub->pinned = false;
+		if (sub->cancelled)
+			IOLockWakeup(pluginLock, sub, false);
+		sub = next;
+	}
+
+	// Subscriptions cancelled by the handlers may still be referenced by writers marking changes.
+	auto released = releasedSubscriptions;
+	releasedSubscriptions = nullptr;
+	if (released)
+		waitForReaders();
+
+	IOLockUnlock(pluginLock);
+	atomic_store_explicit(&deliveryThread, nullptr, memory_order_relaxed);
+
+	while (released) {
+		auto next = released->released;
+		delete released;
+		released = next;
+	}
+}
+
 uint32_t VirtualSMCKeystore::getPublicKeyAmount() {
+	ReadGuard guard(this);
 	auto sz = dataStorage.size();
-	for (size_t i = 0; i < VirtualSMCAPI::PluginMax; i++) {
-		auto p = atomic_load_explicit(&pluginData[i], memory_order_relaxed);
-		if (!p) break;
-		sz += p->data.size();
-	}
+	for (auto curr = atomic_load_explicit(&pluginList, memory_order_acquire); curr; curr = atomic_load_explicit(&curr->next, memory_order_acquire))
+		sz += curr->plugin->data.size();
 	return static_cast<uint32_t>(sz);
 }
 
@@ -641,10 +1011,8 @@ SMC_RESULT VirtualSMCKeystore::getByName(SMC_KEY name, VirtualSMCKeyValue *&val,
 	SMC_RESULT r = getByName(hidden ? dataHiddenStorage : dataStorage, name, val);
 
 	if (r != SmcSuccess) {
-		for (size_t i = 0; i < VirtualSMCAPI::PluginMax; i++) {
-			auto p = atomic_load_explicit(&pluginData[i], memory_order_relaxed);
-			if (!p) break;
-			r = getByName(hidden ? p->dataHidden : p->data, name, val);
+		for (auto curr = atomic_load_explicit(&pluginList, memory_order_acquire); curr; curr = atomic_load_explicit(&curr->next, memory_order_acquire)) {
+			r = getByName(hidden ? curr->plugin->dataHidden : curr->plugin->data, name, val);
 			if (r == SmcSuccess)
 				break;
 		}
@@ -687,14 +1055,13 @@ SMC_RESULT VirtualSMCKeystore::getByIndex(SMC_KEY_INDEX idx, VirtualSMCKeyValue
 	}
 
 	auto nidx = idx - dataStorage.size();
-	for (size_t i = 0; i < VirtualSMCAPI::PluginMax; i++) {
-		auto p = atomic_load_explicit(&pluginData[i], memory_order_relaxed);
-		if (!p) break;
-		if (nidx < p->data.size()) {
-			val = &p->data[nidx];
+	for (auto curr = atomic_load_explicit(&pluginList, memory_order_acquire); curr; curr = atomic_load_explicit(&curr->next, memory_order_acquire)) {
+		auto &data = curr->plugin->data;
+		if (nidx < data.size()) {
+			val = &data[nidx];
 			return SmcSuccess;
 		}
-		nidx -= p->data.size();
+		nidx -= data.size();
 	}
 	
 	DBGLOG("kstore", "key at %u not found", idx);
@@ -718,7 +1085,10 @@ bool VirtualSMCKeystore::addKey(SMC_KEY key, VirtualSMCValue *val, bool hidden)
 	return false;
 }
 
-SMC_RESULT VirtualSMCKeystore::readValueByName(SMC_KEY key, const VirtualSMCValue *&value) {
+SMC_RESULT VirtualSMCKeystore::readValueByName(SMC_KEY key, SMC_DATA *data, SMC_DATA_SIZE &size, uint64_t maxAge) {
+	// Plugin values may only be referenced within the reader section, hence the copy.
+	ReadGuard guard(this);
+	uint64_t duration = VirtualSMCStatistics::NotMeasured;
 	VirtualSMCKeyValue *kv {nullptr};
 	auto res = getByName(key, kv, false);
 	if (res != SmcSuccess)
@@ -729,29 +1099,48 @@ SMC_RESULT VirtualSMCKeystore::readValueByName(SMC_KEY key, const VirtualSMCValu
 		auto currval = atomic_load_explicit(&kv->value, memory_order_relaxed);
 
 		// Check if readable
-		if (!(currval->attr & SMC_KEY_ATTRIBUTE_READ))
-			return SmcNotReadable;
-		
+		if (!(currval->attr & SMC_KEY_ATTRIBUTE_READ)) {
+			res = SmcNotReadable;
 		// Check if privately readable
-		if (currval->attr & SMC_KEY_ATTRIBUTE_PRIVATE_READ &&
+		} else if (currval->attr & SMC_KEY_ATTRIBUTE_PRIVATE_READ &&
 			(!static_cast<VirtualSMCValueKPST *>(valueKPST)->unlocked() ||
-			 OSSwapInt32(*reinterpret_cast<uint32_t *>(valueEPCI->data) & 0xFF00) == 0xF000))
-		return SmcNotReadable;
-		
-		// Update internal buffers
-		res = currval->readAccess();
-		if (res == SmcSuccess)
-			value = currval;
+			 OSSwapInt32(*reinterpret_cast<uint32_t *>(valueEPCI->data) & 0xFF00) == 0xF000)) {
+			res = SmcNotReadable;
+		} else {
+			// Update internal buffers unless the contents are published by the plugin and fresh enough.
+			// For stale published values readAccess works as an on-demand refresh request.
+			bool published = currval->lastPublished() != 0;
+			if (!published || currval->stale(maxAge)) {
+				uint64_t start = statistics ? mach_absolute_time() : 0;
+				res = currval->readAccess();
+				if (statistics)
+					duration = mach_absolute_time() - start;
+				if (res == SmcSuccess && published && currval->stale(maxAge)) {
+					ACCESSLOG("kstore", "key [%c%c%c%c] value is stale",
+						   reinterpret_cast<char *>(&key)[0], reinterpret_cast<char *>(&key)[1],
+						   reinterpret_cast<char *>(&key)[2], reinterpret_cast<char *>(&key)[3]);
+					res = SmcTimeoutError;
+				}
+			}
+			if (res == SmcSuccess && !currval->copy(data, size))
+				res = SmcCommCollision;
+		}
 	} else {
 		SYSLOG_COND(reportMissingKeys || ADDPR(debugEnabled), "kstore", "key [%c%c%c%c] not found for reading",
 					reinterpret_cast<char *>(&key)[0], reinterpret_cast<char *>(&key)[1],
 					reinterpret_cast<char *>(&key)[2], reinterpret_cast<char *>(&key)[3]);
 	}
+
+	if (statistics && kv)
+		statistics->record(key, VirtualSMCStatistics::OpRead, res, duration);
+	else if (statistics)
+		statistics->recordMissing();
 	
 	return res;
 }
 
 SMC_RESULT VirtualSMCKeystore::readNameByIndex(SMC_KEY_INDEX idx, SMC_KEY &key) {
+	ReadGuard guard(this);
 	VirtualSMCKeyValue *kv {nullptr};
 	auto res = getByIndex(idx, kv);
 	if (res == SmcSuccess)
@@ -762,6 +1151,8 @@ SMC_RESULT VirtualSMCKeystore::readNameByIndex(SMC_KEY_INDEX idx, SMC_KEY &key)
 }
 
 SMC_RESULT VirtualSMCKeystore::writeValueByName(SMC_KEY key, const SMC_DATA *data) {
+	ReadGuard guard(this);
+	uint64_t duration = VirtualSMCStatistics::NotMeasured;
 	VirtualSMCKeyValue *kv {nullptr};
 	auto res = getByName(key, kv, false);
 	if (res != SmcSuccess)
@@ -772,30 +1163,41 @@ SMC_RESULT VirtualSMCKeystore::writeValueByName(SMC_KEY key, const SMC_DATA *dat
 		auto currval = atomic_load_explicit(&kv->value, memory_order_relaxed);
 
 		// Check if writable
-		if (!(currval->attr & SMC_KEY_ATTRIBUTE_WRITE))
-			return SmcNotWritable;
-		
+		if (!(currval->attr & SMC_KEY_ATTRIBUTE_WRITE)) {
+			res = SmcNotWritable;
 		// Check if privately writable
-		if (currval->attr & SMC_KEY_ATTRIBUTE_PRIVATE_WRITE &&
+		} else if (currval->attr & SMC_KEY_ATTRIBUTE_PRIVATE_WRITE &&
 			(!static_cast<VirtualSMCValueKPST *>(valueKPST)->unlocked() ||
-			 OSSwapInt32(*reinterpret_cast<uint32_t *>(valueEPCI->data) & 0xFF00) == 0xF000))
-			return SmcNotReadable;
-		
-		// Update internal buffers
-		res = currval->writeAccess();
-		if (res == SmcSuccess) {
-			res = currval->update(data);
+			 OSSwapInt32(*reinterpret_cast<uint32_t *>(valueEPCI->data) & 0xFF00) == 0xF000)) {
+			res = SmcNotReadable;
+		} else {
+			// Update internal buffers
+			res = currval->writeAccess();
+			if (res == SmcSuccess) {
+				uint64_t start = statistics ? mach_absolute_time() : 0;
+				res = currval->update(data);
+				if (statistics)
+					duration = mach_absolute_time() - start;
+				if (res == SmcSuccess && markKeyChange(key))
+					VirtualSMC::postKeyChanges();
+			}
 		}
 	} else {
 		SYSLOG_COND(reportMissingKeys || ADDPR(debugEnabled), "kstore", "key [%c%c%c%c] not found for writing",
 					reinterpret_cast<char *>(&key)[0], reinterpret_cast<char *>(&key)[1],
 					reinterpret_cast<char *>(&key)[2], reinterpret_cast<char *>(&key)[3]);
 	}
+
+	if (statistics && kv)
+		statistics->record(key, VirtualSMCStatistics::OpWrite, res, duration);
+	else if (statistics)
+		statistics->recordMissing();
 	
 	return res;
 }
 
 SMC_RESULT VirtualSMCKeystore::getInfoByName(SMC_KEY key, SMC_DATA_SIZE &size, SMC_KEY_TYPE &type, SMC_KEY_ATTRIBUTES &attr) {
+	ReadGuard guard(this);
 	VirtualSMCKeyValue *kv {nullptr};
 	auto res = getByName(key, kv, false);
 	if (res != SmcSuccess)
@@ -17,6 +17,8 @@
 #include <VirtualSMCSDK/kern_keyvalue.hpp>
 #include <VirtualSMCSDK/vsmcatomic.h>
 
+#include <IOKit/IOLocks.h>
+#include <kern/thread.h>
 #include <IOKit/IORegistryEntry.h>
 #include <libkern/c++/OSArray.h>
 #include <libkern/c++/OSData.h>
@@ -24,6 +26,37 @@
 #include <libkern/libkern.h>
 #include <stdint.h>
 
+#include "kern_profile.hpp"
+#include "kern_stats.hpp"
+
+/**
+ *  Key change subscription, pending bits are set by writers and consumed by the work loop.
+ *  Delivery fields are protected by pluginLock.
+ */
+struct VirtualSMCAPI::KeySubscription {
+	VirtualSMCAPI::Plugin *plugin {nullptr};
+	VirtualSMCAPI::KeyChangeHandler handler {nullptr};
+	void *context {nullptr};
+	SMC_KEY *keys {nullptr};
+	SMC_KEY *changed {nullptr};
+	_Atomic(uint32_t) *pending {nullptr};
+	size_t count {0};
+	size_t changedCount {0};
+	_Atomic(VirtualSMCAPI::KeySubscription *) next;
+	VirtualSMCAPI::KeySubscription *batchNext {nullptr};
+	VirtualSMCAPI::KeySubscription *released {nullptr};
+	bool pinned {false};
+	bool cancelled {false};
+
+	~KeySubscription() {
+		delete[] keys;
+		delete[] changed;
+		delete[] pending;
+	}
+};
+
+class VirtualSMCValueHBKP;
+
 class VirtualSMCKeystore {
 	/**
 	 *  Key name definitions
@@ -101,15 +134,145 @@ class VirtualSMCKeystore {
 	VirtualSMCAPI::KeyStorage dataStorage, dataHiddenStorage;
 
 	/**
-	 *  Registered plugin key arrays in the keystore
+	 *  Registered plugin with the keystore values it overrides
+	 */
+	struct PluginEntry {
+		/**
+		 *  Submitted plugin
+		 */
+		VirtualSMCAPI::Plugin *plugin {nullptr};
+
+		/**
+		 *  Overridden public and hidden keys, backup holds the original keystore value
+		 */
+		VirtualSMCAPI::KeyStorage overrides[2];
+
+		/**
+		 *  Next registered plugin
+		 */
+		_Atomic(PluginEntry *) next;
+	};
+
+	/**
+	 *  Registered plugins in submission order, traversed by readers without locking
+	 */
+	_Atomic(PluginEntry *) pluginList;
+
+	/**
+	 *  Incremented whenever plugins are loaded or unloaded
+	 */
+	_Atomic(uint32_t) generation;
+
+	/**
+	 *  Registered key change subscriptions, traversed by readers without locking
+	 */
+	_Atomic(VirtualSMCAPI::KeySubscription *) subscriptionList;
+
+	/**
+	 *  Serialises plugin loading and unloading, as well as subscription changes
+	 */
+	IOLock *pluginLock {nullptr};
+
+	/**
+	 *  Thread running key change handlers, nullptr outside of delivery
+	 */
+	_Atomic(thread_t) deliveryThread;
+
+	/**
+	 *  Subscriptions cancelled by key change handlers, freed after delivery, protected by pluginLock
+	 */
+	VirtualSMCAPI::KeySubscription *releasedSubscriptions {nullptr};
+
+	/**
+	 *  Check whether we are called from a key change handler
+	 *
+	 *  @return true when called from a handler
+	 */
+	bool inDelivery() {
+		return atomic_load_explicit(&deliveryThread, memory_order_relaxed) == current_thread();
+	}
+
+	/**
+	 *  Unlink subscription and wait until delivery no longer uses it, must be called under pluginLock.
+	 *  The lock is dropped while waiting for a running handler, so list links must be looked up again afterwards.
+	 *
+	 *  @param link  list link pointing to the subscription
+	 *
+	 *  @return true when the subscription may be freed after waitForReaders, false when delivery frees it
+	 */
+	bool cancelSubscription(_Atomic(VirtualSMCAPI::KeySubscription *) *link);
+
+	/**
+	 *  Per-key access statistics, only allocated with -vsmcstat
+	 */
+	VirtualSMCStatistics *statistics {nullptr};
+
+	/**
+	 *  Reader epoch and active reader counts per epoch parity.
+	 *  Unloading waits for the readers of the previous epoch before freeing anything.
+	 */
+	_Atomic(uint32_t) readerEpoch;
+	_Atomic(uint32_t) readersActive[2];
+
+	/**
+	 *  Reader critical section covering plugin list traversal
+	 */
+	class ReadGuard {
+		VirtualSMCKeystore *keystore;
+		uint32_t epoch;
+	public:
+		ReadGuard(VirtualSMCKeystore *keystore) : keystore(keystore), epoch(keystore->enterRead()) {}
+		~ReadGuard() { keystore->leaveRead(epoch); }
+	};
+
+	/**
+	 *  Enter reader critical section
+	 *
+	 *  @return current epoch to pass to leaveRead
+	 */
+	uint32_t enterRead();
+
+	/**
+	 *  Leave reader critical section
+	 *
+	 *  @param epoch  epoch returned by enterRead
+	 */
+	void leaveRead(uint32_t epoch);
+
+	/**
+	 *  Advance reader epoch and wait for readers of the previous one to leave
 	 */
-	_Atomic(VirtualSMCAPI::Plugin *) pluginData[VirtualSMCAPI::PluginMax] {};
+	void waitForReaders();
+
+	/**
+	 *  Check whether a keystore key is already overridden by a loaded plugin, must be called under pluginLock
+	 *
+	 *  @param name    key name
+	 *  @param hidden  hidden key
+	 *
+	 *  @return true if overridden
+	 */
+	bool isOverridden(SMC_KEY name, bool hidden);
+
+	/**
+	 *  Mark key as changed for its subscribers, must be called within reader section
+	 *
+	 *  @param name  written key name
+	 *
+	 *  @return true if anyone is subscribed to the key
+	 */
+	bool markKeyChange(SMC_KEY name);
 
 	/**
 	 *  Quick access pointers to access keys necessary used for r/w privilege management
 	 */
 	VirtualSMCValue *valueKPST {nullptr}, *valueEPCI {nullptr};
 
+	/**
+	 *  Hibernation key, finished in initDeferred
+	 */
+	VirtualSMCValueHBKP *valueHBKP {nullptr};
+
 	/**
 	 *  Emulated device information
 	 */
@@ -275,21 +438,33 @@ public:
 	 *  @param  info       device info
 	 *  @param  board      current board-id if present, otherwise nullptr
 	 *  @param  model      computer model except any, see WIOKit::ComputerModel
-	 *  @param  whbkp      allow hbkp usage
+	 *  @param  profile    startup profile to record keystore phases to
 	 *
 	 *  @return true on success
 	 */
-	bool init(const OSDictionary *mainprops, const OSDictionary *userprops, const SMCInfo &info, const char *board, int model, bool whibkey);
+	bool init(const OSDictionary *mainprops, const OSDictionary *userprops, const SMCInfo &info, const char *board, int model, VirtualSMCStartupProfile &profile);
 
 	/**
-	 *  Obtain key value from the keystore by its name
+	 *  Finish initialisation not needed for AppleSMC attachment.
+	 *  Must be called once after init from the work loop.
+	 *
+	 *  @param  firmwareBackend  allow hbkp usage
+	 */
+	void initDeferred(bool firmwareBackend);
+
+	/**
+	 *  Read key value contents from the keystore by its name
 	 *
 	 *  @param name    key name
-	 *  @param val     resulting value
+	 *  @param data    buffer of at least SMC_MAX_DATA_SIZE bytes for value contents
+	 *  @param size    resulting contents size
+	 *  @param maxAge  refresh published values older than this amount of nanoseconds (0 to use value policy)
 	 *
-	 *  @return SmcSuccess if the value was found, was read-accessible, and the data was read
+	 *  @return SmcSuccess if the value was found, was read-accessible, and the data was read,
+	 *          SmcTimeoutError if published value is stale and could not be refreshed,
+	 *          SmcCommCollision if a concurrent modification of the value did not complete in time
 	 */
-	SMC_RESULT readValueByName(SMC_KEY name, const VirtualSMCValue *&value);
+	SMC_RESULT readValueByName(SMC_KEY name, SMC_DATA *data, SMC_DATA_SIZE &size, uint64_t maxAge = 0);
 
 	/**
 	 *  Obtain key value from the keystore by its index
@@ -330,6 +505,24 @@ public:
 	 */
 	uint32_t getPublicKeyAmount();
 
+	/**
+	 *  Invoke a function for every publicly available key in enumeration order.
+	 *  This walks the storages directly instead of looking up every index.
+	 *
+	 *  @param func  function taking key name and value type, must not load or unload plugins
+	 */
+	template <typename F>
+	void forEachPublicKey(F func) {
+		ReadGuard guard(this);
+		for (size_t i = 0; i < dataStorage.size(); i++)
+			func(dataStorage[i].key, atomic_load_explicit(&dataStorage[i].value, memory_order_relaxed)->type);
+		for (auto curr = atomic_load_explicit(&pluginList, memory_order_acquire); curr; curr = atomic_load_explicit(&curr->next, memory_order_acquire)) {
+			auto &data = curr->plugin->data;
+			for (size_t i = 0; i < data.size(); i++)
+				func(data[i].key, atomic_load_explicit(&data[i].value, memory_order_relaxed)->type);
+		}
+	}
+
 	/**
 	 *  Handle power off (sleep, shutdown, reboot)
 	 */
@@ -349,6 +542,56 @@ public:
 	 */
 	IOReturn loadPlugin(VirtualSMCAPI::Plugin *plugin);
 
+	/**
+	 *  Unload plugin, restoring the keys it overrides and cancelling its key change subscriptions.
+	 *  Returns once no reader may reference plugin storage and no handler of the plugin is running anymore.
+	 *  Key change handlers run plugin code, which must not go away underneath them, hence it fails when
+	 *  called from key change handlers.
+	 *
+	 *  @param plugin  plugin pointer previously passed to loadPlugin
+	 *
+	 *  @return kIOReturnSuccess on success, kIOReturnNotPermitted from key change handlers
+	 */
+	IOReturn unloadPlugin(VirtualSMCAPI::Plugin *plugin);
+
+	/**
+	 *  Subscribe to key changes
+	 *
+	 *  @see VirtualSMCAPI::subscribeKeys
+	 */
+	VirtualSMCAPI::KeySubscription *subscribeKeys(VirtualSMCAPI::Plugin *plugin, const SMC_KEY *keys, size_t count, VirtualSMCAPI::KeyChangeHandler handler, void *context);
+
+	/**
+	 *  Cancel key change subscription
+	 *
+	 *  @see VirtualSMCAPI::unsubscribeKeys
+	 */
+	void unsubscribeKeys(VirtualSMCAPI::KeySubscription *subscription);
+
+	/**
+	 *  Invoke subscription handlers for keys changed since the last delivery, must only be called from the work loop.
+	 *  Handlers run outside of reader section and pluginLock, delivered subscriptions are pinned instead.
+	 */
+	void deliverKeyChanges();
+
+	/**
+	 *  Obtain keystore generation changing whenever the set of keys changes
+	 *
+	 *  @return current generation
+	 */
+	uint32_t getGeneration() {
+		return atomic_load_explicit(&generation, memory_order_acquire);
+	}
+
+	/**
+	 *  Export per-key access statistics
+	 *
+	 *  @return statistics dictionary (must be released) or nullptr when disabled
+	 */
+	OSDictionary *copyStatistics() {
+		return statistics ? statistics->copyStatistics() : nullptr;
+	}
+
 	/**
 	 *  Obtain device info
 	 *
@@ -9,7 +9,8 @@
 #include <VirtualSMCSDK/kern_keyvalue.hpp>
 
 bool VirtualSMCKeyValue::serializable(bool confidential) const {
-	return value->serializable(confidential);
+	// Aliased values are saved once with their owning key.
+	return !alias && value->serializable(confidential);
 }
 
 size_t VirtualSMCKeyValue::serializedSize() const {
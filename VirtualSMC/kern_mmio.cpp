@@ -50,7 +50,7 @@ void SMCProtocolMMIO::submitData() {
 
 void SMCProtocolMMIO::handleRead(mach_vm_address_t base, mach_vm_address_t addr) {
 	uint32_t off = static_cast<uint32_t>(addr-base);
-	DBGLOG("mmio", "read access at %08X", off);
+	ACCESSLOG("mmio", "read access at %08X", off);
 
 	if (off == SMC_MMIO_READ_KEY_STATUS) {
 		mmioBase = base;
@@ -70,7 +70,7 @@ void SMCProtocolMMIO::handleRead(mach_vm_address_t base, mach_vm_address_t addr)
 
 void SMCProtocolMMIO::handleWrite(mach_vm_address_t base, mach_vm_address_t addr) {
 	uint32_t off = static_cast<uint32_t>(addr-base);
-	DBGLOG("mmio", "write access at %08X", off);
+	ACCESSLOG("mmio", "write access at %08X", off);
 	
 	if (off == SMC_MMIO_WRITE_COMMAND) {
 		mmioBase = base;
@@ -126,13 +126,9 @@ void SMCProtocolMMIO::readValue() {
 	auto attr = mmioRead<SMC_KEY_ATTRIBUTES, SMC_MMIO_WRITE_KEY_ATTRIBUTES>();
 	
 	if (attr == 0) {
-		const VirtualSMCValue *value {nullptr};
-		currentResult = VirtualSMC::getKeystore()->readValueByName(key, value);
-		if (currentResult == SmcSuccess) {
-			auto src = value->get(dataSize);
-			lilu_os_memcpy(dataBuffer, src, dataSize);
-			return;
-		}
+		currentResult = VirtualSMC::getKeystore()->readValueByName(key, dataBuffer, dataSize);
+		VirtualSMC::captureTransaction(VirtualSMCCapture::TransportMMIO, SmcCmdReadValue, key, currentResult,
+									   dataBuffer, currentResult == SmcSuccess ? dataSize : 0);
 	} else {
 		DBGLOG("mmio", "read got non-zero attr %02X", attr);
 		currentResult = SmcBadCommand;
@@ -145,9 +141,10 @@ void SMCProtocolMMIO::writeValue() {
 	auto size = mmioRead<SMC_DATA_SIZE, SMC_MMIO_WRITE_DATA_SIZE>();
 	
 	if (attr == 0) {
-		if (size <= SMC_MAX_DATA_SIZE)
+		if (size <= SMC_MAX_DATA_SIZE) {
 			currentResult = VirtualSMC::getKeystore()->writeValueByName(key, mmioPtr<SMC_DATA, 0>());
-		else
+			VirtualSMC::captureTransaction(VirtualSMCCapture::TransportMMIO, SmcCmdWriteValue, key, currentResult, mmioPtr<SMC_DATA, 0>(), size);
+		} else
 			currentResult = SmcKeySizeMismatch;
 	} else {
 		DBGLOG("mmio", "write got non-zero attr %02X", attr);
@@ -166,6 +163,8 @@ void SMCProtocolMMIO::getKeyFromIndex() {
 			dataSize = sizeof(SMC_KEY);
 			lilu_os_memcpy(dataBuffer, &key, dataSize);
 		}
+		VirtualSMC::captureTransaction(VirtualSMCCapture::TransportMMIO, SmcCmdGetKeyFromIndex, OSSwapInt32(index), currentResult,
+									   dataBuffer, currentResult == SmcSuccess ? sizeof(SMC_KEY) : 0);
 	} else {
 		DBGLOG("mmio", "getkey got non-zero attr %02X", attr);
 		currentResult = SmcBadCommand;
@@ -187,6 +186,8 @@ void SMCProtocolMMIO::getKeyInfo() {
 			info.attr = attr;
 			lilu_os_memcpy(dataBuffer, &info, sizeof(info));
 		}
+		VirtualSMC::captureTransaction(VirtualSMCCapture::TransportMMIO, SmcCmdGetKeyInfo, key, currentResult,
+									   dataBuffer, currentResult == SmcSuccess ? sizeof(KeyInfo) : 0);
 	} else {
 		DBGLOG("mmio", "getkeyinfo got non-zero attr %02X", attr);
 		currentResult = SmcBadCommand;
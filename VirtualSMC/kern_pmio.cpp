@@ -33,19 +33,15 @@ void SMCProtocolPMIO::resetBuffer() {
 
 void SMCProtocolPMIO::loadValueInBuffer() {
 	resetBuffer();
-	const VirtualSMCValue *value {nullptr};
-	currentResult = VirtualSMC::getKeystore()->readValueByName(currentKey, value);
-	if (currentResult == SmcSuccess) {
-		auto src = value->get(dataSize);
-		if (dataSize == currentSize) {
-			lilu_os_memcpy(dataBuffer, src, dataSize);
-			return;
-		}
-		currentResult = SmcKeySizeMismatch;
+	currentResult = VirtualSMC::getKeystore()->readValueByName(currentKey, dataBuffer, dataSize);
+	if (currentResult != SmcSuccess || dataSize != currentSize) {
+		if (currentResult == SmcSuccess)
+			currentResult = SmcKeySizeMismatch;
+		dataSize = currentSize;
+		bzero(dataBuffer, dataSize > SMC_MAX_DATA_SIZE ? SMC_MAX_DATA_SIZE : dataSize);
 	}
-	
-	dataSize = currentSize;
-	bzero(dataBuffer, dataSize > SMC_MAX_DATA_SIZE ? SMC_MAX_DATA_SIZE : dataSize);
+
+	VirtualSMC::captureTransaction(VirtualSMCCapture::TransportPMIO, SmcCmdReadValue, currentKey, currentResult, dataBuffer, dataSize);
 }
 
 void SMCProtocolPMIO::loadKeyInBuffer() {
@@ -58,10 +54,13 @@ void SMCProtocolPMIO::loadKeyInBuffer() {
 	} else {
 		bzero(dataBuffer, dataSize);
 	}
+
+	VirtualSMC::captureTransaction(VirtualSMCCapture::TransportPMIO, SmcCmdGetKeyFromIndex, currentKeyIndex, currentResult, dataBuffer, dataSize);
 }
 
 void SMCProtocolPMIO::saveValueFromBuffer() {
 	currentResult = VirtualSMC::getKeystore()->writeValueByName(currentKey, dataBuffer);
+	VirtualSMC::captureTransaction(VirtualSMCCapture::TransportPMIO, SmcCmdWriteValue, currentKey, currentResult, dataBuffer, dataSize);
 	resetBuffer();
 }
 
@@ -81,6 +80,8 @@ void SMCProtocolPMIO::loadKeyInfoInBuffer() {
 	} else {
 		bzero(dataBuffer, dataSize);
 	}
+
+	VirtualSMC::captureTransaction(VirtualSMCCapture::TransportPMIO, SmcCmdGetKeyInfo, currentKey, currentResult, dataBuffer, dataSize);
 }
 
 void SMCProtocolPMIO::writeData(uint8_t v) {
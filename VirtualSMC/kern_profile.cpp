@@ -0,0 +1,51 @@
+//
+//  kern_profile.cpp
+//  VirtualSMC
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <Headers/kern_util.hpp>
+#include <libkern/c++/OSNumber.h>
+
+#include "kern_profile.hpp"
+
+uint64_t VirtualSMCStartupProfile::record(Phase phase, uint64_t start) {
+	auto end = now();
+	durations[phase] = end - start;
+	recorded[phase] = true;
+	return end;
+}
+
+OSDictionary *VirtualSMCStartupProfile::copyProfile() const {
+	static const char *phaseNames[PhaseMax] {
+		"workloop",
+		"model info",
+		"keystore predefined",
+		"keystore merge",
+		"keystore sort",
+		"keystore setup",
+		"protocols",
+		"register",
+		"start",
+		"deferred hibernation"
+	};
+
+	auto dict = OSDictionary::withCapacity(PhaseMax);
+	if (!dict)
+		return nullptr;
+
+	for (size_t i = 0; i < PhaseMax; i++) {
+		if (!recorded[i])
+			continue;
+		uint64_t ns;
+		absolutetime_to_nanoseconds(durations[i], &ns);
+		auto num = OSNumber::withNumber(ns, 64);
+		if (num) {
+			dict->setObject(phaseNames[i], num);
+			num->release();
+		}
+	}
+
+	return dict;
+}
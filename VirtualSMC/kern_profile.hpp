@@ -0,0 +1,76 @@
+//
+//  kern_profile.hpp
+//  VirtualSMC
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_profile_hpp
+#define kern_profile_hpp
+
+#include <kern/clock.h>
+#include <libkern/c++/OSDictionary.h>
+#include <stdint.h>
+
+/**
+ *  Durations of service start phases exported as StartupProfile property.
+ *  Deferred phases run on the work loop after AppleSMC is allowed to attach.
+ */
+class VirtualSMCStartupProfile {
+public:
+	/**
+	 *  Measured phases in execution order
+	 */
+	enum Phase {
+		PhaseWorkLoop,
+		PhaseModelInfo,
+		PhaseKeystorePredefined,
+		PhaseKeystoreMerge,
+		PhaseKeystoreSort,
+		PhaseKeystoreSetup,
+		PhaseProtocols,
+		PhaseRegister,
+		PhaseStart,
+		PhaseDeferredHibernation,
+		PhaseMax
+	};
+
+	/**
+	 *  Obtain phase start timestamp
+	 *
+	 *  @return current absolute time
+	 */
+	static uint64_t now() {
+		return mach_absolute_time();
+	}
+
+	/**
+	 *  Record finished phase
+	 *
+	 *  @param phase  phase
+	 *  @param start  phase start timestamp
+	 *
+	 *  @return current absolute time, usable as the next phase start
+	 */
+	uint64_t record(Phase phase, uint64_t start);
+
+	/**
+	 *  Export recorded phases
+	 *
+	 *  @return dictionary of phase durations in nanoseconds (must be released) or nullptr
+	 */
+	OSDictionary *copyProfile() const;
+
+private:
+	/**
+	 *  Phase durations in absolute time units
+	 */
+	uint64_t durations[PhaseMax] {};
+
+	/**
+	 *  Phases that have already run
+	 */
+	bool recorded[PhaseMax] {};
+};
+
+#endif /* kern_profile_hpp */
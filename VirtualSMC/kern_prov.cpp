@@ -253,7 +253,7 @@ void VirtualSMCProvider::kernelTrap(T *state, uintptr_t *lo_spp) {
 			info.retAddr = retAddr;
 			info.mmioAddr = faultAddr;
 
-#if 0
+#if VSMC_TRACE_LEVEL >= VSMC_TRACE_ACCESS
 			DBGLOG("prov", "fault addr is %08X %08X ret addr is %08X %08X code %d",
 				   static_cast<uint32_t>(faultAddr >> 32), static_cast<uint32_t>(faultAddr & 0xffffffff),
 				   static_cast<uint32_t>(retAddr >> 32), static_cast<uint32_t>(retAddr & 0xffffffff),
@@ -347,7 +347,7 @@ mach_vm_address_t VirtualSMCProvider::ioProcessResult(FaultInfo trinfo) {
 		lilu_os_memcpy(reinterpret_cast<void *>(info.retAddr), info.org, sizeof(Trampoline));
 
 		if (MachInfo::setKernelWriting(false, KernelPatcher::kernelWriteLock) == KERN_SUCCESS) {
-			DBGLOG("prov", "io result page %u mmio %08X: %08X", pageIndex, static_cast<uint32_t>(info.mmioAddr - monitorStart),
+			ACCESSLOG("prov", "io result page %u mmio %08X: %08X", pageIndex, static_cast<uint32_t>(info.mmioAddr - monitorStart),
 				   *reinterpret_cast<uint32_t *>(info.mmioAddr));
 			
 			if (faultType == FaultTypeWrite)
@@ -0,0 +1,148 @@
+//
+//  kern_stats.cpp
+//  VirtualSMC
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <Headers/kern_util.hpp>
+#include <kern/clock.h>
+#include <libkern/c++/OSArray.h>
+#include <libkern/c++/OSNumber.h>
+
+#include "kern_stats.hpp"
+
+extern "C" int cpu_number(void);
+
+bool VirtualSMCStatistics::init() {
+	slots = Buffer::create<_Atomic(SMC_KEY)>(MaxKeys);
+	counters = Buffer::create<Counters>(MaxKeys * Shards);
+	if (!slots || !counters) {
+		SYSLOG("stats", "failed to allocate key statistics");
+		deinit();
+		return false;
+	}
+
+	atomic_init(&missing, 0);
+	for (size_t slot = 0; slot < MaxKeys; slot++)
+		atomic_init(&slots[slot], 0);
+	for (size_t i = 0; i < MaxKeys * Shards; i++) {
+		auto &c = counters[i];
+		atomic_init(&c.errors, 0);
+		for (size_t op = 0; op < OpMax; op++) {
+			atomic_init(&c.count[op], 0);
+			for (size_t b = 0; b < HistogramBuckets; b++)
+				atomic_init(&c.histogram[op][b], 0);
+		}
+	}
+	return true;
+}
+
+void VirtualSMCStatistics::deinit() {
+	Buffer::deleter(slots);
+	Buffer::deleter(counters);
+	slots = nullptr;
+	counters = nullptr;
+}
+
+size_t VirtualSMCStatistics::findSlot(SMC_KEY key) {
+	size_t start = (key * 2654435761U) % MaxKeys;
+	for (size_t i = 0; i < MaxKeys; i++) {
+		size_t slot = (start + i) % MaxKeys;
+		auto curr = atomic_load_explicit(&slots[slot], memory_order_relaxed);
+		if (curr == key)
+			return slot;
+		if (curr == 0) {
+			if (atomic_compare_exchange_strong_explicit(&slots[slot], &curr, key, memory_order_relaxed, memory_order_relaxed) || curr == key)
+				return slot;
+		}
+	}
+
+	return MaxKeys;
+}
+
+void VirtualSMCStatistics::record(SMC_KEY key, Operation op, SMC_RESULT res, uint64_t duration) {
+	auto slot = findSlot(key);
+	if (slot == MaxKeys)
+		return;
+
+	// Preemption between cpu_number and the update only costs some contention.
+	auto &c = counters[(static_cast<uint32_t>(cpu_number()) % Shards) * MaxKeys + slot];
+	atomic_fetch_add_explicit(&c.count[op], 1, memory_order_relaxed);
+	if (res != SmcSuccess)
+		atomic_fetch_add_explicit(&c.errors, 1, memory_order_relaxed);
+
+	if (duration != NotMeasured) {
+		uint64_t ns;
+		absolutetime_to_nanoseconds(duration, &ns);
+		size_t bucket = 0;
+		for (ns >>= HistogramShift + 1; ns != 0 && bucket + 1 < HistogramBuckets; ns >>= 1)
+			bucket++;
+		atomic_fetch_add_explicit(&c.histogram[op][bucket], 1, memory_order_relaxed);
+	}
+}
+
+OSDictionary *VirtualSMCStatistics::copyStatistics() {
+	auto dict = OSDictionary::withCapacity(MaxKeys);
+	if (!dict)
+		return nullptr;
+
+	auto setNumber = [](OSDictionary *d, const char *name, uint64_t value) {
+		auto num = OSNumber::withNumber(value, 64);
+		if (num) {
+			d->setObject(name, num);
+			num->release();
+		}
+	};
+
+	static const char *countNames[OpMax] {"reads", "writes"};
+	static const char *histogramNames[OpMax] {"read latency", "write latency"};
+
+	for (size_t slot = 0; slot < MaxKeys; slot++) {
+		auto key = atomic_load_explicit(&slots[slot], memory_order_relaxed);
+		if (key == 0)
+			continue;
+
+		auto entry = OSDictionary::withCapacity(OpMax * 2 + 1);
+		if (!entry)
+			continue;
+
+		uint64_t errors = 0;
+		uint64_t count[OpMax] {};
+		uint64_t histogram[OpMax][HistogramBuckets] {};
+		for (size_t shard = 0; shard < Shards; shard++) {
+			auto &c = counters[shard * MaxKeys + slot];
+			errors += atomic_load_explicit(&c.errors, memory_order_relaxed);
+			for (size_t op = 0; op < OpMax; op++) {
+				count[op] += atomic_load_explicit(&c.count[op], memory_order_relaxed);
+				for (size_t b = 0; b < HistogramBuckets; b++)
+					histogram[op][b] += atomic_load_explicit(&c.histogram[op][b], memory_order_relaxed);
+			}
+		}
+
+		setNumber(entry, "errors", errors);
+		for (size_t op = 0; op < OpMax; op++) {
+			setNumber(entry, countNames[op], count[op]);
+			auto arr = OSArray::withCapacity(HistogramBuckets);
+			if (arr) {
+				for (size_t b = 0; b < HistogramBuckets; b++) {
+					auto num = OSNumber::withNumber(histogram[op][b], 64);
+					if (num) {
+						arr->setObject(num);
+						num->release();
+					}
+				}
+				entry->setObject(histogramNames[op], arr);
+				arr->release();
+			}
+		}
+
+		char name[sizeof(SMC_KEY) + 1] {};
+		lilu_os_memcpy(name, &key, sizeof(SMC_KEY));
+		dict->setObject(name, entry);
+		entry->release();
+	}
+
+	setNumber(dict, "missing", atomic_load_explicit(&missing, memory_order_relaxed));
+	return dict;
+}
@@ -0,0 +1,122 @@
+//
+//  kern_stats.hpp
+//  VirtualSMC
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_stats_hpp
+#define kern_stats_hpp
+
+#include <VirtualSMCSDK/AppleSmcBridge.hpp>
+#include <VirtualSMCSDK/vsmcatomic.h>
+#include <libkern/c++/OSDictionary.h>
+#include <stdint.h>
+
+/**
+ *  Per-key access telemetry enabled by -vsmcstat boot argument.
+ *  Counters are sharded by CPU to avoid cache line contention on hot keys
+ *  and are summed when exported.
+ */
+class VirtualSMCStatistics {
+public:
+	/**
+	 *  Recorded operations
+	 */
+	enum Operation {
+		OpRead,
+		OpWrite,
+		OpMax
+	};
+
+	/**
+	 *  Duration value for operations that did not invoke value callbacks
+	 */
+	static constexpr uint64_t NotMeasured {UINT64_MAX};
+
+	/**
+	 *  Allocate counter storage
+	 *
+	 *  @return true on success
+	 */
+	bool init();
+
+	/**
+	 *  Free counter storage
+	 */
+	void deinit();
+
+	/**
+	 *  Record finished operation on an existing key
+	 *
+	 *  @param key       key name
+	 *  @param op        operation
+	 *  @param res       operation result
+	 *  @param duration  readAccess or update duration in absolute time units or NotMeasured
+	 */
+	void record(SMC_KEY key, Operation op, SMC_RESULT res, uint64_t duration);
+
+	/**
+	 *  Record operation on a key that does not exist, these are only counted in total
+	 *  so that probing random names does not use up the slots of existing keys
+	 */
+	void recordMissing() {
+		atomic_fetch_add_explicit(&missing, 1, memory_order_relaxed);
+	}
+
+	/**
+	 *  Export aggregated counters.
+	 *  Every key is described by a dictionary with reads, writes, errors counts
+	 *  and read and write latency histograms. Histogram bucket i counts callbacks
+	 *  that took [2^(i+7), 2^(i+8)) nanoseconds, the first and last buckets
+	 *  include all the shorter and longer callbacks. Operations on missing
+	 *  keys are reported as a single missing count.
+	 *
+	 *  @return dictionary keyed by key names (must be released) or nullptr
+	 */
+	OSDictionary *copyStatistics();
+
+private:
+	/**
+	 *  Storage limits, keys over MaxKeys are not recorded
+	 */
+	static constexpr size_t MaxKeys {512};
+	static constexpr size_t Shards {4};
+	static constexpr size_t HistogramBuckets {12};
+	static constexpr uint32_t HistogramShift {7};
+
+	/**
+	 *  Counters of a single key within a shard
+	 */
+	struct Counters {
+		_Atomic(uint32_t) count[OpMax];
+		_Atomic(uint32_t) errors;
+		_Atomic(uint32_t) histogram[OpMax][HistogramBuckets];
+	};
+
+	/**
+	 *  Operations on keys that do not exist
+	 */
+	_Atomic(uint32_t) missing;
+
+	/**
+	 *  Key names owning counter slots, 0 for free slots
+	 */
+	_Atomic(SMC_KEY) *slots {nullptr};
+
+	/**
+	 *  Counters indexed by shard and slot
+	 */
+	Counters *counters {nullptr};
+
+	/**
+	 *  Find or claim counter slot
+	 *
+	 *  @param key  key name
+	 *
+	 *  @return slot index or MaxKeys when full
+	 */
+	size_t findSlot(SMC_KEY key);
+};
+
+#endif /* kern_stats_hpp */
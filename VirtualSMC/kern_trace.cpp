@@ -0,0 +1,66 @@
+//
+//  kern_trace.cpp
+//  VirtualSMC
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include <libkern/c++/OSString.h>
+
+#include "kern_trace.hpp"
+
+#if VSMC_TRACE_LEVEL >= VSMC_TRACE_EVENTS
+
+bool VirtualSMCTrace::enabled;
+VirtualSMCTrace::Event VirtualSMCTrace::events[MaxEvents];
+_Atomic(uint32_t) VirtualSMCTrace::next;
+
+void VirtualSMCTrace::init() {
+	enabled = checkKernelArgument("-vsmctrace");
+	DBGLOG("trace", "protocol trace level %d %s", VSMC_TRACE_LEVEL, enabled ? "enabled" : "disabled");
+}
+
+OSArray *VirtualSMCTrace::copyTrace() {
+	auto arr = OSArray::withCapacity(MaxEvents);
+	if (!arr)
+		return nullptr;
+
+	static const char *transportNames[] {"pmio", "mmio"};
+
+	auto end = atomic_load_explicit(&next, memory_order_relaxed);
+	auto start = end > MaxEvents ? end - MaxEvents : 0;
+	for (auto i = start; i != end; i++) {
+		auto &e = events[i & (MaxEvents - 1)];
+		uint64_t ns;
+		absolutetime_to_nanoseconds(e.time, &ns);
+
+		const char *cmd;
+		switch (e.command) {
+			case SmcCmdReadValue:       cmd = "read";    break;
+			case SmcCmdWriteValue:      cmd = "write";   break;
+			case SmcCmdGetKeyInfo:      cmd = "keyinfo"; break;
+			case SmcCmdGetKeyFromIndex: cmd = "index";   break;
+			default:                    cmd = "unknown"; break;
+		}
+
+		auto transport = e.transport < arrsize(transportNames) ? transportNames[e.transport] : "unknown";
+		auto name = reinterpret_cast<const char *>(&e.key);
+		char line[64];
+		if (e.command == SmcCmdGetKeyFromIndex)
+			snprintf(line, sizeof(line), "%llu %s %s %u result %02X", static_cast<unsigned long long>(ns),
+					 transport, cmd, e.key, e.result);
+		else
+			snprintf(line, sizeof(line), "%llu %s %s [%c%c%c%c] result %02X", static_cast<unsigned long long>(ns),
+					 transport, cmd, name[0], name[1], name[2], name[3], e.result);
+
+		auto str = OSString::withCString(line);
+		if (str) {
+			arr->setObject(str);
+			str->release();
+		}
+	}
+
+	return arr;
+}
+
+#endif
@@ -0,0 +1,116 @@
+//
+//  kern_trace.hpp
+//  VirtualSMC
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_trace_hpp
+#define kern_trace_hpp
+
+#include <Headers/kern_util.hpp>
+#include <VirtualSMCSDK/AppleSmcBridge.hpp>
+#include <VirtualSMCSDK/vsmcatomic.h>
+#include <kern/clock.h>
+#include <libkern/c++/OSArray.h>
+#include <stdint.h>
+
+/**
+ *  Compile-time tracing levels of the protocol hot paths: device memory traps,
+ *  port i/o, keystore transactions and interrupt delivery.
+ *  Regular DBGLOG is too expensive there even when disabled at runtime.
+ *
+ *  VSMC_TRACE_NONE    nothing is compiled in (default for release builds)
+ *  VSMC_TRACE_EVENTS  completed transactions are stored as binary events once -vsmctrace
+ *                     is passed, and are exported as ProtocolTrace property (default for debug builds)
+ *  VSMC_TRACE_ACCESS  additionally log every device access with ACCESSLOG
+ */
+#define VSMC_TRACE_NONE   0
+#define VSMC_TRACE_EVENTS 1
+#define VSMC_TRACE_ACCESS 2
+
+#ifndef VSMC_TRACE_LEVEL
+#ifdef DEBUG
+#define VSMC_TRACE_LEVEL VSMC_TRACE_EVENTS
+#else
+#define VSMC_TRACE_LEVEL VSMC_TRACE_NONE
+#endif
+#endif
+
+#if VSMC_TRACE_LEVEL >= VSMC_TRACE_ACCESS
+#define ACCESSLOG(module, str, ...) DBGLOG(module, str, ## __VA_ARGS__)
+#else
+#define ACCESSLOG(module, str, ...) do { } while (0)
+#endif
+
+#if VSMC_TRACE_LEVEL >= VSMC_TRACE_EVENTS
+
+/**
+ *  Ring of the most recent protocol transactions.
+ *  Events are formatted only on export, so recording costs a few stores.
+ *  Concurrent writers may overwrite each other's slots, which is acceptable for a debug trace.
+ */
+class VirtualSMCTrace {
+public:
+	/**
+	 *  Recorded transaction
+	 */
+	struct Event {
+		uint64_t time;
+		uint32_t key;
+		uint8_t transport;
+		SMC_COMMAND command;
+		SMC_RESULT result;
+	};
+
+	/**
+	 *  Number of kept events, must be a power of two
+	 */
+	static constexpr uint32_t MaxEvents {256};
+
+	/**
+	 *  Set by -vsmctrace boot argument
+	 */
+	static bool enabled;
+
+	/**
+	 *  Read tracing boot arguments
+	 */
+	static void init();
+
+	/**
+	 *  Record completed transaction
+	 *
+	 *  @param transport  VirtualSMCCapture::Transport
+	 *  @param cmd        protocol command
+	 *  @param key        key name or key index
+	 *  @param res        command result
+	 */
+	static void record(uint8_t transport, SMC_COMMAND cmd, uint32_t key, SMC_RESULT res) {
+		auto &e = events[atomic_fetch_add_explicit(&next, 1, memory_order_relaxed) & (MaxEvents - 1)];
+		e.time = mach_absolute_time();
+		e.key = key;
+		e.transport = transport;
+		e.command = cmd;
+		e.result = res;
+	}
+
+	/**
+	 *  Format recorded events from the oldest to the newest
+	 *
+	 *  @return array of strings (must be released) or nullptr
+	 */
+	static OSArray *copyTrace();
+
+private:
+	static Event events[MaxEvents];
+	static _Atomic(uint32_t) next;
+};
+
+#define PROTOTRACE(transport, cmd, key, res) \
+	do { if (VirtualSMCTrace::enabled) VirtualSMCTrace::record(transport, cmd, key, res); } while (0)
+#else
+#define PROTOTRACE(transport, cmd, key, res) do { } while (0)
+#endif
+
+#endif /* kern_trace_hpp */
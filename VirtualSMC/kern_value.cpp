@@ -7,10 +7,33 @@
 
 #include <Headers/kern_iokit.hpp>
 #include <Headers/kern_util.hpp>
+#include <Headers/kern_time.hpp>
 #include <VirtualSMCSDK/kern_value.hpp>
 
+bool VirtualSMCValue::reserve(SMC_DATA_SIZE sz) {
+	if (sz <= capacity && data)
+		return true;
+
+	if (!ownsData || sz > SMC_MAX_DATA_SIZE) {
+		DBGLOG("value", "data size %u exceeds storage %u", sz, capacity);
+		return false;
+	}
+
+	// Zero sized values still get a buffer to keep data valid.
+	SMC_DATA_SIZE alloc = sz > 0 ? sz : 1;
+	if (!Buffer::resize(data, alloc)) {
+		DBGLOG("value", "unable to allocate %u bytes", alloc);
+		return false;
+	}
+
+	if (alloc > capacity)
+		memset(data + capacity, 0, alloc - capacity);
+	capacity = alloc;
+	return true;
+}
+
 bool VirtualSMCValue::init(const SMC_DATA *d, SMC_DATA_SIZE sz, SMC_KEY_TYPE t, SMC_KEY_ATTRIBUTES a, SerializeLevel s) {
-	if (sz <= SMC_MAX_DATA_SIZE) {
+	if (sz <= SMC_MAX_DATA_SIZE && reserve(sz)) {
 		if (d) lilu_os_memcpy(data, d, sz);
 		size = sz;
 		type = t;
@@ -19,7 +42,7 @@ bool VirtualSMCValue::init(const SMC_DATA *d, SMC_DATA_SIZE sz, SMC_KEY_TYPE t,
 		return true;
 	}
 	
-	DBGLOG("value", "data size too large");
+	DBGLOG("value", "data size %u too large", sz);
 	return false;
 }
 
@@ -44,6 +67,9 @@ bool VirtualSMCValue::init(const OSDictionary *dict) {
 		DBGLOG("value", "data length %u exceeds max %u", size, SMC_MAX_DATA_SIZE);
 		return false;
 	}
+
+	if (!reserve(size))
+		return false;
 	
 	if (size > 0 && value)
 		lilu_os_memcpy(data, value->getBytesNoCopy(), size);
@@ -60,6 +86,73 @@ const SMC_DATA *VirtualSMCValue::get(SMC_DATA_SIZE &sz) const {
 }
 
 SMC_RESULT VirtualSMCValue::update(const SMC_DATA *src) {
+	if (!beginModification())
+		return SmcCommCollision;
 	lilu_os_memcpy(data, src, size);
+	endModification();
 	return SmcSuccess;
 }
+
+/**
+ *  Wait a little for a concurrent contents modification to complete
+ *
+ *  @param deadline  wait deadline, 0 before the first wait
+ *  @param timeout   maximum wait time in nanoseconds
+ *
+ *  @return false once the deadline has passed
+ */
+static bool waitModification(uint64_t &deadline, uint64_t timeout) {
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#endif
+	auto time = getCurrentTimeNs();
+	if (deadline == 0)
+		deadline = time + timeout;
+	return time < deadline;
+}
+
+bool VirtualSMCValue::beginModification() {
+	uint64_t deadline = 0;
+	do {
+		uint32_t seq = atomic_load_explicit(&sequence, memory_order_relaxed);
+		if (!(seq & 1) && atomic_compare_exchange_strong_explicit(&sequence, &seq, seq + 1, memory_order_acquire, memory_order_relaxed))
+			return true;
+	} while (waitModification(deadline, MaxSequenceWait));
+
+	SYSLOG("value", "failed to obtain modification access in %u ms", static_cast<uint32_t>(MaxSequenceWait / 1000000));
+	return false;
+}
+
+bool VirtualSMCValue::publish(const SMC_DATA *src) {
+	if (!beginModification())
+		return false;
+	lilu_os_memcpy(data, src, size);
+	endModification();
+	atomic_store_explicit(&publishTime, getCurrentTimeNs(), memory_order_release);
+	return true;
+}
+
+bool VirtualSMCValue::stale(uint64_t age) const {
+	if (age == 0)
+		age = maxAge;
+	auto time = lastPublished();
+	return age != 0 && time != 0 && getTimeSinceNs(time) > age;
+}
+
+bool VirtualSMCValue::copy(SMC_DATA *dst, SMC_DATA_SIZE &sz) const {
+	// Contents may be modified concurrently by a plugin, wait until we get a consistent copy.
+	uint64_t deadline = 0;
+	do {
+		uint32_t seq = atomic_load_explicit(&sequence, memory_order_acquire);
+		if (seq & 1)
+			continue;
+		sz = size;
+		lilu_os_memcpy(dst, data, sz);
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&sequence, memory_order_relaxed) == seq)
+			return true;
+	} while (waitModification(deadline, MaxSequenceWait));
+
+	SYSLOG("value", "failed to obtain consistent contents in %u ms", static_cast<uint32_t>(MaxSequenceWait / 1000000));
+	return false;
+}
@@ -59,6 +59,9 @@ bool VirtualSMC::start(IOService *provider) {
 	// some other SMC implementation is available. Lilu handles limitations for us, and -vsmcoff
 	// is supposed to only switch MMIO mode off.
 
+	auto startTime = VirtualSMCStartupProfile::now();
+	auto phaseStart = startTime;
+
 	watchDogWorkLoop = IOWorkLoop::workLoop();
 	if (watchDogWorkLoop) {
 		watchDogTimer = IOTimerEventSource::timerEventSource(this, watchDogAction);
@@ -66,10 +69,25 @@ bool VirtualSMC::start(IOService *provider) {
 			watchDogWorkLoop->addEventSource(watchDogTimer);
 		else
 			SYSLOG("vsmc", "watchdog timer allocation failure");
+
+		atomic_init(&keyChangesScheduled, false);
+		keyChangeTimer = IOTimerEventSource::timerEventSource(this, keyChangeAction);
+		if (keyChangeTimer)
+			watchDogWorkLoop->addEventSource(keyChangeTimer);
+		else
+			SYSLOG("vsmc", "key change timer allocation failure");
+
+		deferredInitTimer = IOTimerEventSource::timerEventSource(this, deferredInitAction);
+		if (deferredInitTimer)
+			watchDogWorkLoop->addEventSource(deferredInitTimer);
+		else
+			SYSLOG("vsmc", "deferred init timer allocation failure");
 	} else {
 		SYSLOG("vsmc", "watchdog loop allocation failure");
 	}
 
+	phaseStart = profile.record(VirtualSMCStartupProfile::PhaseWorkLoop, phaseStart);
+
 	int computerModel = WIOKit::getComputerModel();
 	if (computerModel == WIOKit::ComputerModel::ComputerAny) {
 		DBGLOG("vsmc", "failed to determine laptop or desktop model");
@@ -96,15 +114,19 @@ bool VirtualSMC::start(IOService *provider) {
 	auto hardwareModel = reinterpret_cast<char *>(deviceInfo.getBuffer(SMCInfo::Buffer::HardwareModel));
 	setProperty("compatible", hardwareModel, static_cast<uint32_t>(strlen(hardwareModel)+1));
 
+	profile.record(VirtualSMCStartupProfile::PhaseModelInfo, phaseStart);
+
 	keystore = new VirtualSMCKeystore;
 	auto store = OSDynamicCast(OSDictionary, getProperty("Keystore"));
 	auto userStore = OSDynamicCast(OSDictionary, getProperty("UserKeystore"));
-	if (!keystore->init(store, userStore, deviceInfo, boardIdentifier, computerModel, VirtualSMCProvider::getFirmwareBackendStatus())) {
+	if (!keystore->init(store, userStore, deviceInfo, boardIdentifier, computerModel, profile)) {
 		SYSLOG("vsmc", "keystore initialisation failure");
 		delete keystore;
 		return false;
 	}
 
+	phaseStart = VirtualSMCStartupProfile::now();
+
 	PMinit();
 	provider->joinPMtree(this);
 	registerPowerDriver(this, powerStates, arrsize(powerStates));
@@ -133,6 +155,20 @@ bool VirtualSMC::start(IOService *provider) {
 		return false;
 	}
 
+#if VSMC_TRACE_LEVEL >= VSMC_TRACE_EVENTS
+	VirtualSMCTrace::init();
+#endif
+
+	uint32_t captureRecords = 0;
+	if (PE_parse_boot_argn("vsmccap", &captureRecords, sizeof(captureRecords)) && captureRecords > 0) {
+		capture = new VirtualSMCCapture;
+		if (capture && !capture->init(captureRecords, static_cast<uint8_t>(deviceInfo.getGeneration()), computerModel, boardIdentifier)) {
+			delete capture;
+			capture = nullptr;
+		}
+		DBGLOG("vsmc", "traffic capture %s", capture ? "enabled" : "unavailable");
+	}
+
 	interruptsLock = IOSimpleLockAlloc();
 	if (!interruptsLock)
 		PANIC("vsmc", "failed to allocate interrupt lock");
@@ -143,6 +179,8 @@ bool VirtualSMC::start(IOService *provider) {
 		PANIC("vsmc", "failed to reserve interrupt slots");
 	}
 
+	phaseStart = profile.record(VirtualSMCStartupProfile::PhaseProtocols, phaseStart);
+
 	// Service initialisation is delayed to allow trap hook to be initialised
 	instance = this;
 
@@ -151,6 +189,21 @@ bool VirtualSMC::start(IOService *provider) {
 		doRegisterService();
 		// Retain ourselves to avoid crashes if lilu is missing
 		ADDPR(startSuccess) = true;
+		profile.record(VirtualSMCStartupProfile::PhaseRegister, phaseStart);
+	}
+
+	profile.record(VirtualSMCStartupProfile::PhaseStart, startTime);
+
+	// Anything AppleSMC does not need to attach runs afterwards on the work loop
+	if (deferredInitTimer)
+		deferredInitTimer->setTimeoutMS(DeferredInitDelayMS);
+	else
+		initDeferred();
+
+	auto dict = profile.copyProfile();
+	if (dict) {
+		setProperty("StartupProfile", dict);
+		dict->release();
 	}
 
 	return true;
@@ -201,7 +254,7 @@ void VirtualSMC::watchDogAction(OSObject *owner, IOTimerEventSource *sender) {
 
 bool VirtualSMC::obtainBooterModelInfo(SMCInfo &deviceInfo) {
 	if (forcedGeneration() != SMCInfo::Generation::Unspecified) {
-		SYSLOG("vsmc", "ignoring booter rev info due to forced gen %d", forcedGeneration());
+		SYSLOG("vsmc", "ignoring booter rev info due to forced gen %d", static_cast<int>(forcedGeneration()));
 		return false;
 	}
 
@@ -322,6 +375,36 @@ void VirtualSMC::stop(IOService * provider) {
 	IOACPIPlatformDevice::stop(this);
 }
 
+bool VirtualSMC::serializeProperties(OSSerialize *s) const {
+	if (keystore) {
+		auto stats = keystore->copyStatistics();
+		if (stats) {
+			const_cast<VirtualSMC *>(this)->setProperty("KeyStatistics", stats);
+			stats->release();
+		}
+	}
+
+	if (capture) {
+		auto data = capture->copyCapture();
+		if (data) {
+			const_cast<VirtualSMC *>(this)->setProperty("TrafficCapture", data);
+			data->release();
+		}
+	}
+
+#if VSMC_TRACE_LEVEL >= VSMC_TRACE_EVENTS
+	if (VirtualSMCTrace::enabled) {
+		auto trace = VirtualSMCTrace::copyTrace();
+		if (trace) {
+			const_cast<VirtualSMC *>(this)->setProperty("ProtocolTrace", trace);
+			trace->release();
+		}
+	}
+#endif
+
+	return IOACPIPlatformDevice::serializeProperties(s);
+}
+
 bool VirtualSMC::devicesPresent(IOService *provider) {
 	// The use of getMatchingServices appears to be no longer possible due to IOService changes in 10.13.
 
@@ -417,7 +500,7 @@ bool VirtualSMC::postInterrupt(SMC_EVENT_CODE code, const void *data, uint32_t d
 				bool oneIntr = instance->storedInterrupts.size() == 1;
 				IOSimpleLockUnlock(instance->interruptsLock);
 				if (oneIntr) {
-					DBGLOG("vsmc", "causing interrupt %02X with size %u", code, dataSize);
+					ACCESSLOG("vsmc", "causing interrupt %02X with size %u", code, dataSize);
 					instance->causeInterrupt(EventInterruptNo);
 				}
 				return true;
@@ -464,7 +547,7 @@ SMC_EVENT_CODE VirtualSMC::getInterrupt() {
 		}
 	}
 	
-	DBGLOG("vsmc", "no interrupt to report");
+	ACCESSLOG("vsmc", "no interrupt to report");
 	return 0;
 }
 
@@ -474,7 +557,7 @@ void VirtualSMC::postWatchDogJob(uint8_t code, uint64_t timeout, bool last) {
 		if (code == WatchDogDoNothing) {
 			instance->watchDogJob = WatchDogDoNothing;
 		} else {
-			DBGLOG("vsmc", "accepted watchdog job %02X with timer %lld", code, timeout);
+			DBGLOG("vsmc", "accepted watchdog job %02X with timer %llu", code, static_cast<unsigned long long>(timeout));
 			instance->watchDogJob = code;
 			instance->watchDogTimer->setTimeoutMS(static_cast<uint32_t>(timeout));
 			instance->watchDogTimer->enable();
@@ -485,6 +568,42 @@ void VirtualSMC::postWatchDogJob(uint8_t code, uint64_t timeout, bool last) {
 	}
 }
 
+void VirtualSMC::keyChangeAction(OSObject *owner, IOTimerEventSource *sender) {
+	auto vsmc = OSDynamicCast(VirtualSMC, owner);
+	if (vsmc) {
+		// Writes arriving during delivery schedule another batch.
+		atomic_store_explicit(&vsmc->keyChangesScheduled, false, memory_order_release);
+		vsmc->keystore->deliverKeyChanges();
+	}
+}
+
+void VirtualSMC::deferredInitAction(OSObject *owner, IOTimerEventSource *sender) {
+	auto vsmc = OSDynamicCast(VirtualSMC, owner);
+	if (vsmc)
+		vsmc->initDeferred();
+}
+
+void VirtualSMC::initDeferred() {
+	auto phaseStart = VirtualSMCStartupProfile::now();
+	// Firmware backend is detected by the provider before start, only the dump setup is deferred.
+	bool firmwareBackend = VirtualSMCProvider::getFirmwareBackendStatus();
+	keystore->initDeferred(firmwareBackend);
+	profile.record(VirtualSMCStartupProfile::PhaseDeferredHibernation, phaseStart);
+	DBGLOG("vsmc", "deferred init done, firmware backend %d", firmwareBackend);
+
+	auto dict = profile.copyProfile();
+	if (dict) {
+		setProperty("StartupProfile", dict);
+		dict->release();
+	}
+}
+
+void VirtualSMC::postKeyChanges() {
+	if (instance && instance->keyChangeTimer &&
+		!atomic_exchange_explicit(&instance->keyChangesScheduled, true, memory_order_acq_rel))
+		instance->keyChangeTimer->setTimeoutMS(KeyChangeBatchMS);
+}
+
 IOMemoryMap *VirtualSMC::mapDeviceMemoryWithIndex(unsigned int index, IOOptionBits options) {
 	DBGLOG("vsmc", "mapDeviceMemoryWithIndex (%u, %u)", index, options);
 	return VirtualSMCProvider::getMapping(index, options);
@@ -653,7 +772,7 @@ IOReturn VirtualSMC::disableInterrupt(int source) {
 }
 
 IOReturn VirtualSMC::causeInterrupt(int source) {
-	DBGLOG("vsmc", "causeInterrupt %d", source);
+	ACCESSLOG("vsmc", "causeInterrupt %d", source);
 	
 	for (size_t i = 0; i < registeredInterrupts.size(); i++) {
 		if (source == registeredInterrupts[i].source) {
@@ -681,9 +800,20 @@ IOReturn VirtualSMC::setPowerState(unsigned long state, IOService *whatDevice){
 IOReturn VirtualSMC::callPlatformFunction(const OSSymbol *functionName, bool, void *param1, void *param2, void *, void *) {
 	if (functionName && param1 && param2 && functionName->isEqualTo(VirtualSMCAPI::SubmitPlugin)) {
 		DBGLOG("vsmc", "received plugin submission");
-		// Retain a plugin just in case the implementation allows unloading...
+		// Keep the plugin service alive for as long as its storage is referenced.
 		static_cast<IOService *>(param1)->retain();
-		return keystore->loadPlugin(static_cast<VirtualSMCAPI::Plugin *>(param2));
+		auto code = keystore->loadPlugin(static_cast<VirtualSMCAPI::Plugin *>(param2));
+		if (code != kIOReturnSuccess)
+			static_cast<IOService *>(param1)->release();
+		return code;
+	}
+
+	if (functionName && param1 && param2 && functionName->isEqualTo(VirtualSMCAPI::UnloadPlugin)) {
+		DBGLOG("vsmc", "received plugin unload request");
+		auto code = keystore->unloadPlugin(static_cast<VirtualSMCAPI::Plugin *>(param2));
+		if (code == kIOReturnSuccess)
+			static_cast<IOService *>(param1)->release();
+		return code;
 	}
 
 	return kIOReturnUnsupported;
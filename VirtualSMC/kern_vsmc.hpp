@@ -22,6 +22,9 @@
 #include "kern_pmio.hpp"
 #include "kern_mmio.hpp"
 #include "kern_keystore.hpp"
+#include "kern_profile.hpp"
+#include "kern_capture.hpp"
+#include "kern_trace.hpp"
 #include "kern_intrs.hpp"
 
 class EXPORT VirtualSMC : public IOACPIPlatformDevice {
@@ -99,6 +102,11 @@ class EXPORT VirtualSMC : public IOACPIPlatformDevice {
 	 */
 	SMCProtocolMMIO *mmio {nullptr};
 
+	/**
+	 *  Protocol traffic capture, only allocated with vsmccap
+	 */
+	VirtualSMCCapture *capture {nullptr};
+
 	/**
 	 *  Power state name indexes
 	 */
@@ -144,6 +152,58 @@ class EXPORT VirtualSMC : public IOACPIPlatformDevice {
 	 */
 	static void watchDogAction(OSObject *owner, IOTimerEventSource *sender);
 
+	/**
+	 *  Key change delivery delay used to batch rapid writes
+	 */
+	static constexpr uint32_t KeyChangeBatchMS {10};
+
+	/**
+	 *  Key change delivery timer, shares watchdog work loop
+	 */
+	IOTimerEventSource *keyChangeTimer {nullptr};
+
+	/**
+	 *  Set while key change delivery is scheduled
+	 */
+	_Atomic(bool) keyChangesScheduled;
+
+	/**
+	 *  Key change timer action handler
+	 *
+	 *  @param owner   VirtualSMC instance
+	 *  @param sender  keyChangeTimer pointer
+	 */
+	static void keyChangeAction(OSObject *owner, IOTimerEventSource *sender);
+
+	/**
+	 *  Delay before running initialisation not needed for AppleSMC attachment
+	 */
+	static constexpr uint32_t DeferredInitDelayMS {1};
+
+	/**
+	 *  Deferred initialisation timer, shares watchdog work loop
+	 */
+	IOTimerEventSource *deferredInitTimer {nullptr};
+
+	/**
+	 *  Deferred initialisation timer action handler
+	 *
+	 *  @param owner   VirtualSMC instance
+	 *  @param sender  deferredInitTimer pointer
+	 */
+	static void deferredInitAction(OSObject *owner, IOTimerEventSource *sender);
+
+	/**
+	 *  Run initialisation not needed for AppleSMC attachment: hibernation key
+	 *  setup accesses NVRAM and RTC
+	 */
+	void initDeferred();
+
+	/**
+	 *  Start phase durations exported as StartupProfile property
+	 */
+	VirtualSMCStartupProfile profile;
+
 	/**
 	 *  Cached value of AppleSMCBufferPMIO mapping
 	 */
@@ -240,6 +300,16 @@ public:
 	 */
 	void stop(IOService *provider) override;
 
+	/**
+	 *  Refresh KeyStatistics property with -vsmcstat, TrafficCapture property with vsmccap,
+	 *  and ProtocolTrace property with -vsmctrace before serialising the properties to userspace
+	 *
+	 *  @param s  serializer
+	 *
+	 *  @return true on success
+	 */
+	bool serializeProperties(OSSerialize *s) const override;
+
 	/**
 	 *  Perform service registration to tell AppleSMC and plugins about us
 	 */
@@ -264,6 +334,22 @@ public:
 		return nullptr;
 	}
 
+	/**
+	 *  Record completed protocol transaction with vsmccap and -vsmctrace
+	 *
+	 *  @param transport  transport
+	 *  @param cmd        protocol command
+	 *  @param key        key name or key index
+	 *  @param res        command result
+	 *  @param data       transferred data
+	 *  @param size       transferred data size
+	 */
+	static void captureTransaction(VirtualSMCCapture::Transport transport, SMC_COMMAND cmd, uint32_t key, SMC_RESULT res, const void *data, SMC_DATA_SIZE size) {
+		PROTOTRACE(transport, cmd, key, res);
+		if (instance && instance->capture)
+			instance->capture->record(transport, cmd, key, res, data, size);
+	}
+
 	/**
 	 *  Transfer mmio pre-read event to the implementation.
 	 *
@@ -347,6 +433,11 @@ public:
 	 */
 	static void postWatchDogJob(uint8_t code, uint64_t timeout, bool last=false);
 
+	/**
+	 *  Schedule delivery of marked key changes to subscribers
+	 */
+	static void postKeyChanges();
+
 	/**
 	 *  Return emulated device memory as a memory map
 	 *
@@ -31,6 +31,19 @@ bool VirtualSMCAPI::postInterrupt(SMC_EVENT_CODE code, const void *data, uint32_
 	return VirtualSMC::postInterrupt(code, data, dataSize);
 }
 
+VirtualSMCAPI::KeySubscription *VirtualSMCAPI::subscribeKeys(Plugin *plugin, const SMC_KEY *keys, size_t count, KeyChangeHandler handler, void *context) {
+	auto kstore = VirtualSMC::getKeystore();
+	if (kstore)
+		return kstore->subscribeKeys(plugin, keys, count, handler, context);
+	return nullptr;
+}
+
+void VirtualSMCAPI::unsubscribeKeys(KeySubscription *subscription) {
+	auto kstore = VirtualSMC::getKeystore();
+	if (kstore && subscription)
+		kstore->unsubscribeKeys(subscription);
+}
+
 bool VirtualSMCAPI::getDeviceInfo(SMCInfo &info) {
 	auto kstore = VirtualSMC::getKeystore();
 	if (kstore) {
@@ -40,9 +53,64 @@ bool VirtualSMCAPI::getDeviceInfo(SMCInfo &info) {
 	return false;
 }
 
+/**
+ *  Find key position in a sorted key storage
+ *
+ *  @param data   key storage
+ *  @param key    an SMC key
+ *  @param found  set to true if the key is present at the returned position
+ *
+ *  @return key position or insertion point keeping the storage sorted
+ */
+static size_t findKey(VirtualSMCAPI::KeyStorage &data, SMC_KEY key, bool &found) {
+	size_t start = 0, end = data.size();
+	found = false;
+	while (start < end) {
+		size_t mid = start + (end - start) / 2;
+		auto cmp = VirtualSMCKeyValue::compare(data[mid].key, key);
+		if (cmp == 0) {
+			found = true;
+			return mid;
+		}
+		if (cmp < 0)
+			start = mid + 1;
+		else
+			end = mid;
+	}
+	return start;
+}
+
+/**
+ *  Insert key/value pair at a position found by findKey
+ *
+ *  @param data  key storage
+ *  @param pos   insertion point
+ *  @param kv    key/value pair
+ *
+ *  @return true on success
+ */
+static bool insertKey(VirtualSMCAPI::KeyStorage &data, size_t pos, const VirtualSMCKeyValue &kv) {
+	if (!data.push_back<4>(kv))
+		return false;
+
+	// Shift the tail by one element, storages are small and keys are normally added in order.
+	for (size_t i = data.size() - 1; i > pos; i--)
+		data[i] = data[i - 1];
+	data[pos] = kv;
+	return true;
+}
+
 bool VirtualSMCAPI::addKey(SMC_KEY key, VirtualSMCAPI::KeyStorage &data, VirtualSMCValue *val) {
 	if (val) {
-		if (data.push_back<4>(VirtualSMCKeyValue::create(key, val))) {
+		bool found;
+		auto pos = findKey(data, key, found);
+		if (found) {
+			SYSLOG("vsmcapi", "duplicate key [%08X]", key);
+			delete val;
+			return false;
+		}
+
+		if (insertKey(data, pos, VirtualSMCKeyValue::create(key, val))) {
 			DBGLOG("vsmcapi", "inserted key [%08X]", key);
 			return true;
 		} else {
@@ -56,6 +124,30 @@ bool VirtualSMCAPI::addKey(SMC_KEY key, VirtualSMCAPI::KeyStorage &data, Virtual
 	return false;
 }
 
+bool VirtualSMCAPI::addAlias(SMC_KEY key, VirtualSMCAPI::KeyStorage &data, SMC_KEY target) {
+	bool found;
+	auto pos = findKey(data, target, found);
+	if (!found) {
+		DBGLOG("vsmcapi", "no target [%08X] for alias [%08X]", target, key);
+		return false;
+	}
+
+	auto val = atomic_load_explicit(&data[pos].value, memory_order_relaxed);
+	pos = findKey(data, key, found);
+	if (found) {
+		SYSLOG("vsmcapi", "duplicate alias [%08X]", key);
+		return false;
+	}
+
+	if (insertKey(data, pos, VirtualSMCKeyValue::createAlias(key, val))) {
+		DBGLOG("vsmcapi", "inserted alias [%08X] for [%08X]", key, target);
+		return true;
+	}
+
+	DBGLOG("vsmcapi", "failed to insert alias [%08X]", key);
+	return false;
+}
+
 VirtualSMCValue *VirtualSMCAPI::valueWithData(const SMC_DATA *smcData, SMC_DATA_SIZE smcDataSize, SMC_KEY_TYPE smcKeyType, VirtualSMCValue *thisValue, SMC_KEY_ATTRIBUTES smcKeyAttrs, SerializeLevel serializeLevel) {
 	if (smcDataSize == 0) {
 		DBGLOG("vsmcapi", "invalid SMC_DATA size");
@@ -76,82 +168,8 @@ VirtualSMCValue *VirtualSMCAPI::valueWithData(const SMC_DATA *smcData, SMC_DATA_
 	return thisValue;
 }
 
-static uint32_t getSpIntegral(uint32_t type) {
-	switch (type) {
-		case SmcKeyTypeSp1e:
-			return 0x1;
-		case SmcKeyTypeSp2d:
-			return 0x2;
-		case SmcKeyTypeSp3c:
-			return 0x3;
-		case SmcKeyTypeSp4b:
-			return 0x4;
-		case SmcKeyTypeSp5a:
-			return 0x5;
-		case SmcKeyTypeSp69:
-			return 0x6;
-		case SmcKeyTypeSp78:
-			return 0x7;
-		case SmcKeyTypeSp87:
-			return 0x8;
-		case SmcKeyTypeSp96:
-			return 0x9;
-		case SmcKeyTypeSpa5:
-			return 0xa;
-		case SmcKeyTypeSpb4:
-			return 0xb;
-		case SmcKeyTypeSpc3:
-			return 0xc;
-		case SmcKeyTypeSpd2:
-			return 0xd;
-		case SmcKeyTypeSpe1:
-			return 0xe;
-		case SmcKeyTypeSpf0:
-			return 0xf;
-		default:
-			return 0;
-	}
-}
-
-static uint32_t getFpIntegral(uint32_t type) {
-	switch (type) {
-		case SmcKeyTypeFp1f:
-			return 0x1;
-		case SmcKeyTypeFp2e:
-			return 0x2;
-		case SmcKeyTypeFp3d:
-			return 0x3;
-		case SmcKeyTypeFp4c:
-			return 0x4;
-		case SmcKeyTypeFp5b:
-			return 0x5;
-		case SmcKeyTypeFp6a:
-			return 0x6;
-		case SmcKeyTypeFp79:
-			return 0x7;
-		case SmcKeyTypeFp88:
-			return 0x8;
-		case SmcKeyTypeFp97:
-			return 0x9;
-		case SmcKeyTypeFpa6:
-			return 0xa;
-		case SmcKeyTypeFpb5:
-			return 0xb;
-		case SmcKeyTypeFpc4:
-			return 0xc;
-		case SmcKeyTypeFpd3:
-			return 0xd;
-		case SmcKeyTypeFpe2:
-			return 0xe;
-		case SmcKeyTypeFpf1:
-			return 0xf;
-		default:
-			return 0;
-	}
-}
-
 double VirtualSMCAPI::decodeSp(uint32_t type, uint16_t value) {
-	uint32_t integral = getSpIntegral(type);
+	uint32_t integral = spIntegral(type);
 	if (integral == 0)
 		return 0;
 	value = OSSwapInt16(value);
@@ -160,7 +178,7 @@ double VirtualSMCAPI::decodeSp(uint32_t type, uint16_t value) {
 }
 
 uint16_t VirtualSMCAPI::encodeSp(uint32_t type, double value) {
-	uint32_t integral = getSpIntegral(type);
+	uint32_t integral = spIntegral(type);
 	if (integral == 0)
 		return 0;
 	uint16_t ret = static_cast<uint16_t>(__builtin_fabs(value) * getBit<uint16_t>(15 - integral)) & 0x7FFF;
@@ -168,7 +186,7 @@ uint16_t VirtualSMCAPI::encodeSp(uint32_t type, double value) {
 }
 
 double VirtualSMCAPI::decodeFp(uint32_t type, uint16_t value) {
-	uint32_t integral = getFpIntegral(type);
+	uint32_t integral = fpIntegral(type);
 	if (integral == 0)
 		return 0;
 	value = OSSwapInt16(value);
@@ -177,9 +195,67 @@ double VirtualSMCAPI::decodeFp(uint32_t type, uint16_t value) {
 }
 
 uint16_t VirtualSMCAPI::encodeFp(uint32_t type, double value) {
-	uint32_t integral = getFpIntegral(type);
+	uint32_t integral = fpIntegral(type);
 	if (integral == 0)
 		return 0;
 	uint16_t ret = static_cast<uint16_t>(__builtin_fabs(value) * getBit<uint16_t>(16 - integral));
 	return OSSwapInt16(ret);
 }
+
+bool VirtualSMCAPI::encodeSpArray(uint32_t type, const int32_t *src, uint16_t *dst, size_t count, uint32_t bits) {
+	uint32_t integral = spIntegral(type);
+	if (integral == 0) {
+		memset(dst, 0, count * sizeof(uint16_t));
+		return false;
+	}
+	uint32_t fraction = 15 - integral;
+	uint32_t left = fraction >= bits ? fraction - bits : 0;
+	uint32_t right = bits > fraction ? bits - fraction : 0;
+	for (size_t i = 0; i < count; i++) {
+		uint32_t sign = static_cast<uint32_t>(src[i]) & 0x80000000U;
+		uint32_t abs = sign ? 0U - static_cast<uint32_t>(src[i]) : static_cast<uint32_t>(src[i]);
+		dst[i] = OSSwapInt16(static_cast<uint16_t>((sign >> 16) | (((abs << left) >> right) & 0x7FFF)));
+	}
+	return true;
+}
+
+bool VirtualSMCAPI::encodeSpArray(uint32_t type, const float *src, uint16_t *dst, size_t count) {
+	uint32_t integral = spIntegral(type);
+	if (integral == 0) {
+		memset(dst, 0, count * sizeof(uint16_t));
+		return false;
+	}
+	float scale = getBit<uint16_t>(15 - integral);
+	for (size_t i = 0; i < count; i++) {
+		uint32_t sign = src[i] < 0 ? 0x8000 : 0;
+		uint32_t abs = static_cast<uint32_t>(__builtin_fabsf(src[i]) * scale);
+		dst[i] = OSSwapInt16(static_cast<uint16_t>(sign | (abs & 0x7FFF)));
+	}
+	return true;
+}
+
+bool VirtualSMCAPI::encodeFpArray(uint32_t type, const uint32_t *src, uint16_t *dst, size_t count, uint32_t bits) {
+	uint32_t integral = fpIntegral(type);
+	if (integral == 0) {
+		memset(dst, 0, count * sizeof(uint16_t));
+		return false;
+	}
+	uint32_t fraction = 16 - integral;
+	uint32_t left = fraction >= bits ? fraction - bits : 0;
+	uint32_t right = bits > fraction ? bits - fraction : 0;
+	for (size_t i = 0; i < count; i++)
+		dst[i] = OSSwapInt16(static_cast<uint16_t>((src[i] << left) >> right));
+	return true;
+}
+
+bool VirtualSMCAPI::encodeFpArray(uint32_t type, const float *src, uint16_t *dst, size_t count) {
+	uint32_t integral = fpIntegral(type);
+	if (integral == 0) {
+		memset(dst, 0, count * sizeof(uint16_t));
+		return false;
+	}
+	float scale = getBit<uint16_t>(16 - integral);
+	for (size_t i = 0; i < count; i++)
+		dst[i] = OSSwapInt16(static_cast<uint16_t>(static_cast<uint32_t>(__builtin_fabsf(src[i]) * scale)));
+	return true;
+}
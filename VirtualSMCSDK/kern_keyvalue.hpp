@@ -28,6 +28,11 @@ struct VirtualSMCKeyValue {
 	 */
 	_Atomic(VirtualSMCValue *) backup;
 
+	/**
+	 *  Value is owned by another key of the same storage
+	 */
+	bool alias;
+
 	/**
 	 *  Should key value pair be serialisable
 	 *
@@ -76,6 +81,21 @@ struct VirtualSMCKeyValue {
 		VirtualSMCKeyValue kv {k};
 		atomic_init(&kv.value, v);
 		atomic_init(&kv.backup, nullptr);
+		kv.alias = false;
+		return kv;
+	}
+
+	/**
+	 *  Create key/value pair sharing the value of another key
+	 *
+	 *  @param k  key name
+	 *  @param v  value owned by another key
+	 *
+	 *  @return key/value pair
+	 */
+	static VirtualSMCKeyValue createAlias(SMC_KEY k, VirtualSMCValue *v) {
+		auto kv = create(k, v);
+		kv.alias = true;
 		return kv;
 	}
 
@@ -88,7 +108,7 @@ struct VirtualSMCKeyValue {
 		// This is just an old compiler crash workaround, no need for atomicity here!
 		auto v = atomic_load_explicit(&kv.value, memory_order_relaxed);
 		auto b = atomic_load_explicit(&kv.backup, memory_order_relaxed);
-		if (v) VirtualSMCValue::deleter(v);
+		if (v && !kv.alias) VirtualSMCValue::deleter(v);
 		if (b) VirtualSMCValue::deleter(b);
 	}
 
@@ -212,6 +212,8 @@ public:
 			case Buffer::MotherboardSerial:
 				return motherboardSerial;
 		}
+
+		return nullptr;
 	}
 
 	/**
@@ -239,6 +241,8 @@ public:
 			case Buffer::MotherboardSerial:
 				return MotherboardSerialSize;
 		}
+
+		return 0;
 	}
 
 	/**
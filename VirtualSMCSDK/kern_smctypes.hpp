@@ -0,0 +1,256 @@
+//
+//  kern_smctypes.hpp
+//  VirtualSMC
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_smctypes_hpp
+#define kern_smctypes_hpp
+
+#include <VirtualSMCSDK/AppleSmcBridge.hpp>
+
+namespace VirtualSMCAPI {
+	/**
+	 *  Parse a lowercase hexadecimal digit of an SMC type name
+	 *
+	 *  @param c  character
+	 *
+	 *  @return digit value or 0x10 for invalid digits
+	 */
+	constexpr uint32_t typeHexDigit(uint32_t c) {
+		return (c >= '0' && c <= '9') ? c - '0' : ((c >= 'a' && c <= 'f') ? c - 'a' + 0xa : 0x10);
+	}
+
+	/**
+	 *  Obtain the number of integral bits of a fixed point type
+	 *
+	 *  @param type    encoding type
+	 *  @param prefix  first two type characters, first one in the low byte
+	 *  @param bits    sum of integral and fractional bits
+	 *
+	 *  @return integral bits or 0 for other types and types with invalid digits
+	 */
+	constexpr uint32_t fixedIntegral(SMC_KEY_TYPE type, uint32_t prefix, uint32_t bits) {
+		return ((type & 0xFFFF) == prefix && typeHexDigit((type >> 16) & 0xFF) < 0x10 && typeHexDigit(type >> 24) < 0x10 &&
+			typeHexDigit((type >> 16) & 0xFF) + typeHexDigit(type >> 24) == bits) ? typeHexDigit((type >> 16) & 0xFF) : 0;
+	}
+
+	/**
+	 *  Obtain the number of integral bits of Apple SP signed fixed point type
+	 *
+	 *  @param type  encoding type, e.g. SmcKeyTypeSp78
+	 *
+	 *  @return integral bits or 0 for non-sp types
+	 */
+	constexpr uint32_t spIntegral(SMC_KEY_TYPE type) {
+		return fixedIntegral(type, 's' | ('p' << 8), 15);
+	}
+
+	/**
+	 *  Obtain the number of integral bits of Apple FP unsigned fixed point type
+	 *
+	 *  @param type  encoding type, e.g. SmcKeyTypeFp88
+	 *
+	 *  @return integral bits or 0 for non-fp types
+	 */
+	constexpr uint32_t fpIntegral(SMC_KEY_TYPE type) {
+		return fixedIntegral(type, 'f' | ('p' << 8), 16);
+	}
+
+	/**
+	 *  Compile-time byte swapping, SMC values are stored in big endian
+	 */
+	constexpr uint16_t typeSwap(uint16_t value) {
+		return static_cast<uint16_t>((value << 8) | (value >> 8));
+	}
+
+	constexpr uint32_t typeSwap(uint32_t value) {
+		return (static_cast<uint32_t>(typeSwap(static_cast<uint16_t>(value))) << 16) | typeSwap(static_cast<uint16_t>(value >> 16));
+	}
+
+	constexpr uint64_t typeSwap(uint64_t value) {
+		return (static_cast<uint64_t>(typeSwap(static_cast<uint32_t>(value))) << 32) | typeSwap(static_cast<uint32_t>(value >> 32));
+	}
+
+	/**
+	 *  Apple SP signed fixed point fractional format (sign and magnitude)
+	 */
+	template <SMC_KEY_TYPE Type>
+	struct SpTypeTraits {
+		static_assert(spIntegral(Type) != 0, "Not an sp type");
+
+		using Encoded = uint16_t;
+		static constexpr SMC_DATA_SIZE Size = sizeof(Encoded);
+		static constexpr uint32_t Integral = spIntegral(Type);
+		static constexpr uint32_t Fraction = 15 - Integral;
+
+		/**
+		 *  Encode fixed point value, fractional part is truncated like in encodeSp
+		 *
+		 *  @param value  source value multiplied by 2^Bits
+		 *
+		 *  @return value as it is to be written to SMC_DATA field
+		 */
+		template <uint32_t Bits = 0>
+		static constexpr Encoded encodeFixed(int32_t value) {
+			return typeSwap(static_cast<uint16_t>(((value < 0 ? 0x8000 : 0)) |
+				(shift<Bits>(value < 0 ? 0U - static_cast<uint32_t>(value) : static_cast<uint32_t>(value)) & 0x7FFF)));
+		}
+
+		/**
+		 *  Decode to fixed point value, extra fractional bits are truncated towards zero
+		 *
+		 *  @param value  value as it is read from SMC_DATA field
+		 *
+		 *  @return decoded value multiplied by 2^Bits
+		 */
+		template <uint32_t Bits = 0>
+		static constexpr int32_t decodeFixed(Encoded value) {
+			return (typeSwap(value) & 0x8000) ? -static_cast<int32_t>(unshift<Bits>(typeSwap(value) & 0x7FFF)) :
+				static_cast<int32_t>(unshift<Bits>(typeSwap(value) & 0x7FFF));
+		}
+
+	private:
+		template <uint32_t Bits>
+		static constexpr uint32_t shift(uint32_t value) {
+			return Fraction >= Bits ? value << (Fraction - Bits) : value >> (Bits - Fraction);
+		}
+
+		template <uint32_t Bits>
+		static constexpr uint32_t unshift(uint32_t value) {
+			return Bits >= Fraction ? value << (Bits - Fraction) : value >> (Fraction - Bits);
+		}
+	};
+
+	/**
+	 *  Apple FP unsigned fixed point fractional format
+	 */
+	template <SMC_KEY_TYPE Type>
+	struct FpTypeTraits {
+		static_assert(fpIntegral(Type) != 0, "Not an fp type");
+
+		using Encoded = uint16_t;
+		static constexpr SMC_DATA_SIZE Size = sizeof(Encoded);
+		static constexpr uint32_t Integral = fpIntegral(Type);
+		static constexpr uint32_t Fraction = 16 - Integral;
+
+		/**
+		 *  Encode fixed point value, fractional part is truncated like in encodeFp
+		 *
+		 *  @param value  source value multiplied by 2^Bits
+		 *
+		 *  @return value as it is to be written to SMC_DATA field
+		 */
+		template <uint32_t Bits = 0>
+		static constexpr Encoded encodeFixed(uint32_t value) {
+			return typeSwap(static_cast<uint16_t>(Fraction >= Bits ? value << (Fraction - Bits) : value >> (Bits - Fraction)));
+		}
+
+		/**
+		 *  Decode to fixed point value, extra fractional bits are truncated
+		 *
+		 *  @param value  value as it is read from SMC_DATA field
+		 *
+		 *  @return decoded value multiplied by 2^Bits
+		 */
+		template <uint32_t Bits = 0>
+		static constexpr uint32_t decodeFixed(Encoded value) {
+			return Bits >= Fraction ? static_cast<uint32_t>(typeSwap(value)) << (Bits - Fraction) : typeSwap(value) >> (Fraction - Bits);
+		}
+	};
+
+	/**
+	 *  Apple ui and si big endian integer formats
+	 */
+	template <typename T, typename U>
+	struct IntTypeTraits {
+		using Encoded = U;
+		using Value = T;
+		static constexpr SMC_DATA_SIZE Size = sizeof(Encoded);
+
+		/**
+		 *  Encode integer value
+		 *
+		 *  @param value  source value
+		 *
+		 *  @return value as it is to be written to SMC_DATA field
+		 */
+		static constexpr Encoded encode(Value value) {
+			return typeSwap(static_cast<U>(value));
+		}
+
+		/**
+		 *  Decode integer value
+		 *
+		 *  @param value  value as it is read from SMC_DATA field
+		 *
+		 *  @return decoded value
+		 */
+		static constexpr Value decode(Encoded value) {
+			return static_cast<T>(typeSwap(value));
+		}
+	};
+
+	/**
+	 *  Single byte integers need no swapping
+	 */
+	template <typename T>
+	struct IntTypeTraits<T, uint8_t> {
+		using Encoded = uint8_t;
+		using Value = T;
+		static constexpr SMC_DATA_SIZE Size = sizeof(Encoded);
+
+		static constexpr Encoded encode(Value value) { return static_cast<uint8_t>(value); }
+		static constexpr Value decode(Encoded value) { return static_cast<T>(value); }
+	};
+
+	/**
+	 *  Compile-time encoding traits for SMC numeric types.
+	 *  SmcKeyTypeSpXX and SmcKeyTypeFpXX types provide encodeFixed and decodeFixed,
+	 *  integer, flag and float types provide encode and decode. Every type provides
+	 *  Encoded storage type and its Size. Unsupported types do not compile.
+	 *
+	 *  @param Type  encoding type, e.g. SmcKeyTypeSp78
+	 */
+	template <SMC_KEY_TYPE Type, bool Sp = spIntegral(Type) != 0, bool Fp = fpIntegral(Type) != 0>
+	struct TypeTraits;
+
+	template <SMC_KEY_TYPE Type>
+	struct TypeTraits<Type, true, false> : SpTypeTraits<Type> {};
+
+	template <SMC_KEY_TYPE Type>
+	struct TypeTraits<Type, false, true> : FpTypeTraits<Type> {};
+
+	template <> struct TypeTraits<SmcKeyTypeFlag, false, false>   : IntTypeTraits<bool, uint8_t> {};
+	template <> struct TypeTraits<SmcKeyTypeUint8, false, false>  : IntTypeTraits<uint8_t, uint8_t> {};
+	template <> struct TypeTraits<SmcKeyTypeUint16, false, false> : IntTypeTraits<uint16_t, uint16_t> {};
+	template <> struct TypeTraits<SmcKeyTypeUint32, false, false> : IntTypeTraits<uint32_t, uint32_t> {};
+	template <> struct TypeTraits<SmcKeyTypeUint64, false, false> : IntTypeTraits<uint64_t, uint64_t> {};
+	template <> struct TypeTraits<SmcKeyTypeSint8, false, false>  : IntTypeTraits<int8_t, uint8_t> {};
+	template <> struct TypeTraits<SmcKeyTypeSint16, false, false> : IntTypeTraits<int16_t, uint16_t> {};
+	template <> struct TypeTraits<SmcKeyTypeSint32, false, false> : IntTypeTraits<int32_t, uint32_t> {};
+	template <> struct TypeTraits<SmcKeyTypeSint64, false, false> : IntTypeTraits<int64_t, uint64_t> {};
+
+	/**
+	 *  Apple float format is stored in host byte order (see encodeFlt)
+	 */
+	template <>
+	struct TypeTraits<SmcKeyTypeFloat, false, false> {
+		using Encoded = uint32_t;
+		using Value = float;
+		static constexpr SMC_DATA_SIZE Size = sizeof(Encoded);
+
+		static Encoded encode(Value value) {
+			union { float f; uint32_t u32; } v {value};
+			return v.u32;
+		}
+
+		static Value decode(Encoded value) {
+			union { uint32_t u32; float f; } v {value};
+			return v.f;
+		}
+	};
+}
+
+#endif /* kern_smctypes_hpp */
@@ -0,0 +1,102 @@
+//
+//  kern_typedvalue.hpp
+//  VirtualSMC
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_typedvalue_hpp
+#define kern_typedvalue_hpp
+
+#include <VirtualSMCSDK/kern_value.hpp>
+#include <VirtualSMCSDK/kern_smctypes.hpp>
+
+/**
+ *  Value with type and size fixed at compile time.
+ *  Size defaults to the encoded size of numeric types from VirtualSMCAPI::TypeTraits,
+ *  and must be passed explicitly for structure types (e.g. SmcKeyTypeAlv).
+ *  Contents are stored in the value itself in exactly Size bytes without a separate allocation.
+ */
+template <SMC_KEY_TYPE Type, SMC_DATA_SIZE Size = VirtualSMCAPI::TypeTraits<Type>::Size>
+class VirtualSMCTypedValue : public VirtualSMCValue {
+	static_assert(Size > 0 && Size <= SMC_MAX_DATA_SIZE, "Invalid SMC value size");
+
+	/**
+	 *  Contents storage
+	 */
+	SMC_DATA storage[Size] {};
+
+protected:
+	/**
+	 *  Access value contents as a structure of matching size
+	 *
+	 *  @return value contents reference
+	 */
+	template <typename T>
+	T &contents() {
+		static_assert(sizeof(T) == Size, "Mismatching SMC value contents size");
+		return *reinterpret_cast<T *>(data);
+	}
+
+public:
+	VirtualSMCTypedValue() : VirtualSMCValue(storage, Size) {}
+
+	/**
+	 *  Value type and size
+	 */
+	static constexpr SMC_KEY_TYPE ValueType {Type};
+	static constexpr SMC_DATA_SIZE ValueSize {Size};
+
+	/**
+	 *  Initialises a value with existing data.
+	 *
+	 *  @param  src    Initial data, must be exactly Size bytes, may be nullptr
+	 *  @param  attr   Value attributes
+	 *  @param  level  Serialization necessity
+	 *
+	 *  @return true on success
+	 */
+	bool init(const SMC_DATA *src = nullptr, SMC_KEY_ATTRIBUTES attr = SMC_KEY_ATTRIBUTE_READ, SerializeLevel level = SerializeLevel::None) {
+		return VirtualSMCValue::init(src, Size, Type, attr, level);
+	}
+
+	/**
+	 *  Initialises a value with existing contents.
+	 *
+	 *  @param  src    Initial contents of exactly Size bytes
+	 *  @param  attr   Value attributes
+	 *  @param  level  Serialization necessity
+	 *
+	 *  @return true on success
+	 */
+	template <typename T>
+	bool initWith(const T &src, SMC_KEY_ATTRIBUTES attr = SMC_KEY_ATTRIBUTE_READ, SerializeLevel level = SerializeLevel::None) {
+		static_assert(sizeof(T) == Size, "Mismatching SMC value contents size");
+		return init(reinterpret_cast<const SMC_DATA *>(&src), attr, level);
+	}
+};
+
+namespace VirtualSMCAPI {
+	/**
+	 *  A convenient method for initializing numeric key value encoded at compile time.
+	 *
+	 *  @param encoded  value as it is to be written to SMC_DATA field, e.g. TypeTraits<SmcKeyTypeSp78>::encodeFixed(30)
+	 *  @param thisValue  typed value to initialise, new VirtualSMCTypedValue is created when nullptr
+	 *  @see VirtualSMCAPI::valueWithData
+	 */
+	template <SMC_KEY_TYPE Type>
+	inline VirtualSMCValue *valueWithEncoded(typename TypeTraits<Type>::Encoded encoded, VirtualSMCTypedValue<Type> *thisValue = nullptr, SMC_KEY_ATTRIBUTES smcKeyAttrs = SMC_KEY_ATTRIBUTE_READ, SerializeLevel serializeLevel = SerializeLevel::None) {
+		if (!thisValue) {
+			thisValue = new VirtualSMCTypedValue<Type>;
+			if (!thisValue)
+				return nullptr;
+		}
+		if (!thisValue->initWith(encoded, smcKeyAttrs, serializeLevel)) {
+			delete thisValue;
+			return nullptr;
+		}
+		return thisValue;
+	}
+}
+
+#endif /* kern_typedvalue_hpp */
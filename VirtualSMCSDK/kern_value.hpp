@@ -12,6 +12,7 @@
 #include <libkern/c++/OSData.h>
 
 #include <VirtualSMCSDK/AppleSmcBridge.hpp>
+#include <VirtualSMCSDK/vsmcatomic.h>
 
 /**
  *  Serialization level determining external value storage necessity
@@ -25,16 +26,28 @@ enum class EXPORT SerializeLevel {
 
 class VirtualSMCKeystore;
 class VirtualSMCKeyValue;
+class VirtualSMCValueAlias;
 
 class EXPORT VirtualSMCValue {
 	friend VirtualSMCKeystore;
 	friend VirtualSMCKeyValue;
+	friend VirtualSMCValueAlias;
 protected:
 
 	/**
-	 *  Value contents retrieved by other protocols
+	 *  Value contents retrieved by other protocols, capacity bytes long
 	 */
-	SMC_DATA data[SMC_MAX_DATA_SIZE] {};
+	SMC_DATA *data {nullptr};
+
+	/**
+	 *  Contents storage size, values without own storage get exactly size bytes allocated by init
+	 */
+	SMC_DATA_SIZE capacity {0};
+
+	/**
+	 *  Contents storage is allocated by init and freed with the value
+	 */
+	bool ownsData {true};
 
 	/**
 	 *  Actual value contents size (could be less than SMC_MAX_DATA_SIZE)
@@ -56,8 +69,47 @@ protected:
 	 */
 	SerializeLevel serializeLevel {SerializeLevel::None};
 
+	/**
+	 *  Contents modification sequence, odd while the contents are being modified
+	 */
+	mutable _Atomic(uint32_t) sequence;
+
+	/**
+	 *  Last publication time in nanoseconds, 0 if the value was never published
+	 */
+	mutable _Atomic(uint64_t) publishTime;
+
+	/**
+	 *  Maximum age of published contents in nanoseconds before they are considered stale, 0 for no limit
+	 */
+	uint64_t maxAge {0};
+
+	/**
+	 *  Maximum time in nanoseconds to wait for a concurrent contents modification to complete.
+	 *  Modifications only copy a few bytes, so this is only reached when the writer is stuck.
+	 */
+	static constexpr uint64_t MaxSequenceWait {50000000};
+
+	/**
+	 *  Start contents modification, waiting for concurrent modifications to complete.
+	 *  Every write to data once the value is added to a keystore, including the ones done by
+	 *  readAccess and update overrides, must be enclosed in beginModification and endModification.
+	 *  Overrides normally prepare the contents in a local buffer and call VirtualSMCValue::update.
+	 *
+	 *  @return true if exclusive modification access was obtained within MaxSequenceWait
+	 */
+	EXPORT bool beginModification();
+
+	/**
+	 *  Complete contents modification started by beginModification
+	 */
+	void endModification() {
+		atomic_fetch_add_explicit(&sequence, 1, memory_order_release);
+	}
+
 	/**
 	 *  On read access, update the data if needed, and perform custom access control.
+	 *  Reads of the same key may run concurrently, see beginModification on updating the data.
 	 *  For base value, always allow the access if keystore allowed it.
 	 *
 	 *  @return SmcSuccess if allowed
@@ -76,7 +128,35 @@ protected:
 		return SmcSuccess;
 	}
 
+	/**
+	 *  Create a value with own contents storage, e.g. VirtualSMCTypedValue
+	 *
+	 *  @param storage      contents storage, must outlive the value
+	 *  @param storageSize  contents storage size, the maximum value size
+	 */
+	VirtualSMCValue(SMC_DATA *storage, SMC_DATA_SIZE storageSize) : data(storage), capacity(storageSize), ownsData(false) {
+		atomic_init(&sequence, 0);
+		atomic_init(&publishTime, 0);
+	}
+
+	/**
+	 *  Make sure contents storage fits the value, only called before the value is added to a keystore
+	 *
+	 *  @param sz  value size
+	 *
+	 *  @return true on success
+	 */
+	bool reserve(SMC_DATA_SIZE sz);
+
 public:
+	VirtualSMCValue() {
+		atomic_init(&sequence, 0);
+		atomic_init(&publishTime, 0);
+	}
+
+	VirtualSMCValue(const VirtualSMCValue &) = delete;
+	VirtualSMCValue &operator =(const VirtualSMCValue &) = delete;
+
 	/**
 	 *  Initialises a value with existing data.
 	 *
@@ -119,6 +199,56 @@ public:
 	 */
 	virtual SMC_RESULT update(const SMC_DATA *src);
 
+	/**
+	 *  Publish new already encoded contents, assuming the same amount of bytes is used for this value.
+	 *  Once a value is published, readAccess is no longer called and reads only copy the contents.
+	 *  This is meant to be used from plugin timers instead of doing the work in readAccess.
+	 *
+	 *  @param src  new contents
+	 *
+	 *  @return true on success, false if a concurrent modification did not complete within MaxSequenceWait
+	 */
+	EXPORT bool publish(const SMC_DATA *src);
+
+	/**
+	 *  Check whether the value uses publication model
+	 *
+	 *  @return last publication time in nanoseconds or 0
+	 */
+	uint64_t lastPublished() const {
+		return atomic_load_explicit(&publishTime, memory_order_acquire);
+	}
+
+	/**
+	 *  Set staleness policy for published contents.
+	 *  When published contents get older than maxAge, reads call readAccess to request a refresh
+	 *  and fail with SmcTimeoutError if the contents are still stale afterwards.
+	 *
+	 *  @param age  maximum age in nanoseconds, 0 for no limit
+	 */
+	void setMaxAge(uint64_t age) {
+		maxAge = age;
+	}
+
+	/**
+	 *  Check whether published contents are older than allowed
+	 *
+	 *  @param age  maximum age in nanoseconds, 0 to use the value policy
+	 *
+	 *  @return true if the value was published and is stale
+	 */
+	EXPORT bool stale(uint64_t age = 0) const;
+
+	/**
+	 *  Obtain consistent copy of value contents
+	 *
+	 *  @param dst   destination buffer of at least SMC_MAX_DATA_SIZE bytes
+	 *  @param size  Amount of copied bytes
+	 *
+	 *  @return true on success, false if a concurrent modification did not complete within MaxSequenceWait
+	 */
+	EXPORT bool copy(SMC_DATA *dst, SMC_DATA_SIZE &size) const;
+
 	/**
 	 *  Checks serialization necessity
 	 *
@@ -134,7 +264,10 @@ public:
 	/**
 	 *  It is not recommended to free created values but you can if you need
 	 */
-	virtual ~VirtualSMCValue() = default;
+	virtual ~VirtualSMCValue() {
+		if (ownsData)
+			Buffer::deleter(data);
+	}
 
 	/**
 	 *  Used for storing values in evector
@@ -146,4 +279,83 @@ public:
 	}
 };
 
+/**
+ *  Value exposing another value with a different type or size.
+ *  Contents are converted from the target on every read, so only the target performs the actual update.
+ *  Use VirtualSMCAPI::addAlias instead when type and size are the same.
+ */
+class VirtualSMCValueAlias : public VirtualSMCValue {
+public:
+	/**
+	 *  Contents conversion from target to alias representation
+	 *
+	 *  @param src      target contents
+	 *  @param srcSize  target contents size
+	 *  @param dst      alias contents
+	 *  @param dstSize  alias contents size
+	 *
+	 *  @return true on success
+	 */
+	using Transform = bool (*)(const SMC_DATA *src, SMC_DATA_SIZE srcSize, SMC_DATA *dst, SMC_DATA_SIZE dstSize);
+
+	/**
+	 *  Create alias value
+	 *
+	 *  @param target     aliased value, must outlive the alias (normally from the same key storage)
+	 *  @param type       alias value type
+	 *  @param size       alias value size
+	 *  @param transform  contents conversion, leading bytes are copied when nullptr
+	 *  @param attr       alias value attributes
+	 *
+	 *  @return alias value or nullptr
+	 */
+	static VirtualSMCValueAlias *withTarget(VirtualSMCValue *target, SMC_KEY_TYPE type, SMC_DATA_SIZE size, Transform transform = nullptr, SMC_KEY_ATTRIBUTES attr = SMC_KEY_ATTRIBUTE_READ) {
+		if (!target)
+			return nullptr;
+		auto value = new VirtualSMCValueAlias;
+		if (value) {
+			if (!value->init(nullptr, size, type, attr)) {
+				delete value;
+				return nullptr;
+			}
+			value->target = target;
+			value->transform = transform;
+		}
+		return value;
+	}
+
+protected:
+	SMC_RESULT readAccess() override {
+		auto res = target->lastPublished() != 0 && !target->stale() ? SmcSuccess : target->readAccess();
+		if (res != SmcSuccess)
+			return res;
+
+		SMC_DATA src[SMC_MAX_DATA_SIZE];
+		SMC_DATA_SIZE srcSize {};
+		if (!target->copy(src, srcSize) || !beginModification())
+			return SmcCommCollision;
+
+		if (transform) {
+			res = transform(src, srcSize, data, size) ? SmcSuccess : SmcError;
+		} else {
+			lilu_os_memcpy(data, src, srcSize < size ? srcSize : size);
+			res = SmcSuccess;
+		}
+
+		endModification();
+		return res;
+	}
+
+private:
+	/**
+	 *  Aliased value
+	 */
+	VirtualSMCValue *target {nullptr};
+
+	/**
+	 *  Contents conversion
+	 */
+	Transform transform {nullptr};
+};
+
 #endif /* kern_value_hpp */
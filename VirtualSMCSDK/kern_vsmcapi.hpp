@@ -11,6 +11,8 @@
 #include <Headers/kern_util.hpp>
 #include <VirtualSMCSDK/kern_smcinfo.hpp>
 #include <VirtualSMCSDK/kern_keyvalue.hpp>
+#include <VirtualSMCSDK/kern_smctypes.hpp>
+#include <VirtualSMCSDK/kern_typedvalue.hpp>
 #include <Library/LegacyIOService.h>
 
 namespace VirtualSMCAPI {
@@ -28,14 +30,25 @@ namespace VirtualSMCAPI {
 	static constexpr const char *SubmitPlugin = "VirtualSMCSubmitPlugin";
 
 	/**
-	 *  A total maximum of allowed plugins for installation.
+	 *  Plugin unloading platform function interface.
+	 *  Takes the same IOService and VirtualSMCPlugin arguments as SubmitPlugin. Once it returns kIOReturnSuccess
+	 *  the keystore no longer references plugin storage, the keys it overrode are restored, and the plugin
+	 *  may free its storage and terminate. Unloaded plugins may be submitted again.
+	 *  Key change subscriptions of the plugin are cancelled, waiting for their running handlers.
+	 *  Unloading waits for running keystore readers, so it must not be requested from value callbacks.
+	 *  Requests from key change handlers are detected and fail with kIOReturnNotPermitted.
+	 */
+	static constexpr const char *UnloadPlugin = "VirtualSMCUnloadPlugin";
+
+	/**
+	 *  Historical maximum of allowed plugins for installation, the keystore no longer limits plugin count.
 	 */
 	static constexpr size_t PluginMax = 16;
 
 	/**
 	 *  Accepted plugin API (and ABI) compatibility
 	 */
-	static constexpr size_t Version = 1;
+	static constexpr size_t Version = 2;
 
 	/**
 	 *  Sorted key storage containing pairs of keys and values.
@@ -43,13 +56,13 @@ namespace VirtualSMCAPI {
 	using KeyStorage = evector<VirtualSMCKeyValue, VirtualSMCKeyValue::deleter>;
 
 	/**
-	 *  Main description structure submitted by a plugin. Must be unchanged and never deallocated after submission.
+	 *  Main description structure submitted by a plugin. Must be unchanged and never deallocated until unloaded.
 	 */
 	struct Plugin {
 		const char *product;        // Product name (e.g. xStringify(PRODUCT_NAME))
 		size_t version;             // Product version (e.g. parseModuleVersion(xStringify(MODULE_VERSION)))
 		size_t apiver;              // Product API compatibility (i.e. VirtualSMCAPIVersion)
-		// Please note, that storage vectors MUST be sorted. Otherwise the behaviour is undefined.
+		// Please note, that storage vectors MUST be sorted and have no duplicates. Use addKey to maintain this.
 		KeyStorage data, dataHidden;
 	};
 
@@ -75,6 +88,50 @@ namespace VirtualSMCAPI {
 	 */
 	EXPORT bool postInterrupt(SMC_EVENT_CODE code, const void *data=nullptr, uint32_t dataSize=0);
 
+	/**
+	 *  Key change handler invoked from VirtualSMC work loop.
+	 *  Writes done shortly one after another are delivered in a single batch, and every
+	 *  written key is reported once per batch in the order it was passed to subscribeKeys.
+	 *  Handlers run without keystore locks held, so they may access the keystore, subscribe and cancel
+	 *  subscriptions, including their own, while other threads load and unload plugins. Writes done by
+	 *  handlers are delivered in the next batch. Subscriptions cancelled from a handler are no longer
+	 *  called and are freed once the delivery completes.
+	 *  Handlers must not unload plugins, VirtualSMCUnloadPlugin fails with kIOReturnNotPermitted.
+	 *
+	 *  @param context  context passed to subscribeKeys
+	 *  @param keys     written keys
+	 *  @param count    number of written keys
+	 */
+	using KeyChangeHandler = void (*)(void *context, const SMC_KEY *keys, size_t count);
+
+	/**
+	 *  Opaque key change subscription
+	 */
+	struct KeySubscription;
+
+	/**
+	 *  Subscribe to successful writes of the given keys (e.g. by macOS).
+	 *  Note, this may only be used after SubmitPlugin. The subscription is cancelled when the plugin
+	 *  is unloaded and must not be used afterwards.
+	 *
+	 *  @param plugin   submitted plugin owning the subscription
+	 *  @param keys     keys to watch, copied
+	 *  @param count    number of keys
+	 *  @param handler  change handler
+	 *  @param context  handler context
+	 *
+	 *  @return subscription or nullptr
+	 */
+	EXPORT KeySubscription *subscribeKeys(Plugin *plugin, const SMC_KEY *keys, size_t count, KeyChangeHandler handler, void *context);
+
+	/**
+	 *  Cancel key change subscription. Once it returns, the handler is no longer running or called,
+	 *  unless it is called from a key change handler, which may be the cancelled handler itself.
+	 *
+	 *  @param subscription  subscription returned by subscribeKeys
+	 */
+	EXPORT void unsubscribeKeys(KeySubscription *subscription);
+
 	/**
 	 *  Obtain emulated SMC device info to determine used keys and their format.
 	 *  Note, this may only be used within SubmitPlugin or afterwards.
@@ -86,8 +143,8 @@ namespace VirtualSMCAPI {
 	EXPORT bool getDeviceInfo(SMCInfo &info);
 
 	/**
-	 *  Adds a key with given value to a key storage.
-	 *  Does nothing if given value is nullptr.
+	 *  Adds a key with given value to a key storage keeping it sorted.
+	 *  Does nothing if given value is nullptr. Duplicate keys are rejected and their values are freed.
 	 *
 	 *  @param key     an SMC key
 	 *  @param data    a key storage to add the key to
@@ -97,6 +154,34 @@ namespace VirtualSMCAPI {
 	 */
 	EXPORT bool addKey(SMC_KEY key, KeyStorage &data, VirtualSMCValue *val);
 
+	/**
+	 *  Adds a key sharing the value of an existing key in the same key storage.
+	 *  Aliases are enumerated and counted as regular keys, but the value is read and updated once.
+	 *  When the target overrides a keystore key, it moves out of the storage on submission and one of
+	 *  the aliases left in the storage takes over the value, so the storage must be freed after unloading.
+	 *  Use VirtualSMCValueAlias to alias a value with a different type or size.
+	 *
+	 *  @param key     an SMC key
+	 *  @param data    a key storage to add the key to
+	 *  @param target  an SMC key already present in data
+	 *
+	 *  @return true on success
+	 */
+	EXPORT bool addAlias(SMC_KEY key, KeyStorage &data, SMC_KEY target);
+
+	/**
+	 *  Check at compile time that a fixed key list has no duplicates, e.g.
+	 *  static_assert(VirtualSMCAPI::keysUnique(keys), "duplicate keys");
+	 *
+	 *  @param keys  key list
+	 *
+	 *  @return true if every key is unique
+	 */
+	template <size_t N>
+	constexpr bool keysUnique(const SMC_KEY (&keys)[N], size_t i = 0, size_t j = 1) {
+		return i + 1 >= N ? true : (j >= N ? keysUnique(keys, i + 1, i + 2) : (keys[i] != keys[j] && keysUnique(keys, i, j + 1)));
+	}
+
 	/**
 	 *  Initializes the given value with the appropriate data. Creates new value if nullptr passed as thisValue.
 	 *
@@ -113,6 +198,7 @@ namespace VirtualSMCAPI {
 
 	/**
 	 *  Decode Apple SP signed fixed point fractional format
+	 *  Prefer TypeTraits<Type>::decodeFixed when the type is known at compile time.
 	 *
 	 *  @param type  encoding type, e.g. SmcKeyTypeSp78
 	 *  @param value value as it is read from SMC_DATA field
@@ -123,6 +209,7 @@ namespace VirtualSMCAPI {
 
 	/**
 	 *  Encode Apple SP signed fixed point fractional format
+	 *  Prefer TypeTraits<Type>::encodeFixed when the type is known at compile time.
 	 *
 	 *  @param type  encoding type, e.g. SmcKeyTypeSp78
 	 *  @param value source value
@@ -133,6 +220,7 @@ namespace VirtualSMCAPI {
 
 	/**
 	 *  Decode Apple FP unsigned fixed point fractional format
+	 *  Prefer TypeTraits<Type>::decodeFixed when the type is known at compile time.
 	 *
 	 *  @param type  encoding type, e.g. SmcKeyTypeFp88
 	 *  @param value value as it is read from SMC_DATA field
@@ -143,6 +231,7 @@ namespace VirtualSMCAPI {
 
 	/**
 	 *  Encode Apple FP unsigned fixed point fractional format
+	 *  Prefer TypeTraits<Type>::encodeFixed when the type is known at compile time.
 	 *
 	 *  @param type  encoding type, e.g. SmcKeyTypeFp88
 	 *  @param value source value
@@ -175,6 +264,70 @@ namespace VirtualSMCAPI {
 		return v.u32;
 	}
 
+	/**
+	 *  Encode an array of fixed point values in Apple SP signed fixed point fractional format
+	 *
+	 *  @param type   encoding type, e.g. SmcKeyTypeSp78
+	 *  @param src    source values multiplied by 2^bits
+	 *  @param dst    values as they are to be written to SMC_DATA fields
+	 *  @param count  number of values
+	 *  @param bits   fractional bits of source values
+	 *
+	 *  @return true on success, dst is zeroed for unsupported types
+	 */
+	EXPORT bool encodeSpArray(uint32_t type, const int32_t *src, uint16_t *dst, size_t count, uint32_t bits = 0);
+
+	/**
+	 *  Encode an array of floating point values in Apple SP signed fixed point fractional format
+	 *  Results match encodeSp for every value with the scaled magnitude below 2^15.
+	 *
+	 *  @param type   encoding type, e.g. SmcKeyTypeSp78
+	 *  @param src    source values
+	 *  @param dst    values as they are to be written to SMC_DATA fields
+	 *  @param count  number of values
+	 *
+	 *  @return true on success, dst is zeroed for unsupported types
+	 */
+	EXPORT bool encodeSpArray(uint32_t type, const float *src, uint16_t *dst, size_t count);
+
+	/**
+	 *  Encode an array of fixed point values in Apple FP unsigned fixed point fractional format
+	 *
+	 *  @param type   encoding type, e.g. SmcKeyTypeFp88
+	 *  @param src    source values multiplied by 2^bits
+	 *  @param dst    values as they are to be written to SMC_DATA fields
+	 *  @param count  number of values
+	 *  @param bits   fractional bits of source values
+	 *
+	 *  @return true on success, dst is zeroed for unsupported types
+	 */
+	EXPORT bool encodeFpArray(uint32_t type, const uint32_t *src, uint16_t *dst, size_t count, uint32_t bits = 0);
+
+	/**
+	 *  Encode an array of floating point values in Apple FP unsigned fixed point fractional format
+	 *  Results match encodeFp for every value with the scaled magnitude below 2^16.
+	 *
+	 *  @param type   encoding type, e.g. SmcKeyTypeFp88
+	 *  @param src    source values
+	 *  @param dst    values as they are to be written to SMC_DATA fields
+	 *  @param count  number of values
+	 *
+	 *  @return true on success, dst is zeroed for unsupported types
+	 */
+	EXPORT bool encodeFpArray(uint32_t type, const float *src, uint16_t *dst, size_t count);
+
+	/**
+	 *  Encode an array of values in Apple float fractional format
+	 *
+	 *  @param src    source values
+	 *  @param dst    values as they are to be written to SMC_DATA fields
+	 *  @param count  number of values
+	 */
+	inline void encodeFltArray(const float *src, uint32_t *dst, size_t count) {
+		for (size_t i = 0; i < count; i++)
+			dst[i] = encodeFlt(src[i]);
+	}
+
 	/**
 	 *  A convenient method for initializing flag type key value.
 	 *
@@ -28,6 +28,11 @@ typedef enum memory_order {
 #define atomic_store_explicit __c11_atomic_store
 #define atomic_load_explicit __c11_atomic_load
 #define atomic_compare_exchange_strong_explicit __c11_atomic_compare_exchange_strong
+#define atomic_exchange_explicit __c11_atomic_exchange
+#define atomic_fetch_add_explicit __c11_atomic_fetch_add
+#define atomic_fetch_sub_explicit __c11_atomic_fetch_sub
+#define atomic_fetch_or_explicit __c11_atomic_fetch_or
+#define atomic_thread_fence __c11_atomic_thread_fence
 
 #endif
 #else